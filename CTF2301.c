@@ -26,39 +26,170 @@
  */
 
 #include "CTF2301.h"
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#endif
+
+#if (configUSE_BUS_INSTRUMENTATION == 1) && !defined(configINSTRUMENT_CYCLES)
+#include <time.h>
+#endif
+
+#if (configUSE_BUS_ARBITER == 1)
+#include "CTF2301_arbiter.h"
+#endif
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS) || (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+// Critical section against the I2C completion interrupts, the previous PRIMASK is kept in state
+#define __CTF2301_LOCK(state)        do { (state) = __get_PRIMASK(); __disable_irq(); } while (0)
+#define __CTF2301_UNLOCK(state)      __set_PRIMASK(state)
+#else
+// No completion interrupts off target, the caller serializes access to a device
+#define __CTF2301_LOCK(state)        ((state) = 0)
+#define __CTF2301_UNLOCK(state)      ((void)(state))
+#endif
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS) || (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+// Memory barrier between the sampler producer and consumer
+#define __CTF2301_BARRIER()          __DMB()
+#else
+#define __CTF2301_BARRIER()          __sync_synchronize()
+#endif
 
 //PV
-uint8_t ctf2301_i2cAddr = configDEVICE_CTF2301_I2C_ADDR;
+// Attached devices, used to route I2C completion interrupts and to share a bus between chips
+static CTF2301_Device *ctf2301_devices[configCTF2301_MAX_DEVICES];
 
-// PWM Programming Enable, Default is Enabled
-// Return: CTF2301_OK if enable is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_ENABLE_PWM_PROGRAMMING(){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
-        regData |= 0x20;
-        if (__CTF2301_writeRegister(PWM_TACH_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+// Per-register transaction counters, shared by all devices
+static CTF2301_RegisterStats ctf2301_busStats[CTF2301_INSTRUMENT_SLOTS];
+#endif
+
+static uint8_t __CTF2301_burstAllowed(CTF2301_Register address, uint16_t length);
+
+// Register address of each shadow cache slot, see __CTF2301_shadowIndex()
+static const CTF2301_Register ctf2301_shadowRegs[CTF2301_SHADOW_SIZE] = {
+    CONFIG, CONVERSION_RATE, LOCAL_HIGH_SETPOINT_MSB, LOCAL_HIGH_SETPOINT_LSB,
+    REMOTE_HIGH_SETPOINT_MSB, REMOTE_LOW_SETPOINT_MSB,
+    REMOTE_TEMP_OFFSET_MSB, REMOTE_TEMP_OFFSET_LSB, REMOTE_HIGH_SETPOINT_LSB, REMOTE_LOW_SETPOINT_LSB,
+    ALERT_MASK, REMOTE_T_CRIT_SETPOINT, REMOTE_T_CRIT_HYST, REMOTE_DIODE_BETA_COMP, SMBUS_TIMEOUT,
+    ENHANCED_CONFIG, TACH_LIMIT_LSB, TACH_LIMIT_MSB, PWM_TACH_CONFIG, FAN_SPIN_UP_CONFIG,
+    PWM_FREQ, LOOKUP_TABLE_OFFSET, LOOKUP_TABLE_HYST,
+    LOOKUP_TABLE_TEMP_1, LOOKUP_TABLE_PWM_1, LOOKUP_TABLE_TEMP_2, LOOKUP_TABLE_PWM_2,
+    LOOKUP_TABLE_TEMP_3, LOOKUP_TABLE_PWM_3, LOOKUP_TABLE_TEMP_4, LOOKUP_TABLE_PWM_4,
+    LOOKUP_TABLE_TEMP_5, LOOKUP_TABLE_PWM_5, LOOKUP_TABLE_TEMP_6, LOOKUP_TABLE_PWM_6,
+    LOOKUP_TABLE_TEMP_7, LOOKUP_TABLE_PWM_7, LOOKUP_TABLE_TEMP_8, LOOKUP_TABLE_PWM_8,
+    LOOKUP_TABLE_TEMP_9, LOOKUP_TABLE_PWM_9, LOOKUP_TABLE_TEMP_10, LOOKUP_TABLE_PWM_10,
+    LOOKUP_TABLE_TEMP_11, LOOKUP_TABLE_PWM_11, LOOKUP_TABLE_TEMP_12, LOOKUP_TABLE_PWM_12,
+    REMOTE_DIODE_TEMP_FILTER
+};
+
+// Registers a configuration transaction stages, in the order they are committed:
+// CONFIG and ENHANCED_CONFIG first so standby, ALERT masking and the resolution formats are settled, then the PWM
+// frequency and spin-up parameters, and PWM_TACH_CONFIG (master clock, polarity, programming mode) last so the fan
+// only changes mode once everything it depends on is in place.
+static const CTF2301_Register ctf2301_txnRegs[CTF2301_TXN_REGISTERS] = {
+    CONFIG, ENHANCED_CONFIG, PWM_FREQ, FAN_SPIN_UP_CONFIG, PWM_TACH_CONFIG
+};
+
+// Map a register address to its transaction slot
+// Return: slot index, or -1 if the register is not staged by transactions
+static int8_t __CTF2301_txnIndex(CTF2301_Register address){
+    for (int8_t i = 0; i < CTF2301_TXN_REGISTERS; i++){
+        if (ctf2301_txnRegs[i] == address){
+            return i;
         }
-    } else {
-        ret = CTF2301_ERROR_COMM;
     }
-    return ret;
+    return -1;
 }
 
-uint32_t __CTF2301_DISABLE_PWM_PROGRAMMING(){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
-        regData &= ~0x20;
-        if (__CTF2301_writeRegister(PWM_TACH_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
+// Map a register address to its shadow cache slot
+// Return: slot index, or -1 if the register is read-only, write-only or volatile and therefore not cached
+static int8_t __CTF2301_shadowIndex(CTF2301_Register address){
+    if (address >= CONFIG && address <= REMOTE_LOW_SETPOINT_MSB){
+        return address - CONFIG;                            // slots 0-5
+    }
+    if (address >= REMOTE_TEMP_OFFSET_MSB && address <= REMOTE_LOW_SETPOINT_LSB){
+        return address - REMOTE_TEMP_OFFSET_MSB + 6;        // slots 6-9
+    }
+    switch (address){
+        case ALERT_MASK:                return 10;
+        case REMOTE_T_CRIT_SETPOINT:    return 11;
+        case REMOTE_T_CRIT_HYST:        return 12;
+        case REMOTE_DIODE_BETA_COMP:    return 13;
+        case SMBUS_TIMEOUT:             return 14;
+        case ENHANCED_CONFIG:           return 15;
+        case REMOTE_DIODE_TEMP_FILTER:  return 47;
+        default:                        break;
+    }
+    if (address >= TACH_LIMIT_LSB && address <= FAN_SPIN_UP_CONFIG){
+        return address - TACH_LIMIT_LSB + 16;               // slots 16-19
+    }
+    if (address >= PWM_FREQ && address <= LOOKUP_TABLE_PWM_12){
+        return address - PWM_FREQ + 20;                     // slots 20-46
+    }
+    return -1;
+}
+
+// Record a value known to be in a register
+static void __CTF2301_shadowStore(CTF2301_Device *dev, CTF2301_Register address, uint8_t data){
+#if (configUSE_SHADOW_REGISTERS == 1)
+    int8_t slot = __CTF2301_shadowIndex(address);
+    if (slot >= 0){
+        dev->shadow.value[slot] = data;
+        dev->shadow.valid[slot >> 5] |= (1UL << (slot & 0x1F));
+    }
+#endif
+}
+
+// Copy a run of registers out of the shadow cache
+// Return: 1 if every register of the run is cached and valid, 0 otherwise
+static uint8_t __CTF2301_shadowLoad(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+#if (configUSE_SHADOW_REGISTERS == 1)
+    int8_t slot;
+    for (uint16_t i = 0; i < length; i++){
+        slot = __CTF2301_shadowIndex(address + i);
+        if (slot < 0 || (dev->shadow.valid[slot >> 5] & (1UL << (slot & 0x1F))) == 0){
+            return 0;
         }
-    } else {
-        ret = CTF2301_ERROR_COMM;
+        buffer[i] = dev->shadow.value[slot];
     }
-    return ret;
+    dev->stats.readsAvoided += length;
+    return 1;
+#else
+    (void)dev;
+    (void)address;
+    (void)buffer;
+    (void)length;
+    return 0;
+#endif
+}
+
+// Forget the cached value of a register
+static void __CTF2301_shadowDrop(CTF2301_Device *dev, CTF2301_Register address){
+#if (configUSE_SHADOW_REGISTERS == 1)
+    int8_t slot = __CTF2301_shadowIndex(address);
+    if (slot >= 0){
+        dev->shadow.valid[slot >> 5] &= ~(1UL << (slot & 0x1F));
+    }
+#endif
+}
+
+// PWM Programming Enable, Default is Enabled
+// Return: CTF2301_OK if enable is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_ENABLE_PWM_PROGRAMMING(CTF2301_Device *dev){
+    return __CTF2301_updateRegister(dev, PWM_TACH_CONFIG, 0x20, 0x20);
+}
+
+uint32_t __CTF2301_DISABLE_PWM_PROGRAMMING(CTF2301_Device *dev){
+    return __CTF2301_updateRegister(dev, PWM_TACH_CONFIG, 0x20, 0x00);
 }
 
 // PWM Output Polarity, Default is RISING edge
@@ -66,62 +197,23 @@ uint32_t __CTF2301_DISABLE_PWM_PROGRAMMING(){
 // 0: 0V for fan OFF and open for fan ON
 // 1: open for fan OFF and 0V for fan ON
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_POLARITY(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
-        if (param == 0){
-            regData &= ~0x10;
-        } else {
-            regData |= 0x10;
-        }
-        if (__CTF2301_writeRegister(PWM_TACH_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_PWM_POLARITY(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, PWM_TACH_CONFIG, 0x10, (param == 0) ? 0x00 : 0x10);
 }
 
 // PWM Master Clock Select， Default is 360kHz
 // 0: 360kHz
 // 1: 1.4kHz
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_MASTER_CLOCK(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
-        if (param == 0){
-            regData &= ~0x08;
-        } else {
-            regData |= 0x08;
-        }
-        if (__CTF2301_writeRegister(PWM_TACH_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_PWM_MASTER_CLOCK(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, PWM_TACH_CONFIG, 0x08, (param == 0) ? 0x00 : 0x08);
 }
 
 // Tachometer Mode Select
 // Note: If the PWM Master Clock is 360 kHz, mode 00 is used regardless of the setting of these two bits.
 // Return: CTF2301_OK if selection is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_TACH_MODE(TachometerMode mode){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
-        regData &= ~0x03;
-        regData |= mode;
-        if (__CTF2301_writeRegister(PWM_TACH_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_TACH_MODE(CTF2301_Device *dev, TachometerMode mode){
+    return __CTF2301_updateRegister(dev, PWM_TACH_CONFIG, 0x03, mode);
 }
 
 // Fast Tachometer Spin-up, Default is 0x01
@@ -133,22 +225,8 @@ uint32_t __CTF2301_SET_TACH_MODE(TachometerMode mode){
 // always 100%. Register x03, bit 2 = 1 for Tachometer mode.
 // If PWM Spin-Up Time (bits 2:0) = 000, the Spin-Up cycle is bypassed, regardless of the state of this bit.
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(FAN_SPIN_UP_CONFIG, &regData) == CTF2301_OK){
-        if (param == 0){
-            regData &= ~0x20;
-        } else {
-            regData |= 0x20;
-        }
-        if (__CTF2301_writeRegister(FAN_SPIN_UP_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, FAN_SPIN_UP_CONFIG, 0x20, (param == 0) ? 0x00 : 0x20);
 }
 
 // PWM Spin-Up Duty Cycle, Default is 0x01
@@ -158,19 +236,8 @@ uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(uint8_t param){
 // 0x02: 75% 81% Depends on PWM Frequency.
 // 0x03: 100%
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(FAN_SPIN_UP_CONFIG, &regData) == CTF2301_OK){
-        regData &= ~0x18;
-        regData |= (param << 3);
-        if (__CTF2301_writeRegister(FAN_SPIN_UP_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, FAN_SPIN_UP_CONFIG, 0x18, param << 3);
 }
 
 // PWM Spin-Up Time Interval, Default is 0x01
@@ -184,43 +251,32 @@ uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(uint8_t param){
 // 0x06: 1.6 seconds
 // 0x07: 3.2 seconds
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_SPIN_UP_TIME_INTERVAL(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(FAN_SPIN_UP_CONFIG, &regData) == CTF2301_OK){
-        regData &= ~0x07;
-        regData |= param;
-        if (__CTF2301_writeRegister(FAN_SPIN_UP_CONFIG, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_PWM_SPIN_UP_TIME_INTERVAL(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, FAN_SPIN_UP_CONFIG, 0x07, param);
 }
 
 // Read or Write PWM Duty Cycle for direct fan speed control, Default is 0x00 (means off)
-uint32_t __CTF2301_SET_PWM_VALUE(uint8_t param){
+uint32_t __CTF2301_SET_PWM_VALUE(CTF2301_Device *dev, uint8_t param){
     uint32_t ret = CTF2301_OK;
     // This is only available when PWM Programming is enabled
     // Read PWPGM bit
     uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_TACH_CONFIG, &regData) == CTF2301_OK){
+    if (__CTF2301_readRegisterCached(dev, PWM_TACH_CONFIG, &regData) == CTF2301_OK){
         if ((regData & 0x20) == 0){
             ret = CTF2301_ERROR_NOT_READY;
-        }
-    } else {
-        if (__CTF2301_writeRegister(PWM_VALUE, param) != CTF2301_OK){
+        } else if (__CTF2301_writeRegister(dev, PWM_VALUE, param) != CTF2301_OK){
             ret = CTF2301_ERROR;
         }
+    } else {
+        ret = CTF2301_ERROR_COMM;
     }
 
     return ret;
 }
 
-uint32_t __CTF2301_GET_PWM_VALUE(uint8_t *param){
+uint32_t __CTF2301_GET_PWM_VALUE(CTF2301_Device *dev, uint8_t *param){
     uint32_t ret = CTF2301_OK;
-    if (__CTF2301_readRegister(PWM_VALUE, param) == CTF2301_OK){
+    if (__CTF2301_readRegister(dev, PWM_VALUE, param) != CTF2301_OK){
     	ret = CTF2301_ERROR;
     }
     return ret;
@@ -230,312 +286,2707 @@ uint32_t __CTF2301_GET_PWM_VALUE(uint8_t *param){
 // Param:
 // Only PWMF[4:0] is used. This sets the n value, then the frequency is calculated base on following formula:
 // f = PWM_CLOCK / (2 * n), where PWM_CLOCK can be set by __CTF2301_SET_PWM_MASTER_CLOCK.
-uint32_t __CTF2301_SET_PWM_OUTPUT_FREQUENCY(uint8_t param){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regData = 0x00;
-    if (__CTF2301_readRegister(PWM_FREQ, &regData) == CTF2301_OK){
-        regData &= ~0x1F;
-        regData |= param;
-        if (__CTF2301_writeRegister(PWM_FREQ, regData) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-        }
-    } else {
-        ret = CTF2301_ERROR_COMM;
-    }
-    return ret;
+uint32_t __CTF2301_SET_PWM_OUTPUT_FREQUENCY(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, PWM_FREQ, 0x1F, param);
 }
 
 // Setup Lookup Table. Default is 0x7F
-uint32_t __CTF2301_SET_LOOKUP_TABLE(){
-    uint32_t ret = CTF2301_OK;
-    uint8_t regAddrTemp[12] = {LOOKUP_TABLE_TEMP_1, 
-                           LOOKUP_TABLE_TEMP_2, 
-                           LOOKUP_TABLE_TEMP_3, 
-                           LOOKUP_TABLE_TEMP_4, 
-                           LOOKUP_TABLE_TEMP_5, 
-                           LOOKUP_TABLE_TEMP_6, 
-                           LOOKUP_TABLE_TEMP_7, 
-                           LOOKUP_TABLE_TEMP_8, 
-                           LOOKUP_TABLE_TEMP_9, 
-                           LOOKUP_TABLE_TEMP_10, 
-                           LOOKUP_TABLE_TEMP_11, 
-                           LOOKUP_TABLE_TEMP_12};
-    uint8_t regAddrPWM[12] = {LOOKUP_TABLE_PWM_1,
-                            LOOKUP_TABLE_PWM_2,
-                            LOOKUP_TABLE_PWM_3,
-                            LOOKUP_TABLE_PWM_4,
-                            LOOKUP_TABLE_PWM_5,
-                            LOOKUP_TABLE_PWM_6,
-                            LOOKUP_TABLE_PWM_7,
-                            LOOKUP_TABLE_PWM_8,
-                            LOOKUP_TABLE_PWM_9,
-                            LOOKUP_TABLE_PWM_10,
-                            LOOKUP_TABLE_PWM_11,
-                            LOOKUP_TABLE_PWM_12};
-    uint8_t regDataTemp[12] = {configLUT_TEMP_ENTRY_1,
-                            configLUT_TEMP_ENTRY_2,
-                            configLUT_TEMP_ENTRY_3,
-                            configLUT_TEMP_ENTRY_4,
-                            configLUT_TEMP_ENTRY_5,
-                            configLUT_TEMP_ENTRY_6,
-                            configLUT_TEMP_ENTRY_7,
-                            configLUT_TEMP_ENTRY_8,
-                            configLUT_TEMP_ENTRY_9,
-                            configLUT_TEMP_ENTRY_10,
-                            configLUT_TEMP_ENTRY_11,
-                            configLUT_TEMP_ENTRY_12};
-    uint8_t regDataPWM[12] = {configLUT_PWM_ENTRY_1,
-                            configLUT_PWM_ENTRY_2,
-                            configLUT_PWM_ENTRY_3,
-                            configLUT_PWM_ENTRY_4,
-                            configLUT_PWM_ENTRY_5,
-                            configLUT_PWM_ENTRY_6,
-                            configLUT_PWM_ENTRY_7,
-                            configLUT_PWM_ENTRY_8,
-                            configLUT_PWM_ENTRY_9,
-                            configLUT_PWM_ENTRY_10,
-                            configLUT_PWM_ENTRY_11,
-                            configLUT_PWM_ENTRY_12};
-    for (int i = 0; i < 12; i++){
-        if (__CTF2301_writeRegister(regAddrTemp[i], regDataTemp[i]) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-            break;
-        }
-        if (__CTF2301_writeRegister(regAddrPWM[i], regDataPWM[i]) != CTF2301_OK){
-            ret = CTF2301_ERROR;
-            break;
+// Loads the table from the configLUT_ defines in the header file
+uint32_t __CTF2301_SET_LOOKUP_TABLE(CTF2301_Device *dev){
+    const CTF2301_LookupTable lut = {
+        .temp = {configLUT_TEMP_ENTRY_1, configLUT_TEMP_ENTRY_2, configLUT_TEMP_ENTRY_3, configLUT_TEMP_ENTRY_4,
+                 configLUT_TEMP_ENTRY_5, configLUT_TEMP_ENTRY_6, configLUT_TEMP_ENTRY_7, configLUT_TEMP_ENTRY_8,
+                 configLUT_TEMP_ENTRY_9, configLUT_TEMP_ENTRY_10, configLUT_TEMP_ENTRY_11, configLUT_TEMP_ENTRY_12},
+        .pwm  = {configLUT_PWM_ENTRY_1, configLUT_PWM_ENTRY_2, configLUT_PWM_ENTRY_3, configLUT_PWM_ENTRY_4,
+                 configLUT_PWM_ENTRY_5, configLUT_PWM_ENTRY_6, configLUT_PWM_ENTRY_7, configLUT_PWM_ENTRY_8,
+                 configLUT_PWM_ENTRY_9, configLUT_PWM_ENTRY_10, configLUT_PWM_ENTRY_11, configLUT_PWM_ENTRY_12},
+        .hysteresis = configLUT_HYST,
+        .resolution = CTF2301_LUT_RES_1C
+    };
+    CTF2301_LookupTable table = lut;
+    // The table follows whichever LUT resolution the device configuration selects, the defines are in °C
+    if (dev->config.useEnhancedConfig && (dev->config.enhancedConfigReg & 0x20)){
+        table.resolution = CTF2301_LUT_RES_0_5C;
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            table.temp[i] = CTF2301_LUT_TEMP_0_5C(lut.temp[i] * 2);
         }
     }
+    return CTF2301_setLookupTable(dev, &table, 0);
+}
 
-    return ret;
+// Set Lookup Table Temp Offset. Default is 0x00
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_LOOKUP_TABLE_OFFSET(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, LOOKUP_TABLE_OFFSET, 0xFF, param);
 }
 
-// Tach measurement
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_readTach(uint16_t *tach){
-    //TODO
+// Set Lookup Table Hysteresis. Default is 0x04
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_LOOKUP_TABLE_HYST(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, LOOKUP_TABLE_HYST, 0xFF, param);
 }
 
-// Basic R/W
-// Read a register from the CTF2301
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_readRegister(CTF2301_Register address, uint8_t *buffer){
-    uint32_t ret = CTF2301_OK;
-    if (HAL_I2C_Mem_Read(&CTF2301_I2C_HANDLE, ctf2301_i2cAddr << 1, address, I2C_MEMADD_SIZE_8BIT, buffer, 1, HAL_MAX_DELAY) != HAL_OK){
-        ret = CTF2301_ERROR;
+// Set Conversion Rate. Default is 0x08
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_CONVERSION_RATE(CTF2301_Device *dev, ConversionRate rate){
+    return __CTF2301_updateRegister(dev, CONVERSION_RATE, 0xFF, rate);
+}
+
+// Set Remote Diode Beta Compensation. Default is 0x82
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_DIODE_BETA_COMP(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, REMOTE_DIODE_BETA_COMP, 0x0F, param);
+}
+
+// Remote temperature offset registers for an offset
+// Same 11-bit two's complement as the setpoints: signed °C in the MSB, 1/8°C in LSB bits 7:5
+static void __CTF2301_encodeOffset(CTF2301_Temp offset, uint8_t *data){
+    int32_t eighths = ((int32_t)offset + 2) >> 2;
+    if (eighths < -1024){
+        eighths = -1024;
+    } else if (eighths > 1023){
+        eighths = 1023;
     }
+    data[0] = (uint8_t)(eighths >> 3);
+    data[1] = (uint8_t)((eighths & 0x07) << 5);
+}
 
-    return ret;
+// Set Remote Temperature Offset. Default is 0x0000
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_TEMP_OFFSET(CTF2301_Device *dev, CTF2301_Temp offset){
+    uint8_t data[2];
+    __CTF2301_encodeOffset(offset, data);
+    return __CTF2301_writeRegisters(dev, REMOTE_TEMP_OFFSET_MSB, data, 2);
 }
 
-// Write a register to the CTF2301
-// Return: CTF2301_OK if writing is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_writeRegister(CTF2301_Register address, uint8_t data){
+// Set Remote Diode Temperature Filter and Comparator Mode, Default is 0x00
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_DIODE_TEMP_FILTER(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, REMOTE_DIODE_TEMP_FILTER, 0x06, (param & 0x03) << 1);
+}
+
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_ALERT_COMPARATOR_MODE(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, REMOTE_DIODE_TEMP_FILTER, 0x01, (param == 0) ? 0x00 : 0x01);
+}
+
+// Set SMBus Timeout. Default is 0x00
+// Param:
+// 0: the SMBus interface waits however long SCL is held low
+// 1: the SMBus interface resets when SCL is held low for more than 25ms
+// Note: bit 7 as the enable bit is not confirmed against the datasheet
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_SMBUS_TIMEOUT(CTF2301_Device *dev, uint8_t param){
+    return __CTF2301_updateRegister(dev, SMBUS_TIMEOUT, 0x80, (param == 0) ? 0x00 : 0x80);
+}
+
+// Set Alarm Mask. Default is 0x00
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_ALERT_MASK(CTF2301_Device *dev, uint8_t mask){
+    return __CTF2301_updateRegister(dev, ALERT_MASK, 0xFF, mask & (uint8_t)~ALERT_STATUS_BUSY);
+}
+
+// Write the registers of a run that differ from what the chip holds. Each stretch of changed registers goes in one
+// transfer. When bursting is possible, unchanged registers in a short gap are rewritten as well since that is cheaper
+// than starting another transaction.
+// Param: wanted - values to write, current - values the chip holds now
+// Return: CTF2301_OK if all writes are successful, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_writeChanged(CTF2301_Device *dev, CTF2301_Register address, const uint8_t *wanted,
+                                       const uint8_t *current, uint16_t length){
     uint32_t ret = CTF2301_OK;
-    if (HAL_I2C_Mem_Write(&CTF2301_I2C_HANDLE, ctf2301_i2cAddr << 1, address, I2C_MEMADD_SIZE_8BIT, &data, 1, HAL_MAX_DELAY) != HAL_OK){
-        ret = CTF2301_ERROR;
+    uint8_t gap = __CTF2301_burstAllowed(address, length) ? 2 : 0;
+    int start, end;
+    for (start = 0; start < length && ret == CTF2301_OK; start = end){
+        if (wanted[start] == current[start]){
+            dev->stats.writesAvoided++;
+            end = start + 1;
+            continue;
+        }
+        end = start + 1;
+        for (int i = start + 1; i < length && i <= end + gap; i++){
+            if (wanted[i] != current[i]){
+                end = i + 1;
+            }
+        }
+        if (__CTF2301_writeRegisters(dev, address + start, &wanted[start], end - start) != CTF2301_OK){
+            ret = CTF2301_ERROR;
+        }
     }
-
     return ret;
-
 }
 
-// Initialize the CTF2301, you have to select the options in the defines above
-// Return: CTF2301_OK if the initialization is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_init(){
+// Upload a lookup table, only the registers that differ from the chip are written
+// Return: CTF2301_OK if the table is uploaded (and verified), CTF2301_ERROR_VERIFY if the readback differs,
+//         CTF2301_ERROR_BUSY if a configuration transaction is open,
+//         CTF2301_ERROR if the table is invalid or a transfer fails
+uint32_t CTF2301_setLookupTable(CTF2301_Device *dev, const CTF2301_LookupTable *lut, uint8_t flags){
     uint32_t ret = CTF2301_OK;
-    uint8_t id_data;
-    uint8_t config_data = 0x00;
-    uint8_t enhanced_config_data = 0x00;
+    uint8_t wanted[CTF2301_LUT_REGISTERS];
+    uint8_t current[CTF2301_LUT_REGISTERS];
+    uint8_t tachConfig;
 
-    // Check if Not Ready Bit is clear in POR
-    if (CTF2301_checkPOR() != CTF2301_OK){
-        ret = CTF2301_ERROR_NOT_READY;
-        return ret;
+    // The upload toggles PWM programming, that can't wait for a transaction to commit
+    if (dev->txn.open){
+        return CTF2301_ERROR_BUSY;
     }
 
-    // Check the device ID
-    if (CTF2301_readManufacturerID(&id_data) == CTF2301_OK){
-        if(id_data != CTF2301_MANUFACTURER_ID){
-            ret = CTF2301_ERROR_ID;
-            return ret;
+    // Temperatures are 7-bit unless the extended 0.5°C resolution is selected
+    for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+        if (lut->resolution == CTF2301_LUT_RES_1C && lut->temp[i] > 0x7F){
+            return CTF2301_ERROR;
+        }
+        wanted[2 * i] = lut->temp[i];
+        wanted[2 * i + 1] = lut->pwm[i];
+    }
+
+    if (__CTF2301_updateRegister(dev, ENHANCED_CONFIG, 0x20, (lut->resolution == CTF2301_LUT_RES_0_5C) ? 0x20 : 0x00) != CTF2301_OK
+        || __CTF2301_SET_LOOKUP_TABLE_HYST(dev, lut->hysteresis) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+
+    // What does the chip hold now? Served from the shadow cache when possible, one burst read otherwise
+    if ((flags & CTF2301_LUT_FORCE) == 0){
+        if (__CTF2301_shadowLoad(dev, LOOKUP_TABLE_TEMP_1, current, CTF2301_LUT_REGISTERS) == 0
+            && __CTF2301_readRegisters(dev, LOOKUP_TABLE_TEMP_1, current, CTF2301_LUT_REGISTERS) != CTF2301_OK){
+            return CTF2301_ERROR;
         }
     } else {
-        ret = CTF2301_ERROR_COMM;
-        return ret;
+        for (int i = 0; i < CTF2301_LUT_REGISTERS; i++){
+            current[i] = ~wanted[i];
+        }
     }
 
-    // Configure PWM TACH
-    // PWM TACH Power on Default is 0x20, you can change the values here so it can setup once and for all during init
-    // But I will comment out here since default usually works fine.
-    /*
-    // Set Tachometer Mode
-    __CTF2301_SET_TACH_MODE(TACH_MODE_01);
-    // Set PWM output polarity
-    __CTF2301_SET_PWM_POLARITY(1);
-    // Set PWM Master Clock
-    __CTF2301_SET_PWM_MASTER_CLOCK(1);
-    */
-
-    // Configure Fan Spin-up
-    // Default value is 0x3F, you can change according to your needs. But I will comment out here since default usually works fine.
-    /*
-    // Set Fast Tachometer Spin-up
-    __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(0x00);
-    // Set PWM Spin-Up Duty Cycle
-    __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(0x00);
-    // Set PWM Spin-Up Time Interval
-    __CTF2301_SET_PWM_SPIN_UP_TIME_INTERVAL(0x00);
-    */
-
-    // Configure PWM Frequency
-    // Default value is 0x17, you can change according to your needs. Refer to the header file and datasheet for how to set the frequency.
-    /*
-    // Set PWM Output Frequency
-    __CTF2301_SET_PWM_OUTPUT_FREQUENCY(0x17);
-    */
-
-    // DEVICE OPTION 1 (You can only choose one of the two options)
-    // Configure Look-up Table LUT (This determines the Auto-Temp Mode Temp to Fan Speed Ratio)
-    // The look-up table has a set of preset data in it, you can change it according to your application needs.
-    
-    #ifndef configUSE_DIRECT_DCY_MODE
-
-    // Setup Look-up Table
-    __CTF2301_SET_LOOKUP_TABLE();
-    // Disable Program Mode to enable Auto Mode
-    __CTF2301_DISABLE_PWM_PROGRAMMING();
+    // The table is only writable with PWM programming enabled
+    if (__CTF2301_readRegisterCached(dev, PWM_TACH_CONFIG, &tachConfig) != CTF2301_OK
+        || ((tachConfig & 0x20) == 0 && __CTF2301_ENABLE_PWM_PROGRAMMING(dev) != CTF2301_OK)){
+        return CTF2301_ERROR;
+    }
 
-    #endif
+    ret = __CTF2301_writeChanged(dev, LOOKUP_TABLE_TEMP_1, wanted, current, CTF2301_LUT_REGISTERS);
 
-    // DEVICE OPTION 2
-    // Configure PWM Value (for manual direct fan speed control)
-    
-    #ifdef configUSE_DIRECT_DCY_MODE
-        __CTF2301_SET_PWM_VALUE(0x00); // Default is 0x00 (means off)
-    #endif
+    if ((tachConfig & 0x20) == 0 && __CTF2301_DISABLE_PWM_PROGRAMMING(dev) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
 
-    // Set the configuration
-    #if (configENABLE_ALERT_RESPONSE == 1)
-        config_data |= 0x80;
-    #endif
-    #if (configENABLE_STANDBY_MODE == 1)
-        config_data |= 0x40;
-    #endif 
-    #if (configENABLE_PWM_STANDBY == 1)
-        config_data |= 0x20;
-    #endif
-    #if (configSELECT_ALERT_TACH_OUTPUT == 1)
-        config_data |= 0x10;
-    #endif
-    #if (configENABLE_T_CRIT_OVERRIDE == 1)
-        config_data |= 0x08;
-    #endif
-    #if (configENABLE_RDTS_FAULT_QUEUE == 1)
-        config_data |= 0x04;
-    #endif
-    
-    if (config_data != 0x00){ // not default
-        if (__CTF2301_writeRegister(CONFIG, config_data) != CTF2301_OK){
+    // Read the whole table back from the chip in one burst
+    if (ret == CTF2301_OK && (flags & CTF2301_LUT_VERIFY)){
+        if (__CTF2301_readRegisters(dev, LOOKUP_TABLE_TEMP_1, current, CTF2301_LUT_REGISTERS) != CTF2301_OK){
             ret = CTF2301_ERROR;
+        } else if (memcmp(current, wanted, CTF2301_LUT_REGISTERS) != 0){
+            ret = CTF2301_ERROR_VERIFY;
         }
     }
 
-    // Set the enhanced configuration
-    #if (configENABLE_SIGNED_TEMP_FILTER == 1)
-        enhanced_config_data |= 0x40;
-    #endif
-    #if (configENABLE_LOOKUP_TABLE_RES_EXT == 1)
-        enhanced_config_data |= 0x20;
-    #endif
-    #if (configENABLE_PWM_HIGH_RES == 1)
-        enhanced_config_data |= 0x10;
-    #endif
-    #if (configENABLE_UNSIGNED_H_T_CRIT_SP_FT == 1)
-        enhanced_config_data |= 0x08;
-    #endif
-    #if (configSET_PWM_SMOOTH_RAMP_RATE == 1)
-        enhanced_config_data |= 0x02;
-    #endif
-    #if (configSET_PWM_SMOOTH_RAMP_RATE == 2)
-        enhanced_config_data |= 0x04;
-    #endif
-    #if (configSET_PWM_SMOOTH_RAMP_RATE == 3)
-        enhanced_config_data |= 0x06;
-    #endif
-    #if (configENABLE_PWM_SMOOTH_RAMP_RATE == 1)
-        enhanced_config_data |= 0x01;
-    #endif
-
-    #if (configUSE_ENHANCE_CONFIG == 1)
-        if (enhanced_config_data != 0x00){ // not default
-            if (__CTF2301_writeRegister(ENHANCED_CONFIG, enhanced_config_data) != CTF2301_OK){
-                ret = CTF2301_ERROR;
-            }
-        }
-    #endif
-
     return ret;
 }
 
-// Check Power On Reset Status
-// Return: CTF2301_OK if POR is ready, CTF2301_ERROR_NOT_READY otherwise
-uint32_t CTF2301_checkPOR(){
+// Read the lookup table from the chip
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_getLookupTable(CTF2301_Device *dev, CTF2301_LookupTable *lut){
     uint32_t ret = CTF2301_OK;
-    uint8_t por_data = 0x00;
-    if (__CTF2301_readRegister(POR_STATUS, &por_data) == CTF2301_OK){
-        if (por_data != 0x00){ // Power On Not Ready
-            ret = CTF2301_ERROR_NOT_READY;
-        }
+    uint8_t regData[CTF2301_LUT_REGISTERS];
+    uint8_t enhancedConfig;
+    if (__CTF2301_readRegisters(dev, LOOKUP_TABLE_TEMP_1, regData, CTF2301_LUT_REGISTERS) != CTF2301_OK
+        || __CTF2301_readRegisterCached(dev, LOOKUP_TABLE_HYST, &lut->hysteresis) != CTF2301_OK
+        || __CTF2301_readRegisterCached(dev, ENHANCED_CONFIG, &enhancedConfig) != CTF2301_OK){
+        ret = CTF2301_ERROR;
     } else {
-        ret = CTF2301_ERROR_COMM;
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            lut->temp[i] = regData[2 * i];
+            lut->pwm[i] = regData[2 * i + 1];
+        }
+        lut->resolution = (enhancedConfig & 0x20) ? CTF2301_LUT_RES_0_5C : CTF2301_LUT_RES_1C;
     }
     return ret;
 }
 
-// Read Manufacturer ID.
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_readManufacturerID(uint8_t *id){
-    uint32_t ret = CTF2301_OK;
-    if (__CTF2301_readRegister(MANUFACTURER_ID, id) != CTF2301_OK){
-        ret = CTF2301_ERROR;
+// Lookup table fitting
+// The curve is taken as one value per temperature code, the middle of its range over the code. With hysteresis an entry
+// also holds while the temperature falls to hysteresis below it, so it has to fit the curve from there up to the next
+// entry. Greedy placement is optimal for a bound on the largest error, a binary search on the bound finds the smallest
+// one 12 entries can hold.
+
+// Index of the first point above a temperature
+static uint16_t __CTF2301_curveAbove(const CTF2301_CurvePoint *curve, uint16_t points, int32_t temp){
+    uint16_t low = 0;
+    uint16_t high = points;
+    while (low < high){
+        uint16_t mid = low + (high - low) / 2;
+        if (curve[mid].temp <= temp){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
-    return ret;
+    return low;
 }
 
-// Read Step and Die Revision ID.
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_readStepDieRevID(uint8_t *id){
-    uint32_t ret = CTF2301_OK;
-    if (__CTF2301_readRegister(STEP_DIE_REV_ID, id) != CTF2301_OK){
-        ret = CTF2301_ERROR;
+// Duty cycle of a curve at a temperature, flat beyond the first and last points
+static uint32_t __CTF2301_curveAt(const CTF2301_CurvePoint *curve, uint16_t points, int32_t temp){
+    uint16_t i = __CTF2301_curveAbove(curve, points, temp);
+    if (i == 0){
+        return curve[0].duty;
     }
-    return ret;
+    if (i == points){
+        return curve[points - 1].duty;
+    }
+    return (uint32_t)((int64_t)curve[i - 1].duty + ((int64_t)curve[i].duty - curve[i - 1].duty) * (temp - curve[i - 1].temp)
+                      / (curve[i].temp - curve[i - 1].temp));
 }
 
+// Value of the curve for temperature code k: the middle of its lowest and highest duty cycle over the code
+static uint32_t __CTF2301_curveCell(const CTF2301_CurvePoint *curve, uint16_t points, int32_t unit, uint16_t k){
+    int32_t from = k * unit;
+    int32_t to = from + unit;
+    uint32_t lo = __CTF2301_curveAt(curve, points, from);
+    uint32_t hi = __CTF2301_curveAt(curve, points, to);
+    if (lo > hi){
+        uint32_t swap = lo;
+        lo = hi;
+        hi = swap;
+    }
+    for (uint16_t i = __CTF2301_curveAbove(curve, points, from); i < points && curve[i].temp < to; i++){
+        if (curve[i].duty < lo){
+            lo = curve[i].duty;
+        }
+        if (curve[i].duty > hi){
+            hi = curve[i].duty;
+        }
+    }
+    return lo + (hi - lo) / 2;
+}
 
-// Set Fan Speed (in PWM Duty Cycle)
-// Param: fanMaxRPM - Maximum RPM of the fan, setRPM - Desired RPM
-// Note: The maximum RPM of the fan varies from fan to fan specs and may not be accurate, the actual RPM may vary. 
-// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_setFanSpeed(uint16_t fanMaxRPM, uint16_t setRPM){
-    //TODO
+// Place the entries for an error bound
+// Param: shift - hysteresis in temperature codes, lut - optional, return the entries
+// Return: entries needed, CTF2301_LUT_ENTRIES + 1 if the bound can't be held
+static uint8_t __CTF2301_lutFitPass(const CTF2301_CurvePoint *curve, uint16_t points, int32_t unit, uint16_t cells,
+                                    uint16_t fullScale, uint16_t shift, uint32_t bound, CTF2301_LookupTable *lut){
+    uint16_t k = 0;
+    uint8_t entries = 0;
+
+    // Below the first entry the chip runs 0%
+    while (k < cells && __CTF2301_curveCell(curve, points, unit, k) <= bound){
+        k++;
+    }
+    while (k < cells){
+        uint16_t start = k;
+        uint16_t j = (start > shift) ? start - shift : 0;
+        uint32_t segLo = UINT32_MAX;
+        uint32_t segHi = 0;
+        int32_t qMin = 0;
+        int32_t qMax = fullScale;
+        int32_t q;
+        if (entries == CTF2301_LUT_ENTRIES){
+            return CTF2301_LUT_ENTRIES + 1;
+        }
+        // Grow the entry, from where it holds on the way down, while some PWM code stays within the bound of it all
+        while (j < cells){
+            uint32_t value = __CTF2301_curveCell(curve, points, unit, j);
+            uint32_t newLo = (value < segLo) ? value : segLo;
+            uint32_t newHi = (value > segHi) ? value : segHi;
+            int32_t a = (newHi > bound)
+                        ? (int32_t)(((uint64_t)(newHi - bound) * fullScale + CTF2301_DUTY_FULL - 1) / CTF2301_DUTY_FULL) : 0;
+            int32_t b = (int32_t)(((uint64_t)newLo + bound) * fullScale / CTF2301_DUTY_FULL);
+            if (b > fullScale){
+                b = fullScale;
+            }
+            if (a > b){
+                break;
+            }
+            segLo = newLo;
+            segHi = newHi;
+            qMin = a;
+            qMax = b;
+            j++;
+        }
+        if (j <= start){
+            return CTF2301_LUT_ENTRIES + 1;
+        }
+        k = j;
+        q = (int32_t)((((uint64_t)segLo + segHi) * fullScale + CTF2301_DUTY_FULL) / (2 * CTF2301_DUTY_FULL));
+        q = (q < qMin) ? qMin : (q > qMax) ? qMax : q;
+        if (lut != NULL){
+            lut->temp[entries] = (uint8_t)start;
+            lut->pwm[entries] = (uint8_t)q;
+        }
+        entries++;
+    }
+    return entries;
 }
 
-// Get Fan Speed (in RPM)
-// Param: rpm - return RPM
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_getFanSpeed(uint16_t *rpm){
-    //TODO
+// Smallest error bound the entries can hold with a hysteresis
+static uint32_t __CTF2301_lutFitBound(const CTF2301_CurvePoint *curve, uint16_t points, int32_t unit, uint16_t cells,
+                                      uint16_t fullScale, uint16_t shift){
+    uint32_t low = 0;
+    uint32_t high = CTF2301_DUTY_FULL;
+    while (low < high){
+        uint32_t bound = low + (high - low) / 2;
+        if (__CTF2301_lutFitPass(curve, points, unit, cells, fullScale, shift, bound, NULL) <= CTF2301_LUT_ENTRIES){
+            high = bound;
+        } else {
+            low = bound + 1;
+        }
+    }
+    return low;
 }
 
-// Get Rounded Remote Temperature
-// Param: temp - return Remote Temperature (Rounded)
-// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_getRdRemoteTemp(uint16_t *temp){
-    uint32_t ret = CTF2301_OK;
-    if (__CTF2301_readRegister(REMOTE_TEMP_MSB, temp) != CTF2301_OK){
-        ret = CTF2301_ERROR;
+// Largest error of a table against the curve
+// Param: shift - temperature codes the steps move down by, the hysteresis while the temperature falls
+static uint32_t __CTF2301_lutFitError(const CTF2301_CurvePoint *curve, uint16_t points, int32_t unit, uint16_t cells,
+                                      uint16_t fullScale, const CTF2301_LookupTable *lut, uint16_t shift){
+    uint32_t worst = 0;
+    for (uint16_t k = 0; k < cells; k++){
+        uint32_t value = __CTF2301_curveCell(curve, points, unit, k);
+        uint32_t duty = 0;
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            if (lut->temp[i] <= k + shift){
+                duty = (uint32_t)((uint64_t)lut->pwm[i] * CTF2301_DUTY_FULL / fullScale);
+            }
+        }
+        if ((duty > value ? duty - value : value - duty) > worst){
+            worst = (duty > value) ? duty - value : value - duty;
+        }
+    }
+    return worst;
+}
+
+// Fit a lookup table to a fan curve
+// Return: CTF2301_OK if the table is fitted, CTF2301_ERROR if the curve or a setting is invalid
+uint32_t CTF2301_fitLookupTable(const CTF2301_CurvePoint *curve, uint16_t points, uint8_t resolution,
+                                uint16_t pwmFullScale, uint8_t hystMin, CTF2301_LookupTable *lut, CTF2301_LutFit *fit){
+    int32_t unit = (resolution == CTF2301_LUT_RES_0_5C) ? CTF2301_TEMP_FROM_C(1) / 2 : CTF2301_TEMP_FROM_C(1);
+    uint16_t cells = (resolution == CTF2301_LUT_RES_0_5C) ? 256 : 128;
+    uint16_t codesPerC = (resolution == CTF2301_LUT_RES_0_5C) ? 2 : 1;
+    uint32_t bound;
+    uint8_t hyst = hystMin;
+    uint8_t entries;
+
+    if (points == 0 || pwmFullScale == 0 || pwmFullScale > 0xFF || resolution > CTF2301_LUT_RES_0_5C){
+        return CTF2301_ERROR;
+    }
+    for (uint16_t i = 0; i < points; i++){
+        if (curve[i].duty > CTF2301_DUTY_FULL || (i > 0 && curve[i].temp <= curve[i - 1].temp)){
+            return CTF2301_ERROR;
+        }
+    }
+
+    // Widen the hysteresis as long as it costs no accuracy, it keeps the fan from hunting around an entry
+    bound = __CTF2301_lutFitBound(curve, points, unit, cells, pwmFullScale, hyst * codesPerC);
+    while (hyst < CTF2301_LUT_FIT_HYST_MAX
+           && __CTF2301_lutFitBound(curve, points, unit, cells, pwmFullScale, (hyst + 1) * codesPerC) <= bound){
+        hyst++;
+    }
+    entries = __CTF2301_lutFitPass(curve, points, unit, cells, pwmFullScale, hyst * codesPerC, bound, lut);
+    // Entries the curve didn't need repeat the last one, a table that never leaves 0% parks them at the top
+    for (int i = entries; i < CTF2301_LUT_ENTRIES; i++){
+        lut->temp[i] = (entries > 0) ? lut->temp[entries - 1] : (uint8_t)(cells - 1);
+        lut->pwm[i] = (entries > 0) ? lut->pwm[entries - 1] : 0;
+    }
+    lut->hysteresis = hyst;
+    lut->resolution = resolution;
+
+    if (fit != NULL){
+        fit->errorRising = __CTF2301_lutFitError(curve, points, unit, cells, pwmFullScale, lut, 0);
+        fit->errorFalling = __CTF2301_lutFitError(curve, points, unit, cells, pwmFullScale, lut, hyst * codesPerC);
+        fit->entries = entries;
+    }
+    return CTF2301_OK;
+}
+
+// Tach measurement
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readTach(CTF2301_Device *dev, uint16_t *tach){
+    // Reading the LSB latches the MSB, so LSB has to go first
+    return __CTF2301_readRegister16(dev, TACH_COUNT_MSB, TACH_COUNT_LSB, 1, tach);
+}
+
+// Reciprocal seeds for counts normalized to [0x8000, 0x10000): 2^32 / the middle of each of 64 bins.
+// The divisions are folded by the compiler.
+#define __CTF2301_TACH_SEED(i)       ((uint32_t)(0x100000000ULL / (0x8000 + 0x200 * (i) + 0x100)))
+#define __CTF2301_TACH_SEED8(i)      __CTF2301_TACH_SEED(i), __CTF2301_TACH_SEED(i + 1), __CTF2301_TACH_SEED(i + 2), __CTF2301_TACH_SEED(i + 3), \
+                                     __CTF2301_TACH_SEED(i + 4), __CTF2301_TACH_SEED(i + 5), __CTF2301_TACH_SEED(i + 6), __CTF2301_TACH_SEED(i + 7)
+static const uint32_t ctf2301_tachSeed[64] = {
+    __CTF2301_TACH_SEED8(0),  __CTF2301_TACH_SEED8(8),  __CTF2301_TACH_SEED8(16), __CTF2301_TACH_SEED8(24),
+    __CTF2301_TACH_SEED8(32), __CTF2301_TACH_SEED8(40), __CTF2301_TACH_SEED8(48), __CTF2301_TACH_SEED8(56)
+};
+
+// Convert a TACH count to RPM without a division
+// The count is normalized to 16 bits, the seed gives 2^32 / count to 7 bits, two Newton-Raphson steps take it past
+// 28 bits and a final correction makes the quotient exact. Multiplies and shifts only.
+// Return: RPM, 0 for CTF2301_TACH_INVALID or 0, saturates at 65535
+uint16_t CTF2301_tachToRPM(uint16_t tach){
+    uint32_t norm = tach;
+    uint32_t shift = 0;
+    int64_t recip;
+    int64_t error;
+    uint32_t rpm;
+    int64_t rem;
+
+    if (tach == 0 || tach == CTF2301_TACH_INVALID){
+        return 0;
+    }
+    // No CLZ on ARMv6-M, find the leading one in four steps
+    if (norm < 0x0100){ norm <<= 8; shift += 8; }
+    if (norm < 0x1000){ norm <<= 4; shift += 4; }
+    if (norm < 0x4000){ norm <<= 2; shift += 2; }
+    if (norm < 0x8000){ norm <<= 1; shift += 1; }
+
+    recip = ctf2301_tachSeed[(norm >> 9) & 0x3F];
+    error = 0x100000000LL - (int64_t)norm * recip;
+    recip += (recip * error) >> 32;
+    error = 0x100000000LL - (int64_t)norm * recip;
+    recip += (recip * error) >> 32;
+
+    // RPM = K / tach = K * 2^shift / norm = K * recip / 2^(32 - shift)
+    rpm = (uint32_t)(((uint64_t)CTF2301_TACH_CLOCK * (uint64_t)recip) >> (32 - shift));
+    rem = (int64_t)CTF2301_TACH_CLOCK - (int64_t)rpm * tach;
+    while (rem < 0){
+        rpm--;
+        rem += tach;
+    }
+    while (rem >= tach){
+        rpm++;
+        rem -= tach;
+    }
+    return (rpm > 0xFFFF) ? 0xFFFF : (uint16_t)rpm;
+}
+
+// Check if a register range can be moved in a single auto-increment transfer
+static uint8_t __CTF2301_burstAllowed(CTF2301_Register address, uint16_t length){
+#if (configENABLE_I2C_AUTO_INCREMENT == 1)
+    // Only the fan control block (0x46-0x67: tach, PWM configuration and LUT) is accessed with auto-increment
+    if (address >= TACH_COUNT_LSB && (address + length - 1) <= LOOKUP_TABLE_PWM_12){
+        return 1;
+    }
+#endif
+    (void)address;
+    (void)length;
+    return 0;
+}
+
+// Book-keeping once a transfer is over: keep the shadow cache in step with the chip
+static void __CTF2301_transferDone(CTF2301_Device *dev, uint8_t write, CTF2301_Register address, const uint8_t *data, uint16_t length, uint32_t status){
+    for (uint16_t i = 0; i < length; i++){
+        if (status == CTF2301_OK){
+            __CTF2301_shadowStore(dev, address + i, data[i]);
+        } else if (write){
+            // The write may or may not have reached the chip, don't trust the cached copy anymore
+            __CTF2301_shadowDrop(dev, address + i);
+        }
+    }
+    if (status == CTF2301_OK){
+        if (write){
+            dev->stats.bytesWritten += length;
+        } else {
+            dev->stats.bytesRead += length;
+        }
+    }
+}
+
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+
+#if defined(configINSTRUMENT_CYCLES)
+#define __CTF2301_CYCLES()           configINSTRUMENT_CYCLES()
+#elif ((configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS) || (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)) \
+      && !defined(CTF2301_HOST_SIM)
+// SysTick counts down from LOAD once per HAL tick, extend it with the tick count
+static uint32_t __CTF2301_systickCycles(void){
+    uint32_t tick, val;
+    do {
+        tick = HAL_GetTick();
+        val = SysTick->VAL;
+    } while (tick != HAL_GetTick());
+    return tick * (SysTick->LOAD + 1) + (SysTick->LOAD - val);
+}
+#define __CTF2301_CYCLES()           __CTF2301_systickCycles()
+#else
+// Nanoseconds, wrapping
+static uint32_t __CTF2301_monotonicCycles(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+#define __CTF2301_CYCLES()           __CTF2301_monotonicCycles()
+#endif
+
+// Counter slot of a register
+// Return: slot index, or -1 if the register is not instrumented
+static int __CTF2301_instrumentIndex(CTF2301_Register address){
+    if (address <= LOOKUP_TABLE_PWM_12){
+        return address;
+    }
+    switch (address){
+        case REMOTE_DIODE_TEMP_FILTER:  return 0x68;
+        case STEP_DIE_REV_ID:           return 0x69;
+        case MANUFACTURER_ID:           return 0x6A;
+        default:                        return -1;
+    }
+}
+
+// Count a finished transaction
+// Param: address - first register, status - CTF2301_OK, CTF2301_ERROR_NACK or another error, started - __CTF2301_CYCLES() at the start
+static void __CTF2301_instrument(CTF2301_Register address, uint8_t write, uint16_t length, uint32_t status, uint32_t started){
+    uint32_t elapsed = __CTF2301_CYCLES() - started;
+    int slot = __CTF2301_instrumentIndex(address);
+    CTF2301_RegisterStats *stats;
+    uint8_t bucket = 0;
+
+    if (slot < 0){
+        return;
+    }
+    stats = &ctf2301_busStats[slot];
+    if (write){
+        stats->writes++;
+    } else {
+        stats->reads++;
+    }
+    if (status == CTF2301_OK){
+        stats->bytes += length;
+    } else {
+        stats->errors++;
+        if (status == CTF2301_ERROR_NACK){
+            stats->nacks++;
+        }
+    }
+    stats->cycles += elapsed;
+    for (elapsed >>= configINSTRUMENT_SHIFT; elapsed > 1 && bucket < configINSTRUMENT_BUCKETS - 1; elapsed >>= 1){
+        bucket++;
+    }
+    if (stats->histogram[bucket] < 0xFFFF){
+        stats->histogram[bucket]++;
+    }
+}
+
+// Copy the counters of every instrumented register
+void CTF2301_getBusStats(CTF2301_RegisterStats *stats){
+    uint32_t primask;
+    __CTF2301_LOCK(primask);
+    memcpy(stats, ctf2301_busStats, sizeof(ctf2301_busStats));
+    __CTF2301_UNLOCK(primask);
+}
+
+// Copy the counters of one register
+// Return: CTF2301_OK if the register is instrumented, CTF2301_ERROR otherwise
+uint32_t CTF2301_getRegisterStats(CTF2301_Register address, CTF2301_RegisterStats *stats){
+    uint32_t primask;
+    int slot = __CTF2301_instrumentIndex(address);
+    if (slot < 0){
+        return CTF2301_ERROR;
+    }
+    __CTF2301_LOCK(primask);
+    *stats = ctf2301_busStats[slot];
+    __CTF2301_UNLOCK(primask);
+    return CTF2301_OK;
+}
+
+// Clear all counters
+void CTF2301_resetBusStats(void){
+    uint32_t primask;
+    __CTF2301_LOCK(primask);
+    memset(ctf2301_busStats, 0, sizeof(ctf2301_busStats));
+    __CTF2301_UNLOCK(primask);
+}
+
+// Register address of a counter slot
+CTF2301_Register CTF2301_instrumentAddress(uint8_t slot){
+    switch (slot){
+        case 0x68:  return REMOTE_DIODE_TEMP_FILTER;
+        case 0x69:  return STEP_DIE_REV_ID;
+        case 0x6A:  return MANUFACTURER_ID;
+        default:    return (CTF2301_Register)slot;
+    }
+}
+
+#else
+
+// Instrumentation compiled out, the calls below optimise away
+#define __CTF2301_CYCLES()           0
+
+static inline void __CTF2301_instrument(CTF2301_Register address, uint8_t write, uint16_t length, uint32_t status, uint32_t started){
+    (void)address;
+    (void)write;
+    (void)length;
+    (void)status;
+    (void)started;
+}
+
+#endif // configUSE_BUS_INSTRUMENTATION
+
+// Bus recovery of the selected peripheral driver, the caller must hold the bus
+// Return: CTF2301_OK if the bus is idle again, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_busRecover(CTF2301_Device *dev){
+    uint32_t ret = CTF2301_OK;
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+    CTF2301_RecoveryPins *pins = &dev->recovery;
+    GPIO_InitTypeDef gpio = {0};
+
+    dev->stats.recoveries++;
+    // Releasing the peripheral also aborts a transfer it is stuck in and hands the pins back to us
+    HAL_I2C_DeInit(dev->bus);
+    if (pins->sclPort != NULL){
+        HAL_GPIO_WritePin(pins->sclPort, pins->sclPin, GPIO_PIN_SET);
+        HAL_GPIO_WritePin(pins->sdaPort, pins->sdaPin, GPIO_PIN_SET);
+        gpio.Mode = GPIO_MODE_OUTPUT_OD;
+        gpio.Pull = GPIO_NOPULL;
+        gpio.Speed = GPIO_SPEED_FREQ_LOW;
+        gpio.Pin = pins->sclPin;
+        HAL_GPIO_Init(pins->sclPort, &gpio);
+        gpio.Pin = pins->sdaPin;
+        HAL_GPIO_Init(pins->sdaPort, &gpio);
+        // A chip cut off in the middle of a read drives SDA until it has clocked out the rest of its byte
+        for (int i = 0; i < 9 && HAL_GPIO_ReadPin(pins->sdaPort, pins->sdaPin) == GPIO_PIN_RESET; i++){
+            HAL_GPIO_WritePin(pins->sclPort, pins->sclPin, GPIO_PIN_RESET);
+            HAL_Delay(1);
+            HAL_GPIO_WritePin(pins->sclPort, pins->sclPin, GPIO_PIN_SET);
+            HAL_Delay(1);
+        }
+        // STOP: SDA rises while SCL is high
+        HAL_GPIO_WritePin(pins->sclPort, pins->sclPin, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(pins->sdaPort, pins->sdaPin, GPIO_PIN_RESET);
+        HAL_Delay(1);
+        HAL_GPIO_WritePin(pins->sclPort, pins->sclPin, GPIO_PIN_SET);
+        HAL_Delay(1);
+        HAL_GPIO_WritePin(pins->sdaPort, pins->sdaPin, GPIO_PIN_SET);
+        HAL_Delay(1);
+        if (HAL_GPIO_ReadPin(pins->sdaPort, pins->sdaPin) == GPIO_PIN_RESET){
+            ret = CTF2301_ERROR;
+        }
+        HAL_GPIO_DeInit(pins->sclPort, pins->sclPin);
+        HAL_GPIO_DeInit(pins->sdaPort, pins->sdaPin);
+    }
+    if (HAL_I2C_Init(dev->bus) != HAL_OK){
+        ret = CTF2301_ERROR;
+    }
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+    dev->stats.recoveries++;
+    dev->bus->DeInit();
+    if (dev->bus->Init() != BSP_ERROR_NONE){
+        ret = CTF2301_ERROR;
+    }
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+    // The adapter driver runs the recovery itself when a transfer times out
+    (void)dev;
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_SIM_I2C_BUS)
+    dev->stats.recoveries++;
+    ret = CTF2301_simRecover(dev->bus);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_CUSTOM_I2C_BUS)
+    if (dev->bus->recover != NULL){
+        dev->stats.recoveries++;
+        ret = dev->bus->recover(dev->bus->context);
+    }
+#endif
+    return ret;
+}
+
+// Wait on the time base of the bus: backoff between the attempts of a transfer, conversions during calibration
+static void __CTF2301_busDelay(CTF2301_Device *dev, uint32_t ms){
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS) || (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+    (void)dev;
+    HAL_Delay(ms);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+    (void)dev;
+    usleep(ms * 1000);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_SIM_I2C_BUS)
+    CTF2301_simAdvance(dev->bus, ms * 1000);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_CUSTOM_I2C_BUS)
+    if (dev->bus->delay != NULL){
+        dev->bus->delay(dev->bus->context, ms);
+    }
+#endif
+}
+
+#if (configUSE_ASYNC_TRANSPORT == 1)
+
+#if (configUSE_I2C_DMA == 1)
+#define __CTF2301_HAL_MEM_READ      HAL_I2C_Mem_Read_DMA
+#define __CTF2301_HAL_MEM_WRITE     HAL_I2C_Mem_Write_DMA
+#else
+#define __CTF2301_HAL_MEM_READ      HAL_I2C_Mem_Read_IT
+#define __CTF2301_HAL_MEM_WRITE     HAL_I2C_Mem_Write_IT
+#endif
+
+static void __CTF2301_asyncStart(CTF2301_Device *dev);
+static void __CTF2301_asyncComplete(CTF2301_Device *dev, uint32_t status);
+
+// Device with a transfer on a bus, if any
+static CTF2301_Device *__CTF2301_busOwner(I2C_HandleTypeDef *hi2c){
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] != NULL && ctf2301_devices[i]->bus == hi2c && ctf2301_devices[i]->async.inFlight){
+            return ctf2301_devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Hand a bus that just became free to the next device with queued requests, round robin after the previous owner
+// Must be called with interrupts masked.
+static void __CTF2301_busNext(I2C_HandleTypeDef *hi2c, CTF2301_Device *previous){
+    int first = 0;
+    CTF2301_Device *dev;
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] == previous){
+            first = i + 1;
+            break;
+        }
+    }
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        dev = ctf2301_devices[(first + i) % configCTF2301_MAX_DEVICES];
+        if (dev != NULL && dev->bus == hi2c && dev->async.count > 0){
+            __CTF2301_asyncStart(dev);
+            if (dev->async.inFlight){
+                break;
+            }
+        }
+    }
+}
+
+
+// Issue the next bus transaction of the request at the head of the queue
+// Must be called with interrupts masked. Requests that fail to start are completed with an error.
+static void __CTF2301_asyncStart(CTF2301_Device *dev){
+    CTF2301_Request *req;
+    HAL_StatusTypeDef halStatus;
+    uint16_t length;
+    // One transfer at a time per bus, the other chips on it wait for the completion interrupt
+    if (__CTF2301_busOwner(dev->bus) != NULL){
+        return;
+    }
+    while (dev->async.count > 0 && dev->async.inFlight == 0){
+        req = &dev->async.request[dev->async.head];
+        if (req->flags & CTF2301_REQ_CANCELLED){
+            __CTF2301_asyncComplete(dev, CTF2301_ERROR_TIMEOUT);
+            continue;
+        }
+        // Bursts go out as one transaction, anything else one register at a time
+        length = (req->flags & CTF2301_REQ_BURST) ? req->length : 1;
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+        req->started = __CTF2301_CYCLES();
+#endif
+        if (req->flags & CTF2301_REQ_WRITE){
+            dev->stats.busWrites++;
+            halStatus = __CTF2301_HAL_MEM_WRITE(dev->bus, dev->i2cAddr << 1, req->address + req->offset,
+                                                I2C_MEMADD_SIZE_8BIT, &req->data[req->offset], length);
+        } else {
+            dev->stats.busReads++;
+            halStatus = __CTF2301_HAL_MEM_READ(dev->bus, dev->i2cAddr << 1, req->address + req->offset,
+                                               I2C_MEMADD_SIZE_8BIT, &req->data[req->offset], length);
+        }
+        if (halStatus == HAL_OK){
+            dev->async.inFlight = 1;
+        } else if (halStatus == HAL_BUSY){
+            // Someone else owns the peripheral, try again on the next submit or CTF2301_asyncPoll(dev)
+            break;
+        } else {
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+            __CTF2301_instrument(req->address + req->offset, (req->flags & CTF2301_REQ_WRITE) != 0, length, CTF2301_ERROR, req->started);
+#endif
+            __CTF2301_asyncComplete(dev, CTF2301_ERROR);
+        }
+    }
+}
+
+// Retire the request at the head of the queue, or move on to its next register
+// Must be called with interrupts masked.
+static void __CTF2301_asyncComplete(CTF2301_Device *dev, uint32_t status){
+    CTF2301_Request *req = &dev->async.request[dev->async.head];
+    CTF2301_Request done;
+    uint16_t length;
+
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+    if (dev->async.inFlight){
+        __CTF2301_instrument(req->address + req->offset, (req->flags & CTF2301_REQ_WRITE) != 0,
+                             (req->flags & CTF2301_REQ_BURST) ? req->length : 1, status, req->started);
+    }
+#endif
+    dev->async.inFlight = 0;
+    // Put the transaction back on the bus with the next __CTF2301_asyncStart, unless nobody waits for it anymore.
+    // No backoff and no recovery here, this runs in the interrupt (see configI2C_RETRIES).
+    if (status != CTF2301_OK && req->retries < configI2C_RETRIES && (req->flags & CTF2301_REQ_CANCELLED) == 0){
+        req->retries++;
+        dev->stats.retries++;
+        return;
+    }
+    // Callers only see the generic error
+    if (status == (uint32_t)CTF2301_ERROR_NACK){
+        status = CTF2301_ERROR;
+    }
+    if (status == CTF2301_OK && (req->flags & CTF2301_REQ_BURST) == 0 && req->offset + 1 < req->length){
+        req->offset++;
+        req->retries = 0;
+        return;
+    }
+    if (status != CTF2301_OK){
+        dev->stats.failures++;
+    }
+
+    // Free the slot before reporting, so the callback can submit the next request
+    done = *req;
+    dev->async.head = (dev->async.head + 1) % configASYNC_QUEUE_DEPTH;
+    dev->async.count--;
+
+    // A failed burst or a write nobody waits for anymore may have landed anywhere in its run, so all of it is dropped
+    if (status == CTF2301_OK || (done.flags & (CTF2301_REQ_BURST | CTF2301_REQ_CANCELLED))){
+        length = done.length;
+    } else {
+        length = done.offset + 1;
+    }
+    __CTF2301_transferDone(dev, (done.flags & CTF2301_REQ_WRITE) != 0, done.address, done.data, length, status);
+    if (done.flags & CTF2301_REQ_CANCELLED){
+        return;
+    }
+    if (status == CTF2301_OK && (done.flags & CTF2301_REQ_WRITE) == 0 && done.buffer != NULL){
+        memcpy(done.buffer, done.data, done.length);
+    }
+    if (done.done != NULL){
+        *done.done = status;
+    }
+    if (done.callback != NULL){
+        done.callback(dev, status, done.context);
+    }
+}
+
+// Queue a transfer
+static uint32_t __CTF2301_asyncSubmit(CTF2301_Device *dev, uint8_t flags, CTF2301_Register address, uint8_t *buffer, const uint8_t *data, uint16_t length,
+                                      CTF2301_Callback callback, void *context, volatile uint32_t *done){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_Request *req;
+    uint32_t primask;
+
+    if (length == 0 || length > CTF2301_ASYNC_MAX_LENGTH){
+        return CTF2301_ERROR;
+    }
+    if (__CTF2301_burstAllowed(address, length)){
+        flags |= CTF2301_REQ_BURST;
+    }
+
+    __CTF2301_LOCK(primask);
+    if (dev->async.count >= configASYNC_QUEUE_DEPTH){
+        ret = CTF2301_ERROR_BUSY;
+    } else {
+        req = &dev->async.request[(dev->async.head + dev->async.count) % configASYNC_QUEUE_DEPTH];
+        req->address = address;
+        req->length = length;
+        req->offset = 0;
+        req->retries = 0;
+        req->flags = flags;
+        req->buffer = buffer;
+        req->callback = callback;
+        req->context = context;
+        req->done = done;
+        if (data != NULL){
+            memcpy(req->data, data, length);
+        }
+        if (done != NULL){
+            *done = CTF2301_PENDING;
+        }
+        dev->async.count++;
+        __CTF2301_asyncStart(dev);
+    }
+    __CTF2301_UNLOCK(primask);
+
+    return ret;
+}
+
+#if (configUSE_BUS_RECOVERY == 1)
+// A blocking wait timed out, so the transfer on the bus is stuck or the peripheral refuses to start one (busy bus).
+// Recover the bus and fail the transfer that was on it, the queues carry on from there.
+static void __CTF2301_asyncRecover(CTF2301_Device *dev){
+    CTF2301_Device *owner;
+    uint32_t primask;
+    __CTF2301_busRecover(dev);
+    __CTF2301_LOCK(primask);
+    owner = __CTF2301_busOwner(dev->bus);
+    if (owner != NULL){
+        __CTF2301_asyncComplete(owner, CTF2301_ERROR_TIMEOUT);
+    }
+    __CTF2301_busNext(dev->bus, owner);
+    __CTF2301_UNLOCK(primask);
+}
+#endif
+
+// Give up on the requests that report to a completion flag
+// Return: the result if they were over already, CTF2301_ERROR_TIMEOUT otherwise
+uint32_t CTF2301_asyncCancel(CTF2301_Device *dev, volatile uint32_t *done){
+    uint32_t primask;
+    // Detach the request from the caller's stack
+    __CTF2301_LOCK(primask);
+    for (uint8_t i = 0; i < dev->async.count; i++){
+        CTF2301_Request *req = &dev->async.request[(dev->async.head + i) % configASYNC_QUEUE_DEPTH];
+        if (req->done == done){
+            req->flags |= CTF2301_REQ_CANCELLED;
+            req->done = NULL;
+            // Until it is retired, nobody knows whether the write lands
+            if (req->flags & CTF2301_REQ_WRITE){
+                __CTF2301_transferDone(dev, 1, req->address, req->data, req->length, CTF2301_ERROR_TIMEOUT);
+            }
+        }
+    }
+    __CTF2301_UNLOCK(primask);
+    if (*done == CTF2301_PENDING){
+        *done = CTF2301_ERROR_TIMEOUT;
+#if (configUSE_BUS_RECOVERY == 1)
+        __CTF2301_asyncRecover(dev);
+#endif
+    }
+    return *done;
+}
+
+// Block until a request submitted with a completion flag is over
+static uint32_t __CTF2301_asyncWait(CTF2301_Device *dev, volatile uint32_t *done){
+    uint32_t start = HAL_GetTick();
+    while (*done == CTF2301_PENDING){
+        CTF2301_asyncPoll(dev);
+        if (HAL_GetTick() - start >= configSYNC_TIMEOUT_MS){
+            CTF2301_asyncCancel(dev, done);
+        }
+    }
+    return *done;
+}
+
+// Asynchronous R/W
+// Return: CTF2301_OK if the request is queued, CTF2301_ERROR_BUSY if the queue is full, CTF2301_ERROR otherwise
+uint32_t CTF2301_readRegistersAsync(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length,
+                                    CTF2301_Callback callback, void *context, volatile uint32_t *done){
+    return __CTF2301_asyncSubmit(dev, 0, address, buffer, NULL, length, callback, context, done);
+}
+
+uint32_t CTF2301_writeRegistersAsync(CTF2301_Device *dev, CTF2301_Register address, const uint8_t *data, uint16_t length,
+                                     CTF2301_Callback callback, void *context, volatile uint32_t *done){
+    return __CTF2301_asyncSubmit(dev, CTF2301_REQ_WRITE, address, NULL, data, length, callback, context, done);
+}
+
+// Restart a queue that is stalled because the I2C peripheral was busy
+void CTF2301_asyncPoll(CTF2301_Device *dev){
+    uint32_t primask;
+    __CTF2301_LOCK(primask);
+    __CTF2301_asyncStart(dev);
+    __CTF2301_UNLOCK(primask);
+}
+
+// Number of requests queued or on the bus
+uint8_t CTF2301_asyncPending(CTF2301_Device *dev){
+    return dev->async.count;
+}
+
+// HAL I2C callback hooks
+void CTF2301_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_Device *dev = __CTF2301_busOwner(hi2c);
+    if (dev != NULL){
+        __CTF2301_asyncComplete(dev, CTF2301_OK);
+        // Finish a multi-register request before letting another chip on the bus
+        __CTF2301_asyncStart(dev);
+        if (dev->async.inFlight == 0){
+            __CTF2301_busNext(hi2c, dev);
+        }
+    }
+}
+
+void CTF2301_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_I2C_MemTxCpltCallback(hi2c);
+}
+
+void CTF2301_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_Device *dev = __CTF2301_busOwner(hi2c);
+    if (dev != NULL){
+        __CTF2301_asyncComplete(dev, (hi2c->ErrorCode & HAL_I2C_ERROR_AF) ? CTF2301_ERROR_NACK : CTF2301_ERROR);
+        __CTF2301_busNext(hi2c, dev);
+    }
+}
+
+// Blocking transfer, built on the request queue
+static uint32_t __CTF2301_transfer(CTF2301_Device *dev, uint8_t write, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    uint32_t ret;
+    volatile uint32_t done;
+    if (write){
+        ret = __CTF2301_asyncSubmit(dev, CTF2301_REQ_WRITE, address, NULL, buffer, length, NULL, NULL, &done);
+    } else {
+        ret = __CTF2301_asyncSubmit(dev, 0, address, buffer, NULL, length, NULL, NULL, &done);
+    }
+    if (ret == CTF2301_OK){
+        ret = __CTF2301_asyncWait(dev, &done);
+    }
+    return ret;
+}
+
+#else
+
+// Bus primitives of the selected peripheral driver, one I2C transaction each
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+
+// Return: CTF2301_OK if the transfer is successful, CTF2301_ERROR_NACK if the chip does not acknowledge, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_halStatus(CTF2301_Device *dev, HAL_StatusTypeDef halStatus){
+    if (halStatus == HAL_OK){
+        return CTF2301_OK;
+    }
+    return (dev->bus->ErrorCode & HAL_I2C_ERROR_AF) ? CTF2301_ERROR_NACK : CTF2301_ERROR;
+}
+
+static uint32_t __CTF2301_busRead(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    return __CTF2301_halStatus(dev, HAL_I2C_Mem_Read(dev->bus, dev->i2cAddr << 1, address, I2C_MEMADD_SIZE_8BIT, buffer, length, configSYNC_TIMEOUT_MS));
+}
+
+static uint32_t __CTF2301_busWrite(CTF2301_Device *dev, CTF2301_Register address, uint8_t *data, uint16_t length){
+    return __CTF2301_halStatus(dev, HAL_I2C_Mem_Write(dev->bus, dev->i2cAddr << 1, address, I2C_MEMADD_SIZE_8BIT, data, length, configSYNC_TIMEOUT_MS));
+}
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+
+// Return: CTF2301_OK if the transfer is successful, CTF2301_ERROR_NACK if the chip does not acknowledge, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_bspStatus(int32_t bspStatus){
+    if (bspStatus == BSP_ERROR_NONE){
+        return CTF2301_OK;
+    }
+    return (bspStatus == BSP_ERROR_BUS_ACKNOWLEDGE_FAILURE) ? CTF2301_ERROR_NACK : CTF2301_ERROR;
+}
+
+static uint32_t __CTF2301_busRead(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    return __CTF2301_bspStatus(dev->bus->ReadReg(dev->i2cAddr << 1, address, buffer, length));
+}
+
+static uint32_t __CTF2301_busWrite(CTF2301_Device *dev, CTF2301_Register address, uint8_t *data, uint16_t length){
+    return __CTF2301_bspStatus(dev->bus->WriteReg(dev->i2cAddr << 1, address, data, length));
+}
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+
+#define CTF2301_LINUX_MAX_WRITE      32     // Longest register run written in one message
+
+// Return: CTF2301_OK if the ioctl moved all messages, CTF2301_ERROR_NACK if the chip does not acknowledge, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_linuxStatus(int result, int messages){
+    if (result == messages){
+        return CTF2301_OK;
+    }
+    // Adapter drivers report a missing ACK as ENXIO or EREMOTEIO
+    return (result < 0 && (errno == ENXIO || errno == EREMOTEIO)) ? CTF2301_ERROR_NACK : CTF2301_ERROR;
+}
+
+// Register pointer write and data read in one combined transfer, no STOP between them
+static uint32_t __CTF2301_busRead(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    uint8_t reg = address;
+    struct i2c_msg msgs[2] = {
+        { .addr = dev->i2cAddr, .flags = 0,        .len = 1,      .buf = &reg },
+        { .addr = dev->i2cAddr, .flags = I2C_M_RD, .len = length, .buf = buffer }
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+    return __CTF2301_linuxStatus(ioctl(dev->bus->fd, I2C_RDWR, &xfer), 2);
+}
+
+static uint32_t __CTF2301_busWrite(CTF2301_Device *dev, CTF2301_Register address, uint8_t *data, uint16_t length){
+    uint8_t out[1 + CTF2301_LINUX_MAX_WRITE];
+    struct i2c_msg msg = { .addr = dev->i2cAddr, .flags = 0, .len = length + 1, .buf = out };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = &msg, .nmsgs = 1 };
+    if (length > CTF2301_LINUX_MAX_WRITE){
+        return CTF2301_ERROR;
+    }
+    out[0] = address;
+    memcpy(&out[1], data, length);
+    return __CTF2301_linuxStatus(ioctl(dev->bus->fd, I2C_RDWR, &xfer), 1);
+}
+
+// Open an I2C adapter
+// Return: CTF2301_OK if the adapter is open, CTF2301_ERROR_COMM otherwise
+uint32_t CTF2301_linuxOpen(CTF2301_Bus *bus, const char *path){
+    unsigned long funcs = 0;
+    bus->fd = open(path, O_RDWR);
+    if (bus->fd < 0){
+        return CTF2301_ERROR_COMM;
+    }
+    if (ioctl(bus->fd, I2C_FUNCS, &funcs) < 0 || (funcs & I2C_FUNC_I2C) == 0){
+        CTF2301_linuxClose(bus);
+        return CTF2301_ERROR_COMM;
+    }
+    // The adapter timeout is counted in 10ms units
+    ioctl(bus->fd, I2C_TIMEOUT, (configSYNC_TIMEOUT_MS + 9) / 10);
+    return CTF2301_OK;
+}
+
+void CTF2301_linuxClose(CTF2301_Bus *bus){
+    if (bus->fd >= 0){
+        close(bus->fd);
+    }
+    bus->fd = -1;
+}
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_SIM_I2C_BUS)
+
+static uint32_t __CTF2301_busRead(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    return CTF2301_simRead(dev->bus, dev->i2cAddr, address, buffer, length);
+}
+
+static uint32_t __CTF2301_busWrite(CTF2301_Device *dev, CTF2301_Register address, uint8_t *data, uint16_t length){
+    return CTF2301_simWrite(dev->bus, dev->i2cAddr, address, data, length);
+}
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_CUSTOM_I2C_BUS)
+
+static uint32_t __CTF2301_busRead(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    return dev->bus->read(dev->bus->context, dev->i2cAddr, address, buffer, length);
+}
+
+static uint32_t __CTF2301_busWrite(CTF2301_Device *dev, CTF2301_Register address, uint8_t *data, uint16_t length){
+    return dev->bus->write(dev->bus->context, dev->i2cAddr, address, data, length);
+}
+
+#endif // configUSE_PERIPHERIAL_DRIVER_CTF2301
+
+#if (configUSE_BUS_ARBITER == 1)
+// Take the bus for one transfer: ALERT_STATUS at ALERT class, other reads at TELEMETRY and writes at CONFIG,
+// raised to the class of the device while its alert handlers run
+// Return: CTF2301_OK if the device holds the bus, CTF2301_ERROR_TIMEOUT otherwise
+static uint32_t __CTF2301_busAcquire(CTF2301_Device *dev, uint8_t write, CTF2301_Register address){
+    uint8_t busClass = write ? CTF2301_BUS_CONFIG : CTF2301_BUS_TELEMETRY;
+    if (dev->arbiter == NULL){
+        return CTF2301_OK;
+    }
+    if (address == ALERT_STATUS && !write){
+        busClass = CTF2301_BUS_ALERT;
+    }
+    if (dev->busBoost < busClass){
+        busClass = dev->busBoost;
+    }
+    return CTF2301_arbiterAcquire(dev->arbiter, (CTF2301_BusClass)busClass, configSYNC_TIMEOUT_MS);
+}
+
+static void __CTF2301_busRelease(CTF2301_Device *dev){
+    if (dev->arbiter != NULL){
+        CTF2301_arbiterRelease(dev->arbiter);
+    }
+}
+#else
+#define __CTF2301_busAcquire(dev, write, address)    CTF2301_OK
+#define __CTF2301_busRelease(dev)                    ((void)(dev))
+#endif
+
+// Blocking transfer through the peripheral driver
+// Every transaction is tried up to 1 + configI2C_RETRIES times, see CTF2301_TRANSFER_WORST_MS for how long that can take.
+static uint32_t __CTF2301_transfer(CTF2301_Device *dev, uint8_t write, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    uint32_t ret = CTF2301_OK;
+    uint32_t status;
+    uint32_t started;
+    uint16_t step = __CTF2301_burstAllowed(address, length) ? length : 1;
+    for (uint16_t i = 0; i < length && ret == CTF2301_OK; i += step){
+        for (uint8_t attempt = 0; ; attempt++){
+            // Wait for the bus before the clock starts, the instrumentation measures the bus only
+            if (__CTF2301_busAcquire(dev, write, address + i) != CTF2301_OK){
+                return CTF2301_ERROR_TIMEOUT;
+            }
+            started = __CTF2301_CYCLES();
+            if (write){
+                dev->stats.busWrites++;
+                status = __CTF2301_busWrite(dev, address + i, &buffer[i], step);
+            } else {
+                dev->stats.busReads++;
+                status = __CTF2301_busRead(dev, address + i, &buffer[i], step);
+            }
+            __CTF2301_instrument(address + i, write, step, status, started);
+#if (configUSE_BUS_RECOVERY == 1)
+            // After a NACK the master has sent a STOP and the bus is idle, anything else may have left it stuck
+            if (status != CTF2301_OK && status != (uint32_t)CTF2301_ERROR_NACK){
+                __CTF2301_busRecover(dev);
+            }
+#endif
+            __CTF2301_busRelease(dev);
+            if (status == CTF2301_OK || attempt >= configI2C_RETRIES){
+                break;
+            }
+            dev->stats.retries++;
+            __CTF2301_busDelay(dev, (uint32_t)configI2C_BACKOFF_MS << attempt);
+        }
+        if (status != CTF2301_OK){
+            dev->stats.failures++;
+        }
+        ret = (status == CTF2301_OK) ? CTF2301_OK : CTF2301_ERROR;
+        __CTF2301_transferDone(dev, write, address + i, &buffer[i], step, ret);
+    }
+    return ret;
+}
+
+#endif // configUSE_ASYNC_TRANSPORT
+
+// Plain read without a register pointer, used for the SMBus Alert Response Address
+// Param: i2cAddr - 7-bit address
+// Return: CTF2301_OK if the transfer is successful, CTF2301_ERROR_NACK if nobody acknowledges, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_busReceive(CTF2301_Bus *bus, uint8_t i2cAddr, uint8_t *data, uint16_t length){
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+    // Interrupt transfers of the attached devices may own the bus, wait for them to finish
+    uint32_t tickstart = HAL_GetTick();
+    HAL_StatusTypeDef status;
+    while ((status = HAL_I2C_Master_Receive(bus, i2cAddr << 1, data, length, configSYNC_TIMEOUT_MS)) == HAL_BUSY){
+        if ((HAL_GetTick() - tickstart) >= configSYNC_TIMEOUT_MS){
+            return CTF2301_ERROR;
+        }
+    }
+    if (status == HAL_OK){
+        return CTF2301_OK;
+    }
+    return (bus->ErrorCode & HAL_I2C_ERROR_AF) ? CTF2301_ERROR_NACK : CTF2301_ERROR;
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+    return __CTF2301_bspStatus(bus->Recv(i2cAddr << 1, data, length));
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+    struct i2c_msg msg = { .addr = i2cAddr, .flags = I2C_M_RD, .len = length, .buf = data };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = &msg, .nmsgs = 1 };
+    return __CTF2301_linuxStatus(ioctl(bus->fd, I2C_RDWR, &xfer), 1);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_SIM_I2C_BUS)
+    return CTF2301_simReceive(bus, i2cAddr, data, length);
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_CUSTOM_I2C_BUS)
+    if (bus->receive == NULL){
+        return CTF2301_ERROR;
+    }
+    return bus->receive(bus->context, i2cAddr, data, length);
+#endif
+}
+
+// Basic R/W
+// Read a register from the CTF2301
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer){
+    return __CTF2301_transfer(dev, 0, address, buffer, 1);
+}
+
+// Write a register to the CTF2301
+// Return: CTF2301_OK if writing is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_writeRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t data){
+    return __CTF2301_transfer(dev, 1, address, &data, 1);
+}
+
+// Read consecutive registers from the CTF2301
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegisters(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length){
+    return __CTF2301_transfer(dev, 0, address, buffer, length);
+}
+
+// Write consecutive registers to the CTF2301
+// Return: CTF2301_OK if writing is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_writeRegisters(CTF2301_Device *dev, CTF2301_Register address, const uint8_t *data, uint16_t length){
+    return __CTF2301_transfer(dev, 1, address, (uint8_t *)data, length);
+}
+
+// Read a 16-bit value split over two registers, in the order the chip latches them
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegister16(CTF2301_Device *dev, CTF2301_Register msb, CTF2301_Register lsb, uint8_t lsbFirst, uint16_t *value){
+    uint32_t ret = CTF2301_OK;
+    uint8_t regData[2];
+    CTF2301_Register first = lsbFirst ? lsb : msb;
+    CTF2301_Register second = lsbFirst ? msb : lsb;
+    if (second == first + 1){
+        ret = __CTF2301_readRegisters(dev, first, regData, 2);
+    } else if (__CTF2301_readRegister(dev, first, &regData[0]) != CTF2301_OK || __CTF2301_readRegister(dev, second, &regData[1]) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    if (ret == CTF2301_OK){
+        *value = lsbFirst ? ((regData[1] << 8) | regData[0]) : ((regData[0] << 8) | regData[1]);
+    }
+    return ret;
+}
+
+// Read a register, served from the shadow cache when the register is cached and valid
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegisterCached(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer){
+#if (configUSE_SHADOW_REGISTERS == 1)
+    int8_t slot = __CTF2301_shadowIndex(address);
+    if (slot >= 0 && (dev->shadow.valid[slot >> 5] & (1UL << (slot & 0x1F))) != 0){
+        *buffer = dev->shadow.value[slot];
+        dev->stats.readsAvoided++;
+        return CTF2301_OK;
+    }
+#endif
+    return __CTF2301_readRegister(dev, address, buffer);
+}
+
+// Update the bits selected by mask in a register, the write is skipped if nothing changes
+// Return: CTF2301_OK if updating is successful, CTF2301_ERROR_COMM if the register can't be read, CTF2301_ERROR otherwise
+uint32_t __CTF2301_updateRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t mask, uint8_t value){
+    uint32_t ret = CTF2301_OK;
+    uint8_t regData = 0x00;
+    uint8_t newData;
+    int8_t slot = __CTF2301_txnIndex(address);
+
+    // Inside a configuration transaction the change is only staged
+    if (dev->txn.open && slot >= 0){
+        if ((dev->txn.loaded & (1 << slot)) == 0){
+            if (__CTF2301_readRegisterCached(dev, address, &regData) != CTF2301_OK){
+                return CTF2301_ERROR_COMM;
+            }
+            dev->txn.base[slot] = regData;
+            dev->txn.value[slot] = regData;
+            dev->txn.loaded |= (1 << slot);
+        }
+        dev->txn.value[slot] = (dev->txn.value[slot] & ~mask) | (value & mask);
+        return CTF2301_OK;
+    }
+
+    if (__CTF2301_readRegisterCached(dev, address, &regData) == CTF2301_OK){
+        newData = (regData & ~mask) | (value & mask);
+        if (newData == regData){
+            dev->stats.writesAvoided++;
+        } else if (__CTF2301_writeRegister(dev, address, newData) != CTF2301_OK){
+            ret = CTF2301_ERROR;
+        }
+    } else {
+        ret = CTF2301_ERROR_COMM;
+    }
+    return ret;
+}
+
+// Configuration Transactions
+// Start staging field changes
+// Return: CTF2301_OK if a transaction is started, CTF2301_ERROR_BUSY if one is open already
+uint32_t CTF2301_beginConfig(CTF2301_Device *dev){
+    if (dev->txn.open){
+        return CTF2301_ERROR_BUSY;
+    }
+    dev->txn.open = 1;
+    dev->txn.loaded = 0;
+    return CTF2301_OK;
+}
+
+// Write every staged register whose value changed, in ctf2301_txnRegs order, and close the transaction
+// Return: CTF2301_OK if all writes are successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_commitConfig(CTF2301_Device *dev){
+    uint32_t ret = CTF2301_OK;
+    dev->txn.open = 0;
+    for (int i = 0; i < CTF2301_TXN_REGISTERS; i++){
+        if ((dev->txn.loaded & (1 << i)) == 0){
+            continue;
+        }
+        if (dev->txn.value[i] == dev->txn.base[i]){
+            dev->stats.writesAvoided++;
+        } else if (__CTF2301_writeRegister(dev, ctf2301_txnRegs[i], dev->txn.value[i]) != CTF2301_OK){
+            ret = CTF2301_ERROR;
+        }
+    }
+    dev->txn.loaded = 0;
+    return ret;
+}
+
+// Drop the staged changes and close the transaction
+void CTF2301_abortConfig(CTF2301_Device *dev){
+    dev->txn.open = 0;
+    dev->txn.loaded = 0;
+}
+
+// Mark every cached register as unknown, the next access to each of them goes to the chip.
+void CTF2301_shadowInvalidate(CTF2301_Device *dev){
+    dev->shadow.valid[0] = 0;
+    dev->shadow.valid[1] = 0;
+}
+
+// Reload every cached register from the chip
+// Return: CTF2301_OK if all registers are read successfully, CTF2301_ERROR_COMM otherwise
+uint32_t CTF2301_shadowResync(CTF2301_Device *dev){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_shadowInvalidate(dev);
+#if (configUSE_SHADOW_REGISTERS == 1)
+    uint8_t regData[CTF2301_SHADOW_SIZE];
+    int run;
+    for (int i = 0; i < CTF2301_SHADOW_SIZE; i += run){
+        // Group slots with consecutive addresses so they can be read as one burst
+        run = 1;
+        while (i + run < CTF2301_SHADOW_SIZE && ctf2301_shadowRegs[i + run] == ctf2301_shadowRegs[i] + run){
+            run++;
+        }
+        // A successful read stores the values in the shadow cache
+        if (__CTF2301_readRegisters(dev, ctf2301_shadowRegs[i], regData, run) != CTF2301_OK){
+            ret = CTF2301_ERROR_COMM;
+            break;
+        }
+    }
+    dev->stats.resyncs++;
+#endif
+    return ret;
+}
+
+// Get or clear the bus access counters
+void CTF2301_getCacheStats(CTF2301_Device *dev, CTF2301_CacheStats *stats){
+    *stats = dev->stats;
+}
+
+void CTF2301_resetCacheStats(CTF2301_Device *dev){
+    CTF2301_CacheStats zero = {0};
+    dev->stats = zero;
+}
+
+// Initialization image
+// Fan control block 0x48-0x67 as composed by the CTF2301_INIT_ macros: TACH limit, PWM/TACH configuration with PWM
+// programming enabled, spin-up, PWM value (off), frequency, LUT offset and hysteresis, then the look-up table.
+static const uint8_t ctf2301_initFanBlock[LOOKUP_TABLE_PWM_12 - TACH_LIMIT_LSB + 1] = {
+    configTACH_LIMIT & 0xFF, configTACH_LIMIT >> 8,
+    CTF2301_INIT_PWM_TACH_CONFIG, CTF2301_INIT_FAN_SPIN_UP_CONFIG, 0x00, configPWM_FREQ,
+    configLUT_OFFSET, configLUT_HYST,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_1), configLUT_PWM_ENTRY_1,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_2), configLUT_PWM_ENTRY_2,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_3), configLUT_PWM_ENTRY_3,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_4), configLUT_PWM_ENTRY_4,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_5), configLUT_PWM_ENTRY_5,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_6), configLUT_PWM_ENTRY_6,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_7), configLUT_PWM_ENTRY_7,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_8), configLUT_PWM_ENTRY_8,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_9), configLUT_PWM_ENTRY_9,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_10), configLUT_PWM_ENTRY_10,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_11), configLUT_PWM_ENTRY_11,
+    CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_12), configLUT_PWM_ENTRY_12
+};
+
+// Register runs CTF2301_init writes, in order. ALERT_MASK goes first so nothing fires while the chip is set up, and
+// ENHANCED_CONFIG before the table so the chip reads the LUT temperatures in the right resolution. CONFIG (standby,
+// ALERT pin) is last. The SMBus timeout, if enabled, follows ALERT_MASK so the rest is written with it in place. Runs
+// without data are per-device registers, taken from dev->config.
+#if (configENABLE_SMBUS_TIMEOUT == 1)
+#define CTF2301_INIT_RUNS                5
+
+static const uint8_t ctf2301_initSmbusTimeout = CTF2301_INIT_SMBUS_TIMEOUT;
+#else
+#define CTF2301_INIT_RUNS                4
+#endif
+
+static const struct {
+    CTF2301_Register address;
+    uint8_t length;
+    const uint8_t *data;
+} ctf2301_initRuns[CTF2301_INIT_RUNS] = {
+    { ALERT_MASK,       1,  NULL },
+#if (configENABLE_SMBUS_TIMEOUT == 1)
+    { SMBUS_TIMEOUT,    1,  &ctf2301_initSmbusTimeout },
+#endif
+    { ENHANCED_CONFIG,  1,  NULL },
+    { TACH_LIMIT_LSB,   sizeof(ctf2301_initFanBlock),  ctf2301_initFanBlock },
+    { CONFIG,           1,  NULL }
+};
+
+// Value of a per-device register of the initialization image
+static uint8_t __CTF2301_initValue(CTF2301_Device *dev, CTF2301_Register address){
+    switch (address){
+    case ALERT_MASK:
+        return dev->config.alertMask & (uint8_t)~ALERT_STATUS_BUSY;
+    case ENHANCED_CONFIG:
+        return dev->config.useEnhancedConfig ? dev->config.enhancedConfigReg : 0x00;
+    default:
+        return dev->config.configReg;
+    }
+}
+
+// Register values of an init run for a device, length bytes of ctf2301_initRuns into image
+// The fan control block is built for the LUT resolution of the defines. A device configured for the other one gets
+// its temperatures rescaled, as __CTF2301_SET_LOOKUP_TABLE does, so the chip reads the table in the right unit.
+static void __CTF2301_initImage(CTF2301_Device *dev, uint8_t run, uint8_t *image){
+    uint8_t halfC = dev->config.useEnhancedConfig && (dev->config.enhancedConfigReg & 0x20);
+
+    if (ctf2301_initRuns[run].data == NULL){
+        image[0] = __CTF2301_initValue(dev, ctf2301_initRuns[run].address);
+        return;
+    }
+    memcpy(image, ctf2301_initRuns[run].data, ctf2301_initRuns[run].length);
+    if (ctf2301_initRuns[run].address == TACH_LIMIT_LSB && halfC != (CTF2301_INIT_LUT_RES == CTF2301_LUT_RES_0_5C)){
+        for (int i = LOOKUP_TABLE_TEMP_1 - TACH_LIMIT_LSB; i < ctf2301_initRuns[run].length; i += 2){
+            image[i] = halfC ? CTF2301_LUT_TEMP_0_5C(image[i] * 2) : CTF2301_LUT_TEMP_1C(image[i] / 2);
+        }
+    }
+}
+
+// Checks both init paths start with: the chip is out of power-on reset and is a CTF2301. Whatever was cached about
+// it is stale then, the shadow cache is refilled by the transfers that follow and the rest is read on first use.
+// Return: CTF2301_OK if the chip can be set up, CTF2301_ERROR_NOT_READY, CTF2301_ERROR_ID or CTF2301_ERROR_COMM otherwise
+static uint32_t __CTF2301_initIdentify(CTF2301_Device *dev){
+    uint32_t ret = CTF2301_OK;
+    uint8_t id_data;
+
+    // Check if Not Ready Bit is clear in POR
+    if (CTF2301_checkPOR(dev) != CTF2301_OK){
+        ret = CTF2301_ERROR_NOT_READY;
+        return ret;
+    }
+
+    // Check the device ID
+    if (CTF2301_readManufacturerID(dev, &id_data) == CTF2301_OK){
+        if(id_data != CTF2301_MANUFACTURER_ID){
+            ret = CTF2301_ERROR_ID;
+            return ret;
+        }
+    } else {
+        ret = CTF2301_ERROR_COMM;
+        return ret;
+    }
+
+    CTF2301_abortConfig(dev);
+    CTF2301_shadowInvalidate(dev);
+    return ret;
+}
+
+// Initialize the CTF2301, you have to select the options in the defines above
+// The register image is written as a fixed sequence of runs (see ctf2301_initRuns), the fan control block in one burst
+// when configENABLE_I2C_AUTO_INCREMENT allows it.
+// Return: CTF2301_OK if the initialization is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_init(CTF2301_Device *dev){
+    uint32_t ret = __CTF2301_initIdentify(dev);
+    uint8_t image[sizeof(ctf2301_initFanBlock)];
+
+    if (ret != CTF2301_OK){
+        return ret;
+    }
+
+    for (int i = 0; i < CTF2301_INIT_RUNS && ret == CTF2301_OK; i++){
+        __CTF2301_initImage(dev, i, image);
+        ret = __CTF2301_writeRegisters(dev, ctf2301_initRuns[i].address, image, ctf2301_initRuns[i].length);
+    }
+
+    // The image leaves PWM programming enabled, Auto-Temp Mode hands the PWM to the look-up table
+    if (ret == CTF2301_OK && dev->config.directDcyMode == 0){
+        ret = __CTF2301_DISABLE_PWM_PROGRAMMING(dev);
+    }
+
+    return (ret == CTF2301_OK) ? CTF2301_OK : CTF2301_ERROR;
+}
+
+// Non-blocking initialization
+// Put the operation of the current stage on the bus. Blocking transports finish it right here, the asynchronous one
+// queues it and sets init->done from the I2C interrupt.
+static void __CTF2301_initIssue(CTF2301_Device *dev, uint8_t write, CTF2301_Register address, const uint8_t *data, uint16_t length){
+    CTF2301_InitEngine *init = &dev->init;
+    init->issued = 1;
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    uint32_t ret;
+    if (write){
+        ret = CTF2301_writeRegistersAsync(dev, address, data, length, NULL, NULL, &init->done);
+    } else {
+        ret = CTF2301_readRegistersAsync(dev, address, &init->data, length, NULL, NULL, &init->done);
+    }
+    if (ret == (uint32_t)CTF2301_ERROR_BUSY){
+        // Queue full, try again on the next step
+        init->issued = 0;
+    } else if (ret != CTF2301_OK){
+        init->done = ret;
+    }
+#else
+    if (write){
+        init->done = __CTF2301_writeRegisters(dev, address, data, length);
+    } else {
+        init->done = __CTF2301_readRegisters(dev, address, &init->data, length);
+    }
+#endif
+}
+
+// Non-blocking initialization, writes the same register image as CTF2301_init. Call CTF2301_initBegin() once, then
+// CTF2301_initStep() from the superloop or a task until it stops returning CTF2301_PENDING. Each step does at most one
+// bus operation; with configUSE_ASYNC_TRANSPORT it queues the operation and a later step picks up the result.
+// Param: nowMs - current time in ms, porTimeoutMs - how long to wait for the chip to leave power-on reset
+void CTF2301_initBegin(CTF2301_Device *dev, uint32_t nowMs, uint32_t porTimeoutMs){
+    CTF2301_InitEngine *init = &dev->init;
+    init->stage = CTF2301_INIT_STAGE_POR;
+    init->run = 0;
+    init->issued = 0;
+    init->done = CTF2301_OK;
+    init->deadline = nowMs + porTimeoutMs;
+    init->nextPoll = nowMs;
+    init->result = CTF2301_PENDING;
+    CTF2301_abortConfig(dev);
+    CTF2301_shadowInvalidate(dev);
+}
+
+// Advance the non-blocking initialization
+// Param: nowMs - current time in ms
+// Return: CTF2301_PENDING while in progress, CTF2301_OK once the image is written, CTF2301_ERROR_TIMEOUT if the chip
+//         didn't leave power-on reset in time, CTF2301_ERROR_ID / CTF2301_ERROR_COMM / CTF2301_ERROR as for CTF2301_init
+uint32_t CTF2301_initStep(CTF2301_Device *dev, uint32_t nowMs){
+    CTF2301_InitEngine *init = &dev->init;
+    uint32_t status;
+    uint8_t image[sizeof(ctf2301_initFanBlock)];
+    uint8_t value;
+
+    switch (init->stage){
+    case CTF2301_INIT_STAGE_IDLE:
+        return CTF2301_ERROR;
+    case CTF2301_INIT_STAGE_DONE:
+    case CTF2301_INIT_STAGE_FAILED:
+        return init->result;
+    default:
+        break;
+    }
+
+    // The operation of the previous step is still on the bus
+    if (init->issued && init->done == CTF2301_PENDING){
+#if (configUSE_ASYNC_TRANSPORT == 1)
+        CTF2301_asyncPoll(dev);
+#endif
+        return CTF2301_PENDING;
+    }
+    status = init->done;
+
+    // Evaluate the operation the last step put on the bus
+    if (init->issued){
+        init->issued = 0;
+        switch (init->stage){
+        case CTF2301_INIT_STAGE_POR:
+            if (status != CTF2301_OK){
+                init->result = CTF2301_ERROR_COMM;
+            } else if (init->data == 0x00){
+                init->stage = CTF2301_INIT_STAGE_ID;
+            } else if ((int32_t)(nowMs - init->deadline) >= 0){
+                init->result = CTF2301_ERROR_TIMEOUT;
+            } else {
+                init->nextPoll = nowMs + configINIT_POR_POLL_MS;
+            }
+            break;
+        case CTF2301_INIT_STAGE_ID:
+            if (status != CTF2301_OK){
+                init->result = CTF2301_ERROR_COMM;
+            } else if (init->data != CTF2301_MANUFACTURER_ID){
+                init->result = CTF2301_ERROR_ID;
+            } else {
+                init->stage = CTF2301_INIT_STAGE_IMAGE;
+            }
+            break;
+        case CTF2301_INIT_STAGE_IMAGE:
+            if (status != CTF2301_OK){
+                init->result = CTF2301_ERROR;
+            } else if (++init->run >= CTF2301_INIT_RUNS){
+                init->stage = (dev->config.directDcyMode == 0) ? CTF2301_INIT_STAGE_AUTO_MODE : CTF2301_INIT_STAGE_DONE;
+            }
+            break;
+        default:
+            if (status != CTF2301_OK){
+                init->result = CTF2301_ERROR;
+            } else {
+                init->stage = CTF2301_INIT_STAGE_DONE;
+            }
+            break;
+        }
+    }
+
+    // Start the operation of the stage we are in now
+    if (init->result == CTF2301_PENDING){
+        switch (init->stage){
+        case CTF2301_INIT_STAGE_POR:
+            if ((int32_t)(nowMs - init->nextPoll) >= 0){
+                __CTF2301_initIssue(dev, 0, POR_STATUS, NULL, 1);
+            }
+            break;
+        case CTF2301_INIT_STAGE_ID:
+            __CTF2301_initIssue(dev, 0, MANUFACTURER_ID, NULL, 1);
+            break;
+        case CTF2301_INIT_STAGE_IMAGE:
+            // The asynchronous transport copies the data when the request is queued
+            __CTF2301_initImage(dev, init->run, image);
+            __CTF2301_initIssue(dev, 1, ctf2301_initRuns[init->run].address, image, ctf2301_initRuns[init->run].length);
+            break;
+        case CTF2301_INIT_STAGE_AUTO_MODE:
+            // The image left PWM programming enabled, clearing it hands the PWM to the look-up table
+            value = CTF2301_INIT_PWM_TACH_CONFIG & (uint8_t)~0x20;
+            __CTF2301_initIssue(dev, 1, PWM_TACH_CONFIG, &value, 1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (init->stage == CTF2301_INIT_STAGE_DONE){
+        init->result = CTF2301_OK;
+    } else if (init->result != CTF2301_PENDING){
+        init->stage = CTF2301_INIT_STAGE_FAILED;
+    }
+    return init->result;
+}
+
+// Warm start: read the register image back and rewrite only the registers that differ from it, e.g. after a watchdog
+// reset of the MCU while the chip kept running. The PWM duty cycle the fan runs at is left alone.
+// Param: path - return CTF2301_INIT_PATH_WARM if the chip already held the image, CTF2301_INIT_PATH_COLD otherwise
+// Return: CTF2301_OK if the chip holds the image, CTF2301_ERROR_NOT_READY / CTF2301_ERROR_ID / CTF2301_ERROR_COMM
+//         as for CTF2301_init, CTF2301_ERROR if a write fails
+uint32_t CTF2301_initWarm(CTF2301_Device *dev, CTF2301_InitPath *path){
+    const int tachConfig = PWM_TACH_CONFIG - TACH_LIMIT_LSB;
+    uint32_t ret = __CTF2301_initIdentify(dev);
+    uint8_t wanted[sizeof(ctf2301_initFanBlock)];
+    uint8_t current[sizeof(ctf2301_initFanBlock)];
+    uint8_t reprogram = 0;
+    uint16_t length;
+
+    *path = CTF2301_INIT_PATH_COLD;
+    if (ret != CTF2301_OK){
+        return ret;
+    }
+
+    // The same runs CTF2301_init writes, each read back in one transfer (the fan control block in one burst)
+    for (int i = 0; i < CTF2301_INIT_RUNS && ret == CTF2301_OK; i++){
+        length = ctf2301_initRuns[i].length;
+        __CTF2301_initImage(dev, i, wanted);
+        if (__CTF2301_readRegisters(dev, ctf2301_initRuns[i].address, current, length) != CTF2301_OK){
+            return CTF2301_ERROR_COMM;
+        }
+
+        if (ctf2301_initRuns[i].address == TACH_LIMIT_LSB){
+            // The duty cycle is live state, not part of the image. Compare against the state init leaves behind,
+            // which has PWM programming disabled in Auto-Temp Mode.
+            wanted[PWM_VALUE - TACH_LIMIT_LSB] = current[PWM_VALUE - TACH_LIMIT_LSB];
+            if (dev->config.directDcyMode == 0){
+                wanted[tachConfig] &= (uint8_t)~0x20;
+            }
+            if (memcmp(wanted, current, length) != 0){
+                // Most of the block is only writable with PWM programming enabled, it comes first in the run
+                wanted[tachConfig] |= 0x20;
+                reprogram = 1;
+            }
+        }
+
+        if (memcmp(wanted, current, length) != 0){
+            reprogram = 1;
+        }
+        ret = __CTF2301_writeChanged(dev, ctf2301_initRuns[i].address, wanted, current, length);
+    }
+
+    if (ret == CTF2301_OK && reprogram && dev->config.directDcyMode == 0){
+        ret = __CTF2301_DISABLE_PWM_PROGRAMMING(dev);
+    }
+
+    if (ret == CTF2301_OK && reprogram == 0){
+        *path = CTF2301_INIT_PATH_WARM;
+    }
+    return (ret == CTF2301_OK) ? CTF2301_OK : CTF2301_ERROR;
+}
+
+// Fill a configuration with the values selected by the defines in the header file
+void CTF2301_getDefaultConfig(CTF2301_Config *config){
+    config->configReg = CTF2301_INIT_CONFIG;
+    config->enhancedConfigReg = CTF2301_INIT_ENHANCED_CONFIG;
+    config->useEnhancedConfig = configUSE_ENHANCE_CONFIG;
+    config->alertMask = configALERT_MASK;
+    #ifdef configUSE_DIRECT_DCY_MODE
+        config->directDcyMode = 1;
+    #else
+        config->directDcyMode = 0;
+    #endif
+}
+
+// Bind a device to a bus and 7-bit address, and load the default configuration
+// Return: CTF2301_OK if the device is attached, CTF2301_ERROR_BUSY if configCTF2301_MAX_DEVICES are attached already
+uint32_t CTF2301_attach(CTF2301_Device *dev, CTF2301_Bus *bus, uint8_t i2cAddr){
+    uint32_t ret = CTF2301_ERROR_BUSY;
+    uint32_t primask;
+
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->i2cAddr = i2cAddr;
+    CTF2301_getDefaultConfig(&dev->config);
+#if (configUSE_BUS_ARBITER == 1)
+    dev->busBoost = CTF2301_BUS_CONFIG;
+#endif
+
+    __CTF2301_LOCK(primask);
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] == NULL){
+            ctf2301_devices[i] = dev;
+            ret = CTF2301_OK;
+            break;
+        }
+    }
+    __CTF2301_UNLOCK(primask);
+    return ret;
+}
+
+// Release a device, it must not have requests in progress
+void CTF2301_detach(CTF2301_Device *dev){
+    uint32_t primask;
+    __CTF2301_LOCK(primask);
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] == dev){
+            ctf2301_devices[i] = NULL;
+        }
+    }
+    __CTF2301_UNLOCK(primask);
+}
+
+#if (configUSE_BUS_ARBITER == 1)
+// Share the bus of the device through an arbiter, all devices on a bus and its other drivers must use the same one
+// Param: arbiter - set up with CTF2301_arbiterInit(), NULL to go back to unarbitrated transfers
+void CTF2301_setArbiter(CTF2301_Device *dev, CTF2301_Arbiter *arbiter){
+    dev->arbiter = arbiter;
+}
+#endif
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+// Pins the bus recovery clocks by hand, the ones the I2C peripheral of the device uses
+// Param: sclPort, sclPin, sdaPort, sdaPin - e.g. GPIOB, GPIO_PIN_10, GPIOB, GPIO_PIN_11
+void CTF2301_setRecoveryPins(CTF2301_Device *dev, GPIO_TypeDef *sclPort, uint16_t sclPin, GPIO_TypeDef *sdaPort, uint16_t sdaPin){
+    dev->recovery.sclPort = sclPort;
+    dev->recovery.sclPin = sclPin;
+    dev->recovery.sdaPort = sdaPort;
+    dev->recovery.sdaPin = sdaPin;
+}
+#endif
+
+// Recover the bus of the device: release the I2C peripheral, clock SCL until SDA is free, send a STOP and set the
+// peripheral up again
+// Return: CTF2301_OK if the bus is idle again, CTF2301_ERROR_TIMEOUT if the arbiter doesn't hand over the bus,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_recoverBus(CTF2301_Device *dev){
+    uint32_t ret;
+#if (configUSE_BUS_ARBITER == 1)
+    // Nobody else may be on the bus meanwhile, a stuck bus holds up everyone so it goes ahead at ALERT class
+    if (dev->arbiter != NULL && CTF2301_arbiterAcquire(dev->arbiter, CTF2301_BUS_ALERT, configSYNC_TIMEOUT_MS) != CTF2301_OK){
+        return CTF2301_ERROR_TIMEOUT;
+    }
+#endif
+    ret = __CTF2301_busRecover(dev);
+#if (configUSE_BUS_ARBITER == 1)
+    if (dev->arbiter != NULL){
+        CTF2301_arbiterRelease(dev->arbiter);
+    }
+#endif
+    return ret;
+}
+
+// Check Power On Reset Status
+// Return: CTF2301_OK if POR is ready, CTF2301_ERROR_NOT_READY otherwise
+uint32_t CTF2301_checkPOR(CTF2301_Device *dev){
+    uint32_t ret = CTF2301_OK;
+    uint8_t por_data = 0x00;
+    if (__CTF2301_readRegister(dev, POR_STATUS, &por_data) == CTF2301_OK){
+        if (por_data != 0x00){ // Power On Not Ready
+            // The chip is (re)starting, the register contents we have cached are going to be lost
+            CTF2301_shadowInvalidate(dev);
+            ret = CTF2301_ERROR_NOT_READY;
+        }
+    } else {
+        ret = CTF2301_ERROR_COMM;
+    }
+    return ret;
+}
+
+// Read Manufacturer ID.
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readManufacturerID(CTF2301_Device *dev, uint8_t *id){
+    uint32_t ret = CTF2301_OK;
+    if (__CTF2301_readRegister(dev, MANUFACTURER_ID, id) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Read Step and Die Revision ID.
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readStepDieRevID(CTF2301_Device *dev, uint8_t *id){
+    uint32_t ret = CTF2301_OK;
+    if (__CTF2301_readRegister(dev, STEP_DIE_REV_ID, id) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+
+// Number of PWM_VALUE codes between 0% and 100% at the current PWM setup
+// Return: CTF2301_OK if the setup is known, CTF2301_ERROR otherwise
+uint32_t __CTF2301_pwmFullScale(CTF2301_Device *dev, uint16_t *fullScale){
+    uint8_t enhanced;
+    uint8_t freq;
+    if (__CTF2301_readRegisterCached(dev, ENHANCED_CONFIG, &enhanced) != CTF2301_OK
+        || __CTF2301_readRegisterCached(dev, PWM_FREQ, &freq) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+    // High resolution gives 0.39% steps, otherwise the duty cycle counts in halves of the PWM_FREQ divider
+    *fullScale = (enhanced & 0x10) ? 255 : 2 * (freq & 0x1F);
+    return (*fullScale != 0) ? CTF2301_OK : CTF2301_ERROR;
+}
+
+// Write PWM_VALUE unless the chip already runs the code
+static uint32_t __CTF2301_writeDutyCode(CTF2301_Device *dev, uint16_t code){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_FanControl *fan = &dev->fan;
+    if (!fan->written || code != fan->code){
+        ret = __CTF2301_SET_PWM_VALUE(dev, (uint8_t)code);
+        if (ret != CTF2301_OK){
+            fan->written = 0;
+            return ret;
+        }
+        fan->code = code;
+        fan->written = 1;
+        fan->writes++;
+    }
+    return ret;
+}
+
+// Set Fan Speed, one step of the closed loop RPM controller
+// Return: CTF2301_OK once the speed is settled, CTF2301_PENDING while it converges,
+//         CTF2301_ERROR_NOT_READY if PWM programming is disabled, CTF2301_ERROR otherwise
+uint32_t CTF2301_setFanSpeed(CTF2301_Device *dev, uint16_t fanMaxRPM, uint16_t setRPM){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_FanControl *fan = &dev->fan;
+    uint16_t fullScale;
+    uint16_t rpm;
+    uint16_t code = 0;
+    int32_t error;
+    int32_t errorDuty;
+    int32_t tolerance;
+    int32_t feedForward;
+    int32_t duty;
+    int32_t current;
+
+    if (fanMaxRPM == 0 || __CTF2301_pwmFullScale(dev, &fullScale) != CTF2301_OK || CTF2301_getFanSpeed(dev, &rpm) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+        return ret;
+    }
+    if (setRPM != fan->target){
+        fan->target = setRPM;
+        fan->settled = 0;
+    }
+    fan->rpm = rpm;
+    error = (int32_t)setRPM - rpm;
+    // A quantized duty cycle can't get closer than one step, don't chase what can't be reached
+    tolerance = fanMaxRPM / fullScale;
+    if (tolerance < configFAN_SETTLE_RPM){
+        tolerance = configFAN_SETTLE_RPM;
+    }
+
+    if (setRPM == 0){
+        fan->integral = 0;
+    } else {
+        errorDuty = (int32_t)((int64_t)error * CTF2301_DUTY_FULL / fanMaxRPM);
+        feedForward = (int32_t)((int64_t)setRPM * CTF2301_DUTY_FULL / fanMaxRPM);
+        duty = feedForward + errorDuty * configFAN_KP / 256 + fan->integral;
+        // Anti-windup: only integrate outside the tolerance and while the output can still move the way the error asks
+        if (abs(error) > tolerance && !(duty >= CTF2301_DUTY_FULL && error > 0) && !(duty <= 0 && error < 0)){
+            fan->integral += errorDuty * configFAN_KI / 256;
+            if (fan->integral > CTF2301_DUTY_FULL){
+                fan->integral = CTF2301_DUTY_FULL;
+            } else if (fan->integral < -CTF2301_DUTY_FULL){
+                fan->integral = -CTF2301_DUTY_FULL;
+            }
+            duty = feedForward + errorDuty * configFAN_KP / 256 + fan->integral;
+        }
+        if (duty > CTF2301_DUTY_FULL){
+            duty = CTF2301_DUTY_FULL;
+        } else if (duty < 0){
+            duty = 0;
+        }
+        code = (uint16_t)(((int64_t)duty * fullScale + CTF2301_DUTY_FULL / 2) / CTF2301_DUTY_FULL);
+        // Keep the current code until the duty cycle is well past the midpoint to the next one
+        current = (int32_t)((int64_t)fan->code * CTF2301_DUTY_FULL / fullScale);
+        if (fan->written && code != 0 && abs(duty - current) < (CTF2301_DUTY_FULL / fullScale) * 3 / 4){
+            code = fan->code;
+        }
+    }
+
+    ret = __CTF2301_writeDutyCode(dev, code);
+    if (ret != CTF2301_OK){
+        return ret;
+    }
+
+    if (abs(error) <= tolerance){
+        if (fan->settled < configFAN_SETTLE_STEPS){
+            fan->settled++;
+        }
+    } else {
+        fan->settled = 0;
+    }
+    ret = (fan->settled >= configFAN_SETTLE_STEPS) ? CTF2301_OK : CTF2301_PENDING;
+    return ret;
+}
+
+// Get Fan Speed (in RPM)
+// Param: rpm - return RPM
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_getFanSpeed(CTF2301_Device *dev, uint16_t *rpm){
+    uint32_t ret = CTF2301_OK;
+    uint16_t tach;
+    if (CTF2301_readTach(dev, &tach) == CTF2301_OK){
+        *rpm = CTF2301_tachToRPM(tach);
+    } else {
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Set the PWM duty cycle in Manual Direct-DCY Mode, PWM_VALUE is only written when its code changes
+// Param: duty - CTF2301_DUTY_FULL is 100%, rounded to the nearest step of the PWM resolution
+// Return: CTF2301_OK if the chip runs the duty cycle, CTF2301_ERROR_NOT_READY if PWM programming is disabled,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_setDutyCycle(CTF2301_Device *dev, uint32_t duty){
+    uint16_t fullScale;
+    if (__CTF2301_pwmFullScale(dev, &fullScale) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+    if (duty > CTF2301_DUTY_FULL){
+        duty = CTF2301_DUTY_FULL;
+    }
+    return __CTF2301_writeDutyCode(dev, (uint16_t)(((uint64_t)duty * fullScale + CTF2301_DUTY_FULL / 2) / CTF2301_DUTY_FULL));
+}
+
+// Read Local Temperature
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readLocalTemp(CTF2301_Device *dev, uint16_t *temp){
+    uint32_t ret = CTF2301_OK;
+    uint16_t regData;
+    // Reading the MSB latches the LSB
+    if (__CTF2301_readRegister16(dev, LOCAL_TEMP, LOCAL_TEMP_LSB, 0, &regData) == CTF2301_OK){
+        *temp = regData >> 4;
+    } else {
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Read Remote Temperature
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readRemoteTemp(CTF2301_Device *dev, uint16_t *temp){
+    uint32_t ret = CTF2301_OK;
+    uint16_t regData;
+    if (__CTF2301_readRegister16(dev, REMOTE_TEMP_MSB, REMOTE_TEMP_LSB, 0, &regData) == CTF2301_OK){
+        *temp = regData >> 3;
+    } else {
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+uint32_t CTF2301_readRemoteTempUnsigned(CTF2301_Device *dev, uint16_t *temp){
+    uint32_t ret = CTF2301_OK;
+    uint16_t regData;
+    if (__CTF2301_readRegister16(dev, REMOTE_TEMP_UNSIGNED_MSB, REMOTE_TEMP_UNSIGNED_LSB, 0, &regData) == CTF2301_OK){
+        *temp = regData >> 3;
+    } else {
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Get Rounded Remote Temperature
+// Param: temp - return Remote Temperature (Rounded)
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_getRdRemoteTemp(CTF2301_Device *dev, int16_t *temp){
+    uint32_t ret = CTF2301_OK;
+    uint16_t regData;
+    if (CTF2301_readRemoteTemp(dev, &regData) == CTF2301_OK){
+        *temp = (int16_t)((CTF2301_decodeRemote(regData) + 16) >> CTF2301_TEMP_FRAC_BITS);
+    } else {
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// ALERT Handling
+// AlertStatus bit behind each CTF2301_AlertEvent
+static const uint8_t ctf2301_alertBits[CTF2301_ALERT_EVENTS] = {
+    ALERT_STATUS_LOCAL_HIGH, ALERT_STATUS_REMOTE_HIGH, ALERT_STATUS_REMOTE_LOW,
+    ALERT_STATUS_REMOTE_DIODE_FAULT, ALERT_STATUS_REMOTE_T_CRIT_ALARM, ALERT_STATUS_TACH_ALARM
+};
+
+// Find the attached device answering to an address on a bus
+static CTF2301_Device *__CTF2301_findDevice(CTF2301_Bus *bus, uint8_t i2cAddr){
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] != NULL && ctf2301_devices[i]->bus == bus && ctf2301_devices[i]->i2cAddr == i2cAddr){
+            return ctf2301_devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Read ALERT_STATUS once and call the handlers of the unmasked events in it
+// Return: CTF2301_OK if the status is read, CTF2301_ERROR_COMM otherwise, the device then stays pending
+static uint32_t __CTF2301_alertDispatch(CTF2301_Device *dev){
+    uint8_t status;
+    uint8_t mask = 0x00;
+
+    uint32_t primask;
+
+    if (CTF2301_readAlertStatus(dev, &status) != CTF2301_OK){
+        dev->alertPending = 1;
+        return CTF2301_ERROR_COMM;
+    }
+    // Plus whatever the sampler or a zone snapshot took off the chip since the last round
+    __CTF2301_LOCK(primask);
+    status |= dev->alertLatched;
+    dev->alertLatched = 0;
+    __CTF2301_UNLOCK(primask);
+    // Masked sources still latch in ALERT_STATUS, they just didn't pull ALERT low
+    __CTF2301_readRegisterCached(dev, ALERT_MASK, &mask);
+    status &= (uint8_t)~(mask | ALERT_STATUS_BUSY);
+#if (configUSE_BUS_ARBITER == 1)
+    // Whatever the handlers do on the bus, e.g. fan to full speed on T_CRIT, goes ahead of telemetry and configuration
+    dev->busBoost = CTF2301_BUS_ALERT;
+#endif
+    for (int event = 0; event < CTF2301_ALERT_EVENTS; event++){
+        if ((status & ctf2301_alertBits[event]) && dev->alertHandler[event] != NULL){
+            dev->alertHandler[event](dev, (CTF2301_AlertEvent)event, status, dev->alertContext[event]);
+        }
+    }
+#if (configUSE_BUS_ARBITER == 1)
+    dev->busBoost = CTF2301_BUS_CONFIG;
+#endif
+    return CTF2301_OK;
+}
+
+// Read ALERT_STATUS, the chip clears the latched bits on read
+// Param: status - return AlertStatus bits
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readAlertStatus(CTF2301_Device *dev, uint8_t *status){
+    uint32_t ret = CTF2301_OK;
+    if (__CTF2301_readRegister(dev, ALERT_STATUS, status) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Keep the ALERT_STATUS bits a read outside the ALERT handling cleared on the chip, safe to call from an interrupt
+// The next CTF2301_alertProcess() on the bus dispatches them.
+void CTF2301_alertLatch(CTF2301_Device *dev, uint8_t status){
+    uint32_t primask;
+    status &= (uint8_t)~ALERT_STATUS_BUSY;
+    if (status){
+        __CTF2301_LOCK(primask);
+        dev->alertLatched |= status;
+        dev->alertPending = 1;
+        __CTF2301_UNLOCK(primask);
+    }
+}
+
+// Register the handler of one event, NULL removes it
+// Return: CTF2301_OK if the handler is set, CTF2301_ERROR if the event is unknown
+uint32_t CTF2301_setAlertHandler(CTF2301_Device *dev, CTF2301_AlertEvent event, CTF2301_AlertHandler handler, void *context){
+    uint32_t primask;
+    if ((unsigned)event >= CTF2301_ALERT_EVENTS){
+        return CTF2301_ERROR;
+    }
+    __CTF2301_LOCK(primask);
+    dev->alertHandler[event] = handler;
+    dev->alertContext[event] = context;
+    __CTF2301_UNLOCK(primask);
+    return CTF2301_OK;
+}
+
+// Note that the ALERT line of a bus went low, safe to call from an interrupt
+void CTF2301_alertIRQ(CTF2301_Bus *bus){
+    // ALERT is a wired-OR line, any chip on the bus may have pulled it
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] != NULL && ctf2301_devices[i]->bus == bus){
+            ctf2301_devices[i]->alertPending = 1;
+        }
+    }
+}
+
+// Ask the SMBus Alert Response Address who pulled ALERT, through the arbiter of the bus if there is one
+// Return: CTF2301_OK if a chip answers, CTF2301_ERROR_NACK if nobody does, CTF2301_ERROR otherwise
+static uint32_t __CTF2301_alertResponse(CTF2301_Bus *bus, uint8_t *response){
+#if (configUSE_BUS_ARBITER == 1)
+    CTF2301_Arbiter *arbiter = NULL;
+    uint32_t ret;
+    for (int i = 0; i < configCTF2301_MAX_DEVICES && arbiter == NULL; i++){
+        if (ctf2301_devices[i] != NULL && ctf2301_devices[i]->bus == bus){
+            arbiter = ctf2301_devices[i]->arbiter;
+        }
+    }
+    if (arbiter != NULL){
+        if (CTF2301_arbiterAcquire(arbiter, CTF2301_BUS_ALERT, configSYNC_TIMEOUT_MS) != CTF2301_OK){
+            return CTF2301_ERROR_TIMEOUT;
+        }
+        ret = __CTF2301_busReceive(bus, configDEVICE_ALERT_RESPONSE_ADDR >> 1, response, 1);
+        CTF2301_arbiterRelease(arbiter);
+        return ret;
+    }
+#endif
+    return __CTF2301_busReceive(bus, configDEVICE_ALERT_RESPONSE_ADDR >> 1, response, 1);
+}
+
+// Find the chips asserting ALERT on a bus and dispatch their events
+// Return: CTF2301_OK if all pending chips are handled, CTF2301_ERROR_COMM if an ALERT_STATUS read fails
+uint32_t CTF2301_alertProcess(CTF2301_Bus *bus){
+    uint32_t ret = CTF2301_OK;
+    uint32_t primask;
+    uint8_t pending = 0;
+    uint8_t answered = 0;
+    uint8_t response;
+    CTF2301_Device *dev;
+
+    // Take the pending flags in one go, an edge during the processing below starts another round
+    __CTF2301_LOCK(primask);
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (ctf2301_devices[i] != NULL && ctf2301_devices[i]->bus == bus && ctf2301_devices[i]->alertPending){
+            ctf2301_devices[i]->alertPending = 0;
+            pending = 1;
+        }
+    }
+    __CTF2301_UNLOCK(primask);
+    if (!pending){
+        return ret;
+    }
+
+    // Every chip pulling ALERT answers the ARA with its address, the lowest one wins the arbitration and
+    // releases ALERT, so keep asking until nobody acknowledges
+    for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+        if (__CTF2301_alertResponse(bus, &response) != CTF2301_OK){
+            break;
+        }
+        answered = 1;
+        dev = __CTF2301_findDevice(bus, response >> 1);
+        // Other SMBus devices share the line, their alerts are not ours to handle
+        if (dev != NULL && __CTF2301_alertDispatch(dev) != CTF2301_OK){
+            ret = CTF2301_ERROR_COMM;
+        }
+    }
+
+    // No answer at all, e.g. the bus driver can't do plain reads: fall back to polling every chip on the bus
+    if (!answered){
+        for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+            dev = ctf2301_devices[i];
+            if (dev != NULL && dev->bus == bus && __CTF2301_alertDispatch(dev) != CTF2301_OK){
+                ret = CTF2301_ERROR_COMM;
+            }
+        }
+    } else {
+        // A chip whose status the sampler or a zone snapshot read released ALERT before the ARA, dispatch it anyway
+        for (int i = 0; i < configCTF2301_MAX_DEVICES; i++){
+            dev = ctf2301_devices[i];
+            if (dev != NULL && dev->bus == bus && dev->alertLatched && __CTF2301_alertDispatch(dev) != CTF2301_OK){
+                ret = CTF2301_ERROR_COMM;
+            }
+        }
+    }
+    return ret;
+}
+
+// Adaptive Conversion Rate
+// Conversion period of each ConversionRate in ms
+static const uint16_t ctf2301_ratePeriodMs[CONVERSION_RATE_9_303_HZ + 1] = {
+    20000, 10000, 4902, 2463, 1000, 615, 307, 154, 108
+};
+
+// Time between two conversions at a rate
+// Return: period in ms
+uint32_t CTF2301_ratePeriodMs(ConversionRate rate){
+    return ctf2301_ratePeriodMs[(rate > CONVERSION_RATE_9_303_HZ) ? CONVERSION_RATE_9_303_HZ : rate];
+}
+
+// Read both temperatures, move the conversion rate by their slope and tell when to call again
+// Return: CTF2301_OK if the update is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_rateUpdate(CTF2301_Device *dev, uint32_t nowMs, uint32_t *pollMs){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_RateState *state = &dev->rate;
+    uint16_t localData;
+    uint16_t remoteData;
+    CTF2301_Temp local;
+    CTF2301_Temp remote;
+    uint32_t elapsed;
+    uint32_t delta;
+    uint8_t rate = state->rate;
+
+    if (__CTF2301_readRegister16(dev, LOCAL_TEMP, LOCAL_TEMP_LSB, 0, &localData) != CTF2301_OK
+        || __CTF2301_readRegister16(dev, REMOTE_TEMP_MSB, REMOTE_TEMP_LSB, 0, &remoteData) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+        return ret;
+    }
+    local = CTF2301_decodeLocal(localData >> 4);
+    remote = CTF2301_decodeRemote(remoteData >> 3);
+
+    if (!state->primed){
+        // Nothing to compare with yet, start fast and let the quiet updates bring it down
+        rate = configRATE_FASTEST;
+        state->quiet = 0;
+        state->slope = 0;
+    } else {
+        elapsed = nowMs - state->lastMs;
+        if (elapsed == 0){
+            elapsed = 1;
+        }
+        // Steeper of the two slopes, 1/32°C to m°C is 1000 / 32
+        delta = (uint32_t)abs(local - state->local);
+        if ((uint32_t)abs(remote - state->remote) > delta){
+            delta = (uint32_t)abs(remote - state->remote);
+        }
+        state->slope = delta * 31250 / elapsed;
+
+        if (state->slope > configRATE_RISE_SLOPE){
+            rate = configRATE_FASTEST;
+            state->quiet = 0;
+        } else if (state->slope < configRATE_FALL_SLOPE){
+            if (++state->quiet >= configRATE_QUIET_UPDATES){
+                state->quiet = 0;
+                if (rate > configRATE_SLOWEST){
+                    rate--;
+                }
+            }
+        } else {
+            state->quiet = 0;
+        }
+    }
+
+    if (!state->primed || rate != state->rate){
+        if (__CTF2301_SET_CONVERSION_RATE(dev, (ConversionRate)rate) != CTF2301_OK){
+            ret = CTF2301_ERROR;
+            return ret;
+        }
+    }
+    state->primed = 1;
+    state->rate = rate;
+    state->local = local;
+    state->remote = remote;
+    state->lastMs = nowMs;
+    *pollMs = CTF2301_ratePeriodMs((ConversionRate)rate);
+    return ret;
+}
+
+// Remote Diode Calibration
+// CRC-16/CCITT (0x1021, initial 0xFFFF) of a calibration, without the CRC itself
+static uint16_t __CTF2301_calibrationCrc(const CTF2301_Calibration *cal){
+    const uint8_t *data = (const uint8_t *)cal;
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < offsetof(CTF2301_Calibration, crc); i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++){
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Check the CRC and version of a stored calibration
+// Return: 1 if the calibration can be applied, 0 otherwise
+uint8_t CTF2301_calibrationValid(const CTF2301_Calibration *cal){
+    uint16_t crc = __CTF2301_calibrationCrc(cal);
+    return cal->version == CTF2301_CAL_VERSION && cal->filter <= 3
+        && cal->crc[0] == (crc & 0xFF) && cal->crc[1] == (crc >> 8);
+}
+
+// Average of configCAL_SAMPLES remote conversions made with the current settings
+// The first conversion after a change may still be running with the old settings, it is skipped.
+static uint32_t __CTF2301_calibrationMeasure(CTF2301_Device *dev, uint32_t periodMs, CTF2301_Temp *temp){
+    int32_t sum = 0;
+    uint16_t raw;
+    __CTF2301_busDelay(dev, 2 * periodMs);
+    for (int i = 0; i < configCAL_SAMPLES; i++){
+        if (CTF2301_readRemoteTemp(dev, &raw) != CTF2301_OK){
+            return CTF2301_ERROR;
+        }
+        sum += CTF2301_decodeRemote(raw);
+        __CTF2301_busDelay(dev, periodMs);
+    }
+    *temp = (CTF2301_Temp)((sum + ((sum < 0) ? -configCAL_SAMPLES : configCAL_SAMPLES) / 2) / configCAL_SAMPLES);
+    return CTF2301_OK;
+}
+
+// Characterize the remote diode against a reference and calibrate the chip
+// Return: CTF2301_OK if the chip is calibrated, CTF2301_ERROR_VERIFY if the error is beyond what the offset can take,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_calibrateRemote(CTF2301_Device *dev, CTF2301_Temp reference, CTF2301_Calibration *cal){
+    // Automatic detection first, it is kept unless a fixed setting does better
+    static const uint8_t candidates[] = {
+        CTF2301_BETA_AUTO, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, CTF2301_BETA_OFF
+    };
+    uint32_t ret = CTF2301_OK;
+    uint32_t periodMs = CTF2301_ratePeriodMs(CONVERSION_RATE_9_303_HZ);
+    uint8_t rate;
+    uint8_t best = CTF2301_BETA_AUTO;
+    int32_t bestError = INT32_MAX;
+    int32_t error;
+    CTF2301_Temp temp;
+    uint8_t offset[2];
+    uint8_t status;
+    uint16_t crc;
+
+    // Raw conversions: no offset, no filter lag, as fast as the chip goes
+    if (__CTF2301_readRegisterCached(dev, CONVERSION_RATE, &rate) != CTF2301_OK
+        || __CTF2301_SET_CONVERSION_RATE(dev, CONVERSION_RATE_9_303_HZ) != CTF2301_OK
+        || __CTF2301_SET_REMOTE_TEMP_OFFSET(dev, 0) != CTF2301_OK
+        || __CTF2301_SET_REMOTE_DIODE_TEMP_FILTER(dev, 0) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+
+    for (size_t i = 0; i < sizeof(candidates) && ret == CTF2301_OK; i++){
+        if (__CTF2301_SET_REMOTE_DIODE_BETA_COMP(dev, candidates[i]) != CTF2301_OK
+            || __CTF2301_calibrationMeasure(dev, periodMs, &temp) != CTF2301_OK){
+            ret = CTF2301_ERROR;
+            break;
+        }
+        if (i == 0){
+            // An open or shorted diode reads the same garbage whatever the setting
+            if (CTF2301_readAlertStatus(dev, &status) != CTF2301_OK){
+                ret = CTF2301_ERROR;
+                break;
+            }
+            CTF2301_alertLatch(dev, status);
+            if (status & ALERT_STATUS_REMOTE_DIODE_FAULT){
+                ret = CTF2301_ERROR_VERIFY;
+                break;
+            }
+        }
+        error = temp - reference;
+        if (abs(error) < abs(bestError)){
+            best = candidates[i];
+            bestError = error;
+        }
+    }
+
+    if (ret == CTF2301_OK && (bestError > CTF2301_TEMP_FROM_C(128) || bestError < -(CTF2301_TEMP_FROM_C(128) - 4))){
+        // Beyond what the offset can correct
+        ret = CTF2301_ERROR_VERIFY;
+    }
+    if (ret != CTF2301_OK){
+        // Leave the chip uncalibrated
+        __CTF2301_SET_REMOTE_DIODE_BETA_COMP(dev, CTF2301_BETA_AUTO);
+        __CTF2301_SET_CONVERSION_RATE(dev, (ConversionRate)rate);
+        return ret;
+    }
+
+    memset(cal, 0, sizeof(*cal));
+    cal->version = CTF2301_CAL_VERSION;
+    cal->betaComp = best;
+    __CTF2301_encodeOffset((CTF2301_Temp)-bestError, offset);
+    cal->offsetMsb = offset[0];
+    cal->offsetLsb = offset[1];
+    cal->filter = configCAL_FILTER;
+    error = (bestError + 2) >> 2;
+    cal->error = (int8_t)((error < -128) ? -128 : (error > 127) ? 127 : error);
+    crc = __CTF2301_calibrationCrc(cal);
+    cal->crc[0] = crc & 0xFF;
+    cal->crc[1] = crc >> 8;
+
+    if (CTF2301_calibrationApply(dev, cal) != CTF2301_OK
+        || __CTF2301_SET_CONVERSION_RATE(dev, (ConversionRate)rate) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Write a stored calibration to the chip
+// Return: CTF2301_OK if the calibration is written, CTF2301_ERROR_VERIFY if the blob is corrupt or of another version,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_calibrationApply(CTF2301_Device *dev, const CTF2301_Calibration *cal){
+    uint32_t ret = CTF2301_OK;
+    uint8_t offset[2];
+    if (!CTF2301_calibrationValid(cal)){
+        ret = CTF2301_ERROR_VERIFY;
+        return ret;
+    }
+    offset[0] = cal->offsetMsb;
+    offset[1] = cal->offsetLsb & 0xE0;
+    if (__CTF2301_SET_REMOTE_DIODE_BETA_COMP(dev, cal->betaComp) != CTF2301_OK
+        || __CTF2301_writeRegisters(dev, REMOTE_TEMP_OFFSET_MSB, offset, 2) != CTF2301_OK
+        || __CTF2301_SET_REMOTE_DIODE_TEMP_FILTER(dev, cal->filter) != CTF2301_OK){
+        ret = CTF2301_ERROR;
+    }
+    return ret;
+}
+
+// Sampler
+// Register runs read for one record, in bus order: reading a temperature MSB latches its LSB, reading the TACH LSB
+// latches its MSB. The first run is three single transfers, auto-increment is only used in the fan control block.
+static const struct {
+    CTF2301_Register address;
+    uint8_t length;
+} ctf2301_sampleRuns[CTF2301_SAMPLE_RUNS] = {
+    { LOCAL_TEMP,       3 },            // LOCAL_TEMP, REMOTE_TEMP_MSB, ALERT_STATUS
+    { REMOTE_TEMP_LSB,  1 },
+    { LOCAL_TEMP_LSB,   1 },
+    { TACH_COUNT_LSB,   2 },
+    { PWM_VALUE,        1 }
+};
+
+#if (configUSE_ASYNC_TRANSPORT == 1) && (configASYNC_QUEUE_DEPTH < CTF2301_SAMPLE_RUNS)
+#error "configASYNC_QUEUE_DEPTH is too small for CTF2301_sampleAsync"
+#endif
+
+// Register run of a record, in bus order
+// Return: offset of the run in the CTF2301_SAMPLE_BYTES read for a record
+uint8_t CTF2301_sampleRun(uint8_t run, CTF2301_Register *address, uint8_t *length){
+    uint8_t offset = 0;
+    for (uint8_t i = 0; i < run; i++){
+        offset += ctf2301_sampleRuns[i].length;
+    }
+    *address = ctf2301_sampleRuns[run].address;
+    *length = ctf2301_sampleRuns[run].length;
+    return offset;
+}
+
+// Fill in the readings of a record from its CTF2301_SAMPLE_BYTES registers, timestamp and sequence are left alone
+void CTF2301_sampleDecode(const uint8_t *raw, CTF2301_Sample *record){
+    record->localTemp = ((raw[0] << 8) | raw[4]) >> 4;
+    record->remoteTemp = ((raw[1] << 8) | raw[3]) >> 3;
+    record->alertStatus = raw[2];
+    record->tach = (raw[6] << 8) | raw[5];
+    record->pwm = raw[7];
+}
+
+// Build a record from the registers read by ctf2301_sampleRuns and push it, runs in the producer context
+// Return: CTF2301_OK if the record is pushed, CTF2301_ERROR_BUSY if the ring is full
+static uint32_t __CTF2301_samplerPush(CTF2301_Device *dev, const uint8_t *raw, uint32_t timestamp){
+    CTF2301_Sampler *sampler = &dev->sampler;
+    uint32_t head = sampler->head;
+    uint16_t sequence = sampler->sequence++;
+    CTF2301_Sample *record;
+
+    // Reading ALERT_STATUS cleared its latched bits, hand them to the ALERT handling even if the record is dropped
+    CTF2301_alertLatch(dev, raw[2]);
+    if (head - sampler->tail >= configSAMPLER_DEPTH){
+        sampler->overruns++;
+        return CTF2301_ERROR_BUSY;
+    }
+    record = &sampler->record[head & (configSAMPLER_DEPTH - 1)];
+    record->timestamp = timestamp;
+    record->sequence = sequence;
+    CTF2301_sampleDecode(raw, record);
+    // The record has to be complete before the consumer can see it
+    __CTF2301_BARRIER();
+    sampler->head = head + 1;
+    return CTF2301_OK;
+}
+
+// Take one record and push it into the ring buffer of the device
+// Return: CTF2301_OK if the record is pushed, CTF2301_ERROR_BUSY if the ring is full and the record is dropped,
+//         CTF2301_ERROR if a read fails
+uint32_t CTF2301_sample(CTF2301_Device *dev, uint32_t timestamp){
+    uint8_t raw[CTF2301_SAMPLE_BYTES];
+    uint8_t *next = raw;
+
+    for (int i = 0; i < CTF2301_SAMPLE_RUNS; i++){
+        if (__CTF2301_readRegisters(dev, ctf2301_sampleRuns[i].address, next, ctf2301_sampleRuns[i].length) != CTF2301_OK){
+            dev->sampler.errors++;
+            return CTF2301_ERROR;
+        }
+        next += ctf2301_sampleRuns[i].length;
+    }
+    return __CTF2301_samplerPush(dev, raw, timestamp);
+}
+
+#if (configUSE_ASYNC_TRANSPORT == 1)
+// Completion of one run of an asynchronous record, runs in the I2C interrupt
+static void __CTF2301_sampleDone(CTF2301_Device *dev, uint32_t status, void *context){
+    CTF2301_Sampler *sampler = &dev->sampler;
+    (void)context;
+    if (status != CTF2301_OK){
+        sampler->failed = 1;
+    }
+    if (--sampler->inFlight == 0){
+        if (sampler->failed){
+            sampler->errors++;
+        } else {
+            __CTF2301_samplerPush(dev, sampler->raw, sampler->timestamp);
+        }
+    }
+}
+
+// Queue the reads of one record and return
+// Return: CTF2301_OK if the reads are queued, CTF2301_ERROR_BUSY if the previous record is still on the bus or the queue is full
+uint32_t CTF2301_sampleAsync(CTF2301_Device *dev, uint32_t timestamp){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_Sampler *sampler = &dev->sampler;
+    uint8_t *next = sampler->raw;
+    uint32_t primask;
+
+    // All runs or none, a record with a hole in it is of no use
+    __CTF2301_LOCK(primask);
+    if (sampler->inFlight != 0 || dev->async.count > configASYNC_QUEUE_DEPTH - CTF2301_SAMPLE_RUNS){
+        ret = CTF2301_ERROR_BUSY;
+    } else {
+        sampler->timestamp = timestamp;
+        sampler->failed = 0;
+        sampler->inFlight = CTF2301_SAMPLE_RUNS;
+        for (int i = 0; i < CTF2301_SAMPLE_RUNS; i++){
+            __CTF2301_asyncSubmit(dev, 0, ctf2301_sampleRuns[i].address, next, NULL, ctf2301_sampleRuns[i].length,
+                                  __CTF2301_sampleDone, NULL, NULL);
+            next += ctf2301_sampleRuns[i].length;
+        }
+    }
+    __CTF2301_UNLOCK(primask);
+    return ret;
+}
+#endif
+
+// Take the oldest records out of the ring buffer
+// Return: number of records copied
+uint16_t CTF2301_samplerDrain(CTF2301_Device *dev, CTF2301_Sample *records, uint16_t max){
+    CTF2301_Sampler *sampler = &dev->sampler;
+    uint32_t tail = sampler->tail;
+    uint32_t count = sampler->head - tail;
+
+    // Read the index before the records it covers
+    __CTF2301_BARRIER();
+    if (count > max){
+        count = max;
+    }
+    for (uint32_t i = 0; i < count; i++){
+        records[i] = sampler->record[(tail + i) & (configSAMPLER_DEPTH - 1)];
+    }
+    // The copies have to be done before the producer may reuse the slots
+    __CTF2301_BARRIER();
+    sampler->tail = tail + count;
+    return (uint16_t)count;
+}
+
+// Number of records waiting in the ring buffer
+uint16_t CTF2301_samplerCount(CTF2301_Device *dev){
+    return (uint16_t)(dev->sampler.head - dev->sampler.tail);
+}
+
+// Fixed-Point Temperature
+// The decoders move the sign bit of the format to bit 15 and shift back arithmetically, no branches and no tables.
+// The encoders round to the step of the format and clamp with conditional moves.
+static inline int32_t __CTF2301_clamp(int32_t value, int32_t min, int32_t max){
+    value = (value < min) ? min : value;
+    return (value > max) ? max : value;
+}
+
+// Half a step of the remote temperature, 2/32°C when LSbs[4:3] carry no data
+#define __CTF2301_REMOTE_TEMP_ROUND      (((~CTF2301_REMOTE_TEMP_MASK & 3) + 1) >> 1)
+
+// Decode a local temperature, 12-bit two's complement in 1/16°C
+CTF2301_Temp CTF2301_decodeLocal(uint16_t raw){
+    return (CTF2301_Temp)((int16_t)(raw << 4) >> 3);
+}
+
+// Decode a signed remote temperature, 13-bit two's complement in 1/32°C
+CTF2301_Temp CTF2301_decodeRemote(uint16_t raw){
+    return (CTF2301_Temp)((int16_t)((raw & CTF2301_REMOTE_TEMP_MASK) << 3) >> 3);
+}
+
+// Decode an unsigned remote temperature, 13-bit in 1/32°C
+CTF2301_Temp CTF2301_decodeRemoteUnsigned(uint16_t raw){
+    return (CTF2301_Temp)(raw & CTF2301_REMOTE_TEMP_MASK);
+}
+
+// Decode a setpoint, whole degrees in the MSB and eighths in LSB bits 7:5
+CTF2301_Temp CTF2301_decodeSetpoint(uint16_t raw){
+#if (configUSE_ENHANCE_CONFIG == 1) && (configENABLE_UNSIGNED_H_T_CRIT_SP_FT == 1)
+    return (CTF2301_Temp)((raw & 0xFFE0) >> 3);
+#else
+    return (CTF2301_Temp)((int16_t)(raw & 0xFFE0) >> 3);
+#endif
+}
+
+uint16_t CTF2301_encodeLocal(CTF2301_Temp temp){
+    return (uint16_t)(__CTF2301_clamp((temp + 1) >> 1, -2048, 2047) & 0x0FFF);
+}
+
+uint16_t CTF2301_encodeRemote(CTF2301_Temp temp){
+    return (uint16_t)(__CTF2301_clamp(temp + __CTF2301_REMOTE_TEMP_ROUND, -4096, 4095) & CTF2301_REMOTE_TEMP_MASK);
+}
+
+uint16_t CTF2301_encodeRemoteUnsigned(CTF2301_Temp temp){
+    return (uint16_t)(__CTF2301_clamp(temp + __CTF2301_REMOTE_TEMP_ROUND, 0, 8191) & CTF2301_REMOTE_TEMP_MASK);
+}
+
+uint16_t CTF2301_encodeSetpoint(CTF2301_Temp temp){
+#if (configUSE_ENHANCE_CONFIG == 1) && (configENABLE_UNSIGNED_H_T_CRIT_SP_FT == 1)
+    return (uint16_t)(__CTF2301_clamp((temp + 2) >> 2, 0, 2047) << 5);
+#else
+    return (uint16_t)((__CTF2301_clamp((temp + 2) >> 2, -1024, 1023) << 5) & 0xFFE0);
+#endif
+}
+
+void CTF2301_decodeLocalBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count){
+    for (size_t i = 0; i < count; i++){
+        temp[i] = CTF2301_decodeLocal(raw[i]);
+    }
+}
+
+void CTF2301_decodeRemoteBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count){
+    for (size_t i = 0; i < count; i++){
+        temp[i] = CTF2301_decodeRemote(raw[i]);
+    }
+}
+
+void CTF2301_decodeRemoteUnsignedBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count){
+    for (size_t i = 0; i < count; i++){
+        temp[i] = CTF2301_decodeRemoteUnsigned(raw[i]);
+    }
+}
+
+void CTF2301_decodeSetpointBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count){
+    for (size_t i = 0; i < count; i++){
+        temp[i] = CTF2301_decodeSetpoint(raw[i]);
     }
-    return ret;
 }
@@ -38,15 +38,8 @@
  extern "C" {
 #endif
 
-// Include your STM32's HAL Library here
-
-#include "stm32g0xx_hal.h"
-
-// Include the header file where your I2C handle is declared
-
-#include "i2c.h"
-
-#warning "Functions require I2C communications here uses HAL_Delay(), if you are using FreeRTOS and want to call these functions in a task, you should overwrite HAL_Delay() to use OS Tick instead."
+#include <stdint.h>
+#include <stddef.h>
 
 // CTF2301 Exported Constants
 
@@ -56,16 +49,27 @@
 #define CTF2301_ERROR_COMM              -2      // I2C Communication Error
 #define CTF2301_ERROR_ID                -3      // Device ID mismatch, someone uses the different chip
 #define CTF2301_ERROR_NOT_READY         -4      // Device is not ready
+#define CTF2301_ERROR_BUSY              -5      // Request queue is full
+#define CTF2301_ERROR_TIMEOUT           -6      // Transfer did not complete in time
+#define CTF2301_ERROR_VERIFY            -7      // Register readback does not match what was written
+#define CTF2301_ERROR_NACK              -8      // Chip did not acknowledge, only reported by the bus primitives
+#define CTF2301_PENDING                  1      // Asynchronous request has not completed yet
 
 #define CTF2301_STEP_DIE_REV_ID          0x01
 #define CTF2301_MANUFACTURER_ID          0x59
 
-#define CTF2301_MX_I2C_BUS               1
-#define CTF2301_BSP_I2C_BUS              2
+#define CTF2301_MX_I2C_BUS               1      // STM32 HAL with CubeMX generated I2C handles
+#define CTF2301_BSP_I2C_BUS              2      // ST BSP bus functions (BSP_I2Cx_ReadReg / BSP_I2Cx_WriteReg)
+#define CTF2301_LINUX_I2C_BUS            3      // Linux /dev/i2c-N character device
+#define CTF2301_SIM_I2C_BUS              4      // In-memory chip, see CTF2301_sim.h
+#define CTF2301_CUSTOM_I2C_BUS           5      // Transfer functions supplied at run time, see CTF2301_Transport
+
+#define CTF2301_ARBITER_FREERTOS         1      // Bus arbiter on FreeRTOS mutexes and semaphores
+#define CTF2301_ARBITER_PTHREAD          2      // Bus arbiter on POSIX threads, for host builds
 
 // CTF2301 Fixed I2C Address
 #define configDEVICE_CTF2301_I2C_ADDR          0x4C
-// CTF2301 Alert Response Address
+// CTF2301 Alert Response Address, SMBus ARA 0x0C with the read bit
 #define configDEVICE_ALERT_RESPONSE_ADDR       0x19
 
 // Select the peripheral driver to use for the CTF2301
@@ -73,15 +77,18 @@
 // for I2C or SPI if you have used other Sensor Libraries from STMicroelectronics. 
 // Then it is better to use BSP Driver for PCM51xx as well.
 
-#define configUSE_PERIPHERIAL_DRIVER_CTF2301           CTF2301_MX_I2C_BUS  // or BSP_I2C_BUS
-
-#if ( configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS )
+// The Linux, simulator and custom drivers let the same code run off target, e.g. on a BMC or in CI.
+// Only the MX driver supports configUSE_ASYNC_TRANSPORT, set it to 0 for the others. Both can be given on the compiler
+// command line instead, e.g. -DconfigUSE_PERIPHERIAL_DRIVER_CTF2301=CTF2301_SIM_I2C_BUS -DconfigUSE_ASYNC_TRANSPORT=0.
 
-#warning "Please make sure you have included the correct I2C Handle here"
-
-#define CTF2301_I2C_HANDLE hi2c2 // Change this to your I2C Handle
+#ifndef configUSE_PERIPHERIAL_DRIVER_CTF2301
+#define configUSE_PERIPHERIAL_DRIVER_CTF2301           CTF2301_MX_I2C_BUS  // or CTF2301_BSP_I2C_BUS, CTF2301_LINUX_I2C_BUS,
+                                                                           // CTF2301_SIM_I2C_BUS, CTF2301_CUSTOM_I2C_BUS
+#endif
 
-#endif // configUSE_PERIPHERIAL_DRIVER
+// Every chip is driven through its own CTF2301_Device, bound to an I2C handle and address with CTF2301_attach().
+// This is the number of devices that can be attached at the same time.
+#define configCTF2301_MAX_DEVICES            4
 
 // Device Control Mode
 // Default will be set at Auto-Temp Mode, uncomment below to enable Manual Direct-DCY Mode
@@ -104,6 +111,10 @@
                                                 //1: unlocks the T_CRIT limit and allows it to be reprogrammed multiple times.
 #define configENABLE_RDTS_FAULT_QUEUE        0  //0: an ALERT will be generated if any Remote Diode conversion result is above the Remote High Set Point or below the Remote Low Setpoint.
                                                 //1: an ALERT will be generated only if three consecutive Remote Diode conversions are above the Remote High Set Point or below the Remote Low Setpoint.
+#define configALERT_MASK                  0x00  // AlertStatus bits that don't pull ALERT low, written to ALERT_MASK during init
+#define configENABLE_SMBUS_TIMEOUT           0  //0: SMBUS_TIMEOUT is left at its power-on value.
+                                                //1: CTF2301_init sets SMBUS_TIMEOUT bit 7, to reset the SMBus interface when SCL stays low for more than 25ms.
+                                                //   The enable bit is not confirmed against the datasheet, check it before turning this on.
 #define configUSE_ENHANCE_CONFIG             0  //0: Standard Configuration
                                                 //1: Enhanced Configuration
 
@@ -126,6 +137,174 @@
 #define configENABLE_PWM_SMOOTH_RAMP_RATE    0  //0: PWM smoothing disabled.
                                                 //1: enable ramp rate control.
 
+// Fan PWM, TACH and Spin-up
+// Power-on values by default. They go into the register image CTF2301_init writes, see CTF2301_INIT_ in the
+// Initialization Image section below. Invalid combinations stop the build.
+#define configTACH_MODE                      0  // 0 to 3, see TachometerMode
+#define configPWM_POLARITY                   0  //0: 0V for fan OFF and open for fan ON.
+                                                //1: open for fan OFF and 0V for fan ON.
+#define configPWM_MASTER_CLOCK               0  //0: 360kHz.
+                                                //1: 1.4kHz.
+#define configPWM_FREQ                    0x17  // PWMF[4:0], f = PWM_CLOCK / (2 * n). 0x08 at 360kHz is 22.5kHz
+#define configFAST_TACH_SPIN_UP              1  //0: the fan spin-up uses the duty cycle and spin-up time below.
+                                                //1: 100% until the spin-up times out or the TACH limit is reached.
+#define configPWM_SPIN_UP_DUTY_CYCLE         3  // 0: bypassed, 1: 50%, 2: 75% - 81%, 3: 100%
+#define configPWM_SPIN_UP_TIME               7  // 0: bypassed, 1: 0.05s, doubling up to 7: 3.2s
+#define configTACH_LIMIT                0xFFFF  // TACH counts above this raise the TACH alarm, 0xFFFF never does
+#define configLUT_OFFSET                  0x00  // LOOKUP_TABLE_OFFSET
+#define configLUT_HYST                    0x04  // LOOKUP_TABLE_HYST
+
+// Non-blocking Initialization
+// CTF2301_initStep() re-reads POR_STATUS at this interval while the chip is still in power-on reset.
+#define configINIT_POR_POLL_MS              10
+
+// Shadow Register Cache
+// The driver keeps a RAM copy of every writable register, filled as registers are written or first read,
+// so field setters cost a single I2C write instead of a read-modify-write round trip.
+// If the chip may have been power cycled behind the driver's back, call CTF2301_shadowInvalidate(dev) or CTF2301_shadowResync(dev).
+#define configUSE_SHADOW_REGISTERS           1  //0: every field update reads the register from the chip first.
+                                                //1: field updates are served from the shadow cache.
+
+// Register Auto-Increment
+// Multi-register accesses (LUT upload, TACH count, cache reload) can be moved in one I2C transaction when the chip
+// advances its register pointer on sequential bytes. The driver only bursts inside the fan control block (0x46-0x67),
+// everything else is always issued as back-to-back single register transfers.
+#define configENABLE_I2C_AUTO_INCREMENT      1  //0: always use one transaction per register.
+                                                //1: use one transaction per contiguous register run inside the fan control block.
+
+// Asynchronous Transport
+// Register accesses are queued and carried out with the interrupt or DMA driven HAL I2C functions, so they return straight
+// away and report back through a callback or a completion flag. The blocking functions queue a request and wait for it.
+// Forward HAL_I2C_MemTxCpltCallback(), HAL_I2C_MemRxCpltCallback() and HAL_I2C_ErrorCallback() to the CTF2301_I2C_ versions,
+// and enable the I2C event / error interrupts (and DMA channels if used) in CubeMX.
+// Blocking functions must not be called from those callbacks or any other interrupt.
+#ifndef configUSE_ASYNC_TRANSPORT
+#define configUSE_ASYNC_TRANSPORT            1  //0: blocking HAL_I2C_Mem_Read/Write.
+                                                //1: queued HAL_I2C_Mem_Read/Write_IT or _DMA.
+#endif
+#define configUSE_I2C_DMA                    0  //0: interrupt driven transfers (_IT).
+                                                //1: DMA driven transfers (_DMA).
+#define configASYNC_QUEUE_DEPTH              8  // Number of requests that can be queued at once
+#define configSYNC_TIMEOUT_MS              100  // Longest time a blocking function waits for its transfer
+
+// Bus Errors and Recovery
+// A blocking transfer that fails is tried again up to configI2C_RETRIES times, after configI2C_BACKOFF_MS and twice as
+// long before every further retry. Failures other than a NACK leave the bus in doubt, with configUSE_BUS_RECOVERY the
+// bus is recovered before the retry: the I2C peripheral is released, up to 9 SCL pulses let a chip stuck in a read
+// finish its byte and release SDA, a STOP resets the chips' interfaces and the peripheral is set up again.
+// CTF2301_TRANSFER_WORST_MS is then the longest a single transfer can take, see CTF2301_getCacheStats() for the counts.
+// The asynchronous transport retries right away from the error interrupt, which can neither wait nor clock the pins:
+// configI2C_BACKOFF_MS is not used and the bus is only recovered once a blocking wait times out (or a request is
+// cancelled with CTF2301_asyncCancel()), so a chip that needs a pause before it answers again burns its retries at once.
+#define configI2C_RETRIES                    2  // Retries after the first attempt, 0 to 7
+#define configI2C_BACKOFF_MS                 1  // Wait before the first retry, doubled for each one after it
+#define configUSE_BUS_RECOVERY               1  //0: failed transfers are only retried.
+                                                //1: the bus is recovered before a retry (MX: CTF2301_setRecoveryPins(), BSP: BSP_I2Cx_DeInit/Init,
+                                                //   CUSTOM: CTF2301_Transport recover; the Linux adapter driver recovers the bus itself).
+
+// Shared Bus Arbiter
+// Tasks and drivers of other chips on the same I2C bus take turns through a CTF2301_Arbiter, see CTF2301_arbiter.h.
+// Link CTF2301_arbiter.c and bind the arbiter of the bus with CTF2301_setArbiter(). Every blocking transfer then holds
+// the bus for just that transfer: ALERT_STATUS reads and the ALERT handlers at ALERT class, other reads at TELEMETRY
+// and writes at CONFIG class. A transfer that doesn't get the bus within configSYNC_TIMEOUT_MS fails with CTF2301_ERROR_TIMEOUT.
+#ifndef configUSE_BUS_ARBITER
+#define configUSE_BUS_ARBITER                0  //0: the application serializes access to the bus.
+                                                //1: blocking transfers go through the arbiter of the device.
+#endif
+#ifndef configARBITER_PORT
+#define configARBITER_PORT                CTF2301_ARBITER_FREERTOS  // or CTF2301_ARBITER_PTHREAD
+#endif
+#define configARBITER_MAX_BYPASS             8  // Grants a waiting TELEMETRY or CONFIG request lets a higher class go first
+
+// Bus Instrumentation
+// Every I2C transaction is counted against the register it starts at: reads, writes, bytes, errors, NACKs, total time
+// and a log2 histogram of its duration. Read the counters with CTF2301_getBusStats() to see what occupies the bus.
+// The counters are shared by all devices. With 0 the instrumentation is compiled out and costs nothing.
+#define configUSE_BUS_INSTRUMENTATION        0  //0: no instrumentation.
+                                                //1: per-register transaction counters and latency histograms.
+#define configINSTRUMENT_BUCKETS            16  // Histogram bucket i counts durations from 2^(i+shift) up to 2^(i+1+shift), the last one everything above
+#define configINSTRUMENT_SHIFT               6  // Durations below 2^shift counter ticks fall into bucket 0
+
+// Free running 32-bit counter the durations are measured with. Default is SysTick on the MX and BSP drivers
+// (Cortex-M0+ has no DWT), and CLOCK_MONOTONIC in ns on the hosted drivers. On Cortex-M3 and up uncomment below
+// and enable the DWT cycle counter.
+
+//#define configINSTRUMENT_CYCLES()         (DWT->CYCCNT)
+
+// Adaptive Conversion Rate
+// CTF2301_rateUpdate() watches how fast the local and remote temperatures move and steps CONVERSION_RATE and the host
+// polling period together. A slope above the rise threshold goes straight to configRATE_FASTEST so a spike is sampled
+// at full speed, the rate then comes down one step at a time after configRATE_QUIET_UPDATES updates below the fall
+// threshold. Slopes between the two thresholds hold the current rate.
+#define configRATE_SLOWEST                CONVERSION_RATE_0_406_HZ  // Slowest rate used while temperatures hold still
+#define configRATE_FASTEST                CONVERSION_RATE_9_303_HZ  // Rate used while temperatures move
+#define configRATE_RISE_SLOPE             1000  // m°C/s, faster changes switch to configRATE_FASTEST
+#define configRATE_FALL_SLOPE              250  // m°C/s, slower changes count as quiet
+#define configRATE_QUIET_UPDATES             4  // Quiet updates in a row before the rate goes down one step
+
+// Sampler
+// CTF2301_sample() reads one full record (temperatures, ALERT_STATUS, TACH count and PWM value) and pushes it with a
+// timestamp into a ring buffer of the device. Logging and control tasks take the records out with CTF2301_samplerDrain()
+// and never touch the bus. The ring is lock-free for one producer and one consumer: a single context samples, either a
+// task with CTF2301_sample() or the I2C interrupt with CTF2301_sampleAsync(), and a single context drains.
+#define configSAMPLER_DEPTH                 16  // Records per device, must be a power of two
+
+// Tachometer
+// The chip counts periods of the tachometer clock between TACH pulses, RPM = clock * 60 * 2 / (pulses per revolution * count).
+#ifndef configTACH_CLOCK_HZ
+#define configTACH_CLOCK_HZ              90000  // Tachometer counting clock
+#endif
+#ifndef configFAN_PULSES_PER_REV
+#define configFAN_PULSES_PER_REV             2  // TACH pulses per fan revolution, 2 for most PC fans
+#endif
+
+// Fan Speed Controller
+// CTF2301_setFanSpeed() is one step of a PI loop on the TACH reading, call it periodically (e.g. every 100ms) with the
+// target in Manual Direct-DCY Mode. Gains are in 1/256, applied to the speed error as a fraction of fanMaxRPM.
+#define configFAN_KP                       128  // Proportional gain, 0.5
+#define configFAN_KI                        32  // Integral gain per step, 0.125
+#define configFAN_SETTLE_RPM                50  // Speed error counted as settled, at least one PWM step worth of RPM is allowed
+#define configFAN_SETTLE_STEPS               3  // Steps in a row within the tolerance before the speed counts as settled
+
+// Fan Zone Manager
+// CTF2301_zone.c polls chips spread over several I2C buses and runs their fans as cooling zones, see CTF2301_zone.h.
+// A manager holds up to configCTF2301_MAX_DEVICES devices.
+#define configZONE_MAX_BUSES                 3  // I2C buses the devices of a manager sit on
+#define configZONE_MAX_ZONES                 4  // Cooling zones of a manager
+#define configZONE_SPIN_UP_STAGGER_MS      500  // A stopped fan is started at most this often, so the spin-up currents don't add up
+
+// Remote Diode Calibration
+// CTF2301_calibrateRemote() tries every beta compensation setting against a reference reading, see CTF2301_Calibration.
+#define configCAL_SAMPLES                    4  // Conversions averaged per beta compensation setting
+#define configCAL_FILTER                     3  // REMOTE_DIODE_TEMP_FILTER level the calibration turns on: 0 off, 1 level 1, 3 level 2
+
+#if (configCAL_SAMPLES < 1) || (configCAL_SAMPLES > 64) || (configCAL_FILTER > 3)
+#error "configCAL_SAMPLES or configCAL_FILTER out of range"
+#endif
+
+// Filter Stage
+// CTF2301_filter.c smooths temperature readings ahead of a control loop with integer math only, see CTF2301_filter.h.
+// These are the defaults of CTF2301_filterInit(), temperatures in 1/32°C.
+#define configFILTER_MEDIAN_MAX              7  // Longest median window a filter can hold
+#define configFILTER_MEDIAN                  3  // Median window, odd, 1 turns the median off
+#define configFILTER_EMA_SHIFT               2  // A new sample weighs 1/2^n in the moving average, 0 turns it off
+#define configFILTER_DECIMATION              4  // Samples in per sample out
+#define configFILTER_SLEW                   16  // Largest step between two outputs, 0 for no limit
+#define configFILTER_DEADBAND                8  // Output changes smaller than this are held back
+
+#if (configFILTER_MEDIAN_MAX > 15) || (configFILTER_MEDIAN > configFILTER_MEDIAN_MAX) || ((configFILTER_MEDIAN & 1) == 0) \
+    || (configFILTER_EMA_SHIFT > 8) || (configFILTER_DECIMATION < 1) || (configFILTER_DECIMATION > 255)
+#error "configFILTER_ out of range"
+#endif
+
+// Telemetry
+// CTF2301_telemetry.c packs sampler records into a compact binary log for flash or a UART, see CTF2301_telemetry.h.
+#define configTELEM_BLOCK_RECORDS          256  // Records per block, every block starts with a header a reader can join at, 0 for one block
+
+#if (configTELEM_BLOCK_RECORDS > 65535)
+#error "configTELEM_BLOCK_RECORDS out of range"
+#endif
+
 // Look up table for Auto-Temp Mode
 
 // Temperature (in °C) 
@@ -156,6 +335,119 @@
 #define configLUT_PWM_ENTRY_11               0   // 0%
 #define configLUT_PWM_ENTRY_12               0   // 0%
 
+/* CTF2301 Bus Driver */
+
+// CTF2301_Bus is whatever the selected peripheral driver addresses a bus with, CTF2301_attach() binds a device to one.
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+
+#if defined(CTF2301_HOST_SIM)
+
+// Host build: the HAL subset the driver uses is simulated, see CTF2301_hal_sim.h
+
+#include "CTF2301_hal_sim.h"
+
+#else
+
+// Include your STM32's HAL Library here
+
+#include "stm32g0xx_hal.h"
+
+// Include the header file where your I2C handle is declared
+
+#include "i2c.h"
+
+#warning "Functions require I2C communications here uses HAL_Delay(), if you are using FreeRTOS and want to call these functions in a task, you should overwrite HAL_Delay() to use OS Tick instead. To share the bus between tasks, see configUSE_BUS_ARBITER."
+
+#endif
+
+// CubeMX I2C handle, e.g. &hi2c2
+typedef I2C_HandleTypeDef CTF2301_Bus;
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_BSP_I2C_BUS)
+
+// Include the BSP bus header generated by CubeMX here
+
+#include "custom_bus.h"
+
+// The BSP functions of one bus, e.g. CTF2301_Bus bus2 = CTF2301_BSP_BUS(2);
+// Call BSP_I2Cx_Init() before CTF2301_init().
+typedef struct {
+    int32_t (*ReadReg)(uint16_t DevAddr, uint16_t Reg, uint8_t *pData, uint16_t Length);
+    int32_t (*WriteReg)(uint16_t DevAddr, uint16_t Reg, uint8_t *pData, uint16_t Length);
+    int32_t (*Recv)(uint16_t DevAddr, uint8_t *pData, uint16_t Length);
+    int32_t (*Init)(void);                  // Bus recovery re-initializes the bus with these
+    int32_t (*DeInit)(void);
+} CTF2301_Bus;
+
+#define CTF2301_BSP_BUS(n)               { BSP_I2C##n##_ReadReg, BSP_I2C##n##_WriteReg, BSP_I2C##n##_Recv, \
+                                           BSP_I2C##n##_Init, BSP_I2C##n##_DeInit }
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+
+// An open /dev/i2c-N, see CTF2301_linuxOpen()
+// Every register access is one I2C_RDWR ioctl, reads are a combined write-then-read with a repeated start.
+typedef struct {
+    int fd;
+} CTF2301_Bus;
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_SIM_I2C_BUS)
+
+#include "CTF2301_sim.h"
+
+// Simulated bus with CTF2301_SimChip models on it
+typedef CTF2301_SimBus CTF2301_Bus;
+
+#elif (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_CUSTOM_I2C_BUS)
+
+// Transfer functions called through pointers, for buses the drivers above don't cover or to switch between buses at run time.
+// Param: context - the context member, i2cAddr - 7-bit address, reg - first register,
+//        data, length - register contents; the driver only asks for multi-register transfers that the chip auto-increments
+// Return: CTF2301_OK if the transfer is successful, CTF2301_ERROR_NACK if the chip does not acknowledge, CTF2301_ERROR otherwise
+typedef struct {
+    uint32_t (*read)(void *context, uint8_t i2cAddr, uint8_t reg, uint8_t *data, uint16_t length);
+    uint32_t (*write)(void *context, uint8_t i2cAddr, uint8_t reg, const uint8_t *data, uint16_t length);
+    uint32_t (*receive)(void *context, uint8_t i2cAddr, uint8_t *data, uint16_t length);    // Plain read without register, optional
+    void *context;
+    uint32_t (*recover)(void *context);                                                     // Free a stuck bus, optional
+    void (*delay)(void *context, uint32_t ms);                                              // Retry backoff, optional
+} CTF2301_Transport;
+
+typedef CTF2301_Transport CTF2301_Bus;
+
+#else
+#error "configUSE_PERIPHERIAL_DRIVER_CTF2301 selects an unknown driver"
+#endif
+
+#if (configUSE_ASYNC_TRANSPORT == 1) && (configUSE_PERIPHERIAL_DRIVER_CTF2301 != CTF2301_MX_I2C_BUS)
+#error "configUSE_ASYNC_TRANSPORT needs the MX peripheral driver"
+#endif
+
+#if (configUSE_BUS_ARBITER == 1) && (configUSE_ASYNC_TRANSPORT == 1)
+#error "configUSE_BUS_ARBITER needs blocking transfers, set configUSE_ASYNC_TRANSPORT to 0"
+#endif
+
+// Shared bus arbiter, see CTF2301_arbiter.h
+typedef struct CTF2301_Arbiter CTF2301_Arbiter;
+
+#if (configI2C_RETRIES < 0) || (configI2C_RETRIES > 7) || (configUSE_BUS_RECOVERY & ~1)
+#error "configI2C_RETRIES must be 0 to 7 and configUSE_BUS_RECOVERY 0 or 1"
+#endif
+
+// Longest bus recovery of the MX driver: 9 SCL pulses and a STOP take 21 HAL_Delay(1), which wait up to 2ms each
+#define CTF2301_RECOVERY_WORST_MS        (configUSE_BUS_RECOVERY * 42)
+
+// Longest a blocking function waits for one register transfer (or one register of a run the chip doesn't auto-increment)
+#if (configUSE_ASYNC_TRANSPORT == 1)
+// The request is given up after configSYNC_TIMEOUT_MS, its back-to-back retries included, and the bus recovered once
+#define CTF2301_TRANSFER_WORST_MS        (configSYNC_TIMEOUT_MS + CTF2301_RECOVERY_WORST_MS)
+#else
+// Every attempt waits for the arbiter (when used) and its transfer and may end in a recovery, the retries add the backoff
+#define CTF2301_TRANSFER_WORST_MS        ((configI2C_RETRIES + 1) * (1 + configUSE_BUS_ARBITER) * configSYNC_TIMEOUT_MS \
+                                         + configI2C_BACKOFF_MS * ((1 << configI2C_RETRIES) - 1) \
+                                         + (configI2C_RETRIES + 1) * CTF2301_RECOVERY_WORST_MS)
+#endif
+
 /* CTF2301 Exported Local Temperature Data */
 
 // The local temperature resolution is 0.0625 °C. Temperature data is clamped and
@@ -197,6 +489,23 @@ typedef enum {
     REMOTE_TEMP_US_255         = 0x1FFF
 } RemoteTemperatureUnsigned;
 
+/* CTF2301 Fixed-Point Temperature */
+
+// Every format decodes to and encodes from signed 1/32°C, the finest resolution the chip has.
+// -128°C is -4096, 255.875°C is 8188.
+typedef int16_t CTF2301_Temp;
+
+#define CTF2301_TEMP_FRAC_BITS           5
+#define CTF2301_TEMP_FROM_C(c)           ((CTF2301_Temp)((c) * 32))
+#define CTF2301_TEMP_TO_MILLI_C(t)       ((int32_t)(t) * 125 / 4)
+
+// Remote temperature bits that carry data, LSbs[4:3] only with the signed temperature filter
+#if (configUSE_ENHANCE_CONFIG == 1) && (configENABLE_SIGNED_TEMP_FILTER == 1)
+#define CTF2301_REMOTE_TEMP_MASK         0x1FFF
+#else
+#define CTF2301_REMOTE_TEMP_MASK         0x1FFC
+#endif
+
 /* CTF2301 Alert Status */
 
 typedef enum {
@@ -209,6 +518,17 @@ typedef enum {
     ALERT_STATUS_TACH_ALARM = 0x01
 } AlertStatus;
 
+// Events reported to the ALERT handlers, one per AlertStatus bit
+typedef enum {
+    CTF2301_EVENT_LOCAL_HIGH = 0,
+    CTF2301_EVENT_REMOTE_HIGH,
+    CTF2301_EVENT_REMOTE_LOW,
+    CTF2301_EVENT_REMOTE_DIODE_FAULT,
+    CTF2301_EVENT_REMOTE_T_CRIT,
+    CTF2301_EVENT_TACH_ALARM,
+    CTF2301_ALERT_EVENTS
+} CTF2301_AlertEvent;
+
 /* CTF2301 Conversion Rate */
 
 typedef enum {
@@ -306,32 +626,397 @@ typedef enum {
     MANUFACTURER_ID = 0x00FF,               // Manufacturer ID, Fixed value 0x59
 } CTF2301_Register;
 
+/* CTF2301 Lookup Table */
+
+#define CTF2301_LUT_ENTRIES              12
+#define CTF2301_LUT_REGISTERS            24     // Temperature and PWM registers are interleaved, 0x50-0x67
+#define CTF2301_LUT_HYST_DEFAULT         0x04
+
+#define CTF2301_LUT_RES_1C               0      // 7-bit temperatures, LSb = 1°C (0 to 127°C)
+#define CTF2301_LUT_RES_0_5C             1      // 8-bit temperatures, LSb = 0.5°C (0 to 127.5°C)
+
+// Temperature entry codes for each resolution
+#define CTF2301_LUT_TEMP_1C(celsius)             ((uint8_t)(celsius))
+#define CTF2301_LUT_TEMP_0_5C(halfCelsius)       ((uint8_t)(halfCelsius))
+
+#define CTF2301_LUT_VERIFY               0x01   // Read the table back after the upload
+#define CTF2301_LUT_FORCE                0x02   // Write every entry, even those the chip already holds
+
+// Auto-Temp fan curve. Entry n applies once the temperature reaches temp[n].
+typedef struct {
+    uint8_t temp[CTF2301_LUT_ENTRIES];      // Temperature codes, see CTF2301_LUT_RES_
+    uint8_t pwm[CTF2301_LUT_ENTRIES];       // PWM duty cycle codes, same format as PWM_VALUE
+    uint8_t hysteresis;                     // LOOKUP_TABLE_HYST
+    uint8_t resolution;                     // CTF2301_LUT_RES_1C or CTF2301_LUT_RES_0_5C
+} CTF2301_LookupTable;
+
+// PWM steps of 100%, the pwmFullScale of CTF2301_fitLookupTable()
+#define CTF2301_PWM_STEPS_6_25           16     // 22.5kHz PWM, PWM_FREQ 0x08
+#define CTF2301_PWM_STEPS_0_39           255    // configENABLE_PWM_HIGH_RES
+#define CTF2301_LUT_FIT_HYST_MAX         10     // Widest hysteresis in °C the fitter picks on its own
+
+// Point of a desired fan curve, the curve runs straight between the points
+typedef struct {
+    CTF2301_Temp temp;
+    uint32_t duty;                          // CTF2301_DUTY_FULL is 100%
+} CTF2301_CurvePoint;
+
+// How close a fitted table comes to the curve, CTF2301_DUTY_FULL is 100%
+typedef struct {
+    uint32_t errorRising;                   // Largest error while the temperature rises
+    uint32_t errorFalling;                  // Largest error while the temperature falls through the hysteresis
+    uint8_t entries;                        // Entries the curve needed, the others repeat the last one
+} CTF2301_LutFit;
+
+/* CTF2301 Shadow Register Cache */
+
+// Number of writable registers mirrored in the shadow cache:
+// 0x03-0x08, 0x11-0x14, 0x16, 0x19, 0x21, 0x30, 0x37, 0x45, 0x48-0x4B, 0x4D-0x67, 0xBF
+// PWM_VALUE (0x4C) is not cached, the chip updates it by itself in Auto-Temp Mode.
+#define CTF2301_SHADOW_SIZE              48
+
+typedef struct {
+    uint8_t  value[CTF2301_SHADOW_SIZE];    // Register contents as last written to or read from the chip
+    uint32_t valid[2];                      // One bit per slot, set when value[] is known to match the chip
+} CTF2301_Shadow;
+
+typedef struct {
+    uint32_t busReads;                      // Read transactions issued on the bus
+    uint32_t busWrites;                     // Write transactions issued on the bus
+    uint32_t bytesRead;                     // Register bytes read from the bus
+    uint32_t bytesWritten;                  // Register bytes written to the bus
+    uint32_t readsAvoided;                  // Register reads served from the shadow cache
+    uint32_t writesAvoided;                 // Field updates dropped because the register already held the value
+    uint32_t resyncs;                       // Number of full shadow cache reloads
+    uint32_t retries;                       // Transactions tried again after an error
+    uint32_t recoveries;                    // Bus recovery sequences run
+    uint32_t failures;                      // Transactions that still failed after the last retry
+} CTF2301_CacheStats;
+
+/* CTF2301 Bus Instrumentation */
+
+// Registers with their own counters: 0x00-0x67, REMOTE_DIODE_TEMP_FILTER, STEP_DIE_REV_ID and MANUFACTURER_ID
+#define CTF2301_INSTRUMENT_SLOTS         0x6B
+
+typedef struct {
+    uint32_t reads;                         // Read transactions starting at the register
+    uint32_t writes;                        // Write transactions starting at the register
+    uint32_t bytes;                         // Register bytes moved, successful transactions only
+    uint32_t errors;                        // Failed transactions, NACKs included
+    uint32_t nacks;                         // Transactions the chip did not acknowledge
+    uint64_t cycles;                        // Time on the bus in configINSTRUMENT_CYCLES() ticks
+    uint16_t histogram[configINSTRUMENT_BUCKETS];   // Transaction durations, log2 buckets, saturating
+} CTF2301_RegisterStats;
+
+/* CTF2301 Adaptive Conversion Rate */
+
+typedef struct {
+    uint8_t primed;                         // 1 once a first sample has been taken
+    uint8_t rate;                           // ConversionRate programmed into the chip
+    uint8_t quiet;                          // Quiet updates in a row
+    int16_t local;                          // Temperatures of the last update in 1/32°C
+    int16_t remote;
+    uint32_t lastMs;                        // Time of the last update
+    uint32_t slope;                         // Steepest slope of the last update in m°C/s
+} CTF2301_RateState;
+
+/* CTF2301 Remote Diode Calibration */
+
+#define CTF2301_BETA_AUTO                0x08   // REMOTE_DIODE_BETA_COMP: the chip detects the transistor's beta
+#define CTF2301_BETA_OFF                 0x07   // REMOTE_DIODE_BETA_COMP: no compensation, for diode-connected transistors
+#define CTF2301_CAL_VERSION              1
+#define CTF2301_CAL_BYTES                8
+
+// Calibration of a remote diode as stored in flash, bytes only so the layout is the same on every compiler
+typedef struct {
+    uint8_t version;                        // CTF2301_CAL_VERSION
+    uint8_t betaComp;                       // REMOTE_DIODE_BETA_COMP
+    uint8_t offsetMsb;                      // REMOTE_TEMP_OFFSET_MSB, signed °C
+    uint8_t offsetLsb;                      // REMOTE_TEMP_OFFSET_LSB, 1/8°C in bits 7:5
+    uint8_t filter;                         // REMOTE_DIODE_TEMP_FILTER level, 0 to 3
+    int8_t error;                           // Error the diode had before the offset, in 1/8°C, saturated
+    uint8_t crc[2];                         // CRC-16/CCITT of the bytes before, low byte first
+} CTF2301_Calibration;
+
+/* CTF2301 Sampler */
+
+#define CTF2301_SAMPLE_RUNS              5      // Register runs read for one record
+#define CTF2301_SAMPLE_BYTES             8      // Registers read for one record
+
+#if (configSAMPLER_DEPTH & (configSAMPLER_DEPTH - 1)) != 0
+#error "configSAMPLER_DEPTH must be a power of two"
+#endif
+
+typedef struct {
+    uint32_t timestamp;                     // Time given to CTF2301_sample()
+    uint16_t sequence;                      // Counts every record taken, a gap means records were dropped
+    uint16_t localTemp;                     // As returned by CTF2301_readLocalTemp()
+    uint16_t remoteTemp;                    // As returned by CTF2301_readRemoteTemp()
+    uint16_t tach;                          // As returned by CTF2301_readTach()
+    uint8_t alertStatus;                    // ALERT_STATUS, its latched bits go on to the ALERT handlers as well
+    uint8_t pwm;                            // PWM_VALUE
+} CTF2301_Sample;
+
+typedef struct {
+    CTF2301_Sample record[configSAMPLER_DEPTH];
+    volatile uint32_t head;                 // Records pushed, written by the producer only
+    volatile uint32_t tail;                 // Records drained, written by the consumer only
+    volatile uint32_t overruns;             // Records dropped because the ring was full
+    volatile uint32_t errors;               // Records lost to bus errors
+    uint16_t sequence;
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    uint8_t raw[CTF2301_SAMPLE_BYTES];      // Registers of the record on the bus
+    uint32_t timestamp;
+    volatile uint8_t inFlight;              // Requests of the record not completed yet
+    volatile uint8_t failed;
+#endif
+} CTF2301_Sampler;
+
+/* CTF2301 Fan Speed Controller */
+
+#define CTF2301_TACH_CLOCK               (configTACH_CLOCK_HZ * 120UL / configFAN_PULSES_PER_REV)  // RPM = CTF2301_TACH_CLOCK / TACH count
+#define CTF2301_TACH_INVALID             0xFFFF     // TACH count of a stopped fan, or one below the lowest measurable speed
+
+#if (configFAN_PULSES_PER_REV < 1) || (configTACH_CLOCK_HZ * 120UL / configFAN_PULSES_PER_REV >= 0x1000000UL)
+#error "configTACH_CLOCK_HZ / configFAN_PULSES_PER_REV out of range"
+#endif
+#define CTF2301_DUTY_FULL                65536      // 100% duty cycle in the controller's fixed point
+
+typedef struct {
+    uint16_t target;                        // RPM asked for in the last step
+    uint16_t rpm;                           // RPM measured in the last step
+    int32_t integral;                       // Integral term, CTF2301_DUTY_FULL is 100%
+    uint16_t code;                          // PWM_VALUE last written
+    uint8_t written;                        // 1 once code holds what the chip has
+    uint8_t settled;                        // Steps in a row within the tolerance
+    uint32_t writes;                        // PWM_VALUE writes
+} CTF2301_FanControl;
+
+/* CTF2301 Configuration Transactions */
+
+#define CTF2301_TXN_REGISTERS            5      // CONFIG, ENHANCED_CONFIG, PWM_FREQ, FAN_SPIN_UP_CONFIG, PWM_TACH_CONFIG
+
+typedef struct {
+    uint8_t open;
+    uint8_t loaded;                         // One bit per register, set once the register has been staged
+    uint8_t base[CTF2301_TXN_REGISTERS];    // Register contents when first staged
+    uint8_t value[CTF2301_TXN_REGISTERS];   // Register contents to commit
+} CTF2301_ConfigTxn;
+
+/* CTF2301 Asynchronous Transport */
+
+#define CTF2301_ASYNC_MAX_LENGTH         32     // Longest register run a single request can move
+
+#define CTF2301_REQ_WRITE                0x01
+#define CTF2301_REQ_BURST                0x02   // Moved in one auto-increment transaction
+#define CTF2301_REQ_CANCELLED            0x04   // Waiter gave up, result is dropped
+
+typedef struct CTF2301_Device CTF2301_Device;
+
+// Completion callback, runs in the I2C interrupt context
+// Param: dev - device the request was submitted to, status - CTF2301_OK or an error code,
+//        context - pointer given when the request was submitted
+typedef void (*CTF2301_Callback)(CTF2301_Device *dev, uint32_t status, void *context);
+
+typedef struct {
+    uint8_t  address;                       // First register
+    uint8_t  flags;                         // CTF2301_REQ_ flags
+    uint16_t length;                        // Number of registers
+    uint16_t offset;                        // Register currently on the bus when not bursting
+    uint8_t  retries;                       // Times the transaction on the bus has been tried again
+    uint8_t  data[CTF2301_ASYNC_MAX_LENGTH];// Write payload or read bounce buffer
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+    uint32_t started;                       // Cycle counter when the transfer on the bus started
+#endif
+    uint8_t *buffer;                        // Read destination
+    volatile uint32_t *done;                // Optional completion flag
+    CTF2301_Callback callback;              // Optional completion callback
+    void *context;
+} CTF2301_Request;
+
+typedef struct {
+    CTF2301_Request request[configASYNC_QUEUE_DEPTH];
+    volatile uint8_t head;
+    volatile uint8_t count;
+    volatile uint8_t inFlight;              // Head request has a transfer on the bus
+} CTF2301_AsyncQueue;
+
+/* CTF2301 Initialization Image */
+
+// Register values composed from the configuration defines at compile time. CTF2301_init writes them in a fixed
+// sequence of runs, the fan control block (TACH limit to the end of the look-up table) in one burst.
+#define CTF2301_INIT_CONFIG              ((configENABLE_ALERT_RESPONSE << 7) | (configENABLE_STANDBY_MODE << 6) \
+                                         | (configENABLE_PWM_STANDBY << 5) | (configSELECT_ALERT_TACH_OUTPUT << 4) \
+                                         | (configENABLE_T_CRIT_OVERRIDE << 3) | (configENABLE_RDTS_FAULT_QUEUE << 2))
+#define CTF2301_INIT_ENHANCED_CONFIG     ((configENABLE_SIGNED_TEMP_FILTER << 6) | (configENABLE_LOOKUP_TABLE_RES_EXT << 5) \
+                                         | (configENABLE_PWM_HIGH_RES << 4) | (configENABLE_UNSIGNED_H_T_CRIT_SP_FT << 3) \
+                                         | (configSET_PWM_SMOOTH_RAMP_RATE << 1) | configENABLE_PWM_SMOOTH_RAMP_RATE)
+// LUT temperatures are configured in °C, the chip takes them in 0.5°C steps with the extended resolution
+#if (configUSE_ENHANCE_CONFIG == 1) && (configENABLE_LOOKUP_TABLE_RES_EXT == 1)
+#define CTF2301_INIT_LUT_RES             CTF2301_LUT_RES_0_5C
+#define CTF2301_INIT_LUT_TEMP(celsius)   ((celsius) * 2)
+#else
+#define CTF2301_INIT_LUT_RES             CTF2301_LUT_RES_1C
+#define CTF2301_INIT_LUT_TEMP(celsius)   (celsius)
+#endif
+// PWM programming stays enabled so the rest of the fan control block can be written, Auto-Temp Mode clears it last
+#define CTF2301_INIT_PWM_TACH_CONFIG     (0x20 | (configPWM_POLARITY << 4) | (configPWM_MASTER_CLOCK << 3) | configTACH_MODE)
+#define CTF2301_INIT_FAN_SPIN_UP_CONFIG  ((configFAST_TACH_SPIN_UP << 5) | (configPWM_SPIN_UP_DUTY_CYCLE << 3) | configPWM_SPIN_UP_TIME)
+#define CTF2301_INIT_SMBUS_TIMEOUT       (configENABLE_SMBUS_TIMEOUT << 7)
+
+// The image is only as good as the defines it is built from, reject the combinations the chip can't take
+#if ((configENABLE_ALERT_RESPONSE | configENABLE_STANDBY_MODE | configENABLE_PWM_STANDBY | configSELECT_ALERT_TACH_OUTPUT \
+      | configENABLE_T_CRIT_OVERRIDE | configENABLE_RDTS_FAULT_QUEUE | configENABLE_SMBUS_TIMEOUT | configUSE_ENHANCE_CONFIG) & ~1)
+#error "Device Configuration options must be 0 or 1"
+#endif
+#if ((configENABLE_SIGNED_TEMP_FILTER | configENABLE_LOOKUP_TABLE_RES_EXT | configENABLE_PWM_HIGH_RES \
+      | configENABLE_UNSIGNED_H_T_CRIT_SP_FT | configENABLE_PWM_SMOOTH_RAMP_RATE) & ~1) || (configSET_PWM_SMOOTH_RAMP_RATE & ~3)
+#error "Device Enhanced Configuration options out of range"
+#endif
+#if (configUSE_ENHANCE_CONFIG == 1) && (configENABLE_PWM_HIGH_RES == 1) && ((configPWM_MASTER_CLOCK != 0) || (configPWM_FREQ != 0x08))
+#error "configENABLE_PWM_HIGH_RES needs 22.5kHz PWM: configPWM_MASTER_CLOCK 0 and configPWM_FREQ 0x08"
+#endif
+#if ((configPWM_POLARITY | configPWM_MASTER_CLOCK | configFAST_TACH_SPIN_UP) & ~1) || (configTACH_MODE & ~3) \
+    || (configPWM_SPIN_UP_DUTY_CYCLE & ~3) || (configPWM_SPIN_UP_TIME & ~7)
+#error "Fan PWM, TACH or Spin-up option out of range"
+#endif
+#if (configPWM_FREQ < 0x01) || (configPWM_FREQ > 0x1F)
+#error "configPWM_FREQ must be 0x01 to 0x1F"
+#endif
+#if ((configTACH_LIMIT | 0xFFFF) != 0xFFFF) || ((configLUT_OFFSET | configLUT_HYST) & ~0xFF)
+#error "configTACH_LIMIT, configLUT_OFFSET or configLUT_HYST out of range"
+#endif
+#if (configALERT_MASK & ~0x7F)
+#error "configALERT_MASK can't mask the BUSY bit"
+#endif
+#if (configLUT_TEMP_ENTRY_1 < 0) || (configLUT_TEMP_ENTRY_12 > 127)
+#error "configLUT_TEMP_ENTRY_ must be 0 to 127°C"
+#endif
+#if (configLUT_TEMP_ENTRY_1 > configLUT_TEMP_ENTRY_2) || (configLUT_TEMP_ENTRY_2 > configLUT_TEMP_ENTRY_3) \
+    || (configLUT_TEMP_ENTRY_3 > configLUT_TEMP_ENTRY_4) || (configLUT_TEMP_ENTRY_4 > configLUT_TEMP_ENTRY_5) \
+    || (configLUT_TEMP_ENTRY_5 > configLUT_TEMP_ENTRY_6) || (configLUT_TEMP_ENTRY_6 > configLUT_TEMP_ENTRY_7) \
+    || (configLUT_TEMP_ENTRY_7 > configLUT_TEMP_ENTRY_8) || (configLUT_TEMP_ENTRY_8 > configLUT_TEMP_ENTRY_9) \
+    || (configLUT_TEMP_ENTRY_9 > configLUT_TEMP_ENTRY_10) || (configLUT_TEMP_ENTRY_10 > configLUT_TEMP_ENTRY_11) \
+    || (configLUT_TEMP_ENTRY_11 > configLUT_TEMP_ENTRY_12)
+#error "configLUT_TEMP_ENTRY_ must not decrease"
+#endif
+#if ((configLUT_PWM_ENTRY_1 | configLUT_PWM_ENTRY_2 | configLUT_PWM_ENTRY_3 | configLUT_PWM_ENTRY_4 | configLUT_PWM_ENTRY_5 \
+      | configLUT_PWM_ENTRY_6 | configLUT_PWM_ENTRY_7 | configLUT_PWM_ENTRY_8 | configLUT_PWM_ENTRY_9 | configLUT_PWM_ENTRY_10 \
+      | configLUT_PWM_ENTRY_11 | configLUT_PWM_ENTRY_12) & ~0xFF)
+#error "configLUT_PWM_ENTRY_ must fit in a register"
+#endif
+
+/* CTF2301 Device */
+
+// Register values applied by CTF2301_init, CTF2301_attach fills them in from the configuration defines above.
+// Change them between CTF2301_attach and CTF2301_init to give one chip a different setup.
+typedef struct {
+    uint8_t configReg;                      // CONFIG register
+    uint8_t enhancedConfigReg;              // ENHANCED_CONFIG register
+    uint8_t useEnhancedConfig;              // 1: write enhancedConfigReg during init
+    uint8_t directDcyMode;                  // 1: Manual Direct-DCY Mode, 0: Auto-Temp Mode with the look-up table
+    uint8_t alertMask;                      // ALERT_MASK register
+} CTF2301_Config;
+
+// How CTF2301_initWarm found the chip
+typedef enum {
+    CTF2301_INIT_PATH_COLD = 0,             // The chip didn't hold the image (power cycled), the registers that differed were rewritten
+    CTF2301_INIT_PATH_WARM = 1              // Only the MCU was reset, the chip held the image and nothing was written
+} CTF2301_InitPath;
+
+// Stages of the non-blocking initialization, in order
+typedef enum {
+    CTF2301_INIT_STAGE_IDLE = 0,            // CTF2301_initBegin() not called
+    CTF2301_INIT_STAGE_POR,                 // Waiting for POR_STATUS to clear
+    CTF2301_INIT_STAGE_ID,                  // Checking the manufacturer ID
+    CTF2301_INIT_STAGE_IMAGE,               // Writing the runs of the register image
+    CTF2301_INIT_STAGE_AUTO_MODE,           // Handing the PWM to the look-up table (Auto-Temp Mode only)
+    CTF2301_INIT_STAGE_DONE,
+    CTF2301_INIT_STAGE_FAILED
+} CTF2301_InitStage;
+
+// Non-blocking initialization, one bus operation per CTF2301_initStep()
+typedef struct {
+    uint8_t stage;                          // CTF2301_InitStage
+    uint8_t run;                            // Run of the register image being written
+    uint8_t issued;                         // The operation of the stage is on the bus or done
+    uint8_t data;                           // POR_STATUS / manufacturer ID read by the stage
+    volatile uint32_t done;                 // Result of the operation, CTF2301_PENDING until it completes
+    uint32_t deadline;                      // Give up waiting for POR_STATUS after this time
+    uint32_t nextPoll;                      // Time of the next POR_STATUS read
+    uint32_t result;                        // Final result once the stage is DONE or FAILED
+} CTF2301_InitEngine;
+
+// ALERT event handler, runs in the context that calls CTF2301_alertProcess()
+// Param: dev - chip that raised the event, event - what happened, status - the ALERT_STATUS value it was decoded from,
+//        context - pointer given to CTF2301_setAlertHandler()
+typedef void (*CTF2301_AlertHandler)(CTF2301_Device *dev, CTF2301_AlertEvent event, uint8_t status, void *context);
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+// SCL and SDA of the bus, driven as open-drain GPIOs while the bus is recovered
+typedef struct {
+    GPIO_TypeDef *sclPort;                  // NULL: the recovery only re-initializes the I2C peripheral
+    uint16_t sclPin;
+    GPIO_TypeDef *sdaPort;
+    uint16_t sdaPin;
+} CTF2301_RecoveryPins;
+#endif
+
+// One CTF2301 chip
+struct CTF2301_Device {
+    CTF2301_Bus *bus;                       // Bus the chip sits on
+    uint8_t i2cAddr;                        // 7-bit I2C address
+    CTF2301_Config config;
+    CTF2301_Shadow shadow;
+    CTF2301_CacheStats stats;
+    CTF2301_ConfigTxn txn;
+    CTF2301_RateState rate;
+    CTF2301_Sampler sampler;
+    CTF2301_FanControl fan;
+    CTF2301_InitEngine init;
+#if (configUSE_BUS_ARBITER == 1)
+    CTF2301_Arbiter *arbiter;               // Arbiter of the bus, NULL if the device has the bus to itself
+    uint8_t busBoost;                       // Class the transfers are raised to, ALERT while the alert handlers run
+#endif
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+    CTF2301_RecoveryPins recovery;
+#endif
+    CTF2301_AlertHandler alertHandler[CTF2301_ALERT_EVENTS];
+    void *alertContext[CTF2301_ALERT_EVENTS];
+    volatile uint8_t alertPending;          // ALERT fired, set by CTF2301_alertIRQ()
+    volatile uint8_t alertLatched;          // ALERT_STATUS bits read outside the ALERT handling, see CTF2301_alertLatch()
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    CTF2301_AsyncQueue async;
+#endif
+};
+
 // Register Handling Function Prototypes
+// Every function takes the CTF2301_Device it works on as the first parameter, see CTF2301_attach()
 
 //
 // Fan PWM and TACH Configuration
 // PWM Programming Enable, Default is Enabled
 // Return: CTF2301_OK if enable is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_ENABLE_PWM_PROGRAMMING();
-uint32_t __CTF2301_DISABLE_PWM_PROGRAMMING();
+uint32_t __CTF2301_ENABLE_PWM_PROGRAMMING(CTF2301_Device *dev);
+uint32_t __CTF2301_DISABLE_PWM_PROGRAMMING(CTF2301_Device *dev);
 
 // PWM Output Polarity, Default is RISING edge
 // Param:
 // 0: 0V for fan OFF and open for fan ON
 // 1: open for fan OFF and 0V for fan ON
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_POLARITY(uint8_t param);
+uint32_t __CTF2301_SET_PWM_POLARITY(CTF2301_Device *dev, uint8_t param);
 
 // PWM Master Clock Select， Default is 360kHz
 // 0: 360kHz
 // 1: 1.4kHz
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_MASTER_CLOCK(uint8_t param);
+uint32_t __CTF2301_SET_PWM_MASTER_CLOCK(CTF2301_Device *dev, uint8_t param);
 
 // Tachometer Mode Select
 // Note: If the PWM Master Clock is 360 kHz, mode 00 is used regardless of the setting of these two bits.
 // Return: CTF2301_OK if selection is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_TACH_MODE(TachometerMode mode);
+uint32_t __CTF2301_SET_TACH_MODE(CTF2301_Device *dev, TachometerMode mode);
 //
 
 //
@@ -345,7 +1030,7 @@ uint32_t __CTF2301_SET_TACH_MODE(TachometerMode mode);
 // always 100%. Register x03, bit 2 = 1 for Tachometer mode.
 // If PWM Spin-Up Time (bits 2:0) = 000, the Spin-Up cycle is bypassed, regardless of the state of this bit.
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(uint8_t param); 
+uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(CTF2301_Device *dev, uint8_t param); 
 
 // PWM Spin-Up Duty Cycle, Default is 0x01
 // Param:
@@ -354,7 +1039,7 @@ uint32_t __CTF2301_SET_FAST_TACHOMETER_SPIN_UP(uint8_t param);
 // 0x02: 75% 81% Depends on PWM Frequency.
 // 0x03: 100%
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(uint8_t param);
+uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(CTF2301_Device *dev, uint8_t param);
 
 // PWM Spin-Up Time Interval, Default is 0x01
 // Param:
@@ -367,39 +1052,101 @@ uint32_t __CTF2301_SET_PWM_SPIN_UP_DUTY_CYCLE(uint8_t param);
 // 0x06: 1.6 seconds
 // 0x07: 3.2 seconds
 // Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_SET_PWM_SPIN_UP_TIME_INTERVAL(uint8_t param);
+uint32_t __CTF2301_SET_PWM_SPIN_UP_TIME_INTERVAL(CTF2301_Device *dev, uint8_t param);
 //
 
 // Read or Write PWM Duty Cycle for direct fan speed control, Default is 0x00 (means off)
-uint32_t __CTF2301_SET_PWM_VALUE(uint8_t param);
-uint32_t __CTF2301_GET_PWM_VALUE(uint8_t *param);
+uint32_t __CTF2301_SET_PWM_VALUE(CTF2301_Device *dev, uint8_t param);
+uint32_t __CTF2301_GET_PWM_VALUE(CTF2301_Device *dev, uint8_t *param);
 
 // Set PWM Output Frequency. Default is 0x17 (7.82KHZ @ 360KHZ Master Clock, 30HZ @ 1.4KHZ Master Clock)
 // Param:
 // Only PWMF[4:0] is used. This sets the n value, then the frequency is calculated base on following formula:
 // f = PWM_CLOCK / (2 * n), where PWM_CLOCK can be set by __CTF2301_SET_PWM_MASTER_CLOCK.
-uint32_t __CTF2301_SET_PWM_OUTPUT_FREQUENCY(uint8_t param);
+uint32_t __CTF2301_SET_PWM_OUTPUT_FREQUENCY(CTF2301_Device *dev, uint8_t param);
 
 // Set Lookup Table Temp Offset. Default is 0x00
-// TODO
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_LOOKUP_TABLE_OFFSET(CTF2301_Device *dev, uint8_t param);
 
 // Set Lookup Table Hysteresis. Default is 0x04
-// TODO
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_LOOKUP_TABLE_HYST(CTF2301_Device *dev, uint8_t param);
 
 // Setup Lookup Table. Default is 0x7F
-uint32_t __CTF2301_SET_LOOKUP_TABLE();
+// Loads the table from the configLUT_ defines, see CTF2301_setLookupTable() to change it at run time
+uint32_t __CTF2301_SET_LOOKUP_TABLE(CTF2301_Device *dev);
+
+// Upload a lookup table at run time
+// Only the registers that differ from what the chip holds are written, in as few transactions as possible.
+// PWM programming is enabled for the upload if needed and restored afterwards, ENHANCED_CONFIG is switched to the
+// resolution of the table.
+// Param: lut - table to upload, flags - CTF2301_LUT_VERIFY to read the table back in one burst and compare it,
+//        CTF2301_LUT_FORCE to write every entry regardless of the current contents
+// Return: CTF2301_OK if the table is uploaded, CTF2301_ERROR_VERIFY if the readback differs,
+//         CTF2301_ERROR_BUSY if a configuration transaction is open, CTF2301_ERROR otherwise
+uint32_t CTF2301_setLookupTable(CTF2301_Device *dev, const CTF2301_LookupTable *lut, uint8_t flags);
+
+// Read the lookup table from the chip
+// Param: lut - return the table, hysteresis and resolution
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_getLookupTable(CTF2301_Device *dev, CTF2301_LookupTable *lut);
+
+// Fit a lookup table to a fan curve
+// The 12 entries are placed so the largest error between the curve and the chip's steps, rising or falling through
+// the hysteresis, is as small as it gets. Below the first entry the chip runs 0%. The hysteresis is the widest up to
+// CTF2301_LUT_FIT_HYST_MAX that doesn't add to that error, at least hystMin. Errors are taken per temperature code.
+// Runs in constant memory, on the MCU or on a host, see CTF2301_lutfit.c.
+// Param: curve - points with ascending temperatures, resolution - CTF2301_LUT_RES_1C or CTF2301_LUT_RES_0_5C,
+//        pwmFullScale - PWM code of 100%, e.g. CTF2301_PWM_STEPS_6_25 or CTF2301_PWM_STEPS_0_39,
+//        hystMin - narrowest hysteresis in °C, lut - return the table, fit - optional, return the errors
+// Return: CTF2301_OK if the table is fitted, CTF2301_ERROR if the curve or a setting is invalid
+uint32_t CTF2301_fitLookupTable(const CTF2301_CurvePoint *curve, uint16_t points, uint8_t resolution,
+                                uint16_t pwmFullScale, uint8_t hystMin, CTF2301_LookupTable *lut, CTF2301_LutFit *fit);
+
+// Set Conversion Rate. Default is 0x08
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_CONVERSION_RATE(CTF2301_Device *dev, ConversionRate rate);
 
 // Set Remote Diode Beta Compensation. Default is 0x82
-// TODO
+// Param:
+// CTF2301_BETA_AUTO: the chip measures the beta of the remote transistor and compensates for it.
+// 0x00 - 0x06: compensation for a fixed beta range, from lowest to highest.
+// CTF2301_BETA_OFF: no compensation, for diode-connected transistors.
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_DIODE_BETA_COMP(CTF2301_Device *dev, uint8_t param);
+
+// Set Remote Temperature Offset. Default is 0x0000
+// Param: offset - added to every remote conversion, rounded to 0.125°C and limited to -128°C to 127.875°C
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_TEMP_OFFSET(CTF2301_Device *dev, CTF2301_Temp offset);
 
 // Set Remote Diode Temperature Filter and Comparator Mode, Default is 0x00
-// TODO
+// Param:
+// 0x00: filter off.
+// 0x01, 0x02: filter level 1, averages out noise with little delay.
+// 0x03: filter level 2, the strongest filtering.
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_REMOTE_DIODE_TEMP_FILTER(CTF2301_Device *dev, uint8_t param);
+
+// Param:
+// 0: ALERT latches until ALERT_STATUS is read.
+// 1: comparator mode, ALERT follows the remote high limit and releases once the temperature is back below it.
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_ALERT_COMPARATOR_MODE(CTF2301_Device *dev, uint8_t param);
 
 // Set SMBus Timeout. Default is 0x00
-// TODO
+// Param:
+// 0: the SMBus interface waits however long SCL is held low
+// 1: the SMBus interface resets when SCL is held low for more than 25ms
+// Note: bit 7 as the enable bit is not confirmed against the datasheet
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_SMBUS_TIMEOUT(CTF2301_Device *dev, uint8_t param);
 
 // Set Alarm Mask. Default is 0x00
-// TODO
+// Param: mask - AlertStatus bits that must not pull ALERT low, they still show up in ALERT_STATUS
+// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_SET_ALERT_MASK(CTF2301_Device *dev, uint8_t mask);
 
 // Set Local Temperature limit
 // TODO
@@ -410,54 +1157,350 @@ uint32_t __CTF2301_SET_LOOKUP_TABLE();
 // Set Tachometer limit
 // TODO
 
+// ALERT Handling
+// Wire the ALERT pin to an EXTI line and call CTF2301_alertIRQ() from its callback, then CTF2301_alertProcess() from a task
+// or the main loop. The processing asks the SMBus Alert Response Address who is asserting ALERT, reads that chip's
+// ALERT_STATUS once and calls the handler of every unmasked event in it. Chips that don't answer the ARA are polled instead.
+// Read ALERT_STATUS, the chip clears the latched bits on read
+// Param: status - return AlertStatus bits
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readAlertStatus(CTF2301_Device *dev, uint8_t *status);
+
+// Keep ALERT_STATUS bits read outside the ALERT handling for the next CTF2301_alertProcess(), safe to call from an interrupt
+// The sampler, zone snapshots and the beta calibration call this themselves. Anything else that reads ALERT_STATUS
+// clears the latched bits on the chip, and if it doesn't pass them here their handlers never run.
+void CTF2301_alertLatch(CTF2301_Device *dev, uint8_t status);
+
+// Register the handler of one event, NULL removes it
+// Return: CTF2301_OK if the handler is set, CTF2301_ERROR if the event is unknown
+uint32_t CTF2301_setAlertHandler(CTF2301_Device *dev, CTF2301_AlertEvent event, CTF2301_AlertHandler handler, void *context);
+
+// Note that the ALERT line of a bus went low, safe to call from an interrupt
+void CTF2301_alertIRQ(CTF2301_Bus *bus);
+
+// Find the chips asserting ALERT on a bus and dispatch their events, does nothing unless CTF2301_alertIRQ() ran
+// Must not be called from an interrupt.
+// Return: CTF2301_OK if all pending chips are handled, CTF2301_ERROR_COMM if an ALERT_STATUS read fails
+uint32_t CTF2301_alertProcess(CTF2301_Bus *bus);
+
+// Adaptive Conversion Rate
+// Read both temperatures, move the conversion rate by their slope and tell when to call again.
+// The temperatures read are left in dev->rate.local / dev->rate.remote (1/32°C) for the application to use.
+// Param: nowMs - current time in ms, pollMs - return the time until the next call, the conversion period of the new rate
+// Return: CTF2301_OK if the update is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_rateUpdate(CTF2301_Device *dev, uint32_t nowMs, uint32_t *pollMs);
+
+// Time between two conversions at a rate
+// Return: period in ms
+uint32_t CTF2301_ratePeriodMs(ConversionRate rate);
+
+// Remote Diode Calibration
+// Characterize the remote diode against a reference, e.g. a calibrated probe on the same heat sink, held steady while
+// this runs. Every beta compensation setting is tried at the fastest conversion rate with configCAL_SAMPLES conversions,
+// the closest one is kept and the offset takes out what is left. The on-chip filter is set to configCAL_FILTER.
+// Takes about 6s, the conversion rate is restored afterwards. ALERT_STATUS is read to check for a diode fault.
+// Param: reference - true temperature of the diode, cal - return the calibration to store
+// Return: CTF2301_OK if the chip is calibrated, CTF2301_ERROR_VERIFY if the diode is open or shorted or its error is
+//         beyond what the offset can take, CTF2301_ERROR otherwise
+uint32_t CTF2301_calibrateRemote(CTF2301_Device *dev, CTF2301_Temp reference, CTF2301_Calibration *cal);
+
+// Write a stored calibration to the chip, e.g. after CTF2301_init()
+// Return: CTF2301_OK if the calibration is written, CTF2301_ERROR_VERIFY if the blob is corrupt or of another version,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_calibrationApply(CTF2301_Device *dev, const CTF2301_Calibration *cal);
+
+// Check the CRC and version of a stored calibration
+// Return: 1 if the calibration can be applied, 0 otherwise
+uint8_t CTF2301_calibrationValid(const CTF2301_Calibration *cal);
+
+// Sampler
+// Take one record and push it into the ring buffer of the device. Call it on a timer, e.g. every CTF2301_ratePeriodMs()
+// of the programmed rate so each record holds a new conversion.
+// Param: timestamp - stored in the record, any time base
+// Return: CTF2301_OK if the record is pushed, CTF2301_ERROR_BUSY if the ring is full and the record is dropped,
+//         CTF2301_ERROR if a read fails
+uint32_t CTF2301_sample(CTF2301_Device *dev, uint32_t timestamp);
+
+#if (configUSE_ASYNC_TRANSPORT == 1)
+// Queue the reads of one record and return, the record is pushed from the I2C interrupt when the last read completes.
+// Can be called from a timer interrupt.
+// Return: CTF2301_OK if the reads are queued, CTF2301_ERROR_BUSY if the previous record is still on the bus or the queue is full
+uint32_t CTF2301_sampleAsync(CTF2301_Device *dev, uint32_t timestamp);
+#endif
+
+// Take the oldest records out of the ring buffer
+// Param: records - return up to max records, oldest first
+// Return: number of records copied
+uint16_t CTF2301_samplerDrain(CTF2301_Device *dev, CTF2301_Sample *records, uint16_t max);
+
+// Number of records waiting in the ring buffer
+uint16_t CTF2301_samplerCount(CTF2301_Device *dev);
+
+// For code that schedules the reads of a record itself, e.g. the zone manager
+// Register run of a record, in bus order
+// Param: run - 0 to CTF2301_SAMPLE_RUNS - 1, address, length - return the run
+// Return: offset of the run in the CTF2301_SAMPLE_BYTES read for a record
+uint8_t CTF2301_sampleRun(uint8_t run, CTF2301_Register *address, uint8_t *length);
+
+// Fill in the readings of a record from its CTF2301_SAMPLE_BYTES registers, timestamp and sequence are left alone
+void CTF2301_sampleDecode(const uint8_t *raw, CTF2301_Sample *record);
+
 // Tach measurement
-// Param: tach - return Tachometer reading
+// TACH_COUNT_LSB is read first, it latches the MSB, so both bytes come from the same measurement.
+// Param: tach - return Tachometer reading, CTF2301_TACH_INVALID if the fan is stopped or too slow to measure
+//        (Smart-TACH modes 01-03 report FFFFh below the minimum detectable RPM)
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_readTach(uint16_t *tach);
+uint32_t CTF2301_readTach(CTF2301_Device *dev, uint16_t *tach);
+
+// Convert a TACH count to RPM without a division, for cores like the Cortex-M0+ that have no divide instruction
+// Return: RPM, 0 for CTF2301_TACH_INVALID or 0, saturates at 65535
+uint16_t CTF2301_tachToRPM(uint16_t tach);
 
 // Basic R/W
 // Read a register from the CTF2301
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_readRegister(CTF2301_Register address, uint8_t *buffer);
+uint32_t __CTF2301_readRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer);
 
 // Write a register to the CTF2301
 // Return: CTF2301_OK if writing is successful, CTF2301_ERROR otherwise
-uint32_t __CTF2301_writeRegister(CTF2301_Register address, uint8_t data);
+uint32_t __CTF2301_writeRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t data);
+
+// Read or write consecutive registers
+// A single auto-increment transaction is used where allowed (see configENABLE_I2C_AUTO_INCREMENT),
+// otherwise the registers are moved with back-to-back single register transfers.
+// Return: CTF2301_OK if the transfer is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegisters(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length);
+uint32_t __CTF2301_writeRegisters(CTF2301_Device *dev, CTF2301_Register address, const uint8_t *data, uint16_t length);
+
+#if (configUSE_ASYNC_TRANSPORT == 1)
+// Asynchronous R/W (configUSE_ASYNC_TRANSPORT)
+// Queue a register transfer and return straight away. Requests complete in submission order.
+// Write data is copied when the request is queued, read data is copied to buffer when the request completes.
+// Param: callback - optional, called on completion, done - optional, set to CTF2301_PENDING now and to the result on completion
+// Return: CTF2301_OK if the request is queued, CTF2301_ERROR_BUSY if the queue is full, CTF2301_ERROR otherwise
+uint32_t CTF2301_readRegistersAsync(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer, uint16_t length,
+                                    CTF2301_Callback callback, void *context, volatile uint32_t *done);
+uint32_t CTF2301_writeRegistersAsync(CTF2301_Device *dev, CTF2301_Register address, const uint8_t *data, uint16_t length,
+                                     CTF2301_Callback callback, void *context, volatile uint32_t *done);
+
+// Restart the queue if a transfer could not start because the I2C peripheral was busy
+void CTF2301_asyncPoll(CTF2301_Device *dev);
+
+// Number of requests queued or on the bus
+uint8_t CTF2301_asyncPending(CTF2301_Device *dev);
+
+// Give up on the requests that report to done: their results are dropped and, if one is still outstanding, the bus is
+// recovered (configUSE_BUS_RECOVERY). done is set to CTF2301_ERROR_TIMEOUT unless they were over already.
+// Return: the value left in done
+uint32_t CTF2301_asyncCancel(CTF2301_Device *dev, volatile uint32_t *done);
+
+// Call these from HAL_I2C_MemTxCpltCallback(), HAL_I2C_MemRxCpltCallback() and HAL_I2C_ErrorCallback()
+void CTF2301_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void CTF2301_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void CTF2301_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+#endif
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_LINUX_I2C_BUS)
+// Linux i2c-dev Bus
+// Open an I2C adapter, the kernel needs I2C_FUNC_I2C (plain I2C_RDWR transfers) from it
+// Param: bus - bus to open, path - adapter device, e.g. "/dev/i2c-1"
+// Return: CTF2301_OK if the adapter is open, CTF2301_ERROR_COMM otherwise
+uint32_t CTF2301_linuxOpen(CTF2301_Bus *bus, const char *path);
+void CTF2301_linuxClose(CTF2301_Bus *bus);
+#endif
+
+// Read a 16-bit value split over two registers
+// Param: msb, lsb - register pair, lsbFirst - 1 if the chip latches the MSB when the LSB is read, 0 for the opposite
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegister16(CTF2301_Device *dev, CTF2301_Register msb, CTF2301_Register lsb, uint8_t lsbFirst, uint16_t *value);
+
+// Read a register, served from the shadow cache when the register is cached and valid
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t __CTF2301_readRegisterCached(CTF2301_Device *dev, CTF2301_Register address, uint8_t *buffer);
+
+// Number of PWM_VALUE codes between 0% and 100% at the current PWM setup
+// Return: CTF2301_OK if the setup is known, CTF2301_ERROR otherwise
+uint32_t __CTF2301_pwmFullScale(CTF2301_Device *dev, uint16_t *fullScale);
+
+// Update the bits selected by mask in a register, the write is skipped if nothing changes
+// Param: address - register, mask - bits to update, value - new bits, already shifted into place
+// Return: CTF2301_OK if updating is successful, CTF2301_ERROR_COMM if the register can't be read, CTF2301_ERROR otherwise
+uint32_t __CTF2301_updateRegister(CTF2301_Device *dev, CTF2301_Register address, uint8_t mask, uint8_t value);
+
+// Configuration Transactions
+// Between CTF2301_beginConfig and CTF2301_commitConfig the field setters of PWM_TACH_CONFIG, FAN_SPIN_UP_CONFIG,
+// PWM_FREQ, CONFIG and ENHANCED_CONFIG only stage their change in RAM. Commit writes each touched register once,
+// skips registers that end up unchanged, and goes in a safe order: CONFIG, ENHANCED_CONFIG, PWM_FREQ,
+// FAN_SPIN_UP_CONFIG, PWM_TACH_CONFIG. CTF2301_setLookupTable can't be used while a transaction is open.
+// Return: CTF2301_OK if successful, CTF2301_ERROR_BUSY if a transaction is open already (begin),
+//         CTF2301_ERROR if a write fails (commit)
+uint32_t CTF2301_beginConfig(CTF2301_Device *dev);
+uint32_t CTF2301_commitConfig(CTF2301_Device *dev);
+void CTF2301_abortConfig(CTF2301_Device *dev);
+
+// Shadow Register Cache
+// Mark every cached register as unknown, the next access to each of them goes to the chip.
+// Call this after the CTF2301 has been power cycled or reset.
+void CTF2301_shadowInvalidate(CTF2301_Device *dev);
+
+// Reload every cached register from the chip
+// Return: CTF2301_OK if all registers are read successfully, CTF2301_ERROR_COMM otherwise
+uint32_t CTF2301_shadowResync(CTF2301_Device *dev);
+
+// Get or clear the bus access counters
+// Param: stats - return a copy of the counters
+void CTF2301_getCacheStats(CTF2301_Device *dev, CTF2301_CacheStats *stats);
+void CTF2301_resetCacheStats(CTF2301_Device *dev);
+
+#if (configUSE_BUS_INSTRUMENTATION == 1)
+// Bus Instrumentation
+// Copy the counters of every instrumented register, slot i belongs to register CTF2301_instrumentAddress(i)
+// Param: stats - array of CTF2301_INSTRUMENT_SLOTS entries
+void CTF2301_getBusStats(CTF2301_RegisterStats *stats);
+
+// Copy the counters of one register
+// Return: CTF2301_OK if the register is instrumented, CTF2301_ERROR otherwise
+uint32_t CTF2301_getRegisterStats(CTF2301_Register address, CTF2301_RegisterStats *stats);
+
+// Clear all counters
+void CTF2301_resetBusStats(void);
+
+// Register address of a counter slot
+CTF2301_Register CTF2301_instrumentAddress(uint8_t slot);
+#endif
 
 // Exported Function Prototypes
+// Bind a device to a bus and 7-bit address, and load the default configuration
+// Param: dev - device to set up, bus - bus of the selected peripheral driver (I2C handle for MX), i2cAddr - usually configDEVICE_CTF2301_I2C_ADDR
+// Return: CTF2301_OK if the device is attached, CTF2301_ERROR_BUSY if configCTF2301_MAX_DEVICES are attached already
+uint32_t CTF2301_attach(CTF2301_Device *dev, CTF2301_Bus *bus, uint8_t i2cAddr);
+
+// Release a device, it must not have requests in progress
+void CTF2301_detach(CTF2301_Device *dev);
+
+#if (configUSE_BUS_ARBITER == 1)
+// Share the bus of the device through an arbiter, all devices on a bus and its other drivers must use the same one
+// Param: arbiter - set up with CTF2301_arbiterInit(), NULL to go back to unarbitrated transfers
+void CTF2301_setArbiter(CTF2301_Device *dev, CTF2301_Arbiter *arbiter);
+#endif
+
+#if (configUSE_PERIPHERIAL_DRIVER_CTF2301 == CTF2301_MX_I2C_BUS)
+// Pins the bus recovery clocks by hand, the ones the I2C peripheral of the device uses. Without them the recovery only
+// re-initializes the peripheral, which doesn't free a chip holding SDA low.
+// Param: sclPort, sclPin, sdaPort, sdaPin - e.g. GPIOB, GPIO_PIN_10, GPIOB, GPIO_PIN_11
+void CTF2301_setRecoveryPins(CTF2301_Device *dev, GPIO_TypeDef *sclPort, uint16_t sclPin, GPIO_TypeDef *sdaPort, uint16_t sdaPin);
+#endif
+
+// Recover the bus of the device: release the I2C peripheral, clock SCL until SDA is free, send a STOP and set the
+// peripheral up again. Transfers do this by themselves with configUSE_BUS_RECOVERY, it must not be called while one runs.
+// Return: CTF2301_OK if the bus is idle again, CTF2301_ERROR_TIMEOUT if the arbiter doesn't hand over the bus,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_recoverBus(CTF2301_Device *dev);
+
+// Fill a configuration with the values selected by the defines above
+void CTF2301_getDefaultConfig(CTF2301_Config *config);
+
 // Initialize the CTF2301, you have to select the options in the defines above
+// The register image is written as a fixed sequence of runs (see ctf2301_initRuns), the fan control block in one burst
+// when configENABLE_I2C_AUTO_INCREMENT allows it.
 // Return: CTF2301_OK if the initialization is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_init();
+uint32_t CTF2301_init(CTF2301_Device *dev);
+
+// Warm start: read the register image back and rewrite only the registers that differ from it, e.g. after a watchdog
+// reset of the MCU while the chip kept running. The PWM duty cycle the fan runs at is left alone.
+// Param: path - return CTF2301_INIT_PATH_WARM if the chip already held the image, CTF2301_INIT_PATH_COLD otherwise
+// Return: CTF2301_OK if the chip holds the image, CTF2301_ERROR_NOT_READY / CTF2301_ERROR_ID / CTF2301_ERROR_COMM
+//         as for CTF2301_init, CTF2301_ERROR if a write fails
+uint32_t CTF2301_initWarm(CTF2301_Device *dev, CTF2301_InitPath *path);
+
+// Non-blocking initialization, writes the same register image as CTF2301_init. Call CTF2301_initBegin() once, then
+// CTF2301_initStep() from the superloop or a task until it stops returning CTF2301_PENDING. Each step does at most one
+// bus operation; with configUSE_ASYNC_TRANSPORT it queues the operation and a later step picks up the result.
+// Param: nowMs - current time in ms, porTimeoutMs - how long to wait for the chip to leave power-on reset
+void CTF2301_initBegin(CTF2301_Device *dev, uint32_t nowMs, uint32_t porTimeoutMs);
+
+// Advance the non-blocking initialization
+// Param: nowMs - current time in ms
+// Return: CTF2301_PENDING while in progress, CTF2301_OK once the image is written, CTF2301_ERROR_TIMEOUT if the chip
+//         didn't leave power-on reset in time, CTF2301_ERROR_ID / CTF2301_ERROR_COMM / CTF2301_ERROR as for CTF2301_init
+uint32_t CTF2301_initStep(CTF2301_Device *dev, uint32_t nowMs);
 
 // Check Power On Reset Status
 // Return: CTF2301_OK if POR is ready, CTF2301_ERROR_NOT_READY otherwise
-uint32_t CTF2301_checkPOR();
+uint32_t CTF2301_checkPOR(CTF2301_Device *dev);
 
 // Read Manufacturer ID.
 // Param: id - return Manufacturer ID
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_readManufacturerID(uint8_t *id);
+uint32_t CTF2301_readManufacturerID(CTF2301_Device *dev, uint8_t *id);
 
 // Read Step and Die Revision ID.
 // Param: id - return Step and Die Revision ID
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_readStepDieRevID(uint8_t *id);
-
-// Set Fan Speed (in PWM Duty Cycle)
-// Param: fanMaxRPM - Maximum RPM of the fan, setRPM - Desired RPM
-// Note: The maximum RPM of the fan varies from fan to fan specs and may not be accurate, the actual RPM may vary. 
-// Return: CTF2301_OK if setting is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_setFanSpeed(uint16_t fanMaxRPM, uint16_t setRPM);
+uint32_t CTF2301_readStepDieRevID(CTF2301_Device *dev, uint8_t *id);
+
+// Set Fan Speed, one step of the closed loop RPM controller (see configFAN_KP)
+// Reads the TACH, updates the PI loop and writes PWM_VALUE only if the duty cycle code changes. The code follows the
+// PWM resolution the chip runs at: 2 * PWM_FREQ steps, or 0.39% steps with configENABLE_PWM_HIGH_RES.
+// Param: fanMaxRPM - Maximum RPM of the fan, setRPM - Desired RPM, 0 stops the fan
+// Note: fanMaxRPM only sets the starting point and the gain scale, the loop corrects for fans that don't reach it
+//       or don't respond linearly. Needs Manual Direct-DCY Mode.
+// Return: CTF2301_OK once the speed has been within the tolerance for configFAN_SETTLE_STEPS steps,
+//         CTF2301_PENDING while it converges, CTF2301_ERROR_NOT_READY if PWM programming is disabled (Auto-Temp Mode),
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_setFanSpeed(CTF2301_Device *dev, uint16_t fanMaxRPM, uint16_t setRPM);
 
 // Get Fan Speed (in RPM)
-// Param: rpm - return RPM
+// Param: rpm - return RPM, 0 if the fan is stopped or below the lowest measurable speed
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_getFanSpeed(CTF2301_Device *dev, uint16_t *rpm);
+
+// Set the PWM duty cycle in Manual Direct-DCY Mode, PWM_VALUE is only written when its code changes
+// Param: duty - CTF2301_DUTY_FULL is 100%, rounded to the nearest step of the PWM resolution
+// Return: CTF2301_OK if the chip runs the duty cycle, CTF2301_ERROR_NOT_READY if PWM programming is disabled,
+//         CTF2301_ERROR otherwise
+uint32_t CTF2301_setDutyCycle(CTF2301_Device *dev, uint32_t duty);
+
+// Read Local Temperature
+// Param: temp - return 12-bit two's complement reading, 0.0625°C per LSb, see LocalTemperature
+// Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
+uint32_t CTF2301_readLocalTemp(CTF2301_Device *dev, uint16_t *temp);
+
+// Read Remote Temperature
+// Param: temp - return 13-bit reading, 0.03125°C per LSb, see RemoteTemperatureSigned and RemoteTemperatureUnsigned
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_getFanSpeed(uint16_t *rpm);
+uint32_t CTF2301_readRemoteTemp(CTF2301_Device *dev, uint16_t *temp);
+uint32_t CTF2301_readRemoteTempUnsigned(CTF2301_Device *dev, uint16_t *temp);
 
 // Get Rounded Remote Temperature
-// Param: temp - return Remote Temperature (Rounded)
+// Param: temp - return Remote Temperature rounded to the nearest °C
 // Return: CTF2301_OK if reading is successful, CTF2301_ERROR otherwise
-uint32_t CTF2301_getRdRemoteTemp(uint16_t *temp);
+uint32_t CTF2301_getRdRemoteTemp(CTF2301_Device *dev, int16_t *temp);
+
+// Fixed-Point Temperature
+// Decode a register value to 1/32°C, branch-free and exact
+// Param: raw - as returned by CTF2301_readLocalTemp(), CTF2301_readRemoteTemp() or CTF2301_readRemoteTempUnsigned()
+CTF2301_Temp CTF2301_decodeLocal(uint16_t raw);
+CTF2301_Temp CTF2301_decodeRemote(uint16_t raw);
+CTF2301_Temp CTF2301_decodeRemoteUnsigned(uint16_t raw);
+
+// Decode a high / low / T_CRIT setpoint, signed or unsigned as configENABLE_UNSIGNED_H_T_CRIT_SP_FT selects
+// Param: raw - MSB << 8 | LSB, 0.125°C in LSB bits 7:5; the 8-bit setpoints (T_CRIT, local high MSB only) pass MSB << 8
+CTF2301_Temp CTF2301_decodeSetpoint(uint16_t raw);
+
+// Encode 1/32°C into a register value, rounded to the nearest step of the format and clamped to its range
+// Return: raw value in the layout the matching decode function takes
+uint16_t CTF2301_encodeLocal(CTF2301_Temp temp);
+uint16_t CTF2301_encodeRemote(CTF2301_Temp temp);
+uint16_t CTF2301_encodeRemoteUnsigned(CTF2301_Temp temp);
+uint16_t CTF2301_encodeSetpoint(CTF2301_Temp temp);
+
+// Decode arrays of raw values, e.g. logged samples. The loops have no branches and vectorize on host compilers.
+// Param: raw - count values, temp - return count decoded values, must not overlap raw
+void CTF2301_decodeLocalBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count);
+void CTF2301_decodeRemoteBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count);
+void CTF2301_decodeRemoteUnsignedBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count);
+void CTF2301_decodeSetpointBatch(const uint16_t *raw, CTF2301_Temp *temp, size_t count);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,305 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Shared I2C bus arbiter
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "CTF2301_arbiter.h"
+#include <string.h>
+
+#if (configARBITER_PORT == CTF2301_ARBITER_PTHREAD)
+#include <errno.h>
+#include <time.h>
+#endif
+
+// OS port
+// The arbiter lock is held around every change to the queues. A waiter sleeps on its own signal and is woken by the
+// task that hands the bus to it, with the lock held, so the waiter can't time out and leave in between.
+#if (configARBITER_PORT == CTF2301_ARBITER_FREERTOS)
+
+#define __CTF2301_ARBITER_LOCK(arbiter)      xSemaphoreTake((arbiter)->lock, portMAX_DELAY)
+#define __CTF2301_ARBITER_UNLOCK(arbiter)    xSemaphoreGive((arbiter)->lock)
+
+static uint32_t __CTF2301_arbiterNow(void){
+    return (uint32_t)xTaskGetTickCount();
+}
+
+static uint32_t __CTF2301_arbiterPortInit(CTF2301_Arbiter *arbiter){
+    arbiter->lock = xSemaphoreCreateMutexStatic(&arbiter->lockBuffer);
+    return (arbiter->lock != NULL) ? CTF2301_OK : CTF2301_ERROR;
+}
+
+static void __CTF2301_waiterInit(CTF2301_ArbiterWaiter *waiter){
+    waiter->signal = xSemaphoreCreateBinaryStatic(&waiter->signalBuffer);
+}
+
+static void __CTF2301_waiterDestroy(CTF2301_ArbiterWaiter *waiter){
+    vSemaphoreDelete(waiter->signal);
+}
+
+static void __CTF2301_waiterWake(CTF2301_ArbiterWaiter *waiter){
+    xSemaphoreGive(waiter->signal);
+}
+
+// Sleep until granted or the timeout runs out, called and returns with the lock held
+static void __CTF2301_waiterSleep(CTF2301_Arbiter *arbiter, CTF2301_ArbiterWaiter *waiter, uint32_t timeoutMs){
+    TickType_t ticks = (timeoutMs == CTF2301_ARBITER_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    __CTF2301_ARBITER_UNLOCK(arbiter);
+    // The signal is only given on a grant, one take is enough
+    xSemaphoreTake(waiter->signal, ticks);
+    __CTF2301_ARBITER_LOCK(arbiter);
+}
+
+#else
+
+#define __CTF2301_ARBITER_LOCK(arbiter)      pthread_mutex_lock(&(arbiter)->lock)
+#define __CTF2301_ARBITER_UNLOCK(arbiter)    pthread_mutex_unlock(&(arbiter)->lock)
+
+static uint32_t __CTF2301_arbiterNow(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u);
+}
+
+static uint32_t __CTF2301_arbiterPortInit(CTF2301_Arbiter *arbiter){
+    return (pthread_mutex_init(&arbiter->lock, NULL) == 0) ? CTF2301_OK : CTF2301_ERROR;
+}
+
+static void __CTF2301_waiterInit(CTF2301_ArbiterWaiter *waiter){
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter->signal, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void __CTF2301_waiterDestroy(CTF2301_ArbiterWaiter *waiter){
+    pthread_cond_destroy(&waiter->signal);
+}
+
+static void __CTF2301_waiterWake(CTF2301_ArbiterWaiter *waiter){
+    pthread_cond_signal(&waiter->signal);
+}
+
+// Sleep until granted or the timeout runs out, called and returns with the lock held
+static void __CTF2301_waiterSleep(CTF2301_Arbiter *arbiter, CTF2301_ArbiterWaiter *waiter, uint32_t timeoutMs){
+    struct timespec deadline;
+    if (timeoutMs == CTF2301_ARBITER_FOREVER){
+        while (!waiter->granted){
+            pthread_cond_wait(&waiter->signal, &arbiter->lock);
+        }
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    // Wake-ups without a grant are possible, go back to sleep until the deadline
+    while (!waiter->granted){
+        if (pthread_cond_timedwait(&waiter->signal, &arbiter->lock, &deadline) == ETIMEDOUT){
+            break;
+        }
+    }
+}
+
+#endif // configARBITER_PORT
+
+// Book-keeping of a grant, with the lock held
+static void __CTF2301_arbiterGrant(CTF2301_Arbiter *arbiter, uint8_t busClass, uint32_t queued, uint32_t now){
+    CTF2301_ArbiterStats *stats = &arbiter->stats[busClass];
+    uint32_t wait = now - queued;
+    arbiter->busy = 1;
+    arbiter->ownerClass = busClass;
+    arbiter->grantedAt = now;
+    stats->grants++;
+    stats->waitTotal += wait;
+    if (wait > stats->waitMax){
+        stats->waitMax = wait;
+    }
+}
+
+// Pick the class the free bus goes to, with the lock held
+// Return: class index, or CTF2301_BUS_CLASSES if nobody is waiting
+static uint8_t __CTF2301_arbiterPick(CTF2301_Arbiter *arbiter){
+    uint8_t pick = CTF2301_BUS_CLASSES;
+
+    // ALERT is never passed over
+    if (arbiter->head[CTF2301_BUS_ALERT] != NULL){
+        return CTF2301_BUS_ALERT;
+    }
+    // A lower class that waited out configARBITER_MAX_BYPASS grants goes first, otherwise strict priority
+    for (uint8_t c = CTF2301_BUS_ALERT + 1; c < CTF2301_BUS_CLASSES; c++){
+        if (arbiter->head[c] != NULL && arbiter->bypassed[c] >= configARBITER_MAX_BYPASS){
+            pick = c;
+            break;
+        }
+    }
+    if (pick == CTF2301_BUS_CLASSES){
+        for (uint8_t c = CTF2301_BUS_ALERT + 1; c < CTF2301_BUS_CLASSES; c++){
+            if (arbiter->head[c] != NULL){
+                pick = c;
+                break;
+            }
+        }
+    } else {
+        for (uint8_t c = CTF2301_BUS_ALERT + 1; c < pick; c++){
+            if (arbiter->head[c] != NULL){
+                arbiter->stats[pick].promotions++;
+                break;
+            }
+        }
+    }
+    if (pick == CTF2301_BUS_CLASSES){
+        return pick;
+    }
+    for (uint8_t c = 0; c < CTF2301_BUS_CLASSES; c++){
+        if (c == pick){
+            arbiter->bypassed[c] = 0;
+        } else if (arbiter->head[c] != NULL && arbiter->bypassed[c] < 0xFF){
+            arbiter->bypassed[c]++;
+        }
+    }
+    return pick;
+}
+
+// Take a waiter out of its class queue, with the lock held
+static void __CTF2301_arbiterUnlink(CTF2301_Arbiter *arbiter, uint8_t busClass, CTF2301_ArbiterWaiter *waiter){
+    CTF2301_ArbiterWaiter *previous = NULL;
+    for (CTF2301_ArbiterWaiter *w = arbiter->head[busClass]; w != NULL; previous = w, w = w->next){
+        if (w == waiter){
+            if (previous == NULL){
+                arbiter->head[busClass] = w->next;
+            } else {
+                previous->next = w->next;
+            }
+            if (arbiter->tail[busClass] == w){
+                arbiter->tail[busClass] = previous;
+            }
+            break;
+        }
+    }
+    if (arbiter->head[busClass] == NULL){
+        arbiter->bypassed[busClass] = 0;
+    }
+}
+
+// Set up an arbiter, once before any client uses it
+// Return: CTF2301_OK if the arbiter is ready, CTF2301_ERROR if the OS objects can't be created
+uint32_t CTF2301_arbiterInit(CTF2301_Arbiter *arbiter){
+    memset(arbiter, 0, sizeof(*arbiter));
+    return __CTF2301_arbiterPortInit(arbiter);
+}
+
+// Wait for the bus, from a task only
+// Param: busClass - priority class of the transaction, timeoutMs - longest wait, CTF2301_ARBITER_FOREVER to wait forever
+// Return: CTF2301_OK once the caller holds the bus, CTF2301_ERROR_TIMEOUT if it didn't get it in time
+uint32_t CTF2301_arbiterAcquire(CTF2301_Arbiter *arbiter, CTF2301_BusClass busClass, uint32_t timeoutMs){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_ArbiterWaiter waiter;
+    uint32_t now;
+
+    if ((unsigned)busClass >= CTF2301_BUS_CLASSES){
+        busClass = CTF2301_BUS_CONFIG;
+    }
+
+    __CTF2301_ARBITER_LOCK(arbiter);
+    now = __CTF2301_arbiterNow();
+    if (!arbiter->busy){
+        __CTF2301_arbiterGrant(arbiter, busClass, now, now);
+    } else if (timeoutMs == 0){
+        arbiter->stats[busClass].timeouts++;
+        ret = CTF2301_ERROR_TIMEOUT;
+    } else {
+        waiter.next = NULL;
+        waiter.granted = 0;
+        waiter.queued = now;
+        __CTF2301_waiterInit(&waiter);
+        if (arbiter->tail[busClass] == NULL){
+            arbiter->head[busClass] = &waiter;
+        } else {
+            arbiter->tail[busClass]->next = &waiter;
+        }
+        arbiter->tail[busClass] = &waiter;
+
+        __CTF2301_waiterSleep(arbiter, &waiter, timeoutMs);
+
+        // The grant is made with the lock held, if it isn't set now the request is still queued
+        if (!waiter.granted){
+            __CTF2301_arbiterUnlink(arbiter, busClass, &waiter);
+            arbiter->stats[busClass].timeouts++;
+            ret = CTF2301_ERROR_TIMEOUT;
+        }
+        __CTF2301_waiterDestroy(&waiter);
+    }
+    __CTF2301_ARBITER_UNLOCK(arbiter);
+    return ret;
+}
+
+// Hand the bus to the next waiting request, or free it
+void CTF2301_arbiterRelease(CTF2301_Arbiter *arbiter){
+    CTF2301_ArbiterStats *stats;
+    CTF2301_ArbiterWaiter *next;
+    uint32_t now;
+    uint32_t hold;
+    uint8_t pick;
+
+    __CTF2301_ARBITER_LOCK(arbiter);
+    now = __CTF2301_arbiterNow();
+    stats = &arbiter->stats[arbiter->ownerClass];
+    hold = now - arbiter->grantedAt;
+    stats->holdTotal += hold;
+    if (hold > stats->holdMax){
+        stats->holdMax = hold;
+    }
+
+    pick = __CTF2301_arbiterPick(arbiter);
+    if (pick == CTF2301_BUS_CLASSES){
+        arbiter->busy = 0;
+    } else {
+        next = arbiter->head[pick];
+        __CTF2301_arbiterUnlink(arbiter, pick, next);
+        __CTF2301_arbiterGrant(arbiter, pick, next->queued, now);
+        next->granted = 1;
+        __CTF2301_waiterWake(next);
+    }
+    __CTF2301_ARBITER_UNLOCK(arbiter);
+}
+
+// Get or clear the fairness accounting
+// Param: stats - array of CTF2301_BUS_CLASSES entries
+void CTF2301_arbiterGetStats(CTF2301_Arbiter *arbiter, CTF2301_ArbiterStats *stats){
+    __CTF2301_ARBITER_LOCK(arbiter);
+    memcpy(stats, arbiter->stats, sizeof(arbiter->stats));
+    __CTF2301_ARBITER_UNLOCK(arbiter);
+}
+
+void CTF2301_arbiterResetStats(CTF2301_Arbiter *arbiter){
+    __CTF2301_ARBITER_LOCK(arbiter);
+    memset(arbiter->stats, 0, sizeof(arbiter->stats));
+    __CTF2301_ARBITER_UNLOCK(arbiter);
+}
@@ -0,0 +1,140 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Shared I2C bus arbiter
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Several tasks, and drivers of other chips on the same I2C bus (EEPROMs,
+  sensors), take turns on the bus through a CTF2301_Arbiter. A client asks for
+  the bus with a priority class and holds it for one transaction:
+
+    CTF2301_BUS_ALERT       ALERT / T_CRIT handling
+    CTF2301_BUS_TELEMETRY   periodic reads
+    CTF2301_BUS_CONFIG      configuration writes
+
+  The free bus goes to the oldest request of the highest class waiting. A
+  TELEMETRY or CONFIG request that has been passed over
+  configARBITER_MAX_BYPASS times in a row is served next, so the low classes
+  can't starve, but nothing is ever served ahead of a waiting ALERT request.
+  An ALERT request therefore waits at most for the transaction on the bus and
+  the ALERT requests queued before it.
+
+  configARBITER_PORT selects the OS: FreeRTOS (a mutex and a binary semaphore
+  per waiter) or POSIX threads (a mutex and a condition variable per waiter)
+  for host builds and load tests. Waiters live on the stack of the requesting
+  task, nothing is allocated.
+
+ */
+
+#ifndef INC_CTF2301_ARBITER_H_
+#define INC_CTF2301_ARBITER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "CTF2301.h"
+
+#if (configARBITER_PORT == CTF2301_ARBITER_FREERTOS)
+#include "FreeRTOS.h"
+#include "semphr.h"
+#elif (configARBITER_PORT == CTF2301_ARBITER_PTHREAD)
+#include <pthread.h>
+#else
+#error "configARBITER_PORT selects an unknown port"
+#endif
+
+#define CTF2301_ARBITER_FOREVER          0xFFFFFFFF     // Timeout that never expires
+
+// Priority classes, highest first
+typedef enum {
+    CTF2301_BUS_ALERT = 0,                  // ALERT / T_CRIT handling
+    CTF2301_BUS_TELEMETRY = 1,              // Periodic reads
+    CTF2301_BUS_CONFIG = 2,                 // Configuration writes
+    CTF2301_BUS_CLASSES
+} CTF2301_BusClass;
+
+// Request waiting for the bus, on the stack of the requesting task
+typedef struct CTF2301_ArbiterWaiter {
+    struct CTF2301_ArbiterWaiter *next;
+    uint32_t queued;                        // Time the request was queued
+    uint8_t granted;                        // Set by the releasing task when it hands the bus over
+#if (configARBITER_PORT == CTF2301_ARBITER_FREERTOS)
+    StaticSemaphore_t signalBuffer;
+    SemaphoreHandle_t signal;
+#else
+    pthread_cond_t signal;
+#endif
+} CTF2301_ArbiterWaiter;
+
+// Fairness accounting of one class. Times are in arbiter clock ticks: FreeRTOS ticks, or µs with POSIX threads.
+typedef struct {
+    uint32_t grants;                        // Times the class got the bus
+    uint32_t promotions;                    // Grants that went ahead of a higher class after configARBITER_MAX_BYPASS
+    uint32_t timeouts;                      // Requests that gave up waiting
+    uint32_t waitMax;                       // Longest wait for the bus
+    uint64_t waitTotal;                     // Sum of all waits, waitTotal / grants is the mean
+    uint32_t holdMax;                       // Longest the class kept the bus
+    uint64_t holdTotal;                     // Sum of all holds
+} CTF2301_ArbiterStats;
+
+struct CTF2301_Arbiter {
+#if (configARBITER_PORT == CTF2301_ARBITER_FREERTOS)
+    StaticSemaphore_t lockBuffer;
+    SemaphoreHandle_t lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    uint8_t busy;                           // A client holds the bus
+    uint8_t ownerClass;                     // Class of that client
+    uint32_t grantedAt;                     // Time the bus was handed to it
+    CTF2301_ArbiterWaiter *head[CTF2301_BUS_CLASSES];
+    CTF2301_ArbiterWaiter *tail[CTF2301_BUS_CLASSES];
+    uint8_t bypassed[CTF2301_BUS_CLASSES];  // Grants that went to a higher class while this one waited
+    CTF2301_ArbiterStats stats[CTF2301_BUS_CLASSES];
+};
+
+// Set up an arbiter, once before any client uses it
+// Return: CTF2301_OK if the arbiter is ready, CTF2301_ERROR if the OS objects can't be created
+uint32_t CTF2301_arbiterInit(CTF2301_Arbiter *arbiter);
+
+// Wait for the bus, from a task only
+// Param: busClass - priority class of the transaction, timeoutMs - longest wait, CTF2301_ARBITER_FOREVER to wait forever
+// Return: CTF2301_OK once the caller holds the bus, CTF2301_ERROR_TIMEOUT if it didn't get it in time
+uint32_t CTF2301_arbiterAcquire(CTF2301_Arbiter *arbiter, CTF2301_BusClass busClass, uint32_t timeoutMs);
+
+// Hand the bus to the next waiting request, or free it
+void CTF2301_arbiterRelease(CTF2301_Arbiter *arbiter);
+
+// Get or clear the fairness accounting
+// Param: stats - array of CTF2301_BUS_CLASSES entries
+void CTF2301_arbiterGetStats(CTF2301_Arbiter *arbiter, CTF2301_ArbiterStats *stats);
+void CTF2301_arbiterResetStats(CTF2301_Arbiter *arbiter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_ARBITER_H_ */
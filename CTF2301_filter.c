@@ -0,0 +1,148 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Temperature filter stage
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+ */
+
+#include "CTF2301_filter.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Set up a filter with the configFILTER_ defaults
+void CTF2301_filterInit(CTF2301_Filter *filter){
+    memset(filter, 0, sizeof(*filter));
+    filter->config.median = configFILTER_MEDIAN;
+    filter->config.emaShift = configFILTER_EMA_SHIFT;
+    filter->config.decimation = configFILTER_DECIMATION;
+    filter->config.slew = configFILTER_SLEW;
+    filter->config.deadband = configFILTER_DEADBAND;
+}
+
+// Start over from the next sample, settings and stats are kept
+void CTF2301_filterReset(CTF2301_Filter *filter){
+    filter->count = 0;
+    filter->phase = 0;
+    filter->primed = 0;
+}
+
+// Median of the window, an insertion sort of at most configFILTER_MEDIAN_MAX values
+// A window widened since it filled up may hold an even count, that takes the lower middle
+static CTF2301_Temp __CTF2301_filterMedian(const CTF2301_Filter *filter){
+    CTF2301_Temp sorted[configFILTER_MEDIAN_MAX];
+    uint8_t n = filter->count;
+    for (uint8_t i = 0; i < n; i++){
+        CTF2301_Temp value = filter->window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > value){
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    return sorted[(n - 1) / 2];
+}
+
+// Push a sample through the filter
+// Return: CTF2301_OK if the output changed, CTF2301_PENDING otherwise, CTF2301_ERROR if the settings are out of range
+uint32_t CTF2301_filterPush(CTF2301_Filter *filter, CTF2301_Temp sample, CTF2301_Temp *output){
+    const CTF2301_FilterConfig *config = &filter->config;
+    uint8_t changedIn;
+    int32_t value;
+    int32_t step;
+
+    if (config->median < 1 || config->median > configFILTER_MEDIAN_MAX || (config->median & 1) == 0
+        || config->emaShift > 8 || config->decimation < 1 || config->slew < 0 || config->deadband < 0){
+        return CTF2301_ERROR;
+    }
+    filter->stats.samples++;
+    changedIn = filter->primed && sample != filter->last;
+    filter->last = sample;
+
+    // Median: slide the window. A window narrowed since the last sample drops all its oldest samples at once.
+    if (filter->count >= config->median){
+        uint8_t drop = filter->count - config->median + 1;
+        memmove(&filter->window[0], &filter->window[drop], (filter->count - drop) * sizeof(filter->window[0]));
+        filter->count -= drop;
+    }
+    filter->window[filter->count++] = sample;
+
+    // Nothing goes out before the window is full, a spike among the first samples would be the output otherwise
+    if (!filter->primed && filter->count < config->median){
+        *output = filter->output;
+        return CTF2301_PENDING;
+    }
+    value = __CTF2301_filterMedian(filter);
+
+    if (!filter->primed){
+        // The first median is the output, there is nothing to hold it against
+        filter->primed = 1;
+        filter->ema = value * (1 << config->emaShift);
+        filter->output = (CTF2301_Temp)value;
+        filter->phase = 0;
+        filter->stats.outputs++;
+        *output = filter->output;
+        return CTF2301_OK;
+    }
+
+    // Moving average, kept with emaShift fractional bits
+    filter->ema += value - ((filter->ema + (1 << config->emaShift >> 1)) >> config->emaShift);
+    value = (filter->ema + (1 << config->emaShift >> 1)) >> config->emaShift;
+
+    *output = filter->output;
+    if (++filter->phase < config->decimation){
+        if (changedIn){
+            filter->stats.suppressed++;
+        }
+        return CTF2301_PENDING;
+    }
+    filter->phase = 0;
+
+    step = value - filter->output;
+    if (abs(step) < config->deadband || step == 0){
+        if (changedIn){
+            filter->stats.suppressed++;
+        }
+        return CTF2301_PENDING;
+    }
+    if (config->slew != 0 && abs(step) > config->slew){
+        step = (step > 0) ? config->slew : -config->slew;
+        filter->stats.slewLimited++;
+    }
+    filter->output += (CTF2301_Temp)step;
+    filter->stats.outputs++;
+    *output = filter->output;
+    return CTF2301_OK;
+}
+
+// Read the remote temperature of a device and push it through the filter
+// Return: as CTF2301_filterPush(), CTF2301_ERROR if the reading fails
+uint32_t CTF2301_filterRemote(CTF2301_Device *dev, CTF2301_Filter *filter, CTF2301_Temp *output){
+    uint16_t raw;
+    if (CTF2301_readRemoteTemp(dev, &raw) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+    return CTF2301_filterPush(filter, CTF2301_decodeRemote(raw), output);
+}
@@ -0,0 +1,106 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Temperature filter stage
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  A CTF2301_Filter sits between sampling and a control loop. Each remote
+  conversion jitters by a few LSbs, and a loop that follows the raw
+  readings keeps moving the fan and writing PWM_VALUE for nothing.
+
+  Every sample goes through, in this order:
+  1. A median of the last N samples, which removes single spikes.
+  2. An exponential moving average, which removes the noise.
+  3. Decimation, so only every Nth sample goes on.
+  4. A deadband, which holds the output until the input has moved far
+     enough from it.
+  5. A slew limiter, which caps the step between two outputs.
+
+  Everything is integer math on CTF2301_Temp, nothing on the M0+ needs float.
+  CTF2301_filterPush() only reports a new output when the value changed, so
+  the loop acts on that alone. The stats show how many actuator writes the
+  stage saved: samples that differed from the one before but didn't change
+  the output.
+
+ */
+
+#ifndef INC_CTF2301_FILTER_H_
+#define INC_CTF2301_FILTER_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "CTF2301.h"
+
+// Settings of a filter, CTF2301_filterInit() loads the configFILTER_ defaults
+typedef struct {
+    uint8_t median;                         // Median window, odd, 1 to configFILTER_MEDIAN_MAX, 1 turns it off
+    uint8_t emaShift;                       // A new sample weighs 1/2^emaShift in the moving average, 0 turns it off
+    uint8_t decimation;                     // Samples in per sample out, 1 passes every sample
+    CTF2301_Temp slew;                      // Largest step between two outputs, 0 for no limit
+    CTF2301_Temp deadband;                  // Output changes smaller than this are held back, 0 passes every change
+} CTF2301_FilterConfig;
+
+typedef struct {
+    uint32_t samples;                       // Samples pushed
+    uint32_t outputs;                       // Outputs that changed, i.e. actuator writes left to do
+    uint32_t suppressed;                    // Samples that changed but left the output alone, actuator writes saved
+    uint32_t slewLimited;                   // Outputs the slew limiter cut short
+} CTF2301_FilterStats;
+
+typedef struct {
+    CTF2301_FilterConfig config;
+    CTF2301_FilterStats stats;
+    CTF2301_Temp window[configFILTER_MEDIAN_MAX];   // Last samples, oldest first once full
+    uint8_t count;                          // Samples in the window
+    uint8_t phase;                          // Samples since the last decimated one
+    uint8_t primed;                         // The average and the output hold a value
+    int32_t ema;                            // Moving average << emaShift
+    CTF2301_Temp last;                      // Last sample pushed
+    CTF2301_Temp output;                    // Current output
+} CTF2301_Filter;
+
+// Set up a filter with the configFILTER_ defaults, change filter->config before the first sample to tune it
+void CTF2301_filterInit(CTF2301_Filter *filter);
+
+// Start over from the next sample, e.g. after a sensor fault, settings and stats are kept
+void CTF2301_filterReset(CTF2301_Filter *filter);
+
+// Push a sample through the filter
+// Param: sample - new reading, output - return the filtered value, the current output if nothing changed
+// Return: CTF2301_OK if the output changed and the control loop should act on it, CTF2301_PENDING otherwise (also
+//         while the median window fills up after init or a reset), CTF2301_ERROR if the settings are out of range
+uint32_t CTF2301_filterPush(CTF2301_Filter *filter, CTF2301_Temp sample, CTF2301_Temp *output);
+
+// Read the remote temperature of a device and push it through the filter
+// Return: as CTF2301_filterPush(), CTF2301_ERROR if the reading fails
+uint32_t CTF2301_filterRemote(CTF2301_Device *dev, CTF2301_Filter *filter, CTF2301_Temp *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_FILTER_H_ */
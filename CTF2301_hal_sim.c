@@ -0,0 +1,361 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Simulated STM32 HAL subset for host builds
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "CTF2301.h"
+#include <string.h>
+
+//PV
+I2C_HandleTypeDef hi2c1;
+I2C_HandleTypeDef hi2c2;
+I2C_HandleTypeDef hi2c3;
+GPIO_TypeDef HAL_SIM_GPIO[2];
+
+uint32_t HAL_SIM_I2C_Latency = 1;
+
+static uint32_t hal_sim_tick;
+static HAL_SIM_I2C_Slave *hal_sim_slaves;
+static I2C_HandleTypeDef *hal_sim_active;
+
+// Find the slave answering to an address on a bus
+static HAL_SIM_I2C_Slave *__HAL_SIM_findSlave(I2C_HandleTypeDef *hi2c, uint16_t devAddress){
+    for (HAL_SIM_I2C_Slave *slave = hal_sim_slaves; slave != NULL; slave = slave->next){
+        if (slave->bus == hi2c && slave->devAddress == (devAddress & 0xFE)){
+            return slave;
+        }
+    }
+    return NULL;
+}
+
+// A slave on the bus holds SDA low, the peripheral can't get a START out
+static uint8_t __HAL_SIM_stuck(I2C_HandleTypeDef *hi2c){
+    for (HAL_SIM_I2C_Slave *slave = hal_sim_slaves; slave != NULL; slave = slave->next){
+        if (slave->bus == hi2c && slave->sdaStuck > 0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Blocking transfer on a stuck bus: the peripheral waits for the bus until its timeout
+static HAL_StatusTypeDef __HAL_SIM_busyTimeout(I2C_HandleTypeDef *hi2c, uint32_t timeout){
+    HAL_SIM_Advance(timeout);
+    hi2c->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+    return HAL_ERROR;
+}
+
+// Carry out a register transfer against the attached slave
+static HAL_StatusTypeDef __HAL_SIM_memTransfer(I2C_HandleTypeDef *hi2c, uint8_t write, uint16_t devAddress, uint16_t memAddress,
+                                               uint8_t *data, uint16_t length){
+    HAL_SIM_I2C_Slave *slave = __HAL_SIM_findSlave(hi2c, devAddress);
+    HAL_StatusTypeDef ret = HAL_OK;
+
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    if (slave == NULL){
+        // Nobody acknowledged the address
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+        return HAL_ERROR;
+    }
+    if (write){
+        if (slave->memWrite != NULL){
+            ret = slave->memWrite(slave, memAddress, data, length);
+        } else {
+            for (uint16_t i = 0; i < length; i++){
+                slave->regs[(memAddress + i) & 0xFF] = data[i];
+            }
+        }
+    } else {
+        if (slave->memRead != NULL){
+            ret = slave->memRead(slave, memAddress, data, length);
+        } else {
+            for (uint16_t i = 0; i < length; i++){
+                data[i] = slave->regs[(memAddress + i) & 0xFF];
+            }
+        }
+    }
+    if (ret != HAL_OK){
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+    }
+    return ret;
+}
+
+// Start an interrupt / DMA transfer, it completes in HAL_SIM_Process()
+static HAL_StatusTypeDef __HAL_SIM_memStart(I2C_HandleTypeDef *hi2c, uint8_t write, uint16_t devAddress, uint16_t memAddress,
+                                            uint8_t *data, uint16_t length){
+    // The peripheral sees the bus busy
+    if (hi2c->simTransfer.active || __HAL_SIM_stuck(hi2c)){
+        return HAL_BUSY;
+    }
+    hi2c->simTransfer.active = 1;
+    hi2c->simTransfer.write = write;
+    hi2c->simTransfer.devAddress = devAddress;
+    hi2c->simTransfer.memAddress = memAddress;
+    hi2c->simTransfer.data = data;
+    hi2c->simTransfer.length = length;
+    hi2c->simTransfer.due = hal_sim_tick + HAL_SIM_I2C_Latency;
+    hi2c->simNext = hal_sim_active;
+    hal_sim_active = hi2c;
+    return HAL_OK;
+}
+
+// The bus a pin is SCL or SDA of
+static I2C_HandleTypeDef *__HAL_SIM_pinBus(GPIO_TypeDef *port, uint16_t pin, uint8_t sda){
+    I2C_HandleTypeDef *handles[3] = { &hi2c1, &hi2c2, &hi2c3 };
+    for (int i = 0; i < 3; i++){
+        if (!sda && handles[i]->simSclPort == port && handles[i]->simSclPin == pin){
+            return handles[i];
+        }
+        if (sda && handles[i]->simSdaPort == port && handles[i]->simSdaPin == pin){
+            return handles[i];
+        }
+    }
+    return NULL;
+}
+
+// Simulator control
+void HAL_SIM_I2C_Attach(HAL_SIM_I2C_Slave *slave){
+    slave->next = hal_sim_slaves;
+    hal_sim_slaves = slave;
+}
+
+void HAL_SIM_I2C_Detach(HAL_SIM_I2C_Slave *slave){
+    for (HAL_SIM_I2C_Slave **link = &hal_sim_slaves; *link != NULL; link = &(*link)->next){
+        if (*link == slave){
+            *link = slave->next;
+            break;
+        }
+    }
+}
+
+void HAL_SIM_I2C_Pins(I2C_HandleTypeDef *hi2c, GPIO_TypeDef *sclPort, uint16_t sclPin, GPIO_TypeDef *sdaPort, uint16_t sdaPin){
+    hi2c->simSclPort = sclPort;
+    hi2c->simSclPin = sclPin;
+    hi2c->simSdaPort = sdaPort;
+    hi2c->simSdaPin = sdaPin;
+}
+
+// Complete every transfer that is due, the way the I2C interrupt handler would
+void HAL_SIM_Process(void){
+    I2C_HandleTypeDef **link = &hal_sim_active;
+    I2C_HandleTypeDef *hi2c;
+    HAL_SIM_Transfer xfer;
+
+    while (*link != NULL){
+        hi2c = *link;
+        if ((int32_t)(hal_sim_tick - hi2c->simTransfer.due) < 0){
+            link = &hi2c->simNext;
+            continue;
+        }
+        // Retire the transfer first, the callback is allowed to start the next one
+        xfer = hi2c->simTransfer;
+        hi2c->simTransfer.active = 0;
+        *link = hi2c->simNext;
+        if (__HAL_SIM_memTransfer(hi2c, xfer.write, xfer.devAddress, xfer.memAddress, xfer.data, xfer.length) != HAL_OK){
+            HAL_I2C_ErrorCallback(hi2c);
+        } else if (xfer.write){
+            HAL_I2C_MemTxCpltCallback(hi2c);
+        } else {
+            HAL_I2C_MemRxCpltCallback(hi2c);
+        }
+        // The list may have changed under us
+        link = &hal_sim_active;
+    }
+}
+
+void HAL_SIM_Advance(uint32_t ticks){
+    hal_sim_tick += ticks;
+    HAL_SIM_Process();
+}
+
+// HAL subset
+uint32_t HAL_GetTick(void){
+    HAL_SIM_Advance(1);
+    return hal_sim_tick;
+}
+
+void HAL_Delay(uint32_t Delay){
+    HAL_SIM_Advance(Delay);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                   uint8_t *pData, uint16_t Size, uint32_t Timeout){
+    (void)MemAddSize;
+    if (hi2c->simTransfer.active){
+        return HAL_BUSY;
+    }
+    if (__HAL_SIM_stuck(hi2c)){
+        return __HAL_SIM_busyTimeout(hi2c, Timeout);
+    }
+    return __HAL_SIM_memTransfer(hi2c, 0, DevAddress, MemAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                    uint8_t *pData, uint16_t Size, uint32_t Timeout){
+    (void)MemAddSize;
+    if (hi2c->simTransfer.active){
+        return HAL_BUSY;
+    }
+    if (__HAL_SIM_stuck(hi2c)){
+        return __HAL_SIM_busyTimeout(hi2c, Timeout);
+    }
+    return __HAL_SIM_memTransfer(hi2c, 1, DevAddress, MemAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                      uint8_t *pData, uint16_t Size){
+    (void)MemAddSize;
+    return __HAL_SIM_memStart(hi2c, 0, DevAddress, MemAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                       uint8_t *pData, uint16_t Size){
+    (void)MemAddSize;
+    return __HAL_SIM_memStart(hi2c, 1, DevAddress, MemAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                       uint8_t *pData, uint16_t Size){
+    return HAL_I2C_Mem_Read_IT(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                        uint8_t *pData, uint16_t Size){
+    return HAL_I2C_Mem_Write_IT(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout){
+    HAL_SIM_I2C_Slave *slave;
+    if (hi2c->simTransfer.active){
+        return HAL_BUSY;
+    }
+    if (__HAL_SIM_stuck(hi2c)){
+        return __HAL_SIM_busyTimeout(hi2c, Timeout);
+    }
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    slave = __HAL_SIM_findSlave(hi2c, DevAddress);
+    if (slave == NULL){
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+        return HAL_ERROR;
+    }
+    if (slave->receive != NULL){
+        if (slave->receive(slave, pData, Size) != HAL_OK){
+            hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+            return HAL_ERROR;
+        }
+        return HAL_OK;
+    }
+    for (uint16_t i = 0; i < Size; i++){
+        pData[i] = slave->regs[i & 0xFF];
+    }
+    return HAL_OK;
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c){
+    return hi2c->ErrorCode;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c){
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    return HAL_OK;
+}
+
+// Drops a transfer in progress without calling back, like disabling the peripheral and its interrupts
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c){
+    for (I2C_HandleTypeDef **link = &hal_sim_active; *link != NULL; link = &(*link)->simNext){
+        if (*link == hi2c){
+            *link = hi2c->simNext;
+            break;
+        }
+    }
+    hi2c->simTransfer.active = 0;
+    return HAL_OK;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init){
+    (void)GPIOx;
+    (void)GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin){
+    (void)GPIOx;
+    (void)GPIO_Pin;
+}
+
+// A rising edge on SCL clocks every slave on the bus that holds SDA
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState){
+    I2C_HandleTypeDef *hi2c = __HAL_SIM_pinBus(GPIOx, GPIO_Pin, 0);
+    uint8_t rising = (PinState == GPIO_PIN_SET) && (GPIOx->ODR & GPIO_Pin) == 0;
+
+    if (PinState == GPIO_PIN_SET){
+        GPIOx->ODR |= GPIO_Pin;
+    } else {
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    }
+    if (hi2c != NULL && rising){
+        for (HAL_SIM_I2C_Slave *slave = hal_sim_slaves; slave != NULL; slave = slave->next){
+            if (slave->bus == hi2c && slave->sdaStuck > 0){
+                slave->sdaStuck--;
+            }
+        }
+    }
+}
+
+// Open drain: SDA reads low while a slave holds it
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin){
+    I2C_HandleTypeDef *hi2c = __HAL_SIM_pinBus(GPIOx, GPIO_Pin, 1);
+    if ((GPIOx->ODR & GPIO_Pin) == 0 || (hi2c != NULL && __HAL_SIM_stuck(hi2c))){
+        return GPIO_PIN_RESET;
+    }
+    return GPIO_PIN_SET;
+}
+
+// Default completion callbacks, override them like on target to add other I2C users
+#if (configUSE_ASYNC_TRANSPORT == 1)
+__attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_I2C_MemTxCpltCallback(hi2c);
+}
+
+__attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_I2C_MemRxCpltCallback(hi2c);
+}
+
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c){
+    CTF2301_I2C_ErrorCallback(hi2c);
+}
+#else
+__attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c){
+    (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c){
+    (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c){
+    (void)hi2c;
+}
+#endif
@@ -0,0 +1,185 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Simulated STM32 HAL subset for host builds
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Build the driver with -DCTF2301_HOST_SIM and link CTF2301_hal_sim.c to run it on a
+  Linux host. Only the functions and types the driver uses are provided.
+
+  Interrupt and DMA transfers are not carried out when they are started. They complete
+  once HAL_SIM_I2C_Latency ticks have passed, the next time HAL_GetTick() or
+  HAL_SIM_Process() runs, and then call the HAL_I2C_ completion callbacks like the
+  real interrupt handler would. Every HAL_GetTick() call advances the simulated clock
+  by one tick so blocking waits make progress.
+
+  A slave can hold SDA low (sdaStuck). Transfers on its bus then fail like on a busy bus
+  until the recovery clocks SCL through the GPIOs given to HAL_SIM_I2C_Pins().
+
+ */
+
+#ifndef INC_CTF2301_HAL_SIM_H_
+#define INC_CTF2301_HAL_SIM_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    HAL_OK       = 0x00,
+    HAL_ERROR    = 0x01,
+    HAL_BUSY     = 0x02,
+    HAL_TIMEOUT  = 0x03
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY                    0xFFFFFFFFU
+#define I2C_MEMADD_SIZE_8BIT             0x00000001U
+
+#define HAL_I2C_ERROR_NONE               0x00000000U
+#define HAL_I2C_ERROR_AF                 0x00000004U    // Acknowledge failure
+#define HAL_I2C_ERROR_TIMEOUT            0x00000020U    // Bus stayed busy
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+    uint32_t ODR;                           // Output levels, open drain: 1 releases the line
+} GPIO_TypeDef;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODE_OUTPUT_OD              0x00000011U
+#define GPIO_NOPULL                      0x00000000U
+#define GPIO_SPEED_FREQ_LOW              0x00000000U
+
+extern GPIO_TypeDef HAL_SIM_GPIO[2];
+#define GPIOA                            (&HAL_SIM_GPIO[0])
+#define GPIOB                            (&HAL_SIM_GPIO[1])
+
+// Transfer started with an _IT or _DMA function and not completed yet
+typedef struct {
+    uint8_t  active;
+    uint8_t  write;
+    uint16_t devAddress;
+    uint16_t memAddress;
+    uint8_t *data;
+    uint16_t length;
+    uint32_t due;                           // Tick at which the transfer completes
+} HAL_SIM_Transfer;
+
+typedef struct __I2C_HandleTypeDef {
+    void *Instance;
+    volatile uint32_t ErrorCode;
+    HAL_SIM_Transfer simTransfer;
+    struct __I2C_HandleTypeDef *simNext;    // List of handles with transfers in progress
+    GPIO_TypeDef *simSclPort;               // Pins of the bus, see HAL_SIM_I2C_Pins()
+    uint16_t simSclPin;
+    GPIO_TypeDef *simSdaPort;
+    uint16_t simSdaPin;
+} I2C_HandleTypeDef;
+
+// Simulated I2C slave with 8-bit register addressing
+// memRead / memWrite / receive may be left NULL, the slave then behaves as a plain 256 byte register file
+// and plain reads return the registers from 0x00.
+typedef struct HAL_SIM_I2C_Slave {
+    I2C_HandleTypeDef *bus;
+    uint16_t devAddress;                    // Address as passed to the HAL, i.e. 7-bit address << 1
+    HAL_StatusTypeDef (*memRead)(struct HAL_SIM_I2C_Slave *slave, uint16_t memAddress, uint8_t *data, uint16_t length);
+    HAL_StatusTypeDef (*memWrite)(struct HAL_SIM_I2C_Slave *slave, uint16_t memAddress, const uint8_t *data, uint16_t length);
+    HAL_StatusTypeDef (*receive)(struct HAL_SIM_I2C_Slave *slave, uint8_t *data, uint16_t length);
+    void *context;
+    uint32_t sdaStuck;                      // SCL clocks the slave still holds SDA low for, 0 when it doesn't
+    uint8_t regs[256];
+    struct HAL_SIM_I2C_Slave *next;
+} HAL_SIM_I2C_Slave;
+
+// I2C handles the driver refers to
+extern I2C_HandleTypeDef hi2c1;
+extern I2C_HandleTypeDef hi2c2;
+extern I2C_HandleTypeDef hi2c3;
+
+// Ticks an _IT / _DMA transfer takes to complete, default is 1
+extern uint32_t HAL_SIM_I2C_Latency;
+
+// Simulator control
+void HAL_SIM_I2C_Attach(HAL_SIM_I2C_Slave *slave);
+void HAL_SIM_I2C_Detach(HAL_SIM_I2C_Slave *slave);
+void HAL_SIM_I2C_Pins(I2C_HandleTypeDef *hi2c, GPIO_TypeDef *sclPort, uint16_t sclPin, GPIO_TypeDef *sdaPort, uint16_t sdaPin);
+void HAL_SIM_Advance(uint32_t ticks);
+void HAL_SIM_Process(void);
+
+// HAL subset
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                   uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                    uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                      uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                       uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                       uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                        uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+// CMSIS interrupt masking, the simulator runs everything on one thread
+static inline uint32_t __get_PRIMASK(void){ return 0; }
+static inline void __set_PRIMASK(uint32_t priMask){ (void)priMask; }
+static inline void __disable_irq(void){ }
+static inline void __enable_irq(void){ }
+static inline void __DMB(void){ __sync_synchronize(); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_HAL_SIM_H_ */
@@ -0,0 +1,141 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Lookup table fitter, host tool
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Compiles a fan curve into the 12 entries and hysteresis of the Auto-Temp
+  lookup table with CTF2301_fitLookupTable() and prints them as the
+  configLUT_ defines of CTF2301.h or as a CTF2301_LookupTable for
+  CTF2301_setLookupTable().
+
+  gcc -DCTF2301_HOST_SIM -I. -o lutfit CTF2301_lutfit.c CTF2301.c CTF2301_hal_sim.c
+  ./lutfit [-r 1|0.5] [-p 16|255] [-H hysteresis] [-t name] [curve.csv]
+
+  -r  LUT temperature resolution in °C, default 1
+  -p  PWM code of 100%: 16 for 6.25% steps, 255 for 0.39%, default 16
+  -H  narrowest hysteresis in °C, default 0
+  -t  print a runtime table with this name instead of the defines, needed for 0.5°C
+  The curve is read from the file or stdin, one "temperature,duty" line per point, °C and %, ascending.
+  Lines starting with # are skipped.
+
+ */
+
+#include "CTF2301.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LUTFIT_MAX_POINTS                1024
+
+static double percent(uint32_t duty){
+    return duty * 100.0 / CTF2301_DUTY_FULL;
+}
+
+int main(int argc, char **argv){
+    static CTF2301_CurvePoint curve[LUTFIT_MAX_POINTS];
+    CTF2301_LookupTable lut;
+    CTF2301_LutFit fit;
+    uint16_t points = 0;
+    uint8_t resolution = CTF2301_LUT_RES_1C;
+    uint16_t fullScale = CTF2301_PWM_STEPS_6_25;
+    uint8_t hystMin = 0;
+    const char *table = NULL;
+    char line[128];
+    FILE *in = stdin;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:p:H:t:")) != -1){
+        switch (opt){
+            case 'r':   resolution = (atof(optarg) == 0.5) ? CTF2301_LUT_RES_0_5C : CTF2301_LUT_RES_1C; break;
+            case 'p':   fullScale = (uint16_t)atoi(optarg); break;
+            case 'H':   hystMin = (uint8_t)atoi(optarg); break;
+            case 't':   table = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-r 1|0.5] [-p 16|255] [-H hysteresis] [-t name] [curve.csv]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (resolution == CTF2301_LUT_RES_0_5C && table == NULL){
+        fprintf(stderr, "the configLUT_ defines are whole °C, use -t for 0.5°C resolution\n");
+        return 2;
+    }
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL){
+        perror(argv[optind]);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL){
+        double temp, duty;
+        if (line[0] == '#' || sscanf(line, "%lf,%lf", &temp, &duty) != 2){
+            continue;
+        }
+        if (points == LUTFIT_MAX_POINTS){
+            fprintf(stderr, "more than %d points\n", LUTFIT_MAX_POINTS);
+            return 1;
+        }
+        curve[points].temp = (CTF2301_Temp)(temp * 32 + ((temp < 0) ? -0.5 : 0.5));
+        curve[points].duty = (uint32_t)(duty * CTF2301_DUTY_FULL / 100 + 0.5);
+        points++;
+    }
+    if (in != stdin){
+        fclose(in);
+    }
+
+    if (CTF2301_fitLookupTable(curve, points, resolution, fullScale, hystMin, &lut, &fit) != CTF2301_OK){
+        fprintf(stderr, "invalid curve or settings: temperatures must ascend, duty cycles be 0 to 100%%, -p 1 to 255\n");
+        return 1;
+    }
+
+    printf("// Fitted from %u points, %u entries used, PWM code %u is 100%%\n", points, fit.entries, fullScale);
+    printf("// Largest error %.2f%% with the temperature rising, %.2f%% falling\n",
+           percent(fit.errorRising), percent(fit.errorFalling));
+    if (table == NULL){
+        printf("#define configLUT_HYST                    0x%02X  // LOOKUP_TABLE_HYST\n\n", lut.hysteresis);
+        printf("// Temperature (in °C)\n");
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            printf("#define configLUT_TEMP_ENTRY_%-2d %14u  // %u°C\n", i + 1, lut.temp[i], lut.temp[i]);
+        }
+        printf("\n// PWM Duty Cycle\n");
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            printf("#define configLUT_PWM_ENTRY_%-2d %14u   // %.1f%%\n", i + 1, lut.pwm[i], lut.pwm[i] * 100.0 / fullScale);
+        }
+    } else {
+        printf("static const CTF2301_LookupTable %s = {\n", table);
+        printf("    .temp = {");
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            printf((resolution == CTF2301_LUT_RES_0_5C) ? "CTF2301_LUT_TEMP_0_5C(%u)%s" : "CTF2301_LUT_TEMP_1C(%u)%s",
+                   lut.temp[i], (i + 1 < CTF2301_LUT_ENTRIES) ? ((i % 4 == 3) ? ",\n             " : ", ") : "},\n");
+        }
+        printf("    .pwm  = {");
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            printf("%u%s", lut.pwm[i], (i + 1 < CTF2301_LUT_ENTRIES) ? ", " : "},\n");
+        }
+        printf("    .hysteresis = %u,\n", lut.hysteresis);
+        printf("    .resolution = %s\n", (resolution == CTF2301_LUT_RES_0_5C) ? "CTF2301_LUT_RES_0_5C" : "CTF2301_LUT_RES_1C");
+        printf("};\n");
+    }
+    return 0;
+}
@@ -0,0 +1,566 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  In-memory CTF2301 for host builds
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "CTF2301_sim.h"
+#include "CTF2301.h"
+#include <stdlib.h>
+#include <string.h>
+
+//PV
+// Register contents after power-on, everything not listed reads 0x00
+static const struct {
+    CTF2301_Register address;
+    uint8_t value;
+} ctf2301_simPorValues[] = {
+    { CONVERSION_RATE,          0x08 },
+    { LOCAL_HIGH_SETPOINT_MSB,  0x46 },
+    { REMOTE_HIGH_SETPOINT_MSB, 0x46 },
+    { ALERT_MASK,               0xA4 },
+    { REMOTE_T_CRIT_SETPOINT,   0x6E },
+    { REMOTE_T_CRIT_HYST,       0x0A },
+    { REMOTE_DIODE_BETA_COMP,   0x08 },
+    { TACH_LIMIT_LSB,           0xFF },
+    { TACH_LIMIT_MSB,           0xFF },
+    { TACH_COUNT_LSB,           0xFF },
+    { TACH_COUNT_MSB,           0xFF },
+    { PWM_TACH_CONFIG,          0x20 },
+    { FAN_SPIN_UP_CONFIG,       0x3F },
+    { PWM_FREQ,                 0x17 },
+    { LOOKUP_TABLE_HYST,        0x04 },
+    { STEP_DIE_REV_ID,          CTF2301_STEP_DIE_REV_ID },
+    { MANUFACTURER_ID,          CTF2301_MANUFACTURER_ID }
+};
+
+// Conversion period for each CONVERSION_RATE value, anything above 0x08 runs at 9.303Hz
+static const uint32_t ctf2301_simConversionUs[9] = {
+    20000000, 10000000, 4902000, 2463000, 1000000, 615000, 307000, 154000, 107500
+};
+
+// Write addresses that alias a register, see the CTF2301_Register comments
+#define CTF2301_SIM_CONFIG_WR            0x09
+#define CTF2301_SIM_CONVERSION_RATE_WR   0x0A
+#define CTF2301_SIM_LOCAL_HIGH_WR        0x0B
+#define CTF2301_SIM_REMOTE_HIGH_WR       0x0D
+#define CTF2301_SIM_REMOTE_LOW_WR        0x0E
+
+// Slots of CTF2301_SimChip.latch
+#define CTF2301_SIM_LATCH_LOCAL          0
+#define CTF2301_SIM_LATCH_REMOTE         1
+#define CTF2301_SIM_LATCH_UNSIGNED       2
+#define CTF2301_SIM_LATCH_TACH           3
+
+static int32_t __CTF2301_simClamp(int32_t value, int32_t min, int32_t max){
+    return (value < min) ? min : ((value > max) ? max : value);
+}
+
+// m°C to a count of 1/scale °C, rounded to nearest
+static int32_t __CTF2301_simScale(int32_t milli, int32_t scale){
+    int64_t v = (int64_t)milli * scale;
+    return (int32_t)((v >= 0) ? (v + 500) / 1000 : (v - 500) / 1000);
+}
+
+// Setpoint register pair to m°C, the LSB holds eighths of a degree in bits 7:5
+static int32_t __CTF2301_simSetpoint(CTF2301_SimChip *chip, CTF2301_Register msb, int lsb){
+    int32_t whole = (chip->regs[ENHANCED_CONFIG] & 0x08) ? chip->regs[msb] : (int8_t)chip->regs[msb];
+    return whole * 1000 + ((lsb >= 0) ? (chip->regs[lsb] >> 5) * 125 : 0);
+}
+
+// PWM duty cycle in ‰ from PWM_VALUE, full scale is twice PWM_FREQ
+static uint32_t __CTF2301_simDuty(CTF2301_SimChip *chip){
+    // High resolution counts in 0.39% steps, otherwise in halves of the PWM_FREQ divider
+    uint32_t fullScale = (chip->regs[ENHANCED_CONFIG] & 0x10) ? 255 : 2 * (chip->regs[PWM_FREQ] & 0x1F);
+    uint32_t value = chip->regs[PWM_VALUE];
+    if (fullScale == 0){
+        return 0;
+    }
+    return (value >= fullScale) ? 1000 : value * 1000 / fullScale;
+}
+
+// Auto-Temp Mode: pick the look-up table entry for the remote temperature
+// The step goes up as soon as the temperature reaches an entry and only comes down once the temperature
+// drops LOOKUP_TABLE_HYST below it.
+static void __CTF2301_simLookup(CTF2301_SimChip *chip, int32_t remote){
+    int32_t unit = (chip->regs[ENHANCED_CONFIG] & 0x20) ? 500 : 1000;
+    int32_t hyst = chip->regs[LOOKUP_TABLE_HYST] * 1000;
+    int8_t step = -1;
+    for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+        if (remote >= chip->regs[LOOKUP_TABLE_TEMP_1 + 2 * i] * unit){
+            step = i;
+        }
+    }
+    while (chip->lutStep > step && remote < chip->regs[LOOKUP_TABLE_TEMP_1 + 2 * chip->lutStep] * unit - hyst){
+        chip->lutStep--;
+    }
+    if (step > chip->lutStep){
+        chip->lutStep = step;
+    }
+    chip->regs[PWM_VALUE] = (chip->lutStep >= 0) ? chip->regs[LOOKUP_TABLE_PWM_1 + 2 * chip->lutStep] : 0x00;
+}
+
+// End of a conversion: publish the results, evaluate the limits and update the Auto-Temp PWM
+static void __CTF2301_simConvert(CTF2301_SimChip *chip){
+    int32_t local = chip->localTemp;
+    int32_t remote = chip->remoteTemp;
+    int32_t raw;
+    uint8_t status = 0x00;
+    uint8_t remoteOut = 0;
+    uint8_t lsbMask = (chip->regs[ENHANCED_CONFIG] & 0x40) ? 0xF8 : 0xE0;
+
+    // Diode model: a fixed error, the beta compensation setting and noise, then the filter
+    remote += chip->remoteError;
+    if (chip->regs[REMOTE_DIODE_BETA_COMP] & CTF2301_BETA_AUTO){
+        remote += chip->remoteBetaAutoError;
+    } else {
+        remote += abs((chip->regs[REMOTE_DIODE_BETA_COMP] & 0x07) - chip->remoteBeta) * 2000;
+    }
+    if (chip->remoteNoise != 0){
+        chip->noiseSeed = chip->noiseSeed * 1103515245 + 12345;
+        remote += (int32_t)((chip->noiseSeed >> 16) % (2 * chip->remoteNoise + 1)) - chip->remoteNoise;
+    }
+    switch ((chip->regs[REMOTE_DIODE_TEMP_FILTER] >> 1) & 0x03){
+        case 0:     chip->remoteFiltered = remote; break;
+        case 3:     chip->remoteFiltered += (remote - chip->remoteFiltered) / 8; break;
+        default:    chip->remoteFiltered += (remote - chip->remoteFiltered) / 4; break;
+    }
+    remote = chip->remoteFiltered;
+    // Remote offset: signed degrees in the MSB, eighths of a degree in LSB bits 7:5
+    remote += (int8_t)chip->regs[REMOTE_TEMP_OFFSET_MSB] * 1000 + (chip->regs[REMOTE_TEMP_OFFSET_LSB] >> 5) * 125;
+    if (chip->remoteOpen){
+        // An open diode reads full scale
+        remote = 127875;
+        status |= ALERT_STATUS_REMOTE_DIODE_FAULT;
+    }
+
+    raw = __CTF2301_simClamp(__CTF2301_simScale(local, 16), -2048, 2047) << 4;
+    chip->regs[LOCAL_TEMP] = (raw >> 8) & 0xFF;
+    chip->regs[LOCAL_TEMP_LSB] = raw & 0xF0;
+    raw = __CTF2301_simClamp(__CTF2301_simScale(remote, 32), -4096, 4095) << 3;
+    chip->regs[REMOTE_TEMP_MSB] = (raw >> 8) & 0xFF;
+    chip->regs[REMOTE_TEMP_LSB] = raw & lsbMask;
+    raw = __CTF2301_simClamp(__CTF2301_simScale(remote, 32), 0, 8191) << 3;
+    chip->regs[REMOTE_TEMP_UNSIGNED_MSB] = (raw >> 8) & 0xFF;
+    chip->regs[REMOTE_TEMP_UNSIGNED_LSB] = raw & lsbMask;
+
+    if (local > __CTF2301_simSetpoint(chip, LOCAL_HIGH_SETPOINT_MSB, LOCAL_HIGH_SETPOINT_LSB)){
+        status |= ALERT_STATUS_LOCAL_HIGH;
+    }
+    if (remote > __CTF2301_simSetpoint(chip, REMOTE_HIGH_SETPOINT_MSB, REMOTE_HIGH_SETPOINT_LSB)){
+        remoteOut = ALERT_STATUS_REMOTE_HIGH;
+    } else if (remote <= __CTF2301_simSetpoint(chip, REMOTE_LOW_SETPOINT_MSB, REMOTE_LOW_SETPOINT_LSB)){
+        remoteOut = ALERT_STATUS_REMOTE_LOW;
+    }
+    // With the fault queue enabled the remote limits need three conversions in a row
+    chip->faultQueue = remoteOut ? chip->faultQueue + 1 : 0;
+    if (remoteOut && ((chip->regs[CONFIG] & 0x04) == 0 || chip->faultQueue >= 3)){
+        status |= remoteOut;
+    }
+    if (remote >= __CTF2301_simSetpoint(chip, REMOTE_T_CRIT_SETPOINT, -1)){
+        chip->tCrit = 1;
+    } else if (remote < __CTF2301_simSetpoint(chip, REMOTE_T_CRIT_SETPOINT, -1) - chip->regs[REMOTE_T_CRIT_HYST] * 1000){
+        chip->tCrit = 0;
+    }
+    if (chip->tCrit){
+        status |= ALERT_STATUS_REMOTE_T_CRIT_ALARM;
+    }
+    // Fan slower than the TACH limit, the power-on limit of 0xFFFF never trips
+    if ((chip->regs[TACH_COUNT_LSB] | (chip->regs[TACH_COUNT_MSB] << 8)) > (chip->regs[TACH_LIMIT_LSB] | (chip->regs[TACH_LIMIT_MSB] << 8))){
+        status |= ALERT_STATUS_TACH_ALARM;
+    }
+    chip->status |= status;
+
+    // Auto-Temp Mode drives the PWM from the table, with programming enabled the host does
+    if ((chip->regs[PWM_TACH_CONFIG] & 0x20) == 0){
+        __CTF2301_simLookup(chip, remote);
+    }
+    chip->conversions++;
+}
+
+// Fan and TACH, runs once per millisecond
+static void __CTF2301_simFan(CTF2301_SimChip *chip){
+    int64_t target = (int64_t)chip->fanMaxRPM * __CTF2301_simDuty(chip) * 256 / 1000;
+    uint32_t rpm;
+    uint32_t count = 0xFFFF;
+    if (chip->fanTauMs > 0){
+        chip->fanRPM += (target - chip->fanRPM) / (chip->fanTauMs + 1);
+    } else {
+        chip->fanRPM = target;
+    }
+    rpm = (uint32_t)(chip->fanRPM >> 8);
+    // Below the lowest measurable speed the count saturates
+    if (rpm > 0 && CTF2301_SIM_TACH_CLOCK / rpm < 0xFFFF){
+        count = CTF2301_SIM_TACH_CLOCK / rpm;
+    }
+    chip->regs[TACH_COUNT_LSB] = count & 0xFF;
+    chip->regs[TACH_COUNT_MSB] = count >> 8;
+}
+
+// One millisecond of chip time
+static void __CTF2301_simTick(CTF2301_SimChip *chip){
+    uint8_t rate = chip->regs[CONVERSION_RATE];
+    if (chip->porDoneUs != 0 && chip->timeUs >= chip->porDoneUs){
+        chip->regs[POR_STATUS] = 0x00;
+        chip->porDoneUs = 0;
+    }
+    if (chip->converting && chip->timeUs >= chip->conversionEndUs){
+        chip->converting = 0;
+        __CTF2301_simConvert(chip);
+    }
+    // Standby stops the conversions, a ONE_SHOT write still starts one
+    if (!chip->converting && chip->regs[POR_STATUS] == 0x00
+        && (((chip->regs[CONFIG] & 0x40) == 0 && chip->timeUs >= chip->nextConversionUs) || chip->oneShot)){
+        chip->converting = 1;
+        chip->oneShot = 0;
+        chip->conversionEndUs = chip->timeUs + CTF2301_SIM_CONVERSION_US;
+        chip->nextConversionUs = chip->timeUs + ctf2301_simConversionUs[(rate > 0x08) ? 0x08 : rate];
+    }
+    __CTF2301_simFan(chip);
+}
+
+// Bring a chip up to a point in time
+static void __CTF2301_simRun(CTF2301_SimChip *chip, uint64_t until){
+    uint64_t next;
+    while (chip->timeUs < until){
+        next = (chip->timeUs / 1000 + 1) * 1000;
+        if (next > until){
+            chip->timeUs = until;
+            break;
+        }
+        chip->timeUs = next;
+        __CTF2301_simTick(chip);
+    }
+}
+
+// Register read as seen from the bus
+static uint8_t __CTF2301_simReadReg(CTF2301_SimChip *chip, uint8_t address){
+    uint8_t value = chip->regs[address];
+    switch (address){
+        // Reading the MSB latches the LSB so the pair belongs to one conversion
+        case LOCAL_TEMP:                chip->latch[CTF2301_SIM_LATCH_LOCAL] = chip->regs[LOCAL_TEMP_LSB]; break;
+        case LOCAL_TEMP_LSB:            value = chip->latch[CTF2301_SIM_LATCH_LOCAL]; break;
+        case REMOTE_TEMP_MSB:           chip->latch[CTF2301_SIM_LATCH_REMOTE] = chip->regs[REMOTE_TEMP_LSB]; break;
+        case REMOTE_TEMP_LSB:           value = chip->latch[CTF2301_SIM_LATCH_REMOTE]; break;
+        case REMOTE_TEMP_UNSIGNED_MSB:  chip->latch[CTF2301_SIM_LATCH_UNSIGNED] = chip->regs[REMOTE_TEMP_UNSIGNED_LSB]; break;
+        case REMOTE_TEMP_UNSIGNED_LSB:  value = chip->latch[CTF2301_SIM_LATCH_UNSIGNED]; break;
+        // TACH latches the other way round, reading the LSB freezes the MSB
+        case TACH_COUNT_LSB:            chip->latch[CTF2301_SIM_LATCH_TACH] = chip->regs[TACH_COUNT_MSB]; break;
+        case TACH_COUNT_MSB:            value = chip->latch[CTF2301_SIM_LATCH_TACH]; break;
+        case ALERT_STATUS:
+            // Latched bits clear on read, conditions still present come back with the next conversion
+            value = chip->status | (chip->converting ? ALERT_STATUS_BUSY : 0x00);
+            chip->status = 0x00;
+            chip->alertAcked = 0;
+            break;
+        case CTF2301_SIM_CONFIG_WR:
+        case CTF2301_SIM_CONVERSION_RATE_WR:
+        case CTF2301_SIM_LOCAL_HIGH_WR:
+        case CTF2301_SIM_REMOTE_HIGH_WR:
+        case CTF2301_SIM_REMOTE_LOW_WR:
+        case ONE_SHOT:
+            value = 0x00;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+// Register write as seen from the bus, writes to read-only registers are acknowledged and dropped
+static void __CTF2301_simWriteReg(CTF2301_SimChip *chip, uint8_t address, uint8_t value){
+    uint8_t programming = (chip->regs[PWM_TACH_CONFIG] & 0x20) != 0;
+    switch (address){
+        case CTF2301_SIM_CONFIG_WR:             address = CONFIG; break;
+        case CTF2301_SIM_CONVERSION_RATE_WR:    address = CONVERSION_RATE; break;
+        case CTF2301_SIM_LOCAL_HIGH_WR:         address = LOCAL_HIGH_SETPOINT_MSB; break;
+        case CTF2301_SIM_REMOTE_HIGH_WR:        address = REMOTE_HIGH_SETPOINT_MSB; break;
+        case CTF2301_SIM_REMOTE_LOW_WR:         address = REMOTE_LOW_SETPOINT_MSB; break;
+        default: break;
+    }
+    switch (address){
+        case LOCAL_TEMP:
+        case REMOTE_TEMP_MSB:
+        case ALERT_STATUS:
+        case REMOTE_TEMP_LSB:
+        case LOCAL_TEMP_LSB:
+        case REMOTE_TEMP_UNSIGNED_MSB:
+        case REMOTE_TEMP_UNSIGNED_LSB:
+        case POR_STATUS:
+        case NC_FACTORY:
+        case TACH_COUNT_LSB:
+        case TACH_COUNT_MSB:
+        case STEP_DIE_REV_ID:
+        case MANUFACTURER_ID:
+            return;
+        case ONE_SHOT:
+            chip->oneShot = 1;
+            return;
+        case FAN_SPIN_UP_CONFIG:
+        case PWM_VALUE:
+        case PWM_FREQ:
+            // Only writable while PWM programming is enabled
+            if (!programming){
+                return;
+            }
+            break;
+        case PWM_TACH_CONFIG:
+            if (programming && (value & 0x20) == 0){
+                // Entering Auto-Temp Mode, start from the bottom of the table
+                chip->lutStep = -1;
+            }
+            break;
+        default:
+            if (address >= LOOKUP_TABLE_TEMP_1 && address <= LOOKUP_TABLE_PWM_12 && !programming){
+                return;
+            }
+            break;
+    }
+    chip->regs[address] = value;
+}
+
+// Put a transaction on the wire and let its time pass
+static void __CTF2301_simWire(CTF2301_SimBus *bus, uint32_t bytes){
+    uint32_t us = bus->latencyUs + bytes * bus->byteUs;
+    bus->transactions++;
+    bus->bytes += bytes;
+    bus->busyUs += us;
+    CTF2301_simAdvance(bus, us);
+}
+
+// A chip holding SDA low, the master can't even send a START then
+static uint8_t __CTF2301_simStuck(CTF2301_SimBus *bus){
+    for (CTF2301_SimChip *chip = bus->chips; chip != NULL; chip = chip->next){
+        if (chip->sdaStuck > 0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Time a transaction and find the chip that acknowledges it, if any
+static CTF2301_SimChip *__CTF2301_simTransaction(CTF2301_SimBus *bus, uint8_t i2cAddr, uint32_t bytes){
+    CTF2301_SimChip *chip;
+    __CTF2301_simWire(bus, bytes);
+    for (chip = bus->chips; chip != NULL; chip = chip->next){
+        if (chip->i2cAddr != i2cAddr){
+            continue;
+        }
+        chip->transactions++;
+        if (chip->nackNext > 0){
+            chip->nackNext--;
+            break;
+        }
+        if (chip->nackEvery > 0 && chip->transactions % chip->nackEvery == 0){
+            break;
+        }
+        return chip;
+    }
+    bus->nacks++;
+    return NULL;
+}
+
+// Set up an empty bus
+void CTF2301_simBusInit(CTF2301_SimBus *bus, uint32_t clockHz){
+    memset(bus, 0, sizeof(*bus));
+    // 8 data bits and the ACK
+    bus->byteUs = (clockHz > 0) ? 9000000 / clockHz : 0;
+}
+
+// Set up a chip that has been powered for a while
+void CTF2301_simChipInit(CTF2301_SimChip *chip, uint8_t i2cAddr){
+    memset(chip, 0, sizeof(*chip));
+    chip->i2cAddr = i2cAddr;
+    chip->localTemp = 25000;
+    chip->remoteTemp = 25000;
+    chip->fanTauMs = 500;
+    CTF2301_simPowerCycle(chip);
+    chip->regs[POR_STATUS] = 0x00;
+    chip->porDoneUs = 0;
+}
+
+// Power cycle a chip
+void CTF2301_simPowerCycle(CTF2301_SimChip *chip){
+    memset(chip->regs, 0, sizeof(chip->regs));
+    for (size_t i = 0; i < sizeof(ctf2301_simPorValues) / sizeof(ctf2301_simPorValues[0]); i++){
+        chip->regs[ctf2301_simPorValues[i].address] = ctf2301_simPorValues[i].value;
+    }
+    // The look-up table temperatures power up at 127°C
+    for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+        chip->regs[LOOKUP_TABLE_TEMP_1 + 2 * i] = 0x7F;
+    }
+    chip->regs[POR_STATUS] = 0x01;
+    chip->porDoneUs = chip->timeUs + CTF2301_SIM_POR_US;
+    chip->nextConversionUs = chip->porDoneUs;
+    chip->converting = 0;
+    chip->oneShot = 0;
+    chip->status = 0x00;
+    chip->alertAcked = 0;
+    chip->pointer = 0x00;
+    chip->tCrit = 0;
+    chip->faultQueue = 0;
+    chip->lutStep = -1;
+    chip->fanRPM = 0;
+}
+
+// Put a chip on a bus, its clock joins the bus clock
+void CTF2301_simAttach(CTF2301_SimBus *bus, CTF2301_SimChip *chip){
+    uint64_t delta = bus->timeUs - chip->timeUs;
+    chip->timeUs += delta;
+    chip->nextConversionUs += delta;
+    chip->conversionEndUs += delta;
+    if (chip->porDoneUs != 0){
+        chip->porDoneUs += delta;
+    }
+    chip->next = bus->chips;
+    bus->chips = chip;
+}
+
+// Take a chip off a bus
+void CTF2301_simDetach(CTF2301_SimBus *bus, CTF2301_SimChip *chip){
+    CTF2301_SimChip **link;
+    for (link = &bus->chips; *link != NULL; link = &(*link)->next){
+        if (*link == chip){
+            *link = chip->next;
+            break;
+        }
+    }
+}
+
+// Let time pass on a bus and the chips on it
+void CTF2301_simAdvance(CTF2301_SimBus *bus, uint32_t us){
+    CTF2301_SimChip *chip;
+    bus->timeUs += us;
+    for (chip = bus->chips; chip != NULL; chip = chip->next){
+        __CTF2301_simRun(chip, bus->timeUs);
+    }
+}
+
+// Bus recovery: 9 SCL pulses and a STOP
+// Return: CTF2301_OK if SDA is free afterwards, CTF2301_ERROR otherwise
+uint32_t CTF2301_simRecover(CTF2301_SimBus *bus){
+    // 10 clocks, byteUs covers 9
+    uint32_t us = bus->latencyUs + bus->byteUs * 10 / 9;
+    bus->recoveries++;
+    bus->busyUs += us;
+    CTF2301_simAdvance(bus, us);
+    for (CTF2301_SimChip *chip = bus->chips; chip != NULL; chip = chip->next){
+        chip->sdaStuck = (chip->sdaStuck > 9) ? chip->sdaStuck - 9 : 0;
+    }
+    return __CTF2301_simStuck(bus) ? CTF2301_ERROR : CTF2301_OK;
+}
+
+// State of the ALERT output
+// Return: 1 if the chip pulls ALERT low, 0 otherwise
+uint8_t CTF2301_simAlert(CTF2301_SimChip *chip){
+    // CONFIG bit 7 masks ALERT, bit 4 turns the pin into the TACH input
+    if ((chip->regs[CONFIG] & 0x90) || chip->alertAcked){
+        return 0;
+    }
+    return (chip->status & ~chip->regs[ALERT_MASK] & ~ALERT_STATUS_BUSY) != 0;
+}
+
+// Current fan speed
+// Return: RPM
+uint32_t CTF2301_simFanRPM(CTF2301_SimChip *chip){
+    return (uint32_t)(chip->fanRPM >> 8);
+}
+
+// Read registers
+// Return: CTF2301_OK if a chip acknowledges, CTF2301_ERROR_NACK if none does, CTF2301_ERROR if SDA is held low
+uint32_t CTF2301_simRead(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t reg, uint8_t *data, uint16_t length){
+    if (__CTF2301_simStuck(bus)){
+        bus->stuck++;
+        return CTF2301_ERROR;
+    }
+    // Address + register pointer, repeated start + address, data
+    CTF2301_SimChip *chip = __CTF2301_simTransaction(bus, i2cAddr, 3 + length);
+    if (chip == NULL){
+        return CTF2301_ERROR_NACK;
+    }
+    for (uint16_t i = 0; i < length; i++){
+        data[i] = __CTF2301_simReadReg(chip, (uint8_t)(reg + i));
+    }
+    chip->pointer = (uint8_t)(reg + length);
+    return CTF2301_OK;
+}
+
+// Write registers
+// Return: CTF2301_OK if a chip acknowledges, CTF2301_ERROR_NACK if none does, CTF2301_ERROR if SDA is held low
+uint32_t CTF2301_simWrite(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t reg, const uint8_t *data, uint16_t length){
+    if (__CTF2301_simStuck(bus)){
+        bus->stuck++;
+        return CTF2301_ERROR;
+    }
+    // Address + register pointer, data
+    CTF2301_SimChip *chip = __CTF2301_simTransaction(bus, i2cAddr, 2 + length);
+    if (chip == NULL){
+        return CTF2301_ERROR_NACK;
+    }
+    for (uint16_t i = 0; i < length; i++){
+        __CTF2301_simWriteReg(chip, (uint8_t)(reg + i), data[i]);
+    }
+    chip->pointer = (uint8_t)(reg + length);
+    return CTF2301_OK;
+}
+
+// Plain read
+// Return: CTF2301_OK if a chip acknowledges, CTF2301_ERROR_NACK if none does, CTF2301_ERROR if SDA is held low
+uint32_t CTF2301_simReceive(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t *data, uint16_t length){
+    CTF2301_SimChip *chip;
+    CTF2301_SimChip *winner = NULL;
+
+    if (__CTF2301_simStuck(bus)){
+        bus->stuck++;
+        return CTF2301_ERROR;
+    }
+    if (i2cAddr == (configDEVICE_ALERT_RESPONSE_ADDR >> 1)){
+        // Address, data
+        __CTF2301_simWire(bus, 1 + length);
+        for (chip = bus->chips; chip != NULL; chip = chip->next){
+            if (CTF2301_simAlert(chip) && (winner == NULL || chip->i2cAddr < winner->i2cAddr)){
+                winner = chip;
+            }
+        }
+        if (winner == NULL){
+            bus->nacks++;
+            return CTF2301_ERROR_NACK;
+        }
+        winner->alertAcked = 1;
+        for (uint16_t i = 0; i < length; i++){
+            data[i] = (uint8_t)(winner->i2cAddr << 1);
+        }
+        return CTF2301_OK;
+    }
+
+    chip = __CTF2301_simTransaction(bus, i2cAddr, 1 + length);
+    if (chip == NULL){
+        return CTF2301_ERROR_NACK;
+    }
+    for (uint16_t i = 0; i < length; i++){
+        data[i] = __CTF2301_simReadReg(chip, chip->pointer++);
+    }
+    return CTF2301_OK;
+}
@@ -0,0 +1,168 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  In-memory CTF2301 for host builds
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Select CTF2301_SIM_I2C_BUS as configUSE_PERIPHERIAL_DRIVER_CTF2301 and link
+  CTF2301_sim.c to run the driver against simulated chips without any HAL.
+  Put a CTF2301_SimChip on a CTF2301_SimBus with CTF2301_simAttach() and attach
+  the driver to the bus.
+
+  The chip model follows the register map: read-only and write-only registers,
+  the backup write addresses, MSB/LSB latching, POR_STATUS, conversions at the
+  programmed CONVERSION_RATE, ALERT_STATUS with the ALERT mask, fault queue and the SMBus ARA,
+  T_CRIT with hysteresis, Auto-Temp PWM from the look-up table and a first order
+  fan whose speed shows up in the TACH count.
+
+  Faults are injected per chip: NACKs, and SDA held low until the bus is recovered.
+
+  Time only passes when the bus is used or CTF2301_simAdvance() is called. Every
+  transaction takes latencyUs plus byteUs per byte on the wire, so the bus time
+  and busyUs tell how efficiently the driver uses the bus.
+
+ */
+
+#ifndef INC_CTF2301_SIM_H_
+#define INC_CTF2301_SIM_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CTF2301_SIM_POR_US               15000      // POR_STATUS stays busy this long after power-on
+#define CTF2301_SIM_CONVERSION_US        12000      // Length of one local + remote conversion
+#define CTF2301_SIM_TACH_CLOCK           5400000    // RPM = CTF2301_SIM_TACH_CLOCK / TACH count
+
+// One simulated chip
+typedef struct CTF2301_SimChip {
+    uint8_t i2cAddr;                        // 7-bit address
+    uint8_t regs[256];                      // Register file
+
+    // Environment, change it at any time
+    int32_t localTemp;                      // Die temperature in m°C
+    int32_t remoteTemp;                     // Remote diode temperature in m°C
+    uint8_t remoteOpen;                     // 1: remote diode disconnected
+    int32_t remoteError;                    // m°C the diode reads off (ideality factor, series resistance), the offset cancels it
+    uint8_t remoteBeta;                     // REMOTE_DIODE_BETA_COMP setting that matches the transistor, 0-6,
+                                            // CTF2301_BETA_OFF for a diode-connected one. Each setting off adds 2°C.
+    int32_t remoteBetaAutoError;            // m°C left with CTF2301_BETA_AUTO, 0 when automatic detection works
+    int32_t remoteNoise;                    // Peak noise on a remote conversion in m°C, the on-chip filter takes it out
+    uint16_t fanMaxRPM;                     // Fan speed at 100% duty cycle, 0 for no fan
+    uint16_t fanTauMs;                      // Fan time constant
+
+    // Fault injection
+    uint32_t nackNext;                      // Number of upcoming transactions to NACK
+    uint32_t nackEvery;                     // NACK every Nth transaction, 0 to disable
+    uint32_t sdaStuck;                      // SCL clocks the chip still holds SDA low for, as after a read cut short.
+                                            // Every transaction on the bus fails until CTF2301_simRecover() frees it.
+
+    // Counters
+    uint32_t transactions;                  // Transactions addressed to the chip
+    uint32_t conversions;                   // Completed conversions
+
+    // Model state
+    uint64_t timeUs;
+    uint64_t porDoneUs;                     // POR_STATUS clears at this time
+    uint64_t nextConversionUs;              // Next conversion starts at this time
+    uint64_t conversionEndUs;               // Running conversion ends at this time
+    uint8_t converting;
+    uint8_t oneShot;                        // ONE_SHOT written while in standby
+    uint8_t status;                         // ALERT_STATUS bits latched since the last read
+    uint8_t alertAcked;                     // Won the Alert Response Address, ALERT released until ALERT_STATUS is read
+    uint8_t pointer;                        // Register pointer, plain reads start here
+    uint8_t tCrit;                          // Remote T_CRIT alarm active
+    uint8_t faultQueue;                     // Consecutive out of limit remote conversions
+    int8_t  lutStep;                        // Active look-up table entry, -1 for none
+    int32_t remoteFiltered;                 // Output of the remote temperature filter in m°C
+    uint32_t noiseSeed;
+    uint8_t latch[4];                       // LSBs latched by reading the MSB (TACH: the other way round)
+    int64_t fanRPM;                         // Fan speed in 1/256 RPM
+    struct CTF2301_SimChip *next;
+} CTF2301_SimChip;
+
+// Simulated bus
+typedef struct {
+    CTF2301_SimChip *chips;
+    uint64_t timeUs;                        // Simulated time
+    uint32_t latencyUs;                     // Added to every transaction, e.g. driver or OS overhead
+    uint32_t byteUs;                        // Time of one byte on the wire including ACK, 90 at 100kHz
+    uint64_t busyUs;                        // Time the bus spent on transactions
+    uint32_t transactions;                  // Transactions seen on the bus, acknowledged or not
+    uint32_t nacks;                         // Transactions nobody acknowledged
+    uint32_t bytes;                         // Bytes on the wire, addresses included
+    uint32_t stuck;                         // Transactions that found SDA held low
+    uint32_t recoveries;                    // Recovery sequences clocked on the bus
+} CTF2301_SimBus;
+
+// Set up an empty bus
+// Param: bus - bus to set up, clockHz - SCL frequency, 0 for transactions that take no time
+void CTF2301_simBusInit(CTF2301_SimBus *bus, uint32_t clockHz);
+
+// Set up a chip that has been powered for a while: power-on register contents, POR done,
+// 25°C on both sensors, no fan
+// Param: chip - chip to reset, i2cAddr - 7-bit address it answers on
+void CTF2301_simChipInit(CTF2301_SimChip *chip, uint8_t i2cAddr);
+
+// Power cycle a chip, the registers return to their power-on contents and POR_STATUS is busy for CTF2301_SIM_POR_US
+void CTF2301_simPowerCycle(CTF2301_SimChip *chip);
+
+// Put a chip on a bus or take it off
+void CTF2301_simAttach(CTF2301_SimBus *bus, CTF2301_SimChip *chip);
+void CTF2301_simDetach(CTF2301_SimBus *bus, CTF2301_SimChip *chip);
+
+// Let time pass on a bus and the chips on it
+void CTF2301_simAdvance(CTF2301_SimBus *bus, uint32_t us);
+
+// State of the ALERT output
+// Return: 1 if the chip pulls ALERT low, 0 otherwise
+uint8_t CTF2301_simAlert(CTF2301_SimChip *chip);
+
+// Current fan speed
+// Return: RPM
+uint32_t CTF2301_simFanRPM(CTF2301_SimChip *chip);
+
+// Bus transactions, the register pointer auto-increments over multi-register transfers
+// Return: CTF2301_OK if a chip acknowledges, CTF2301_ERROR_NACK if none does, CTF2301_ERROR if SDA is held low
+uint32_t CTF2301_simRead(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t reg, uint8_t *data, uint16_t length);
+uint32_t CTF2301_simWrite(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t reg, const uint8_t *data, uint16_t length);
+
+// Bus recovery: 9 SCL pulses and a STOP, a chip holding SDA low lets go once it has seen the clocks it waits for
+// Return: CTF2301_OK if SDA is free afterwards, CTF2301_ERROR otherwise
+uint32_t CTF2301_simRecover(CTF2301_SimBus *bus);
+
+// Plain read without a register pointer write. On the Alert Response Address every chip pulling ALERT
+// answers with its address, the lowest address wins the arbitration and releases ALERT.
+// Return: CTF2301_OK if a chip acknowledges, CTF2301_ERROR_NACK if none does, CTF2301_ERROR if SDA is held low
+uint32_t CTF2301_simReceive(CTF2301_SimBus *bus, uint8_t i2cAddr, uint8_t *data, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_SIM_H_ */
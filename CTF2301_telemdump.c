@@ -0,0 +1,110 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Telemetry log decoder, host tool
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Turns a log written with CTF2301_telemEncode() back into one CSV line per
+  record with CTF2301_telemDecode().
+
+  gcc -DCTF2301_HOST_SIM -I. -o telemdump CTF2301_telemdump.c CTF2301_telemetry.c CTF2301.c CTF2301_hal_sim.c
+  ./telemdump [-r] [log.bin]
+
+  -r  print the register values as logged instead of °C, RPM and %
+  The log is read from the file or stdin. RPM uses configTACH_CLOCK_HZ and
+  configFAN_PULSES_PER_REV of the CTF2301.h it is built with.
+
+ */
+
+#include "CTF2301_telemetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TELEMDUMP_CHUNK                  65536
+#define TELEMDUMP_RECORDS                4096
+
+int main(int argc, char **argv){
+    static uint8_t buffer[TELEMDUMP_CHUNK];
+    static CTF2301_Sample records[TELEMDUMP_RECORDS];
+    CTF2301_TelemDecoder dec;
+    size_t have = 0;
+    size_t bytes = 0;
+    int raw = 0;
+    FILE *in = stdin;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r")) != -1){
+        switch (opt){
+            case 'r':   raw = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-r] [log.bin]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc && (in = fopen(argv[optind], "rb")) == NULL){
+        perror(argv[optind]);
+        return 1;
+    }
+
+    CTF2301_telemDecoderInit(&dec);
+    printf(raw ? "device,timestamp,sequence,local,remote,tach,pwm,alert\n"
+               : "device,timestamp,sequence,local_c,remote_c,rpm,duty_pct,alert\n");
+    for (;;){
+        size_t got = fread(buffer + have, 1, sizeof(buffer) - have, in);
+        size_t used;
+        size_t count;
+        have += got;
+        bytes += got;
+        // Decode until the rest is a record cut off by the end of the chunk
+        do {
+            CTF2301_telemDecode(&dec, buffer, have, &used, records, TELEMDUMP_RECORDS, &count);
+            for (size_t i = 0; i < count; i++){
+                const CTF2301_Sample *r = &records[i];
+                if (raw){
+                    printf("%u,%u,%u,%u,%u,%u,%u,%u\n", dec.header.device, r->timestamp, r->sequence, r->localTemp,
+                           r->remoteTemp, r->tach, r->pwm, r->alertStatus);
+                } else {
+                    printf("%u,%u,%u,%.4f,%.5f,%lu,%.2f,%u\n", dec.header.device, r->timestamp, r->sequence,
+                           CTF2301_decodeLocal(r->localTemp) / 32.0, CTF2301_decodeRemote(r->remoteTemp) / 32.0,
+                           (r->tach == CTF2301_TACH_INVALID || r->tach == 0) ? 0UL : CTF2301_TACH_CLOCK / r->tach,
+                           dec.header.pwmFullScale ? r->pwm * 100.0 / dec.header.pwmFullScale : 0.0, r->alertStatus);
+                }
+            }
+            memmove(buffer, buffer + used, have - used);
+            have -= used;
+        } while (count > 0 || (used > 0 && have > 0));
+        if (got == 0){
+            break;
+        }
+    }
+    if (in != stdin){
+        fclose(in);
+    }
+
+    fprintf(stderr, "%u records in %u blocks from %zu bytes, %.2f bytes a record, %u bytes skipped, %zu left over\n",
+            dec.records, dec.blocks, bytes, dec.records ? (double)bytes / dec.records : 0.0, dec.skipped, have);
+    return (dec.skipped != 0 || have != 0) ? 1 : 0;
+}
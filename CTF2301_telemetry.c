@@ -0,0 +1,344 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Compact binary telemetry
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+ */
+
+#include "CTF2301_telemetry.h"
+#include <string.h>
+
+#define CTF2301_TELEM_MAGIC_0            0xCF
+#define CTF2301_TELEM_MAGIC_1            0x23
+
+// Record mask bits
+#define CTF2301_TELEM_LOCAL              0x01
+#define CTF2301_TELEM_REMOTE             0x02
+#define CTF2301_TELEM_TACH               0x04
+#define CTF2301_TELEM_PWM                0x08
+#define CTF2301_TELEM_ALERT              0x10
+#define CTF2301_TELEM_GAP                0x20
+#define CTF2301_TELEM_RESERVED           0x40
+#define CTF2301_TELEM_HEADER             0x80
+
+static uint32_t __CTF2301_zigzag(uint32_t value){
+    return (value << 1) ^ (0 - (value >> 31));
+}
+
+static uint32_t __CTF2301_unzigzag(uint32_t value){
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static uint8_t *__CTF2301_putVarint(uint8_t *p, uint32_t value){
+    while (value >= 0x80){
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+// Zigzag of a 16-bit difference, at most 3 bytes
+static uint8_t *__CTF2301_putDelta(uint8_t *p, uint16_t value, uint16_t last){
+    return __CTF2301_putVarint(p, __CTF2301_zigzag((uint32_t)(int32_t)(int16_t)(uint16_t)(value - last)));
+}
+
+// Header fields of a device
+uint32_t CTF2301_telemHeader(CTF2301_Device *dev, uint16_t device, CTF2301_TelemHeader *header){
+    uint8_t enhanced;
+    uint16_t fullScale;
+    if (__CTF2301_readRegisterCached(dev, CONVERSION_RATE, &header->rate) != CTF2301_OK
+        || __CTF2301_readRegisterCached(dev, ENHANCED_CONFIG, &enhanced) != CTF2301_OK
+        || __CTF2301_pwmFullScale(dev, &fullScale) != CTF2301_OK){
+        return CTF2301_ERROR;
+    }
+    header->device = device;
+    header->pwmFullScale = (uint8_t)fullScale;
+    header->flags = (enhanced & 0x40) ? CTF2301_TELEM_REMOTE_FINE : 0;
+    return CTF2301_OK;
+}
+
+// Set up an encoder
+void CTF2301_telemInit(CTF2301_TelemEncoder *enc, const CTF2301_TelemHeader *header){
+    memset(enc, 0, sizeof(*enc));
+    enc->header = *header;
+}
+
+// Start a new block with the next record
+void CTF2301_telemRestart(CTF2301_TelemEncoder *enc){
+    enc->inBlock = 0;
+}
+
+// Encode one record
+// Return: CTF2301_OK if the record is encoded, CTF2301_ERROR if the buffer is too small
+uint32_t CTF2301_telemEncode(CTF2301_TelemEncoder *enc, const CTF2301_Sample *record, uint8_t *out, uint16_t size,
+                             uint16_t *length){
+    uint8_t *p = out;
+    uint8_t *mask;
+    uint32_t step;
+    uint16_t gap;
+
+    if (size < CTF2301_TELEM_MAX_BYTES){
+        return CTF2301_ERROR;
+    }
+    if (enc->inBlock == 0){
+        uint8_t sum = 0;
+        p[0] = CTF2301_TELEM_MAGIC_0;
+        p[1] = CTF2301_TELEM_MAGIC_1;
+        p[2] = CTF2301_TELEM_VERSION;
+        p[3] = enc->header.flags;
+        p[4] = (uint8_t)enc->header.device;
+        p[5] = (uint8_t)(enc->header.device >> 8);
+        p[6] = enc->header.rate;
+        p[7] = enc->header.pwmFullScale;
+        p[8] = 0;
+        p[9] = (uint8_t)record->timestamp;
+        p[10] = (uint8_t)(record->timestamp >> 8);
+        p[11] = (uint8_t)(record->timestamp >> 16);
+        p[12] = (uint8_t)(record->timestamp >> 24);
+        p[13] = (uint8_t)record->sequence;
+        p[14] = (uint8_t)(record->sequence >> 8);
+        for (int i = 0; i < CTF2301_TELEM_HEADER_BYTES; i++){
+            sum += p[i];
+        }
+        p[8] = (uint8_t)(0 - sum);
+        p += CTF2301_TELEM_HEADER_BYTES;
+
+        // The block starts from zero, so the first record carries its values in full
+        memset(&enc->last, 0, sizeof(enc->last));
+        enc->last.timestamp = record->timestamp;
+        enc->last.sequence = record->sequence - 1;
+        enc->step = 0;
+    }
+
+    step = record->timestamp - enc->last.timestamp;
+    gap = record->sequence - enc->last.sequence - 1;
+    mask = p++;
+    *mask = ((record->localTemp != enc->last.localTemp) ? CTF2301_TELEM_LOCAL : 0)
+            | ((record->remoteTemp != enc->last.remoteTemp) ? CTF2301_TELEM_REMOTE : 0)
+            | ((record->tach != enc->last.tach) ? CTF2301_TELEM_TACH : 0)
+            | ((record->pwm != enc->last.pwm) ? CTF2301_TELEM_PWM : 0)
+            | ((record->alertStatus != 0) ? CTF2301_TELEM_ALERT : 0)
+            | ((gap != 0) ? CTF2301_TELEM_GAP : 0);
+    p = __CTF2301_putVarint(p, __CTF2301_zigzag(step - enc->step));
+    if (gap != 0){
+        p = __CTF2301_putVarint(p, gap);
+    }
+    if (*mask & CTF2301_TELEM_LOCAL){
+        p = __CTF2301_putDelta(p, record->localTemp, enc->last.localTemp);
+    }
+    if (*mask & CTF2301_TELEM_REMOTE){
+        p = __CTF2301_putDelta(p, record->remoteTemp, enc->last.remoteTemp);
+    }
+    if (*mask & CTF2301_TELEM_TACH){
+        p = __CTF2301_putDelta(p, record->tach, enc->last.tach);
+    }
+    if (*mask & CTF2301_TELEM_PWM){
+        p = __CTF2301_putDelta(p, record->pwm, enc->last.pwm);
+    }
+    if (*mask & CTF2301_TELEM_ALERT){
+        *p++ = record->alertStatus;
+    }
+
+    enc->last = *record;
+    enc->step = step;
+    enc->inBlock++;
+    if (configTELEM_BLOCK_RECORDS == 0){
+        enc->inBlock = 1;
+    } else if (enc->inBlock >= configTELEM_BLOCK_RECORDS){
+        enc->inBlock = 0;
+    }
+    enc->records++;
+    enc->bytes += (uint32_t)(p - out);
+    *length = (uint16_t)(p - out);
+    return CTF2301_OK;
+}
+
+// Take records out of the sampler of a device and encode them
+// Return: number of records encoded
+uint16_t CTF2301_telemDrain(CTF2301_Device *dev, CTF2301_TelemEncoder *enc, uint8_t *out, uint16_t size,
+                            uint16_t *length){
+    CTF2301_Sample record;
+    uint16_t written = 0;
+    uint16_t count = 0;
+
+    while (size - written >= CTF2301_TELEM_MAX_BYTES && CTF2301_samplerDrain(dev, &record, 1) == 1){
+        uint16_t n;
+        CTF2301_telemEncode(enc, &record, out + written, size - written, &n);
+        written += n;
+        count++;
+    }
+    *length = written;
+    return count;
+}
+
+// Set up a decoder
+void CTF2301_telemDecoderInit(CTF2301_TelemDecoder *dec){
+    memset(dec, 0, sizeof(*dec));
+}
+
+// Varint of at most 5 bytes
+// Return: bytes read, 0 if the data ends first, -1 if it runs longer than 5 bytes
+static int __CTF2301_getVarint(const uint8_t *p, const uint8_t *end, uint32_t *value){
+    uint32_t result = 0;
+    for (int i = 0; i < 5; i++){
+        if (p + i >= end){
+            return 0;
+        }
+        result |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if ((p[i] & 0x80) == 0){
+            *value = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+// Check a header
+// Return: 1 if it is valid, 0 if the data ends first, -1 if it is damaged
+static int __CTF2301_telemCheckHeader(const uint8_t *p, const uint8_t *end){
+    uint8_t sum = 0;
+    if (p[0] != CTF2301_TELEM_MAGIC_0 || (end - p >= 2 && p[1] != CTF2301_TELEM_MAGIC_1)){
+        return -1;
+    }
+    if (end - p < CTF2301_TELEM_HEADER_BYTES){
+        return 0;
+    }
+    for (int i = 0; i < CTF2301_TELEM_HEADER_BYTES; i++){
+        sum += p[i];
+    }
+    if (p[2] != CTF2301_TELEM_VERSION || sum != 0){
+        return -1;
+    }
+    return 1;
+}
+
+// Start a block from a valid header
+static void __CTF2301_telemGetHeader(CTF2301_TelemDecoder *dec, const uint8_t *p){
+    dec->header.flags = p[3];
+    dec->header.device = (uint16_t)(p[4] | (p[5] << 8));
+    dec->header.rate = p[6];
+    dec->header.pwmFullScale = p[7];
+    memset(&dec->last, 0, sizeof(dec->last));
+    dec->last.timestamp = (uint32_t)p[9] | ((uint32_t)p[10] << 8) | ((uint32_t)p[11] << 16) | ((uint32_t)p[12] << 24);
+    dec->last.sequence = (uint16_t)((p[13] | (p[14] << 8)) - 1);
+    dec->step = 0;
+}
+
+// Read a record into dec->last
+// Return: bytes read, 0 if the data ends first, -1 if it is damaged
+static int __CTF2301_telemGetRecord(CTF2301_TelemDecoder *dec, const uint8_t *p, const uint8_t *end){
+    CTF2301_Sample record = dec->last;
+    uint16_t *field[3] = {&record.localTemp, &record.remoteTemp, &record.tach};
+    const uint8_t *start = p;
+    uint8_t mask = *p++;
+    uint32_t value;
+    uint32_t step;
+    uint32_t gap = 0;
+    int n;
+
+    if ((n = __CTF2301_getVarint(p, end, &value)) <= 0){
+        return n;
+    }
+    p += n;
+    step = dec->step + __CTF2301_unzigzag(value);
+    if (mask & CTF2301_TELEM_GAP){
+        if ((n = __CTF2301_getVarint(p, end, &gap)) <= 0){
+            return n;
+        }
+        p += n;
+    }
+    for (int i = 0; i < 3; i++){
+        if (mask & (CTF2301_TELEM_LOCAL << i)){
+            if ((n = __CTF2301_getVarint(p, end, &value)) <= 0){
+                return n;
+            }
+            p += n;
+            *field[i] += (uint16_t)__CTF2301_unzigzag(value);
+        }
+    }
+    if (mask & CTF2301_TELEM_PWM){
+        if ((n = __CTF2301_getVarint(p, end, &value)) <= 0){
+            return n;
+        }
+        p += n;
+        record.pwm += (uint8_t)__CTF2301_unzigzag(value);
+    }
+    record.alertStatus = 0;
+    if (mask & CTF2301_TELEM_ALERT){
+        if (p >= end){
+            return 0;
+        }
+        record.alertStatus = *p++;
+    }
+    record.timestamp += step;
+    record.sequence += (uint16_t)(gap + 1);
+    dec->last = record;
+    dec->step = step;
+    return (int)(p - start);
+}
+
+// Decode records from a log
+// Return: CTF2301_OK, CTF2301_ERROR_VERIFY if bytes were skipped to find a header
+uint32_t CTF2301_telemDecode(CTF2301_TelemDecoder *dec, const uint8_t *data, size_t size, size_t *used,
+                             CTF2301_Sample *records, size_t max, size_t *count){
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    uint32_t skipped = dec->skipped;
+    size_t n = 0;
+
+    while (p < end && n < max){
+        int r;
+        if (*p & CTF2301_TELEM_HEADER){
+            if ((r = __CTF2301_telemCheckHeader(p, end)) == 0 || (r > 0 && n > 0)){
+                break;
+            }
+            if (r > 0){
+                __CTF2301_telemGetHeader(dec, p);
+                p += CTF2301_TELEM_HEADER_BYTES;
+                dec->inBlock = 1;
+                dec->blocks++;
+                continue;
+            }
+        } else if (dec->inBlock && (*p & CTF2301_TELEM_RESERVED) == 0){
+            if ((r = __CTF2301_telemGetRecord(dec, p, end)) == 0){
+                break;
+            }
+            if (r > 0){
+                p += r;
+                records[n++] = dec->last;
+                continue;
+            }
+        }
+        // Not a header and not a record of a good block, skip ahead to the next header
+        dec->inBlock = 0;
+        dec->skipped++;
+        p++;
+    }
+    dec->records += (uint32_t)n;
+    *used = (size_t)(p - data);
+    *count = n;
+    return (dec->skipped != skipped) ? CTF2301_ERROR_VERIFY : CTF2301_OK;
+}
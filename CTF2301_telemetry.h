@@ -0,0 +1,144 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Compact binary telemetry
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Sampler records packed for a log in flash or a stream over a UART. A
+  CTF2301_Sample is 16 bytes in RAM and a printed line is around 60, while
+  a record here takes 2 bytes as long as the readings hold still.
+
+  The log is a row of blocks. A block is a 15 byte header followed by
+  records, all multi-byte header fields are little endian:
+    0   magic CFh 23h
+    2   format version, CTF2301_TELEM_VERSION
+    3   flags, CTF2301_TELEM_REMOTE_FINE
+    4   device id given by the application, 2 bytes
+    6   ConversionRate of the chip when the block started
+    7   PWM value of 100%, 255 in high resolution, else 2 * PWM_FREQ
+    8   check byte, the 8-bit sum of the header is 0
+    9   timestamp of the first record, 4 bytes
+    13  sequence of the first record, 2 bytes
+
+  A record is a mask byte, then varints (7 bits a byte, low first):
+    mask bit 0-3   local, remote, tach, pwm changed, a zigzag varint of
+                   the 16-bit difference to the previous value follows
+    mask bit 4     alertStatus is not zero, the byte follows
+    mask bit 5     records were dropped, the sequence gap - 1 follows
+    always         zigzag varint of the change of the timestamp step,
+                   0 while the records come at a steady rate
+  Bit 7 of the first byte tells a header from a record, bit 6 is reserved.
+  A block decodes on its own: values start from 0, the timestamp step
+  from 0. A reader that joins a stream, or finds a damaged block, skips to
+  the next header.
+
+  The encoder keeps no buffer and allocates nothing, every call writes one
+  record, and the header in front when a block starts, into the caller's
+  buffer. Timestamps and sequences wrap, all differences are modulo their
+  width.
+
+ */
+
+#ifndef INC_CTF2301_TELEMETRY_H_
+#define INC_CTF2301_TELEMETRY_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "CTF2301.h"
+
+#define CTF2301_TELEM_VERSION            1
+#define CTF2301_TELEM_HEADER_BYTES       15
+#define CTF2301_TELEM_RECORD_MAX         22     // Longest record: mask, 5 byte timestamp, 3 byte gap, 4 * 3 byte values, alert
+#define CTF2301_TELEM_MAX_BYTES          (CTF2301_TELEM_HEADER_BYTES + CTF2301_TELEM_RECORD_MAX)    // Longest write of one record
+
+#define CTF2301_TELEM_REMOTE_FINE        0x01   // Remote temperature LSbs[4:3] are live (1/32°C), otherwise they read 0
+
+typedef struct {
+    uint16_t device;                        // Id of the chip in the application, e.g. bus << 8 | I2C address
+    uint8_t rate;                           // ConversionRate
+    uint8_t pwmFullScale;                   // PWM value of 100%
+    uint8_t flags;                          // CTF2301_TELEM_REMOTE_FINE
+} CTF2301_TelemHeader;
+
+typedef struct {
+    CTF2301_TelemHeader header;             // Goes into every block, changes show up from the next block on
+    CTF2301_Sample last;                    // Previous record of the block
+    uint32_t step;                          // Previous timestamp step
+    uint16_t inBlock;                       // Records in the current block, 0 starts a new one
+    uint32_t records;                       // Records encoded
+    uint32_t bytes;                         // Bytes written, headers included
+} CTF2301_TelemEncoder;
+
+typedef struct {
+    CTF2301_TelemHeader header;             // Header of the block the last records came from
+    CTF2301_Sample last;
+    uint32_t step;
+    uint8_t inBlock;                        // A valid header has been read, records follow
+    uint32_t records;                       // Records decoded
+    uint32_t blocks;                        // Headers read
+    uint32_t skipped;                       // Bytes skipped over to find a header, damaged or joined mid-block
+} CTF2301_TelemDecoder;
+
+// Header fields of a device: conversion rate, PWM scale and resolution, bus reads unless the shadow cache holds them
+// Param: device - id the application gives the chip, header - return the fields
+// Return: CTF2301_OK if the registers are read, CTF2301_ERROR otherwise
+uint32_t CTF2301_telemHeader(CTF2301_Device *dev, uint16_t device, CTF2301_TelemHeader *header);
+
+// Set up an encoder, the first record starts a block
+void CTF2301_telemInit(CTF2301_TelemEncoder *enc, const CTF2301_TelemHeader *header);
+
+// Start a new block with the next record, e.g. at the start of a flash page so every page decodes on its own
+void CTF2301_telemRestart(CTF2301_TelemEncoder *enc);
+
+// Encode one record
+// Param: out - buffer of at least CTF2301_TELEM_MAX_BYTES, length - return bytes written
+// Return: CTF2301_OK if the record is encoded, CTF2301_ERROR if the buffer is too small
+uint32_t CTF2301_telemEncode(CTF2301_TelemEncoder *enc, const CTF2301_Sample *record, uint8_t *out, uint16_t size,
+                             uint16_t *length);
+
+// Take records out of the sampler of a device and encode them, as long as a longest record still fits
+// Param: out - buffer, length - return bytes written
+// Return: number of records encoded
+uint16_t CTF2301_telemDrain(CTF2301_Device *dev, CTF2301_TelemEncoder *enc, uint8_t *out, uint16_t size,
+                            uint16_t *length);
+
+// Set up a decoder, it skips ahead to the first header
+void CTF2301_telemDecoderInit(CTF2301_TelemDecoder *dec);
+
+// Decode records from a log
+// A call stops at the end of the data, at a record cut off by it, after max records or in front of a new header once it
+// has records, so all records of a call belong to dec->header. Pass the bytes not used again, with more behind them.
+// Param: used - return bytes consumed, records - return up to max records, count - return number of records
+// Return: CTF2301_OK, CTF2301_ERROR_VERIFY if bytes were skipped to find a header
+uint32_t CTF2301_telemDecode(CTF2301_TelemDecoder *dec, const uint8_t *data, size_t size, size_t *used,
+                             CTF2301_Sample *records, size_t max, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_TELEMETRY_H_ */
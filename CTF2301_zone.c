@@ -0,0 +1,362 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Fan zone manager
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+ */
+
+#include "CTF2301_zone.h"
+#include <string.h>
+
+#if (configUSE_ASYNC_TRANSPORT == 1)
+// Longest a snapshot can take: every run of every device on the busiest bus at its worst
+static uint32_t __CTF2301_zoneWorstMs(CTF2301_ZoneManager *mgr){
+    uint8_t most = 0;
+    for (uint8_t i = 0; i < mgr->buses; i++){
+        if (mgr->bus[i].members > most){
+            most = mgr->bus[i].members;
+        }
+    }
+    return (uint32_t)most * CTF2301_SAMPLE_RUNS * CTF2301_TRANSFER_WORST_MS;
+}
+#endif
+
+// Duty cycle of a curve at a temperature
+static uint32_t __CTF2301_zoneCurve(const CTF2301_ZoneCurve *curve, CTF2301_Temp temp){
+    if (temp <= curve->tempLow){
+        return curve->dutyMin;
+    }
+    if (temp >= curve->tempHigh){
+        return curve->dutyMax;
+    }
+    return curve->dutyMin + (uint32_t)((uint64_t)(curve->dutyMax - curve->dutyMin) * (uint32_t)(temp - curve->tempLow)
+                                       / (uint32_t)(curve->tempHigh - curve->tempLow));
+}
+
+// Set up an empty manager, every zone with a curve from 40°C / 20% to 80°C / 100% and no coupling
+void CTF2301_zoneInit(CTF2301_ZoneManager *mgr, CTF2301_ZonePolicy policy){
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->policy = policy;
+    for (uint8_t i = 0; i < configZONE_MAX_ZONES; i++){
+        mgr->curve[i].tempLow = CTF2301_TEMP_FROM_C(40);
+        mgr->curve[i].tempHigh = CTF2301_TEMP_FROM_C(80);
+        mgr->curve[i].dutyMin = CTF2301_DUTY_FULL / 5;
+        mgr->curve[i].dutyMax = CTF2301_DUTY_FULL;
+    }
+}
+
+// Add an attached and initialized device to a zone, it is grouped with the other devices on its bus
+// Return: CTF2301_OK if the device is added, CTF2301_ERROR_BUSY if the manager holds configCTF2301_MAX_DEVICES devices
+//         or configZONE_MAX_BUSES buses already, CTF2301_ERROR if the zone doesn't exist
+uint32_t CTF2301_zoneAdd(CTF2301_ZoneManager *mgr, CTF2301_Device *dev, uint8_t zone){
+    CTF2301_ZoneMember *member;
+    CTF2301_ZoneBus *zb;
+    uint8_t bus;
+
+    if (zone >= configZONE_MAX_ZONES || dev == NULL){
+        return CTF2301_ERROR;
+    }
+    if (mgr->members >= configCTF2301_MAX_DEVICES){
+        return CTF2301_ERROR_BUSY;
+    }
+    for (bus = 0; bus < mgr->buses; bus++){
+        if (mgr->bus[bus].bus == dev->bus){
+            break;
+        }
+    }
+    if (bus == mgr->buses){
+        if (mgr->buses >= configZONE_MAX_BUSES){
+            return CTF2301_ERROR_BUSY;
+        }
+        mgr->bus[bus].bus = dev->bus;
+        mgr->buses++;
+    }
+    zb = &mgr->bus[bus];
+    zb->member[zb->members++] = mgr->members;
+    member = &mgr->member[mgr->members++];
+    memset(member, 0, sizeof(*member));
+    member->dev = dev;
+    member->zone = zone;
+    member->bus = bus;
+    member->status = CTF2301_ERROR;         // Not read yet
+    return CTF2301_OK;
+}
+
+// Set the fan curve of a zone
+// Return: CTF2301_OK if the curve is set, CTF2301_ERROR if the zone doesn't exist or the curve is reversed
+uint32_t CTF2301_zoneSetCurve(CTF2301_ZoneManager *mgr, uint8_t zone, const CTF2301_ZoneCurve *curve){
+    if (zone >= configZONE_MAX_ZONES || curve->tempHigh <= curve->tempLow || curve->dutyMin > curve->dutyMax
+        || curve->dutyMax > CTF2301_DUTY_FULL){
+        return CTF2301_ERROR;
+    }
+    mgr->curve[zone] = *curve;
+    return CTF2301_OK;
+}
+
+// Couple two zones that share airflow
+// Param: share - part of the other zone's demand the zone runs at least, in 1/256; 0 decouples them
+// Return: CTF2301_OK if the coupling is set, CTF2301_ERROR if a zone doesn't exist
+uint32_t CTF2301_zoneSetCoupling(CTF2301_ZoneManager *mgr, uint8_t zone, uint8_t other, uint16_t share){
+    if (zone >= configZONE_MAX_ZONES || other >= configZONE_MAX_ZONES || share > 256){
+        return CTF2301_ERROR;
+    }
+    mgr->coupling[zone][other] = (zone == other) ? 0 : share;
+    return CTF2301_OK;
+}
+
+// Start reading the devices of a bus from the first one
+static void __CTF2301_zoneBusBegin(CTF2301_ZoneBus *zb){
+    zb->cursor = 0;
+    zb->run = 0;
+    zb->issued = 0;
+}
+
+// Move a bus one transaction on
+// Blocking transports do one transfer per call. With configUSE_ASYNC_TRANSPORT the completed transfer is picked up and
+// the next one queued, so only one transaction of the bus is ever outstanding.
+// Return: CTF2301_PENDING while devices of the bus are left to read, CTF2301_OK once all are
+static uint32_t __CTF2301_zoneBusStep(CTF2301_ZoneManager *mgr, CTF2301_ZoneBus *zb){
+    CTF2301_ZoneMember *member;
+    CTF2301_Register address;
+    uint8_t length;
+    uint8_t offset;
+    uint32_t status;
+
+    if (zb->cursor >= zb->members){
+        return CTF2301_OK;
+    }
+    member = &mgr->member[zb->member[zb->cursor]];
+    offset = CTF2301_sampleRun(zb->run, &address, &length);
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    if (!zb->issued){
+        status = CTF2301_readRegistersAsync(member->dev, address, &zb->raw[offset], length, NULL, NULL, &zb->done);
+        if (status == (uint32_t)CTF2301_ERROR_BUSY){
+            return CTF2301_PENDING;         // Queue of the device full, try again on the next step
+        }
+        if (status == CTF2301_OK){
+            zb->issued = 1;
+            return CTF2301_PENDING;
+        }
+    } else {
+        CTF2301_asyncPoll(member->dev);
+        if (zb->done == CTF2301_PENDING){
+            return CTF2301_PENDING;
+        }
+        zb->issued = 0;
+        status = zb->done;
+    }
+#else
+    status = __CTF2301_readRegisters(member->dev, address, &zb->raw[offset], length);
+#endif
+
+    if (status != CTF2301_OK){
+        // Skip the rest of the device, its zone runs fail-safe
+        member->status = CTF2301_ERROR;
+        mgr->failed = 1;
+        zb->run = CTF2301_SAMPLE_RUNS;
+    } else if (++zb->run == CTF2301_SAMPLE_RUNS){
+        CTF2301_sampleDecode(zb->raw, &member->sample);
+        CTF2301_alertLatch(member->dev, member->sample.alertStatus);
+        member->sample.timestamp = mgr->timestamp;
+        member->sample.sequence++;
+        member->status = CTF2301_OK;
+    }
+    if (zb->run == CTF2301_SAMPLE_RUNS){
+        zb->run = 0;
+        zb->cursor++;
+    }
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    // Queue the next transaction of the bus straight away
+    return __CTF2301_zoneBusStep(mgr, zb);
+#else
+    return (zb->cursor < zb->members) ? CTF2301_PENDING : CTF2301_OK;
+#endif
+}
+
+// Start a snapshot, then call CTF2301_zoneSnapshotStep() until it stops returning CTF2301_PENDING
+// Param: timestamp - stored in the samples, any time base
+// Return: CTF2301_OK if the snapshot is started, CTF2301_ERROR_BUSY if a transfer of the last one is still on a bus
+uint32_t CTF2301_zoneSnapshotBegin(CTF2301_ZoneManager *mgr, uint32_t timestamp){
+    for (uint8_t i = 0; i < mgr->buses; i++){
+        if (mgr->bus[i].issued && mgr->bus[i].done == CTF2301_PENDING){
+            return CTF2301_ERROR_BUSY;
+        }
+    }
+    for (uint8_t i = 0; i < mgr->buses; i++){
+        __CTF2301_zoneBusBegin(&mgr->bus[i]);
+    }
+    mgr->timestamp = timestamp;
+    mgr->failed = 0;
+    mgr->pending = mgr->buses;
+    return CTF2301_OK;
+}
+
+// Advance the snapshot: every bus that is done with its last transaction gets the next one
+// Return: CTF2301_PENDING while in progress, CTF2301_OK once every device is read, CTF2301_ERROR if a device couldn't
+//         be read (see the member status)
+uint32_t CTF2301_zoneSnapshotStep(CTF2301_ZoneManager *mgr){
+    uint8_t pending = 0;
+    for (uint8_t i = 0; i < mgr->buses; i++){
+        if (__CTF2301_zoneBusStep(mgr, &mgr->bus[i]) == CTF2301_PENDING){
+            pending++;
+        }
+    }
+    mgr->pending = pending;
+    if (pending){
+        return CTF2301_PENDING;
+    }
+    return mgr->failed ? CTF2301_ERROR : CTF2301_OK;
+}
+
+// Stop a snapshot that doesn't complete: the devices not read yet are marked failed and their zones run fail-safe
+void CTF2301_zoneSnapshotAbort(CTF2301_ZoneManager *mgr){
+    CTF2301_ZoneBus *zb;
+    for (uint8_t i = 0; i < mgr->buses; i++){
+        zb = &mgr->bus[i];
+#if (configUSE_ASYNC_TRANSPORT == 1)
+        // Drop the outstanding run, recovering the bus if it is stuck, so the next snapshot can start
+        if (zb->issued){
+            CTF2301_asyncCancel(mgr->member[zb->member[zb->cursor]].dev, &zb->done);
+            zb->issued = 0;
+        }
+#endif
+        for (; zb->cursor < zb->members; zb->cursor++){
+            mgr->member[zb->member[zb->cursor]].status = CTF2301_ERROR;
+            mgr->failed = 1;
+        }
+        zb->run = 0;
+    }
+    mgr->pending = 0;
+}
+
+// Read all devices of one bus, for a task per bus with the blocking transports
+// Param: bus - index of the bus in the manager (CTF2301_ZoneMember.bus), timestamp - stored in the samples
+// Return: CTF2301_OK if the devices are read, CTF2301_ERROR otherwise
+uint32_t CTF2301_zoneSnapshotBus(CTF2301_ZoneManager *mgr, uint8_t bus, uint32_t timestamp){
+    uint32_t ret = CTF2301_OK;
+    CTF2301_ZoneBus *zb;
+
+    if (bus >= mgr->buses){
+        return CTF2301_ERROR;
+    }
+    zb = &mgr->bus[bus];
+    __CTF2301_zoneBusBegin(zb);
+    mgr->timestamp = timestamp;
+    while (__CTF2301_zoneBusStep(mgr, zb) == CTF2301_PENDING){
+    }
+    for (uint8_t i = 0; i < zb->members; i++){
+        if (mgr->member[zb->member[i]].status != CTF2301_OK){
+            ret = CTF2301_ERROR;
+        }
+    }
+    return ret;
+}
+
+// Take a whole snapshot, waiting for it
+// Return: CTF2301_OK once every device is read, CTF2301_ERROR if a device couldn't be read, CTF2301_ERROR_TIMEOUT if
+//         the asynchronous transfers didn't complete within CTF2301_TRANSFER_WORST_MS each
+uint32_t CTF2301_zoneSnapshot(CTF2301_ZoneManager *mgr, uint32_t timestamp){
+    uint32_t ret = CTF2301_zoneSnapshotBegin(mgr, timestamp);
+#if (configUSE_ASYNC_TRANSPORT == 1)
+    uint32_t start = HAL_GetTick();
+    uint32_t worst = __CTF2301_zoneWorstMs(mgr);
+#endif
+
+    if (ret != CTF2301_OK){
+        return ret;
+    }
+    do {
+        ret = CTF2301_zoneSnapshotStep(mgr);
+#if (configUSE_ASYNC_TRANSPORT == 1)
+        if (ret == CTF2301_PENDING && HAL_GetTick() - start > worst){
+            CTF2301_zoneSnapshotAbort(mgr);
+            return CTF2301_ERROR_TIMEOUT;
+        }
+#endif
+    } while (ret == CTF2301_PENDING);
+    return ret;
+}
+
+// Work out the zone duty cycles from the last snapshot and apply them to the fans
+// Param: nowMs - current time in ms, for the spin-up stagger
+// Return: CTF2301_OK if every device runs its duty cycle (a deferred spin-up included), CTF2301_ERROR otherwise
+uint32_t CTF2301_zoneUpdate(CTF2301_ZoneManager *mgr, uint32_t nowMs){
+    uint32_t ret = CTF2301_OK;
+    uint32_t highest = 0;
+
+    // Demand of a zone: the hottest of its devices, a device that couldn't be read counts as the top of the curve
+    memset(mgr->demand, 0, sizeof(mgr->demand));
+    for (uint8_t i = 0; i < mgr->members; i++){
+        CTF2301_ZoneMember *member = &mgr->member[i];
+        const CTF2301_ZoneCurve *curve = &mgr->curve[member->zone];
+        uint32_t demand = curve->dutyMax;
+        if (member->status == CTF2301_OK){
+            demand = __CTF2301_zoneCurve(curve, CTF2301_decodeRemote(member->sample.remoteTemp));
+        }
+        if (demand > mgr->demand[member->zone]){
+            mgr->demand[member->zone] = demand;
+        }
+    }
+
+    for (uint8_t z = 0; z < configZONE_MAX_ZONES; z++){
+        if (mgr->demand[z] > highest){
+            highest = mgr->demand[z];
+        }
+    }
+    for (uint8_t z = 0; z < configZONE_MAX_ZONES; z++){
+        uint32_t duty = mgr->demand[z];
+        if (mgr->policy == CTF2301_ZONE_POLICY_MAX){
+            duty = highest;
+        } else {
+            for (uint8_t other = 0; other < configZONE_MAX_ZONES; other++){
+                uint32_t share = (mgr->demand[other] * mgr->coupling[z][other]) >> 8;
+                if (share > duty){
+                    duty = share;
+                }
+            }
+        }
+        mgr->duty[z] = duty;
+    }
+
+    for (uint8_t i = 0; i < mgr->members; i++){
+        CTF2301_ZoneMember *member = &mgr->member[i];
+        uint32_t duty = mgr->duty[member->zone];
+        if (member->duty == 0 && duty != 0){
+            // Stopped fan, start it only once the last one had time to spin up
+            if (mgr->spinUpArmed && (int32_t)(nowMs - mgr->nextSpinUp) < 0){
+                mgr->spinUpsDeferred++;
+                continue;
+            }
+            mgr->nextSpinUp = nowMs + configZONE_SPIN_UP_STAGGER_MS;
+            mgr->spinUpArmed = 1;
+        }
+        if (CTF2301_setDutyCycle(member->dev, duty) == CTF2301_OK){
+            member->duty = duty;
+        } else {
+            ret = CTF2301_ERROR;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,168 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Fan zone manager
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  A CTF2301_ZoneManager owns the CTF2301 devices of a chassis, spread over
+  several I2C buses, and runs their fans as cooling zones.
+
+  Snapshots read every device once (temperatures, ALERT_STATUS, TACH and
+  PWM, the registers of a CTF2301_Sample). The devices are grouped by bus and
+  each bus keeps one transaction outstanding at a time, so with
+  configUSE_ASYNC_TRANSPORT the buses work in parallel and a snapshot takes
+  as long as the bus with the most devices, not the sum of all of them.
+  The blocking transports interleave the buses one transaction at a time;
+  a task per bus calling CTF2301_zoneSnapshotBus() gets the parallelism there.
+
+  Every zone maps the hottest remote diode among its devices to a duty cycle
+  through its curve. Zones that share airflow are coupled: a zone runs at
+  least the share of its neighbour's duty cycle given by the coupling, or,
+  with CTF2301_ZONE_POLICY_MAX, all zones run at the highest demand. A device
+  that can't be read pushes its zone to the maximum of its curve. Stopped
+  fans are started one at a time, configZONE_SPIN_UP_STAGGER_MS apart, so
+  their spin-up currents don't add up.
+
+  The devices run in Manual Direct-DCY Mode and nothing is allocated.
+
+ */
+
+#ifndef INC_CTF2301_ZONE_H_
+#define INC_CTF2301_ZONE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "CTF2301.h"
+
+// How the duty cycles of the zones are combined
+typedef enum {
+    CTF2301_ZONE_POLICY_COUPLED = 0,        // Every zone runs its own demand, raised by the coupling to the other zones
+    CTF2301_ZONE_POLICY_MAX = 1             // Every zone runs the highest demand of all zones
+} CTF2301_ZonePolicy;
+
+// Fan curve of a zone: dutyMin up to tempLow, rising linearly to dutyMax at tempHigh
+typedef struct {
+    CTF2301_Temp tempLow;
+    CTF2301_Temp tempHigh;
+    uint32_t dutyMin;                       // CTF2301_DUTY_FULL is 100%
+    uint32_t dutyMax;
+} CTF2301_ZoneCurve;
+
+// One device of the manager
+typedef struct {
+    CTF2301_Device *dev;
+    uint8_t zone;
+    uint8_t bus;                            // Index into the buses of the manager
+    uint32_t status;                        // CTF2301_OK if the last snapshot read the device, CTF2301_ERROR otherwise
+    CTF2301_Sample sample;                  // Readings of the last snapshot, sequence counts the reads of the device
+    uint32_t duty;                          // Duty cycle last applied, CTF2301_DUTY_FULL is 100%
+} CTF2301_ZoneMember;
+
+// Snapshot progress on one bus
+typedef struct {
+    CTF2301_Bus *bus;
+    uint8_t member[configCTF2301_MAX_DEVICES];  // Members on the bus, in polling order
+    uint8_t members;
+    uint8_t cursor;                         // Member being read
+    uint8_t run;                            // Register run of that member on the bus
+    uint8_t issued;                         // The run has been issued, done tells when it completes
+    volatile uint32_t done;
+    uint8_t raw[CTF2301_SAMPLE_BYTES];
+} CTF2301_ZoneBus;
+
+typedef struct {
+    CTF2301_ZoneMember member[configCTF2301_MAX_DEVICES];
+    uint8_t members;
+    CTF2301_ZoneBus bus[configZONE_MAX_BUSES];
+    uint8_t buses;
+    CTF2301_ZonePolicy policy;
+    CTF2301_ZoneCurve curve[configZONE_MAX_ZONES];
+    uint16_t coupling[configZONE_MAX_ZONES][configZONE_MAX_ZONES]; // [zone][other]: share of the other zone's demand
+                                                                   // the zone runs at least, 256 is all of it
+    uint32_t demand[configZONE_MAX_ZONES];  // Duty cycle each zone asked for in the last update
+    uint32_t duty[configZONE_MAX_ZONES];    // Duty cycle each zone got after coupling and policy
+    uint8_t pending;                        // Buses the snapshot is still running on
+    uint8_t failed;                         // A device of the snapshot couldn't be read
+    uint32_t timestamp;                     // Time of the snapshot
+    uint32_t nextSpinUp;                    // Earliest time the next stopped fan may start
+    uint8_t spinUpArmed;                    // nextSpinUp is valid
+    uint32_t spinUpsDeferred;               // Fans held back by the stagger, once per update
+} CTF2301_ZoneManager;
+
+// Set up an empty manager, every zone with a curve from 40°C / 20% to 80°C / 100% and no coupling
+void CTF2301_zoneInit(CTF2301_ZoneManager *mgr, CTF2301_ZonePolicy policy);
+
+// Add an attached and initialized device to a zone, it is grouped with the other devices on its bus
+// Return: CTF2301_OK if the device is added, CTF2301_ERROR_BUSY if the manager holds configCTF2301_MAX_DEVICES devices
+//         or configZONE_MAX_BUSES buses already, CTF2301_ERROR if the zone doesn't exist
+uint32_t CTF2301_zoneAdd(CTF2301_ZoneManager *mgr, CTF2301_Device *dev, uint8_t zone);
+
+// Set the fan curve of a zone
+// Return: CTF2301_OK if the curve is set, CTF2301_ERROR if the zone doesn't exist or the curve is reversed
+uint32_t CTF2301_zoneSetCurve(CTF2301_ZoneManager *mgr, uint8_t zone, const CTF2301_ZoneCurve *curve);
+
+// Couple two zones that share airflow
+// Param: share - part of the other zone's demand the zone runs at least, in 1/256; 0 decouples them
+// Return: CTF2301_OK if the coupling is set, CTF2301_ERROR if a zone doesn't exist
+uint32_t CTF2301_zoneSetCoupling(CTF2301_ZoneManager *mgr, uint8_t zone, uint8_t other, uint16_t share);
+
+// Start a snapshot, then call CTF2301_zoneSnapshotStep() until it stops returning CTF2301_PENDING
+// Param: timestamp - stored in the samples, any time base
+// Return: CTF2301_OK if the snapshot is started, CTF2301_ERROR_BUSY if a transfer of the last one is still on a bus
+uint32_t CTF2301_zoneSnapshotBegin(CTF2301_ZoneManager *mgr, uint32_t timestamp);
+
+// Advance the snapshot: every bus that is done with its last transaction gets the next one
+// Return: CTF2301_PENDING while in progress, CTF2301_OK once every device is read, CTF2301_ERROR if a device couldn't
+//         be read (see the member status)
+uint32_t CTF2301_zoneSnapshotStep(CTF2301_ZoneManager *mgr);
+
+// Stop a snapshot that doesn't complete, e.g. after a deadline of the superloop
+// The devices not read yet get status CTF2301_ERROR, so their zones run fail-safe. With configUSE_ASYNC_TRANSPORT the
+// outstanding transfers are cancelled with CTF2301_asyncCancel() and the next snapshot can begin straight away.
+void CTF2301_zoneSnapshotAbort(CTF2301_ZoneManager *mgr);
+
+// Read all devices of one bus, for a task per bus with the blocking transports
+// Param: bus - index of the bus in the manager (CTF2301_ZoneMember.bus), timestamp - stored in the samples
+// Return: CTF2301_OK if the devices are read, CTF2301_ERROR otherwise
+uint32_t CTF2301_zoneSnapshotBus(CTF2301_ZoneManager *mgr, uint8_t bus, uint32_t timestamp);
+
+// Take a whole snapshot, waiting for it
+// Return: CTF2301_OK once every device is read, CTF2301_ERROR if a device couldn't be read, CTF2301_ERROR_TIMEOUT if
+//         the asynchronous transfers didn't complete within CTF2301_TRANSFER_WORST_MS each (the snapshot is aborted)
+uint32_t CTF2301_zoneSnapshot(CTF2301_ZoneManager *mgr, uint32_t timestamp);
+
+// Work out the zone duty cycles from the last snapshot and apply them to the fans
+// Param: nowMs - current time in ms, for the spin-up stagger
+// Return: CTF2301_OK if every device runs its duty cycle (a deferred spin-up included), CTF2301_ERROR otherwise
+uint32_t CTF2301_zoneUpdate(CTF2301_ZoneManager *mgr, uint32_t nowMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CTF2301_ZONE_H_ */
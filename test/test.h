@@ -0,0 +1,55 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Host test helpers
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  CHECK() reports a failed condition with its file and line and carries on,
+  TEST_RESULT() prints the summary and gives the exit code of the test.
+
+ */
+
+#ifndef INC_CTF2301_TEST_H_
+#define INC_CTF2301_TEST_H_
+
+#include <stdio.h>
+
+static int testChecks;
+static int testFailures;
+
+#define CHECK(cond)                                                                         \
+    do {                                                                                    \
+        testChecks++;                                                                       \
+        if (!(cond)){                                                                       \
+            testFailures++;                                                                 \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);        \
+        }                                                                                   \
+    } while (0)
+
+#define TEST_RESULT(name)                                                                   \
+    (printf("%s: %d checks, %d failed\n", (name), testChecks, testFailures), testFailures != 0)
+
+#endif /* INC_CTF2301_TEST_H_ */
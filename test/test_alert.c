@@ -0,0 +1,205 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  ALERT handling host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Runs CTF2301_alertProcess() against two CTF2301_SimChip on one bus: the
+  ARA loop picks every chip pulling ALERT in address order, only unmasked
+  bits reach the handlers, nothing happens without CTF2301_alertIRQ() and the
+  chips are polled when ALERT is masked and nobody answers the ARA, and bits
+  the sampler read off a chip before the ARA still reach the handlers.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+#define TEST_ADDR_A                      configDEVICE_CTF2301_I2C_ADDR
+#define TEST_ADDR_B                      (configDEVICE_CTF2301_I2C_ADDR + 1)
+#define TEST_SETPOINT                    80      // °C, local and remote high limit
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chipA;
+static CTF2301_SimChip chipB;
+static CTF2301_Device devA;
+static CTF2301_Device devB;
+
+// Handler calls seen by record(), in order
+static struct {
+    uint8_t count;
+    CTF2301_Device *dev[16];
+    CTF2301_AlertEvent event[16];
+    uint8_t status[16];
+} calls;
+
+static void record(CTF2301_Device *dev, CTF2301_AlertEvent event, uint8_t status, void *context){
+    (void)context;
+    if (calls.count < sizeof(calls.status)){
+        calls.dev[calls.count] = dev;
+        calls.event[calls.count] = event;
+        calls.status[calls.count] = status;
+        calls.count++;
+    }
+}
+
+static void setupDevice(CTF2301_Device *dev, CTF2301_SimChip *chip, uint8_t i2cAddr){
+    CTF2301_simChipInit(chip, i2cAddr);
+    CTF2301_simAttach(&bus, chip);
+    CTF2301_detach(dev);
+    CTF2301_attach(dev, &bus, i2cAddr);
+    CHECK(CTF2301_init(dev) == CTF2301_OK);
+    CHECK(__CTF2301_writeRegister(dev, LOCAL_HIGH_SETPOINT_MSB, TEST_SETPOINT) == CTF2301_OK);
+    CHECK(__CTF2301_writeRegister(dev, REMOTE_HIGH_SETPOINT_MSB, TEST_SETPOINT) == CTF2301_OK);
+    for (int event = 0; event < CTF2301_ALERT_EVENTS; event++){
+        CHECK(CTF2301_setAlertHandler(dev, (CTF2301_AlertEvent)event, record, NULL) == CTF2301_OK);
+    }
+}
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    setupDevice(&devA, &chipA, TEST_ADDR_A);
+    setupDevice(&devB, &chipB, TEST_ADDR_B);
+    memset(&calls, 0, sizeof(calls));
+}
+
+// Let a few conversions run
+static void convert(void){
+    CTF2301_simAdvance(&bus, 3000000);
+}
+
+static void testAraLoop(void){
+    setup();
+    chipA.localTemp = (TEST_SETPOINT + 5) * 1000;
+    chipB.localTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+    CHECK(CTF2301_simAlert(&chipA) && CTF2301_simAlert(&chipB));
+
+    // Without the interrupt nothing is read
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 0);
+
+    // Both chips answer the ARA, the lower address first, and both release ALERT
+    CTF2301_alertIRQ(&bus);
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 2);
+    CHECK(calls.dev[0] == &devA && calls.dev[1] == &devB);
+    CHECK(calls.event[0] == CTF2301_EVENT_LOCAL_HIGH && calls.event[1] == CTF2301_EVENT_LOCAL_HIGH);
+    CHECK(calls.status[0] == ALERT_STATUS_LOCAL_HIGH);
+    CHECK(!CTF2301_simAlert(&chipA) && !CTF2301_simAlert(&chipB));
+
+    // The flag is consumed, a second round does nothing
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 2);
+}
+
+static void testMasked(void){
+    setup();
+    // LOCAL_HIGH still latches in ALERT_STATUS, but doesn't pull ALERT low and is not dispatched
+    CHECK(__CTF2301_SET_ALERT_MASK(&devB, ALERT_STATUS_LOCAL_HIGH) == CTF2301_OK);
+    chipB.localTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+    CHECK(!CTF2301_simAlert(&chipB));
+
+    chipB.remoteTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+    CHECK(CTF2301_simAlert(&chipB));
+    CTF2301_alertIRQ(&bus);
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 1);
+    CHECK(calls.dev[0] == &devB);
+    CHECK(calls.event[0] == CTF2301_EVENT_REMOTE_HIGH);
+    CHECK(calls.status[0] == ALERT_STATUS_REMOTE_HIGH);
+}
+
+static void testPolling(void){
+    setup();
+    // ALERT masked in CONFIG: nobody answers the ARA, every chip on the bus is read instead
+    CHECK(__CTF2301_updateRegister(&devA, CONFIG, 0x80, 0x80) == CTF2301_OK);
+    CHECK(__CTF2301_updateRegister(&devB, CONFIG, 0x80, 0x80) == CTF2301_OK);
+    chipB.localTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+    CHECK(!CTF2301_simAlert(&chipB));
+
+    CTF2301_alertIRQ(&bus);
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 1);
+    CHECK(calls.dev[0] == &devB && calls.event[0] == CTF2301_EVENT_LOCAL_HIGH);
+}
+
+static void testReadFailure(void){
+    setup();
+    chipA.localTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+
+    // The chip answers the ARA but its ALERT_STATUS read is NACKed past the retries: reported, and the device stays pending
+    chipA.nackNext = configI2C_RETRIES + 1;
+    CTF2301_alertIRQ(&bus);
+    CHECK(CTF2301_alertProcess(&bus) == (uint32_t)CTF2301_ERROR_COMM);
+    CHECK(calls.count == 0);
+    CHECK(devA.alertPending == 1);
+
+    // The next round picks the latched bit up by polling, ALERT was already released to the ARA
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 1);
+    CHECK(calls.dev[0] == &devA && calls.event[0] == CTF2301_EVENT_LOCAL_HIGH);
+}
+
+static void testSampled(void){
+    CTF2301_Sample sample;
+
+    setup();
+    chipA.localTemp = (TEST_SETPOINT + 5) * 1000;
+    chipB.localTemp = (TEST_SETPOINT + 5) * 1000;
+    convert();
+
+    // The sampler reads chipA's ALERT_STATUS first, which releases ALERT: only chipB answers the ARA
+    CHECK(CTF2301_sample(&devA, 0) == CTF2301_OK);
+    CHECK(CTF2301_samplerDrain(&devA, &sample, 1) == 1);
+    CHECK(sample.alertStatus & ALERT_STATUS_LOCAL_HIGH);
+    CHECK(!CTF2301_simAlert(&chipA) && CTF2301_simAlert(&chipB));
+
+    // The bits it took are dispatched all the same, once
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 2);
+    CHECK(calls.dev[0] == &devB && calls.dev[1] == &devA);
+    CHECK(calls.event[1] == CTF2301_EVENT_LOCAL_HIGH && calls.status[1] == ALERT_STATUS_LOCAL_HIGH);
+    CHECK(devA.alertLatched == 0);
+    CTF2301_alertIRQ(&bus);
+    CHECK(CTF2301_alertProcess(&bus) == CTF2301_OK);
+    CHECK(calls.count == 2);
+}
+
+int main(void){
+    testAraLoop();
+    testMasked();
+    testPolling();
+    testReadFailure();
+    testSampled();
+    return TEST_RESULT("test_alert");
+}
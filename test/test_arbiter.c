@@ -0,0 +1,303 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Bus arbiter load test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Runs CTF2301_arbiterAcquire() / CTF2301_arbiterRelease() of the POSIX
+  threads port from many threads:
+  - waiters queued behind a held bus are served ALERT first, then TELEMETRY,
+    then CONFIG, each class in arrival order
+  - a CONFIG waiter is promoted after configARBITER_MAX_BYPASS TELEMETRY grants
+  - 26 clients of all classes never hold the bus together, every one of them
+    is served and ALERT waits less than the other classes
+  - short timeouts racing the grants neither lose the bus nor hand it to a
+    client that already gave up
+
+  make test
+
+ */
+
+#include "CTF2301_arbiter.h"
+#include "test.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_LOAD_ALERT                  2
+#define TEST_LOAD_TELEMETRY              12
+#define TEST_LOAD_CONFIG                 12
+#define TEST_LOAD_CLIENTS                (TEST_LOAD_ALERT + TEST_LOAD_TELEMETRY + TEST_LOAD_CONFIG)
+#define TEST_LOAD_ROUNDS                 200
+#define TEST_HOLD_US                     100
+#define TEST_RACE_CLIENTS                16
+#define TEST_RACE_ROUNDS                 500
+
+static CTF2301_Arbiter arbiter;
+
+// Clients holding the bus right now, and the most ever seen at once
+static int holders;
+static int holdersMax;
+
+// Order the clients of the ordering tests got the bus in
+static uint8_t order[32];
+static int orderCount;
+
+typedef struct {
+    CTF2301_BusClass busClass;
+    uint8_t tag;
+    uint32_t timeoutMs;
+    uint32_t rounds;
+    uint32_t granted;
+    uint32_t timedOut;
+} Client;
+
+static pthread_barrier_t start;
+
+static void sleepUs(uint32_t us){
+    struct timespec ts = { us / 1000000, (long)(us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+// Enter and leave the bus, counting overlapping holders
+static void hold(uint32_t us){
+    int now = __atomic_add_fetch(&holders, 1, __ATOMIC_SEQ_CST);
+    int max = __atomic_load_n(&holdersMax, __ATOMIC_SEQ_CST);
+    while (now > max && !__atomic_compare_exchange_n(&holdersMax, &max, now, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+    }
+    if (us > 0){
+        sleepUs(us);
+    }
+    __atomic_sub_fetch(&holders, 1, __ATOMIC_SEQ_CST);
+}
+
+// Requests queued in a class
+static int queued(CTF2301_BusClass busClass){
+    int count = 0;
+    pthread_mutex_lock(&arbiter.lock);
+    for (CTF2301_ArbiterWaiter *w = arbiter.head[busClass]; w != NULL; w = w->next){
+        count++;
+    }
+    pthread_mutex_unlock(&arbiter.lock);
+    return count;
+}
+
+static void waitQueued(CTF2301_BusClass busClass, int count){
+    for (int i = 0; i < 10000 && queued(busClass) < count; i++){
+        sleepUs(100);
+    }
+}
+
+// Take the bus once and note the order
+static void *orderedClient(void *arg){
+    Client *client = arg;
+    if (CTF2301_arbiterAcquire(&arbiter, client->busClass, CTF2301_ARBITER_FOREVER) == CTF2301_OK){
+        order[orderCount++] = client->tag;
+        hold(0);
+        CTF2301_arbiterRelease(&arbiter);
+    }
+    return NULL;
+}
+
+static void *loadClient(void *arg){
+    Client *client = arg;
+    pthread_barrier_wait(&start);
+    for (uint32_t i = 0; i < client->rounds; i++){
+        if (CTF2301_arbiterAcquire(&arbiter, client->busClass, client->timeoutMs) == CTF2301_OK){
+            client->granted++;
+            hold(TEST_HOLD_US);
+            CTF2301_arbiterRelease(&arbiter);
+        } else {
+            client->timedOut++;
+        }
+        sleepUs(TEST_HOLD_US * (1 + i % 3));
+    }
+    return NULL;
+}
+
+// Queue the clients one after the other behind a held bus, then let them go
+static void runOrdered(Client *clients, int count){
+    pthread_t threads[32];
+    int perClass[CTF2301_BUS_CLASSES] = {0};
+
+    orderCount = 0;
+    CHECK(CTF2301_arbiterAcquire(&arbiter, CTF2301_BUS_CONFIG, 0) == CTF2301_OK);
+    CTF2301_arbiterResetStats(&arbiter);
+    for (int i = 0; i < count; i++){
+        pthread_create(&threads[i], NULL, orderedClient, &clients[i]);
+        waitQueued(clients[i].busClass, ++perClass[clients[i].busClass]);
+    }
+    CTF2301_arbiterRelease(&arbiter);
+    for (int i = 0; i < count; i++){
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static void testPriority(void){
+    Client clients[] = {
+        { CTF2301_BUS_CONFIG, 5, 0, 0, 0, 0 },
+        { CTF2301_BUS_TELEMETRY, 3, 0, 0, 0, 0 },
+        { CTF2301_BUS_ALERT, 1, 0, 0, 0, 0 },
+        { CTF2301_BUS_CONFIG, 6, 0, 0, 0, 0 },
+        { CTF2301_BUS_TELEMETRY, 4, 0, 0, 0, 0 },
+        { CTF2301_BUS_ALERT, 2, 0, 0, 0, 0 }
+    };
+    static const uint8_t expected[] = { 1, 2, 3, 4, 5, 6 };
+
+    CTF2301_arbiterInit(&arbiter);
+    runOrdered(clients, sizeof(clients) / sizeof(clients[0]));
+    CHECK(orderCount == sizeof(expected));
+    CHECK(memcmp(order, expected, sizeof(expected)) == 0);
+    CHECK(arbiter.busy == 0);
+}
+
+static void testPromotion(void){
+    Client clients[configARBITER_MAX_BYPASS + 3];
+    CTF2301_ArbiterStats stats[CTF2301_BUS_CLASSES];
+    int count = sizeof(clients) / sizeof(clients[0]);
+
+    CTF2301_arbiterInit(&arbiter);
+    memset(clients, 0, sizeof(clients));
+    clients[0].busClass = CTF2301_BUS_CONFIG;
+    clients[0].tag = 0xC0;
+    for (int i = 1; i < count; i++){
+        clients[i].busClass = CTF2301_BUS_TELEMETRY;
+        clients[i].tag = (uint8_t)i;
+    }
+    runOrdered(clients, count);
+
+    // Served after configARBITER_MAX_BYPASS TELEMETRY grants, ahead of the TELEMETRY requests still queued
+    CHECK(orderCount == count);
+    CHECK(order[configARBITER_MAX_BYPASS] == 0xC0);
+    CTF2301_arbiterGetStats(&arbiter, stats);
+    CHECK(stats[CTF2301_BUS_CONFIG].promotions == 1);
+    CHECK(stats[CTF2301_BUS_CONFIG].grants == 1);
+    CHECK(stats[CTF2301_BUS_TELEMETRY].grants == (uint32_t)count - 1);
+}
+
+// Start the clients together and wait for them
+static void runLoad(Client *clients, int count){
+    pthread_t threads[TEST_LOAD_CLIENTS];
+
+    pthread_barrier_init(&start, NULL, count);
+    for (int i = 0; i < count; i++){
+        pthread_create(&threads[i], NULL, loadClient, &clients[i]);
+    }
+    for (int i = 0; i < count; i++){
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start);
+}
+
+static void testLoad(void){
+    Client clients[TEST_LOAD_CLIENTS];
+    CTF2301_ArbiterStats stats[CTF2301_BUS_CLASSES];
+    uint32_t granted[CTF2301_BUS_CLASSES] = {0};
+    uint8_t everyone = 1;
+    double mean[CTF2301_BUS_CLASSES];
+
+    CTF2301_arbiterInit(&arbiter);
+    holdersMax = 0;
+    memset(clients, 0, sizeof(clients));
+    for (int i = 0; i < TEST_LOAD_CLIENTS; i++){
+        clients[i].busClass = (i < TEST_LOAD_ALERT) ? CTF2301_BUS_ALERT
+                            : (i < TEST_LOAD_ALERT + TEST_LOAD_TELEMETRY) ? CTF2301_BUS_TELEMETRY : CTF2301_BUS_CONFIG;
+        clients[i].timeoutMs = CTF2301_ARBITER_FOREVER;
+        clients[i].rounds = TEST_LOAD_ROUNDS;
+    }
+    runLoad(clients, TEST_LOAD_CLIENTS);
+
+    CTF2301_arbiterGetStats(&arbiter, stats);
+    for (int i = 0; i < TEST_LOAD_CLIENTS; i++){
+        everyone &= (clients[i].granted == TEST_LOAD_ROUNDS);
+        granted[clients[i].busClass] += clients[i].granted;
+    }
+    CHECK(holdersMax == 1);
+    CHECK(everyone);
+    for (int c = 0; c < CTF2301_BUS_CLASSES; c++){
+        CHECK(stats[c].grants == granted[c]);
+        CHECK(stats[c].timeouts == 0);
+        mean[c] = (double)stats[c].waitTotal / stats[c].grants;
+    }
+    CHECK(mean[CTF2301_BUS_ALERT] < mean[CTF2301_BUS_TELEMETRY]);
+    CHECK(mean[CTF2301_BUS_ALERT] < mean[CTF2301_BUS_CONFIG]);
+    printf("load: ALERT wait max %uus mean %.0fus, TELEMETRY max %uus mean %.0fus, CONFIG max %uus mean %.0fus, "
+           "%u promotions\n",
+           stats[CTF2301_BUS_ALERT].waitMax, mean[CTF2301_BUS_ALERT],
+           stats[CTF2301_BUS_TELEMETRY].waitMax, mean[CTF2301_BUS_TELEMETRY],
+           stats[CTF2301_BUS_CONFIG].waitMax, mean[CTF2301_BUS_CONFIG],
+           stats[CTF2301_BUS_TELEMETRY].promotions + stats[CTF2301_BUS_CONFIG].promotions);
+}
+
+static void testTimeoutRace(void){
+    Client clients[TEST_RACE_CLIENTS];
+    CTF2301_ArbiterStats stats[CTF2301_BUS_CLASSES];
+    uint32_t granted = 0;
+    uint32_t timedOut = 0;
+    uint32_t grants = 0;
+    uint32_t timeouts = 0;
+
+    CTF2301_arbiterInit(&arbiter);
+    holdersMax = 0;
+    memset(clients, 0, sizeof(clients));
+    for (int i = 0; i < TEST_RACE_CLIENTS; i++){
+        clients[i].busClass = (CTF2301_BusClass)(i % CTF2301_BUS_CLASSES);
+        clients[i].timeoutMs = (i % 4 == 0) ? 0 : 1;
+        clients[i].rounds = TEST_RACE_ROUNDS;
+    }
+    runLoad(clients, TEST_RACE_CLIENTS);
+
+    CTF2301_arbiterGetStats(&arbiter, stats);
+    for (int i = 0; i < TEST_RACE_CLIENTS; i++){
+        granted += clients[i].granted;
+        timedOut += clients[i].timedOut;
+    }
+    for (int c = 0; c < CTF2301_BUS_CLASSES; c++){
+        grants += stats[c].grants;
+        timeouts += stats[c].timeouts;
+    }
+    CHECK(holdersMax == 1);
+    CHECK(granted + timedOut == TEST_RACE_CLIENTS * TEST_RACE_ROUNDS);
+    CHECK(timedOut > 0);
+    // A grant to a client that gave up would be counted here but never released
+    CHECK(grants == granted);
+    CHECK(timeouts == timedOut);
+    CHECK(arbiter.busy == 0);
+    for (int c = 0; c < CTF2301_BUS_CLASSES; c++){
+        CHECK(arbiter.head[c] == NULL && arbiter.tail[c] == NULL);
+    }
+    CHECK(CTF2301_arbiterAcquire(&arbiter, CTF2301_BUS_CONFIG, 0) == CTF2301_OK);
+    CTF2301_arbiterRelease(&arbiter);
+}
+
+int main(void){
+    testPriority();
+    testPromotion();
+    testLoad();
+    testTimeoutRace();
+    return TEST_RESULT("test_arbiter");
+}
@@ -0,0 +1,205 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Remote diode calibration test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Runs CTF2301_calibrateRemote() against a CTF2301_SimChip with a diode
+  error and a beta mismatch: the best beta compensation is found, the offset
+  takes out the rest and the conversion rate is restored. A diode fault or
+  an error beyond the offset range leaves the chip uncalibrated. The stored
+  blob is checked against CRC-16/CCITT and applied to a fresh chip.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+#define TEST_TEMP                        50     // °C of the diode and the reference
+#define TEST_STEP                        4      // 1/8°C in CTF2301_Temp
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    chip.remoteTemp = TEST_TEMP * 1000;
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+}
+
+// CRC-16/CCITT, MSB first from 0xFFFF
+static uint16_t crc16(const uint8_t *data, size_t length){
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++){
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void sign(CTF2301_Calibration *cal){
+    uint16_t crc = crc16((const uint8_t *)cal, CTF2301_CAL_BYTES - 2);
+    cal->crc[0] = crc & 0xFF;
+    cal->crc[1] = crc >> 8;
+}
+
+// Remote temperature after the filter had time to settle
+static CTF2301_Temp settled(void){
+    uint16_t raw = 0;
+    CTF2301_simAdvance(&bus, 30000000);
+    CHECK(CTF2301_readRemoteTemp(&dev, &raw) == CTF2301_OK);
+    return CTF2301_decodeRemote(raw);
+}
+
+static void testBeta(void){
+    CTF2301_Calibration cal;
+    CTF2301_Temp temp;
+    uint8_t rate;
+
+    // The diode reads 1.5°C high with the matching setting 3, and 4°C high with automatic detection
+    setup();
+    rate = chip.regs[CONVERSION_RATE];
+    chip.remoteError = 1500;
+    chip.remoteBeta = 3;
+    chip.remoteBetaAutoError = 4000;
+    chip.remoteNoise = 250;
+    CHECK(CTF2301_calibrateRemote(&dev, CTF2301_TEMP_FROM_C(TEST_TEMP), &cal) == CTF2301_OK);
+    CHECK(cal.version == CTF2301_CAL_VERSION);
+    CHECK(cal.betaComp == 3);
+    CHECK(cal.filter == configCAL_FILTER);
+    CHECK(cal.error >= 12 - 1 && cal.error <= 12 + 1);
+    CHECK(CTF2301_calibrationValid(&cal));
+
+    // The chip runs the calibration at the old conversion rate
+    CHECK(chip.regs[REMOTE_DIODE_BETA_COMP] == 3);
+    CHECK(chip.regs[REMOTE_TEMP_OFFSET_MSB] == cal.offsetMsb && chip.regs[REMOTE_TEMP_OFFSET_LSB] == cal.offsetLsb);
+    CHECK(chip.regs[CONVERSION_RATE] == rate);
+    temp = settled();
+    CHECK(temp >= CTF2301_TEMP_FROM_C(TEST_TEMP) - TEST_STEP && temp <= CTF2301_TEMP_FROM_C(TEST_TEMP) + TEST_STEP);
+}
+
+static void testAuto(void){
+    CTF2301_Calibration cal;
+    CTF2301_Temp temp;
+
+    // Automatic detection works, it is kept, only the diode error is left for the offset
+    setup();
+    chip.remoteError = 2000;
+    chip.remoteBeta = 5;
+    CHECK(CTF2301_calibrateRemote(&dev, CTF2301_TEMP_FROM_C(TEST_TEMP), &cal) == CTF2301_OK);
+    CHECK(cal.betaComp == CTF2301_BETA_AUTO);
+    CHECK(cal.error == 16);
+    CHECK((int8_t)cal.offsetMsb == -2 && (cal.offsetLsb & 0xE0) == 0);
+    temp = settled();
+    CHECK(temp == CTF2301_TEMP_FROM_C(TEST_TEMP));
+}
+
+static void testFault(void){
+    CTF2301_Calibration cal;
+    uint8_t rate;
+
+    // Open diode: nothing to calibrate
+    setup();
+    rate = chip.regs[CONVERSION_RATE];
+    memset(&cal, 0, sizeof(cal));
+    chip.remoteOpen = 1;
+    CHECK(CTF2301_calibrateRemote(&dev, CTF2301_TEMP_FROM_C(TEST_TEMP), &cal) == (uint32_t)CTF2301_ERROR_VERIFY);
+    CHECK(!CTF2301_calibrationValid(&cal));
+    CHECK(chip.regs[REMOTE_DIODE_BETA_COMP] == CTF2301_BETA_AUTO);
+    CHECK(chip.regs[CONVERSION_RATE] == rate);
+
+    // An error the offset can't take
+    setup();
+    CHECK(CTF2301_calibrateRemote(&dev, CTF2301_TEMP_FROM_C(-100), &cal) == (uint32_t)CTF2301_ERROR_VERIFY);
+    CHECK(chip.regs[REMOTE_TEMP_OFFSET_MSB] == 0 && chip.regs[REMOTE_TEMP_OFFSET_LSB] == 0);
+    CHECK(chip.regs[CONVERSION_RATE] == rate);
+}
+
+static void testBlob(void){
+    static const uint8_t check[] = "123456789";
+    CTF2301_Calibration cal;
+    CTF2301_Calibration bad;
+
+    // Check value of CRC-16/CCITT
+    CHECK(crc16(check, sizeof(check) - 1) == 0x29B1);
+    CHECK(sizeof(CTF2301_Calibration) == CTF2301_CAL_BYTES);
+
+    setup();
+    chip.remoteError = 3000;
+    chip.remoteBeta = 1;
+    chip.remoteBetaAutoError = 2000;
+    CHECK(CTF2301_calibrateRemote(&dev, CTF2301_TEMP_FROM_C(TEST_TEMP), &cal) == CTF2301_OK);
+    CHECK(crc16((const uint8_t *)&cal, CTF2301_CAL_BYTES - 2) == (cal.crc[0] | (cal.crc[1] << 8)));
+
+    // Every flipped bit is caught, and nothing is written
+    setup();
+    chip.remoteError = 3000;
+    chip.remoteBeta = 1;
+    chip.remoteBetaAutoError = 2000;
+    for (size_t i = 0; i < CTF2301_CAL_BYTES * 8; i++){
+        bad = cal;
+        ((uint8_t *)&bad)[i / 8] ^= 1 << (i % 8);
+        CHECK(!CTF2301_calibrationValid(&bad));
+        CHECK(CTF2301_calibrationApply(&dev, &bad) == (uint32_t)CTF2301_ERROR_VERIFY);
+    }
+    CHECK(chip.regs[REMOTE_DIODE_BETA_COMP] == CTF2301_BETA_AUTO);
+    CHECK(chip.regs[REMOTE_TEMP_OFFSET_MSB] == 0);
+
+    // Another version or filter level is refused even with a good CRC
+    bad = cal;
+    bad.version = CTF2301_CAL_VERSION + 1;
+    sign(&bad);
+    CHECK(CTF2301_calibrationApply(&dev, &bad) == (uint32_t)CTF2301_ERROR_VERIFY);
+    bad = cal;
+    bad.filter = 4;
+    sign(&bad);
+    CHECK(CTF2301_calibrationApply(&dev, &bad) == (uint32_t)CTF2301_ERROR_VERIFY);
+
+    // The stored blob calibrates a fresh chip with the same diode
+    CHECK(CTF2301_calibrationApply(&dev, &cal) == CTF2301_OK);
+    CHECK(chip.regs[REMOTE_DIODE_BETA_COMP] == cal.betaComp);
+    CHECK(chip.regs[REMOTE_TEMP_OFFSET_MSB] == cal.offsetMsb);
+    CHECK((chip.regs[REMOTE_TEMP_OFFSET_LSB] & 0xE0) == (cal.offsetLsb & 0xE0));
+    CHECK(settled() == CTF2301_TEMP_FROM_C(TEST_TEMP));
+}
+
+int main(void){
+    testBeta();
+    testAuto();
+    testFault();
+    testBlob();
+    return TEST_RESULT("test_calibrate");
+}
@@ -0,0 +1,114 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Fixed-point temperature host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Every raw value of every temperature format survives a decode / encode
+  round trip unchanged, every CTF2301_Temp encodes to the nearest step of the
+  format (or its limit) and the batch decoders match the scalar ones.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <stdlib.h>
+
+typedef struct {
+    const char *name;
+    CTF2301_Temp (*decode)(uint16_t raw);
+    uint16_t (*encode)(CTF2301_Temp temp);
+    void (*decodeBatch)(const uint16_t *raw, CTF2301_Temp *temp, size_t count);
+    uint16_t mask;                          // Bits of the raw value that carry data
+    CTF2301_Temp step;                      // Resolution in 1/32°C
+} Format;
+
+static const Format formats[] = {
+    { "local", CTF2301_decodeLocal, CTF2301_encodeLocal, CTF2301_decodeLocalBatch, 0x0FFF, 2 },
+    { "remote", CTF2301_decodeRemote, CTF2301_encodeRemote, CTF2301_decodeRemoteBatch,
+      CTF2301_REMOTE_TEMP_MASK, (CTF2301_REMOTE_TEMP_MASK & 3) ? 1 : 4 },
+    { "remote unsigned", CTF2301_decodeRemoteUnsigned, CTF2301_encodeRemoteUnsigned, CTF2301_decodeRemoteUnsignedBatch,
+      CTF2301_REMOTE_TEMP_MASK, (CTF2301_REMOTE_TEMP_MASK & 3) ? 1 : 4 },
+    { "setpoint", CTF2301_decodeSetpoint, CTF2301_encodeSetpoint, CTF2301_decodeSetpointBatch, 0xFFE0, 4 }
+};
+
+static void testFormat(const Format *format){
+    static uint16_t raw[0x10000];
+    static CTF2301_Temp batch[0x10000];
+    CTF2301_Temp lowest = 0x7FFF;
+    CTF2301_Temp highest = -0x8000;
+    CTF2301_Temp decoded;
+    uint32_t count = 0;
+    uint32_t roundTrip = 0;
+    uint32_t nearest = 0;
+    uint32_t batchOk = 0;
+
+    // Raw values of the format, and the range they cover
+    for (uint32_t r = 0; r <= 0xFFFF; r++){
+        if ((r & ~(uint32_t)format->mask) == 0){
+            raw[count++] = (uint16_t)r;
+            decoded = format->decode((uint16_t)r);
+            lowest = (decoded < lowest) ? decoded : lowest;
+            highest = (decoded > highest) ? decoded : highest;
+            roundTrip += (format->encode(decoded) == r);
+        }
+    }
+    CHECK(roundTrip == count);
+
+    // Encoding rounds to the nearest step inside the range and clamps outside it
+    for (int32_t t = -0x8000; t <= 0x7FFF; t++){
+        decoded = format->decode(format->encode((CTF2301_Temp)t));
+        if (t < lowest){
+            nearest += (decoded == lowest);
+        } else if (t > highest){
+            nearest += (decoded == highest);
+        } else {
+            nearest += (abs(decoded - t) <= format->step / 2);
+        }
+    }
+    CHECK(nearest == 0x10000);
+
+    format->decodeBatch(raw, batch, count);
+    for (uint32_t i = 0; i < count; i++){
+        batchOk += (batch[i] == format->decode(raw[i]));
+    }
+    CHECK(batchOk == count);
+
+    printf("%s: %u raw values, %d to %d\n", format->name, count, lowest, highest);
+}
+
+int main(void){
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++){
+        testFormat(&formats[i]);
+    }
+    // Fixed points of the scale
+    CHECK(CTF2301_decodeLocal(CTF2301_encodeLocal(CTF2301_TEMP_FROM_C(25))) == CTF2301_TEMP_FROM_C(25));
+    CHECK(CTF2301_decodeRemote(CTF2301_encodeRemote(CTF2301_TEMP_FROM_C(-40))) == CTF2301_TEMP_FROM_C(-40));
+    CHECK(CTF2301_TEMP_TO_MILLI_C(CTF2301_TEMP_FROM_C(85)) == 85000);
+    return TEST_RESULT("test_decode");
+}
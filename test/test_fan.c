@@ -0,0 +1,160 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Fan speed controller host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Runs the PI loop of CTF2301_setFanSpeed() every 100ms against the fan of
+  CTF2301_SimChip: it settles on the target, also when fanMaxRPM is off,
+  holds PWM_VALUE once settled, follows a new target, stops the fan and
+  refuses to run in Auto-Temp Mode.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FAN_MAX_RPM                 6000
+#define TEST_STEP_US                     100000
+#define TEST_MAX_STEPS                   50         // 5s to settle
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+
+static void setup(uint8_t directDcyMode){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    chip.fanMaxRPM = TEST_FAN_MAX_RPM;
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    dev.config.directDcyMode = directDcyMode;
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+}
+
+// Step the loop until it reports settled
+// Return: steps taken, TEST_MAX_STEPS + 1 if it never settles
+static int settle(uint16_t fanMaxRPM, uint16_t setRPM){
+    for (int i = 1; i <= TEST_MAX_STEPS; i++){
+        CTF2301_simAdvance(&bus, TEST_STEP_US);
+        uint32_t ret = CTF2301_setFanSpeed(&dev, fanMaxRPM, setRPM);
+        if (ret == CTF2301_OK){
+            return i;
+        }
+        if (ret != CTF2301_PENDING){
+            break;
+        }
+    }
+    return TEST_MAX_STEPS + 1;
+}
+
+// Speed within tolerance of a target, one PWM step worth of RPM or configFAN_SETTLE_RPM
+static int near(uint32_t rpm, uint32_t target){
+    uint32_t tolerance = TEST_FAN_MAX_RPM / (2 * chip.regs[PWM_FREQ]);
+    if (tolerance < configFAN_SETTLE_RPM){
+        tolerance = configFAN_SETTLE_RPM;
+    }
+    return abs((int)rpm - (int)target) <= (int)tolerance;
+}
+
+static void testSettle(void){
+    uint16_t rpm;
+    uint32_t writes;
+    uint8_t held = 1;
+
+    setup(1);
+    CHECK(CTF2301_setFanSpeed(&dev, TEST_FAN_MAX_RPM, 3000) == CTF2301_PENDING);
+    CHECK(settle(TEST_FAN_MAX_RPM, 3000) <= TEST_MAX_STEPS);
+    CHECK(near(CTF2301_simFanRPM(&chip), 3000));
+    CHECK(CTF2301_getFanSpeed(&dev, &rpm) == CTF2301_OK);
+    CHECK(near(rpm, 3000));
+    CHECK(dev.fan.code == chip.regs[PWM_VALUE]);
+
+    // Once settled PWM_VALUE is left alone
+    writes = dev.fan.writes;
+    for (int i = 0; i < 20; i++){
+        CTF2301_simAdvance(&bus, TEST_STEP_US);
+        held &= (CTF2301_setFanSpeed(&dev, TEST_FAN_MAX_RPM, 3000) == CTF2301_OK);
+    }
+    CHECK(held);
+    CHECK(dev.fan.writes == writes);
+
+    // A new target starts over
+    CHECK(CTF2301_setFanSpeed(&dev, TEST_FAN_MAX_RPM, 4500) == CTF2301_PENDING);
+    CHECK(dev.fan.settled == 0);
+    CHECK(settle(TEST_FAN_MAX_RPM, 4500) <= TEST_MAX_STEPS);
+    CHECK(near(CTF2301_simFanRPM(&chip), 4500));
+}
+
+static void testWrongMax(void){
+    // The loop corrects for a fan that doesn't reach the fanMaxRPM it is given
+    setup(1);
+    CHECK(settle(8000, 3000) <= TEST_MAX_STEPS);
+    CHECK(near(CTF2301_simFanRPM(&chip), 3000));
+    CHECK(dev.fan.integral > 0);
+
+    // Or that is faster than that
+    setup(1);
+    CHECK(settle(4000, 3000) <= TEST_MAX_STEPS);
+    CHECK(near(CTF2301_simFanRPM(&chip), 3000));
+    CHECK(dev.fan.integral < 0);
+}
+
+static void testStop(void){
+    uint16_t rpm;
+
+    setup(1);
+    CHECK(settle(TEST_FAN_MAX_RPM, 3000) <= TEST_MAX_STEPS);
+
+    // 0 RPM writes a zero duty cycle, the fan winds down and reads as stopped
+    CHECK(settle(TEST_FAN_MAX_RPM, 0) <= TEST_MAX_STEPS);
+    CHECK(chip.regs[PWM_VALUE] == 0);
+    CHECK(dev.fan.integral == 0);
+    CTF2301_simAdvance(&bus, 3000000);
+    CHECK(CTF2301_getFanSpeed(&dev, &rpm) == CTF2301_OK);
+    CHECK(rpm == 0);
+}
+
+static void testAutoMode(void){
+    // PWM_VALUE belongs to the look-up table in Auto-Temp Mode
+    setup(0);
+    CTF2301_simAdvance(&bus, TEST_STEP_US);
+    CHECK(CTF2301_setFanSpeed(&dev, TEST_FAN_MAX_RPM, 3000) == (uint32_t)CTF2301_ERROR_NOT_READY);
+    CHECK(dev.fan.writes == 0);
+    CHECK(CTF2301_setFanSpeed(&dev, 0, 3000) == (uint32_t)CTF2301_ERROR);
+}
+
+int main(void){
+    testSettle();
+    testWrongMax();
+    testStop();
+    testAutoMode();
+    return TEST_RESULT("test_fan");
+}
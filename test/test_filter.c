@@ -0,0 +1,255 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Filter stage test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Pushes known sequences through CTF2301_filterPush() one stage at a time:
+  the median drops spikes and holds the output back until its window is
+  full, the moving average converges, decimation passes
+  every Nth sample, the deadband holds small changes and the slew limiter
+  caps the steps, with the suppressed and slewLimited counters. Then the
+  defaults against a noisy simulated diode.
+
+  make test
+
+ */
+
+#include "CTF2301_filter.h"
+#include "test.h"
+#include <string.h>
+
+static CTF2301_Filter filter;
+
+// A filter with every stage off
+static void setup(void){
+    CTF2301_filterInit(&filter);
+    filter.config.median = 1;
+    filter.config.emaShift = 0;
+    filter.config.decimation = 1;
+    filter.config.slew = 0;
+    filter.config.deadband = 0;
+}
+
+// Push a sample, check the result and the output
+static void push(CTF2301_Temp sample, uint32_t expected, CTF2301_Temp output){
+    CTF2301_Temp out = -1;
+    CHECK(CTF2301_filterPush(&filter, sample, &out) == expected);
+    CHECK(out == output);
+}
+
+static void testMedian(void){
+    setup();
+    filter.config.median = 3;
+
+    // Nothing goes out until the window is full, a spike among the first samples included
+    push(1000, CTF2301_PENDING, 0);
+    push(100, CTF2301_PENDING, 0);
+    push(100, CTF2301_OK, 100);
+
+    // A single spike never reaches the output
+    push(1000, CTF2301_PENDING, 100);
+    push(100, CTF2301_PENDING, 100);
+    push(100, CTF2301_PENDING, 100);
+
+    // A step does, once it holds the majority of the window
+    push(200, CTF2301_PENDING, 100);
+    push(200, CTF2301_OK, 200);
+    CHECK(filter.stats.outputs == 2);
+
+    // A window narrowed on the fly keeps only its newest samples
+    setup();
+    filter.config.median = 5;
+    for (int i = 0; i < 4; i++){
+        push(100, CTF2301_PENDING, 0);
+    }
+    push(100, CTF2301_OK, 100);
+    filter.config.median = 3;
+    push(200, CTF2301_PENDING, 100);
+    push(200, CTF2301_OK, 200);
+    CHECK(filter.count == 3);
+
+    // A reset fills the window again before the next output
+    CTF2301_filterReset(&filter);
+    push(300, CTF2301_PENDING, 200);
+    push(300, CTF2301_PENDING, 200);
+    push(300, CTF2301_OK, 300);
+}
+
+static void testEma(void){
+    CTF2301_Temp out = 0;
+    CTF2301_Temp last = 0;
+    int steps = 0;
+
+    setup();
+    filter.config.emaShift = 2;
+    push(0, CTF2301_OK, 0);
+
+    // A quarter of the step at first, then closing in without overshoot
+    push(320, CTF2301_OK, 80);
+    last = 80;
+    while (out != 320 && steps < 40){
+        uint32_t ret = CTF2301_filterPush(&filter, 320, &out);
+        CHECK(ret == CTF2301_OK || ret == CTF2301_PENDING);
+        CHECK(out >= last && out <= 320);
+        last = out;
+        steps++;
+    }
+    CHECK(out == 320);
+    push(320, CTF2301_PENDING, 320);
+}
+
+static void testDecimation(void){
+    setup();
+    filter.config.decimation = 4;
+    push(0, CTF2301_OK, 0);
+
+    // Three samples in are held back, the fourth goes out
+    push(32, CTF2301_PENDING, 0);
+    push(64, CTF2301_PENDING, 0);
+    push(96, CTF2301_PENDING, 0);
+    push(128, CTF2301_OK, 128);
+    CHECK(filter.stats.samples == 5);
+    CHECK(filter.stats.outputs == 2);
+    CHECK(filter.stats.suppressed == 3);
+
+    // Samples that repeat the last one are not counted as saved writes
+    push(128, CTF2301_PENDING, 128);
+    push(128, CTF2301_PENDING, 128);
+    CHECK(filter.stats.suppressed == 3);
+}
+
+static void testDeadband(void){
+    setup();
+    filter.config.deadband = 8;
+    push(0, CTF2301_OK, 0);
+    push(7, CTF2301_PENDING, 0);
+    push(8, CTF2301_OK, 8);
+    push(1, CTF2301_PENDING, 8);
+    push(0, CTF2301_OK, 0);
+    CHECK(filter.stats.suppressed == 2);
+    CHECK(filter.stats.outputs == 3);
+}
+
+static void testSlew(void){
+    static const CTF2301_Temp ramp[] = { 16, 32, 48, 64, 80, 96, 100 };
+
+    setup();
+    filter.config.slew = 16;
+    push(0, CTF2301_OK, 0);
+
+    // The step is taken in slew sized pieces, the last one is what is left
+    for (size_t i = 0; i < sizeof(ramp) / sizeof(ramp[0]); i++){
+        push(100, CTF2301_OK, ramp[i]);
+    }
+    CHECK(filter.stats.slewLimited == 6);
+    push(100, CTF2301_PENDING, 100);
+    push(-100, CTF2301_OK, 84);
+    CHECK(filter.stats.slewLimited == 7);
+}
+
+static void testConfig(void){
+    CTF2301_Temp out = 0;
+
+    setup();
+    filter.config.median = 2;
+    CHECK(CTF2301_filterPush(&filter, 0, &out) == (uint32_t)CTF2301_ERROR);
+    filter.config.median = configFILTER_MEDIAN_MAX + 2;
+    CHECK(CTF2301_filterPush(&filter, 0, &out) == (uint32_t)CTF2301_ERROR);
+    filter.config.median = 1;
+    filter.config.decimation = 0;
+    CHECK(CTF2301_filterPush(&filter, 0, &out) == (uint32_t)CTF2301_ERROR);
+    filter.config.decimation = 1;
+    filter.config.emaShift = 9;
+    CHECK(CTF2301_filterPush(&filter, 0, &out) == (uint32_t)CTF2301_ERROR);
+    CHECK(filter.stats.samples == 0);
+
+    // After a reset the next sample starts over, whatever the output was
+    filter.config.emaShift = 2;
+    push(0, CTF2301_OK, 0);
+    CTF2301_filterReset(&filter);
+    push(500, CTF2301_OK, 500);
+    CHECK(filter.stats.samples == 2);
+}
+
+static void testRemote(void){
+    CTF2301_SimBus bus;
+    CTF2301_SimChip chip;
+    CTF2301_Device dev;
+    CTF2301_Temp out = 0;
+    uint32_t writes = 0;
+    uint32_t changes = 0;
+    uint32_t seed = 1;
+    uint16_t raw;
+    uint16_t last = 0;
+    uint32_t ret;
+
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    CTF2301_simAttach(&bus, &chip);
+    memset(&dev, 0, sizeof(dev));
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // The defaults against +/-0.4°C of noise around 50°C: a twentieth of the writes of the raw readings, close to 50°C
+    CTF2301_filterInit(&filter);
+    for (int i = 0; i < 2000; i++){
+        seed = seed * 1103515245 + 12345;
+        chip.remoteTemp = 50000 + (int32_t)((seed >> 16) % 801) - 400;
+        CTF2301_simAdvance(&bus, 1000000);
+        // What a loop on raw readings would write
+        CHECK(CTF2301_readRemoteTemp(&dev, &raw) == CTF2301_OK);
+        if (i > 0 && raw != last){
+            changes++;
+        }
+        last = raw;
+        ret = CTF2301_filterRemote(&dev, &filter, &out);
+        CHECK(ret == CTF2301_OK || ret == CTF2301_PENDING);
+        if (ret == CTF2301_OK){
+            writes++;
+        }
+    }
+    CHECK(writes == filter.stats.outputs);
+    CHECK(writes * 20 < changes);
+    CHECK(filter.stats.suppressed + filter.stats.outputs >= changes);
+    CHECK(out >= CTF2301_TEMP_FROM_C(50) - configFILTER_DEADBAND && out <= CTF2301_TEMP_FROM_C(50) + configFILTER_DEADBAND);
+
+    // A failed read pushes nothing
+    chip.nackNext = configI2C_RETRIES + 1;
+    CHECK(CTF2301_filterRemote(&dev, &filter, &out) == (uint32_t)CTF2301_ERROR);
+    CHECK(filter.stats.samples == 2000);
+}
+
+int main(void){
+    testMedian();
+    testEma();
+    testDecimation();
+    testDeadband();
+    testSlew();
+    testConfig();
+    testRemote();
+    return TEST_RESULT("test_filter");
+}
@@ -0,0 +1,347 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Asynchronous transport host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Runs the interrupt driven request queue of the MX driver against the
+  simulated HAL: completion callbacks and flags, submission order, a full
+  queue, retries from the error interrupt, two chips sharing a bus, a blocking
+  wait that times out, the shadow registers of failed and abandoned writes,
+  a zone snapshot that times out and the bus recovery after a slave held SDA low.
+  Transfers complete when HAL_SIM_Process() finds them due, after
+  HAL_SIM_I2C_Latency ticks.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "CTF2301_zone.h"
+#include "test.h"
+#include <string.h>
+
+#define TEST_ADDR_A                      configDEVICE_CTF2301_I2C_ADDR
+#define TEST_ADDR_B                      (configDEVICE_CTF2301_I2C_ADDR + 1)
+#define TEST_SCL_PIN                     (1U << 8)
+#define TEST_SDA_PIN                     (1U << 9)
+
+static HAL_SIM_I2C_Slave chipA;
+static HAL_SIM_I2C_Slave chipB;
+static CTF2301_Device devA;
+static CTF2301_Device devB;
+
+// Completions seen by record(), in order
+static struct {
+    uint8_t count;
+    uint8_t tag[2 * configASYNC_QUEUE_DEPTH];
+    uint32_t status[2 * configASYNC_QUEUE_DEPTH];
+} completions;
+
+// Reads and writes of chipA that fail before one goes through
+static uint32_t failReads;
+static uint32_t failWrites;
+
+static void record(CTF2301_Device *dev, uint32_t status, void *context){
+    (void)dev;
+    if (completions.count < sizeof(completions.tag)){
+        completions.tag[completions.count] = (uint8_t)(uintptr_t)context;
+        completions.status[completions.count] = status;
+        completions.count++;
+    }
+}
+
+static HAL_StatusTypeDef failingRead(HAL_SIM_I2C_Slave *slave, uint16_t memAddress, uint8_t *data, uint16_t length){
+    if (failReads > 0){
+        failReads--;
+        return HAL_ERROR;
+    }
+    memcpy(data, &slave->regs[memAddress], length);
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef failingWrite(HAL_SIM_I2C_Slave *slave, uint16_t memAddress, const uint8_t *data, uint16_t length){
+    if (failWrites > 0){
+        failWrites--;
+        return HAL_ERROR;
+    }
+    memcpy(&slave->regs[memAddress], data, length);
+    return HAL_OK;
+}
+
+static void setupSlave(HAL_SIM_I2C_Slave *slave, uint8_t i2cAddr, uint8_t localTemp){
+    HAL_SIM_I2C_Detach(slave);
+    memset(slave, 0, sizeof(*slave));
+    slave->bus = &hi2c2;
+    slave->devAddress = i2cAddr << 1;
+    slave->regs[LOCAL_TEMP] = localTemp;
+    slave->regs[MANUFACTURER_ID] = CTF2301_MANUFACTURER_ID;
+    HAL_SIM_I2C_Attach(slave);
+}
+
+static void setup(void){
+    CTF2301_detach(&devA);
+    CTF2301_detach(&devB);
+    setupSlave(&chipA, TEST_ADDR_A, 0x28);
+    setupSlave(&chipB, TEST_ADDR_B, 0x30);
+    CTF2301_attach(&devA, &hi2c2, TEST_ADDR_A);
+    CTF2301_attach(&devB, &hi2c2, TEST_ADDR_B);
+    HAL_SIM_I2C_Latency = 1;
+    HAL_SIM_I2C_Pins(&hi2c2, NULL, 0, NULL, 0);
+    memset(&completions, 0, sizeof(completions));
+    failReads = 0;
+    failWrites = 0;
+}
+
+// Let the simulated interrupts run until both queues are empty
+static void drain(void){
+    for (int i = 0; i < 1000 && (CTF2301_asyncPending(&devA) || CTF2301_asyncPending(&devB)); i++){
+        HAL_SIM_Advance(1);
+    }
+}
+
+static void testReadWrite(void){
+    static const uint8_t offset[2] = { 0x12, 0x40 };
+    uint8_t temp = 0;
+    volatile uint32_t doneRead;
+    volatile uint32_t doneWrite;
+
+    setup();
+    HAL_SIM_I2C_Latency = 5;
+    CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp, 1, record, (void *)1, &doneRead) == CTF2301_OK);
+    CHECK(CTF2301_writeRegistersAsync(&devA, REMOTE_TEMP_OFFSET_MSB, offset, 2, record, (void *)2, &doneWrite) == CTF2301_OK);
+    CHECK(doneRead == CTF2301_PENDING && doneWrite == CTF2301_PENDING);
+    CHECK(CTF2301_asyncPending(&devA) == 2);
+
+    // Nothing completes before the latency has passed
+    HAL_SIM_Advance(4);
+    CHECK(doneRead == CTF2301_PENDING);
+    CHECK(completions.count == 0);
+
+    drain();
+    CHECK(doneRead == CTF2301_OK && doneWrite == CTF2301_OK);
+    CHECK(temp == 0x28);
+    CHECK(chipA.regs[REMOTE_TEMP_OFFSET_MSB] == offset[0] && chipA.regs[REMOTE_TEMP_OFFSET_LSB] == offset[1]);
+    CHECK(completions.count == 2);
+    CHECK(completions.tag[0] == 1 && completions.tag[1] == 2);
+    CHECK(completions.status[0] == CTF2301_OK && completions.status[1] == CTF2301_OK);
+}
+
+static void testQueueFull(void){
+    uint8_t temp[configASYNC_QUEUE_DEPTH + 1];
+    uint8_t inOrder = 1;
+
+    setup();
+    for (int i = 0; i < configASYNC_QUEUE_DEPTH; i++){
+        CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp[i], 1, record, (void *)(uintptr_t)i, NULL) == CTF2301_OK);
+    }
+    CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp[configASYNC_QUEUE_DEPTH], 1, record, NULL, NULL)
+          == (uint32_t)CTF2301_ERROR_BUSY);
+
+    drain();
+    CHECK(completions.count == configASYNC_QUEUE_DEPTH);
+    for (int i = 0; i < completions.count; i++){
+        inOrder &= (completions.tag[i] == i && completions.status[i] == CTF2301_OK && temp[i] == 0x28);
+    }
+    CHECK(inOrder);
+
+    // The slots are free again
+    CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp[0], 1, NULL, NULL, NULL) == CTF2301_OK);
+    drain();
+}
+
+static void testRetry(void){
+    uint8_t temp = 0;
+    volatile uint32_t done;
+
+    setup();
+    chipA.memRead = failingRead;
+
+    // Errors up to configI2C_RETRIES are retried from the error interrupt
+    failReads = configI2C_RETRIES;
+    CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp, 1, record, (void *)1, &done) == CTF2301_OK);
+    drain();
+    CHECK(done == CTF2301_OK);
+    CHECK(temp == 0x28);
+    CHECK(devA.stats.retries == configI2C_RETRIES);
+    CHECK(devA.stats.failures == 0);
+    CHECK(completions.count == 1);
+
+    // One more and the request fails with the generic error
+    CTF2301_resetCacheStats(&devA);
+    failReads = configI2C_RETRIES + 1;
+    CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &temp, 1, record, (void *)2, &done) == CTF2301_OK);
+    drain();
+    CHECK(done == (uint32_t)CTF2301_ERROR);
+    CHECK(devA.stats.retries == configI2C_RETRIES);
+    CHECK(devA.stats.failures == 1);
+    CHECK(completions.count == 2 && completions.status[1] == (uint32_t)CTF2301_ERROR);
+
+    // A NACKed address is an error as well
+    HAL_SIM_I2C_Detach(&chipB);
+    CHECK(CTF2301_readRegistersAsync(&devB, LOCAL_TEMP, &temp, 1, NULL, NULL, &done) == CTF2301_OK);
+    drain();
+    CHECK(done == (uint32_t)CTF2301_ERROR);
+    CHECK(devB.stats.failures == 1);
+}
+
+static void testSharedBus(void){
+    uint8_t tempA[3] = {0};
+    uint8_t tempB[3] = {0};
+    uint8_t tagged = 1;
+
+    setup();
+    HAL_SIM_I2C_Latency = 3;
+    for (int i = 0; i < 3; i++){
+        CHECK(CTF2301_readRegistersAsync(&devA, LOCAL_TEMP, &tempA[i], 1, record, (void *)(uintptr_t)(0x10 + i), NULL) == CTF2301_OK);
+        CHECK(CTF2301_readRegistersAsync(&devB, LOCAL_TEMP, &tempB[i], 1, record, (void *)(uintptr_t)(0x20 + i), NULL) == CTF2301_OK);
+    }
+    // One transfer on the bus at a time, devB waits for devA
+    CHECK(devA.async.inFlight == 1 && devB.async.inFlight == 0);
+
+    drain();
+    CHECK(completions.count == 6);
+    for (int i = 0; i < 3; i++){
+        tagged &= (tempA[i] == 0x28 && tempB[i] == 0x30);
+    }
+    CHECK(tagged);
+    CHECK(devA.stats.busReads == 3 && devB.stats.busReads == 3);
+}
+
+static void testBlockingTimeout(void){
+    uint8_t id = 0;
+
+    setup();
+    // The transfer takes longer than a blocking caller waits: it is dropped and the bus recovered
+    HAL_SIM_I2C_Latency = 2 * configSYNC_TIMEOUT_MS;
+    CHECK(__CTF2301_readRegister(&devA, MANUFACTURER_ID, &id) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+    CHECK(devA.stats.recoveries == 1);
+    CHECK(CTF2301_asyncPending(&devA) == 0);
+    CHECK(hi2c2.simTransfer.active == 0);
+
+    // The queue carries on once the bus is back to normal
+    HAL_SIM_I2C_Latency = 1;
+    CHECK(__CTF2301_readRegister(&devA, MANUFACTURER_ID, &id) == CTF2301_OK);
+    CHECK(id == CTF2301_MANUFACTURER_ID);
+}
+
+// Whether a register is served from the shadow cache rather than read from the chip
+static uint8_t cached(CTF2301_Device *dev, CTF2301_Register address){
+    uint32_t avoided = dev->stats.readsAvoided;
+    uint8_t data;
+    CHECK(__CTF2301_readRegisterCached(dev, address, &data) == CTF2301_OK);
+    return dev->stats.readsAvoided != avoided;
+}
+
+static void testWriteShadow(void){
+    static const uint8_t lut[4] = { 0x20, 0x10, 0x30, 0x20 };
+    static const uint8_t lutNew[4] = { 0x28, 0x18, 0x38, 0x28 };
+    volatile uint32_t done;
+
+    setup();
+    chipA.memWrite = failingWrite;
+    CHECK(CTF2301_writeRegistersAsync(&devA, LOOKUP_TABLE_TEMP_1, lut, 4, NULL, NULL, &done) == CTF2301_OK);
+    drain();
+    CHECK(done == CTF2301_OK);
+    CHECK(cached(&devA, LOOKUP_TABLE_TEMP_1) && cached(&devA, LOOKUP_TABLE_PWM_2));
+
+    // A failed burst may have stopped anywhere in its run: none of it is trusted anymore
+    failWrites = configI2C_RETRIES + 1;
+    CHECK(CTF2301_writeRegistersAsync(&devA, LOOKUP_TABLE_TEMP_1, lutNew, 4, NULL, NULL, &done) == CTF2301_OK);
+    drain();
+    CHECK(done == (uint32_t)CTF2301_ERROR);
+    CHECK(!cached(&devA, LOOKUP_TABLE_TEMP_1));
+    CHECK(!cached(&devA, LOOKUP_TABLE_PWM_2));
+
+    // Same for a write the blocking caller gave up on, whether it is dropped or still lands later
+    CHECK(__CTF2301_writeRegister(&devA, TACH_LIMIT_LSB, 0x40) == CTF2301_OK);
+    CHECK(cached(&devA, TACH_LIMIT_LSB));
+    HAL_SIM_I2C_Latency = 2 * configSYNC_TIMEOUT_MS;
+    CHECK(__CTF2301_writeRegister(&devA, TACH_LIMIT_LSB, 0x80) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+    HAL_SIM_I2C_Latency = 1;
+    CHECK(!cached(&devA, TACH_LIMIT_LSB));
+    CHECK(cached(&devA, TACH_LIMIT_LSB));
+}
+
+static void testZoneTimeout(void){
+    static CTF2301_ZoneManager mgr;
+
+    setup();
+    CTF2301_zoneInit(&mgr, CTF2301_ZONE_POLICY_COUPLED);
+    CHECK(CTF2301_zoneAdd(&mgr, &devA, 0) == CTF2301_OK);
+    CHECK(CTF2301_zoneAdd(&mgr, &devB, 0) == CTF2301_OK);
+
+    // The first run never completes: the snapshot gives up, fails both devices and leaves nothing on the bus
+    HAL_SIM_I2C_Latency = 100000;
+    CHECK(CTF2301_zoneSnapshot(&mgr, 1) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+    CHECK(mgr.member[0].status == (uint32_t)CTF2301_ERROR && mgr.member[1].status == (uint32_t)CTF2301_ERROR);
+    CHECK(mgr.failed == 1 && mgr.pending == 0);
+    CHECK(devA.stats.recoveries == 1);
+    CHECK(hi2c2.simTransfer.active == 0);
+
+    // The next snapshot starts straight away
+    HAL_SIM_I2C_Latency = 1;
+    CHECK(CTF2301_zoneSnapshot(&mgr, 2) == CTF2301_OK);
+    CHECK(mgr.member[0].status == CTF2301_OK && mgr.member[1].status == CTF2301_OK);
+    CHECK(mgr.member[0].sample.timestamp == 2);
+}
+
+static void testStuckRecovery(void){
+    uint8_t id = 0;
+    volatile uint32_t done;
+
+    setup();
+    HAL_SIM_I2C_Pins(&hi2c2, GPIOB, TEST_SCL_PIN, GPIOB, TEST_SDA_PIN);
+    CTF2301_setRecoveryPins(&devA, GPIOB, TEST_SCL_PIN, GPIOB, TEST_SDA_PIN);
+
+    // A slave holds SDA low: transfers can't start and stay queued
+    chipB.sdaStuck = 5;
+    CHECK(CTF2301_readRegistersAsync(&devB, LOCAL_TEMP, &id, 1, NULL, NULL, &done) == CTF2301_OK);
+    HAL_SIM_Advance(10);
+    CHECK(done == CTF2301_PENDING);
+    CHECK(devB.async.inFlight == 0);
+
+    // The blocking read times out, clocks SCL until SDA is released and the queued request goes out
+    CHECK(__CTF2301_readRegister(&devA, MANUFACTURER_ID, &id) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+    CHECK(devA.stats.recoveries == 1);
+    CHECK(chipB.sdaStuck == 0);
+    drain();
+    CHECK(done == CTF2301_OK);
+    CHECK(__CTF2301_readRegister(&devA, MANUFACTURER_ID, &id) == CTF2301_OK);
+    CHECK(id == CTF2301_MANUFACTURER_ID);
+}
+
+int main(void){
+    testReadWrite();
+    testQueueFull();
+    testRetry();
+    testSharedBus();
+    testBlockingTimeout();
+    testWriteShadow();
+    testZoneTimeout();
+    testStuckRecovery();
+    return TEST_RESULT("test_hal_sim");
+}
@@ -0,0 +1,172 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Non-blocking init host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Steps CTF2301_initStep() once per simulated millisecond against
+  CTF2301_SimChip: a chip coming out of power-on reset gets the same image
+  as CTF2301_init() with at most one transaction per step, POR_STATUS is
+  polled every configINIT_POR_POLL_MS until the deadline, and a wrong ID or
+  a NACK ends the init with the matching error.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+#define TEST_MAX_STEPS                   1000
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+static uint32_t nowMs;
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    nowMs = 0;
+}
+
+// Step until the init is over, 1ms apart
+// Param: maxPerStep - return the most transactions seen in one step
+static uint32_t run(uint32_t *maxPerStep){
+    uint32_t ret = CTF2301_PENDING;
+    uint32_t transactions;
+    for (int i = 0; i < TEST_MAX_STEPS && ret == CTF2301_PENDING; i++){
+        transactions = bus.transactions;
+        ret = CTF2301_initStep(&dev, nowMs);
+        if (maxPerStep != NULL && bus.transactions - transactions > *maxPerStep){
+            *maxPerStep = bus.transactions - transactions;
+        }
+        CTF2301_simAdvance(&bus, 1000);
+        nowMs++;
+    }
+    return ret;
+}
+
+static void testCold(void){
+    uint8_t image[256];
+    uint32_t maxPerStep = 0;
+    uint32_t porReads;
+
+    // Image written by the blocking init, to compare with
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    memcpy(image, chip.regs, sizeof(image));
+
+    setup();
+    CTF2301_simPowerCycle(&chip);
+    CTF2301_initBegin(&dev, nowMs, 100);
+    CHECK(run(&maxPerStep) == CTF2301_OK);
+    CHECK(dev.init.stage == CTF2301_INIT_STAGE_DONE);
+    CHECK(maxPerStep == 1);
+    CHECK(chip.regs[CONFIG] == image[CONFIG]);
+    CHECK(chip.regs[ALERT_MASK] == image[ALERT_MASK]);
+    CHECK(chip.regs[ENHANCED_CONFIG] == image[ENHANCED_CONFIG]);
+    CHECK(chip.regs[PWM_TACH_CONFIG] == image[PWM_TACH_CONFIG]);
+    CHECK(memcmp(&chip.regs[TACH_LIMIT_LSB], &image[TACH_LIMIT_LSB], 2) == 0);
+    CHECK(memcmp(&chip.regs[LOOKUP_TABLE_TEMP_1], &image[LOOKUP_TABLE_TEMP_1], 24) == 0);
+
+    // POR_STATUS was read once per poll interval while the chip was busy, then once more to see it clear
+    porReads = CTF2301_SIM_POR_US / 1000 / configINIT_POR_POLL_MS + 1;
+    CHECK(dev.stats.busReads >= porReads && dev.stats.busReads <= porReads + 2);
+
+    // Further steps just report the result
+    CHECK(CTF2301_initStep(&dev, nowMs) == CTF2301_OK);
+}
+
+static void testAutoMode(void){
+    setup();
+    dev.config.directDcyMode = 0;
+    CTF2301_initBegin(&dev, nowMs, 100);
+    CHECK(run(NULL) == CTF2301_OK);
+    // The look-up table drives the PWM
+    CHECK((chip.regs[PWM_TACH_CONFIG] & 0x20) == 0);
+}
+
+static void testPorDeadline(void){
+    uint8_t config;
+
+    // The chip stays in power-on reset past the deadline
+    setup();
+    CTF2301_simPowerCycle(&chip);
+    config = chip.regs[CONFIG];
+    CTF2301_initBegin(&dev, nowMs, CTF2301_SIM_POR_US / 1000 / 2);
+    CHECK(run(NULL) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+    CHECK(dev.init.stage == CTF2301_INIT_STAGE_FAILED);
+    CHECK(nowMs >= CTF2301_SIM_POR_US / 1000 / 2 && nowMs <= CTF2301_SIM_POR_US / 1000 / 2 + configINIT_POR_POLL_MS + 1);
+    CHECK(dev.stats.busWrites == 0);
+    CHECK(chip.regs[CONFIG] == config);
+    CHECK(CTF2301_initStep(&dev, nowMs) == (uint32_t)CTF2301_ERROR_TIMEOUT);
+
+    // A deadline past the end of the reset is met
+    setup();
+    CTF2301_simPowerCycle(&chip);
+    CTF2301_initBegin(&dev, nowMs, 2 * CTF2301_SIM_POR_US / 1000);
+    CHECK(run(NULL) == CTF2301_OK);
+}
+
+static void testErrors(void){
+    // Not started
+    setup();
+    CHECK(CTF2301_initStep(&dev, nowMs) == (uint32_t)CTF2301_ERROR);
+
+    // Someone else's chip
+    setup();
+    chip.regs[MANUFACTURER_ID] = CTF2301_MANUFACTURER_ID + 1;
+    CTF2301_initBegin(&dev, nowMs, 100);
+    CHECK(run(NULL) == (uint32_t)CTF2301_ERROR_ID);
+    CHECK(dev.stats.busWrites == 0);
+
+    // Nobody answers
+    setup();
+    chip.nackNext = configI2C_RETRIES + 1;
+    CTF2301_initBegin(&dev, nowMs, 100);
+    CHECK(run(NULL) == (uint32_t)CTF2301_ERROR_COMM);
+
+    // A failed image write
+    setup();
+    CTF2301_initBegin(&dev, nowMs, 100);
+    CHECK(CTF2301_initStep(&dev, nowMs) == CTF2301_PENDING);
+    CHECK(CTF2301_initStep(&dev, nowMs) == CTF2301_PENDING);
+    chip.nackNext = configI2C_RETRIES + 1;
+    CHECK(run(NULL) == (uint32_t)CTF2301_ERROR);
+    CHECK(dev.init.stage == CTF2301_INIT_STAGE_FAILED);
+}
+
+int main(void){
+    testCold();
+    testAutoMode();
+    testPorDeadline();
+    testErrors();
+    return TEST_RESULT("test_init");
+}
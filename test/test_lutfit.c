@@ -0,0 +1,268 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Lookup table fitter test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Fits a linear fan curve with CTF2301_fitLookupTable() for both LUT
+  resolutions and both PWM scales: the entries ascend, the hysteresis is
+  never below hystMin and errorRising / errorFalling match the errors
+  worked out here against the curve. Then runs the lutfit tool on the same
+  curve and checks it prints the same table.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef LUTFIT
+#define LUTFIT                           "build/lutfit"
+#endif
+
+// 20% up to 30°C, rising linearly to 100% at 70°C
+#define TEST_T0                          30
+#define TEST_T1                          70
+#define TEST_D0                          (CTF2301_DUTY_FULL / 5)
+#define TEST_D1                          CTF2301_DUTY_FULL
+
+static const CTF2301_CurvePoint curve[] = {
+    { CTF2301_TEMP_FROM_C(TEST_T0), TEST_D0 },
+    { CTF2301_TEMP_FROM_C(TEST_T1), TEST_D1 }
+};
+
+static const uint16_t scales[] = { CTF2301_PWM_STEPS_6_25, CTF2301_PWM_STEPS_0_39 };
+
+// The curve at a temperature, flat outside the points
+static uint32_t curveAt(int32_t temp){
+    if (temp <= curve[0].temp){
+        return TEST_D0;
+    }
+    if (temp >= curve[1].temp){
+        return TEST_D1;
+    }
+    return TEST_D0 + (uint32_t)((int64_t)(TEST_D1 - TEST_D0) * (temp - curve[0].temp) / (curve[1].temp - curve[0].temp));
+}
+
+// Largest error of the table against the middle of the curve over every temperature code, the steps moved down by
+// shift codes
+static uint32_t tableError(const CTF2301_LookupTable *lut, uint16_t fullScale, uint16_t shift){
+    int32_t unit = (lut->resolution == CTF2301_LUT_RES_0_5C) ? CTF2301_TEMP_FROM_C(1) / 2 : CTF2301_TEMP_FROM_C(1);
+    uint16_t cells = (lut->resolution == CTF2301_LUT_RES_0_5C) ? 256 : 128;
+    uint32_t worst = 0;
+    for (uint16_t k = 0; k < cells; k++){
+        uint32_t lo = curveAt(k * unit);
+        uint32_t hi = curveAt((k + 1) * unit);
+        uint32_t value = lo + (hi - lo) / 2;
+        uint32_t duty = 0;
+        uint32_t error;
+        for (int i = 0; i < CTF2301_LUT_ENTRIES; i++){
+            if (lut->temp[i] <= k + shift){
+                duty = (uint32_t)((uint64_t)lut->pwm[i] * CTF2301_DUTY_FULL / fullScale);
+            }
+        }
+        error = (duty > value) ? duty - value : value - duty;
+        if (error > worst){
+            worst = error;
+        }
+    }
+    return worst;
+}
+
+static void testFit(void){
+    static const uint8_t hystMins[] = { 0, 2, 4, CTF2301_LUT_FIT_HYST_MAX + 2 };
+
+    for (uint8_t resolution = CTF2301_LUT_RES_1C; resolution <= CTF2301_LUT_RES_0_5C; resolution++){
+        uint16_t codesPerC = (resolution == CTF2301_LUT_RES_0_5C) ? 2 : 1;
+        uint32_t fine = 0;
+        for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++){
+            uint32_t last = 0;
+            for (size_t h = 0; h < sizeof(hystMins); h++){
+                CTF2301_LookupTable lut;
+                CTF2301_LutFit fit;
+
+                memset(&lut, 0xA5, sizeof(lut));
+                CHECK(CTF2301_fitLookupTable(curve, 2, resolution, scales[s], hystMins[h], &lut, &fit) == CTF2301_OK);
+                CHECK(lut.resolution == resolution);
+                CHECK(fit.entries >= 1 && fit.entries <= CTF2301_LUT_ENTRIES);
+
+                // Entries ascend, the ones the curve didn't need repeat the last
+                for (int i = 1; i < CTF2301_LUT_ENTRIES; i++){
+                    if (i < fit.entries){
+                        CHECK(lut.temp[i] > lut.temp[i - 1] && lut.pwm[i] > lut.pwm[i - 1]);
+                    } else {
+                        CHECK(lut.temp[i] == lut.temp[i - 1] && lut.pwm[i] == lut.pwm[i - 1]);
+                    }
+                }
+                CHECK(lut.pwm[fit.entries - 1] <= scales[s]);
+                CHECK(lut.temp[fit.entries - 1] <= TEST_T1 * codesPerC);
+
+                // Never below the floor, wider only up to CTF2301_LUT_FIT_HYST_MAX
+                CHECK(lut.hysteresis >= hystMins[h]);
+                CHECK(lut.hysteresis == hystMins[h] || lut.hysteresis <= CTF2301_LUT_FIT_HYST_MAX);
+
+                // The errors are those of the table against the curve
+                CHECK(fit.errorRising == tableError(&lut, scales[s], 0));
+                CHECK(fit.errorFalling == tableError(&lut, scales[s], lut.hysteresis * codesPerC));
+                CHECK(fit.errorRising >= last);
+                last = fit.errorRising;
+                if (hystMins[h] == 0){
+                    // Twelve steps over 80%: within a PWM step of 6.25%, and a finer PWM does better
+                    CHECK(fit.errorRising < CTF2301_DUTY_FULL / 16);
+                    CHECK(s == 0 || fit.errorRising < fine);
+                    fine = fit.errorRising;
+                }
+            }
+        }
+    }
+}
+
+static void testFlat(void){
+    static const CTF2301_CurvePoint half[] = { { 0, CTF2301_DUTY_FULL / 2 } };
+    static const CTF2301_CurvePoint off[] = { { 0, 0 }, { CTF2301_TEMP_FROM_C(100), 0 } };
+    CTF2301_LookupTable lut;
+    CTF2301_LutFit fit;
+
+    // One entry holds a flat curve exactly, any hysteresis is free
+    CHECK(CTF2301_fitLookupTable(half, 1, CTF2301_LUT_RES_1C, CTF2301_PWM_STEPS_6_25, 0, &lut, &fit) == CTF2301_OK);
+    CHECK(fit.entries == 1 && fit.errorRising == 0 && fit.errorFalling == 0);
+    CHECK(lut.temp[0] == 0 && lut.pwm[0] == CTF2301_PWM_STEPS_6_25 / 2);
+    CHECK(lut.hysteresis == CTF2301_LUT_FIT_HYST_MAX);
+
+    // A curve that never leaves 0% parks the entries at the top
+    CHECK(CTF2301_fitLookupTable(off, 2, CTF2301_LUT_RES_0_5C, CTF2301_PWM_STEPS_0_39, 0, &lut, &fit) == CTF2301_OK);
+    CHECK(fit.entries == 0 && fit.errorRising == 0);
+    CHECK(lut.temp[0] == 255 && lut.temp[11] == 255 && lut.pwm[11] == 0);
+}
+
+static void testInvalid(void){
+    CTF2301_CurvePoint bad[2] = { curve[1], curve[0] };
+    CTF2301_LookupTable lut;
+
+    CHECK(CTF2301_fitLookupTable(bad, 2, CTF2301_LUT_RES_1C, CTF2301_PWM_STEPS_6_25, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+    bad[0] = curve[0];
+    bad[1].temp = curve[1].temp;
+    bad[1].duty = CTF2301_DUTY_FULL + 1;
+    CHECK(CTF2301_fitLookupTable(bad, 2, CTF2301_LUT_RES_1C, CTF2301_PWM_STEPS_6_25, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+    CHECK(CTF2301_fitLookupTable(curve, 0, CTF2301_LUT_RES_1C, CTF2301_PWM_STEPS_6_25, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+    CHECK(CTF2301_fitLookupTable(curve, 2, CTF2301_LUT_RES_1C, 0, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+    CHECK(CTF2301_fitLookupTable(curve, 2, CTF2301_LUT_RES_1C, 256, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+    CHECK(CTF2301_fitLookupTable(curve, 2, 2, CTF2301_PWM_STEPS_6_25, 0, &lut, NULL) == (uint32_t)CTF2301_ERROR);
+}
+
+// Run lutfit on the curve and read back the table it prints
+// Return: exit status of the tool
+static int lutfit(const char *path, const char *args, CTF2301_LookupTable *lut){
+    char command[256];
+    char line[256];
+    unsigned temps = 0;
+    unsigned index;
+    unsigned value;
+    FILE *out;
+
+    memset(lut, 0, sizeof(*lut));
+    snprintf(command, sizeof(command), "%s %s %s 2>/dev/null", LUTFIT, args, path);
+    out = popen(command, "r");
+    if (out == NULL){
+        return -1;
+    }
+    while (fgets(line, sizeof(line), out) != NULL){
+        char *p;
+        if (sscanf(line, "#define configLUT_HYST %x", &value) == 1 || sscanf(line, "    .hysteresis = %u", &value) == 1){
+            lut->hysteresis = (uint8_t)value;
+        } else if (sscanf(line, "#define configLUT_TEMP_ENTRY_%u %u", &index, &value) == 2 && index >= 1 && index <= 12){
+            lut->temp[index - 1] = (uint8_t)value;
+        } else if (sscanf(line, "#define configLUT_PWM_ENTRY_%u %u", &index, &value) == 2 && index >= 1 && index <= 12){
+            lut->pwm[index - 1] = (uint8_t)value;
+        } else if (strstr(line, ".pwm") != NULL){
+            p = strchr(line, '{');
+            for (index = 0; p != NULL && index < CTF2301_LUT_ENTRIES; index++){
+                lut->pwm[index] = (uint8_t)strtoul(p + 1, &p, 10);
+            }
+        } else if (strstr(line, "CTF2301_LUT_RES_0_5C") != NULL && strstr(line, ".resolution") != NULL){
+            lut->resolution = CTF2301_LUT_RES_0_5C;
+        }
+        // .temp spans lines, every CTF2301_LUT_TEMP_ is one entry in order
+        for (p = strstr(line, "CTF2301_LUT_TEMP_"); p != NULL && temps < CTF2301_LUT_ENTRIES; p = strstr(p + 1, "CTF2301_LUT_TEMP_")){
+            lut->temp[temps++] = (uint8_t)strtoul(strchr(p, '(') + 1, NULL, 10);
+        }
+    }
+    return pclose(out);
+}
+
+static void testTool(void){
+    char path[] = "/tmp/test_lutfitXXXXXX";
+    CTF2301_LookupTable expected;
+    CTF2301_LookupTable lut;
+    char args[64];
+    FILE *csv;
+    int fd;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0){
+        return;
+    }
+    csv = fdopen(fd, "w");
+    fprintf(csv, "# temperature,duty\n%d,%d\n%d,%d\n", TEST_T0, 20, TEST_T1, 100);
+    fclose(csv);
+
+    for (uint8_t resolution = CTF2301_LUT_RES_1C; resolution <= CTF2301_LUT_RES_0_5C; resolution++){
+        for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++){
+            CHECK(CTF2301_fitLookupTable(curve, 2, resolution, scales[s], 2, &expected, NULL) == CTF2301_OK);
+            snprintf(args, sizeof(args), "-r %s -p %u -H 2 -t fanCurve", (resolution == CTF2301_LUT_RES_0_5C) ? "0.5" : "1",
+                     scales[s]);
+            CHECK(lutfit(path, args, &lut) == 0);
+            CHECK(memcmp(lut.temp, expected.temp, sizeof(lut.temp)) == 0);
+            CHECK(memcmp(lut.pwm, expected.pwm, sizeof(lut.pwm)) == 0);
+            CHECK(lut.hysteresis == expected.hysteresis && lut.resolution == resolution);
+            if (resolution == CTF2301_LUT_RES_1C){
+                // The defines carry the same table
+                snprintf(args, sizeof(args), "-p %u -H 2", scales[s]);
+                CHECK(lutfit(path, args, &lut) == 0);
+                CHECK(memcmp(lut.temp, expected.temp, sizeof(lut.temp)) == 0);
+                CHECK(memcmp(lut.pwm, expected.pwm, sizeof(lut.pwm)) == 0);
+                CHECK(lut.hysteresis == expected.hysteresis);
+            }
+        }
+    }
+
+    // The defines are whole °C, 0.5°C needs a runtime table
+    CHECK(lutfit(path, "-r 0.5", &lut) != 0);
+    unlink(path);
+}
+
+int main(void){
+    testFit();
+    testFlat();
+    testInvalid();
+    testTool();
+    return TEST_RESULT("test_lutfit");
+}
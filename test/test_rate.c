@@ -0,0 +1,175 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Adaptive conversion rate host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Runs CTF2301_rateUpdate() against CTF2301_SimChip at the poll period it
+  asks for: the fast start, the step down after configRATE_QUIET_UPDATES quiet
+  updates to configRATE_SLOWEST, the jump back on a steep ramp, slopes that
+  hold the rate and CONVERSION_RATE only being written when it changes.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+static uint32_t nowMs;
+static uint32_t pollMs;
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    // Let the first conversion fill the temperature registers
+    CTF2301_simAdvance(&bus, 1000000);
+    nowMs = 0;
+    pollMs = 0;
+}
+
+// Wait the period the last update asked for, move the remote temperature by slope m°C/s meanwhile, and update
+static uint32_t step(int32_t slope){
+    chip.remoteTemp += slope * (int32_t)pollMs / 1000;
+    CTF2301_simAdvance(&bus, pollMs * 1000);
+    nowMs += pollMs;
+    return CTF2301_rateUpdate(&dev, nowMs, &pollMs);
+}
+
+static void testStepDown(void){
+    uint8_t stepsOk = 1;
+
+    setup();
+    // Nothing to compare with on the first update, it starts fast
+    CHECK(step(0) == CTF2301_OK);
+    CHECK(dev.rate.rate == configRATE_FASTEST);
+    CHECK(chip.regs[CONVERSION_RATE] == configRATE_FASTEST);
+    CHECK(pollMs == CTF2301_ratePeriodMs(configRATE_FASTEST));
+
+    // Every configRATE_QUIET_UPDATES quiet updates the rate goes down one step, and the poll period with it
+    for (int rate = configRATE_FASTEST - 1; rate >= configRATE_SLOWEST; rate--){
+        for (int i = 0; i < configRATE_QUIET_UPDATES; i++){
+            stepsOk &= (step(0) == CTF2301_OK);
+        }
+        stepsOk &= (dev.rate.rate == rate && chip.regs[CONVERSION_RATE] == rate);
+        stepsOk &= (pollMs == CTF2301_ratePeriodMs((ConversionRate)rate));
+    }
+    CHECK(stepsOk);
+
+    // And no lower than configRATE_SLOWEST
+    for (int i = 0; i < 2 * configRATE_QUIET_UPDATES; i++){
+        CHECK(step(0) == CTF2301_OK);
+    }
+    CHECK(dev.rate.rate == configRATE_SLOWEST);
+    CHECK(chip.regs[CONVERSION_RATE] == configRATE_SLOWEST);
+}
+
+static void testRise(void){
+    setup();
+    CHECK(step(0) == CTF2301_OK);
+    for (int i = 0; i < 3 * configRATE_QUIET_UPDATES; i++){
+        CHECK(step(0) == CTF2301_OK);
+    }
+    CHECK(dev.rate.rate < configRATE_FASTEST);
+
+    // A ramp above the rise threshold goes straight back to the fastest rate
+    CHECK(step(4 * configRATE_RISE_SLOPE) == CTF2301_OK);
+    CHECK(dev.rate.slope > configRATE_RISE_SLOPE);
+    CHECK(dev.rate.rate == configRATE_FASTEST);
+    CHECK(chip.regs[CONVERSION_RATE] == configRATE_FASTEST);
+    CHECK(pollMs == CTF2301_ratePeriodMs(configRATE_FASTEST));
+}
+
+static void testHold(void){
+    uint8_t rate;
+    uint8_t held = 1;
+
+    setup();
+    CHECK(step(0) == CTF2301_OK);
+    for (int i = 0; i < configRATE_QUIET_UPDATES; i++){
+        CHECK(step(0) == CTF2301_OK);
+    }
+    rate = dev.rate.rate;
+
+    // A slope between the thresholds holds the rate and restarts the quiet count, an update that missed the
+    // conversion in between counts as quiet but one is never enough. CONVERSION_RATE is not written meanwhile.
+    CTF2301_resetCacheStats(&dev);
+    for (int i = 0; i < 4 * configRATE_QUIET_UPDATES; i++){
+        held &= (step((configRATE_RISE_SLOPE + configRATE_FALL_SLOPE) / 2) == CTF2301_OK);
+        held &= (dev.rate.slope <= configRATE_RISE_SLOPE);
+        held &= (dev.rate.rate == rate && dev.rate.quiet < 2);
+    }
+    CHECK(held);
+    CHECK(dev.stats.busWrites == 0);
+
+    // End on an update that saw the ramp
+    for (int i = 0; i < configRATE_QUIET_UPDATES && dev.rate.quiet != 0; i++){
+        CHECK(step((configRATE_RISE_SLOPE + configRATE_FALL_SLOPE) / 2) == CTF2301_OK);
+    }
+    CHECK(dev.rate.quiet == 0);
+
+    // Quiet again, configRATE_QUIET_UPDATES - 1 updates are not enough
+    for (int i = 0; i < configRATE_QUIET_UPDATES - 1; i++){
+        CHECK(step(0) == CTF2301_OK);
+    }
+    CHECK(dev.rate.rate == rate);
+    CHECK(step(0) == CTF2301_OK);
+    CHECK(dev.rate.rate == rate - 1);
+}
+
+static void testFailure(void){
+    setup();
+    CHECK(step(0) == CTF2301_OK);
+
+    // A failed read leaves the state alone
+    chip.nackNext = configI2C_RETRIES + 1;
+    CHECK(step(0) == (uint32_t)CTF2301_ERROR);
+    CHECK(dev.rate.rate == configRATE_FASTEST && dev.rate.lastMs == 0);
+}
+
+static void testPeriod(void){
+    CHECK(CTF2301_ratePeriodMs(CONVERSION_RATE_0_05_HZ) == 20000);
+    CHECK(CTF2301_ratePeriodMs(CONVERSION_RATE_1_HZ) == 1000);
+    CHECK(CTF2301_ratePeriodMs(CONVERSION_RATE_9_303_HZ) == 108);
+    // Anything above 0x08 runs at 9.303Hz
+    CHECK(CTF2301_ratePeriodMs((ConversionRate)0x0F) == 108);
+}
+
+int main(void){
+    testStepDown();
+    testRise();
+    testHold();
+    testFailure();
+    testPeriod();
+    return TEST_RESULT("test_rate");
+}
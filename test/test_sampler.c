@@ -0,0 +1,166 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Sampler host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Runs CTF2301_sample() against CTF2301_SimChip: the fields of a record
+  against the single register reads, draining in order across the wrap of
+  the free running ring indices, a full ring that drops and counts records
+  with a gap in the sequence numbers, and a failed read.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    chip.fanMaxRPM = 6000;
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    dev.config.directDcyMode = 1;
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+}
+
+static void testRecord(void){
+    CTF2301_Sample record;
+    uint16_t value;
+    uint8_t pwm;
+
+    setup();
+    // Full scale of PWM_VALUE is twice PWM_FREQ, this is half duty cycle
+    CHECK(__CTF2301_SET_PWM_VALUE(&dev, chip.regs[PWM_FREQ]) == CTF2301_OK);
+    CHECK(__CTF2301_writeRegister(&dev, LOCAL_HIGH_SETPOINT_MSB, 30) == CTF2301_OK);
+    chip.localTemp = 40500;
+    chip.remoteTemp = 71250;
+    CTF2301_simAdvance(&bus, 3000000);
+
+    CHECK(CTF2301_sample(&dev, 1234) == CTF2301_OK);
+    CHECK(CTF2301_samplerCount(&dev) == 1);
+    CHECK(CTF2301_samplerDrain(&dev, &record, 1) == 1);
+    CHECK(CTF2301_samplerCount(&dev) == 0);
+    CHECK(record.timestamp == 1234);
+    CHECK(record.sequence == 0);
+    CHECK(record.alertStatus & ALERT_STATUS_LOCAL_HIGH);
+
+    // The same values as the single reads, nothing moves without a conversion in between
+    CHECK(CTF2301_readLocalTemp(&dev, &value) == CTF2301_OK);
+    CHECK(record.localTemp == value && value == 40500 * 16 / 1000);
+    CHECK(CTF2301_readRemoteTemp(&dev, &value) == CTF2301_OK);
+    CHECK(record.remoteTemp == value && value == 71250 * 32 / 1000);
+    CHECK(CTF2301_readTach(&dev, &value) == CTF2301_OK);
+    CHECK(record.tach == value && value > 0 && value < 0xFFFF);
+    CHECK(__CTF2301_GET_PWM_VALUE(&dev, &pwm) == CTF2301_OK);
+    CHECK(record.pwm == pwm && pwm == chip.regs[PWM_FREQ]);
+}
+
+static void testWrap(void){
+    CTF2301_Sample records[configSAMPLER_DEPTH];
+    uint16_t expected = 0;
+    uint8_t inOrder = 1;
+
+    setup();
+    // Three records in, two out, long enough for the indices to go round the ring many times
+    for (int round = 0; round < 4 * configSAMPLER_DEPTH; round++){
+        for (int i = 0; i < 3; i++){
+            inOrder &= (CTF2301_sample(&dev, 3 * round + i) == CTF2301_OK);
+        }
+        inOrder &= (CTF2301_samplerDrain(&dev, records, 2) == 2);
+        for (int i = 0; i < 2; i++){
+            inOrder &= (records[i].sequence == expected && records[i].timestamp == expected);
+            expected++;
+        }
+        if (CTF2301_samplerCount(&dev) >= configSAMPLER_DEPTH - 3){
+            uint16_t count = CTF2301_samplerDrain(&dev, records, configSAMPLER_DEPTH);
+            for (int i = 0; i < count; i++){
+                inOrder &= (records[i].sequence == expected && records[i].timestamp == expected);
+                expected++;
+            }
+        }
+    }
+    CHECK(inOrder);
+    CHECK(dev.sampler.overruns == 0);
+    CHECK(dev.sampler.head > 2 * configSAMPLER_DEPTH);
+}
+
+static void testOverrun(void){
+    CTF2301_Sample records[configSAMPLER_DEPTH];
+    uint8_t inOrder = 1;
+
+    setup();
+    for (int i = 0; i < configSAMPLER_DEPTH; i++){
+        CHECK(CTF2301_sample(&dev, i) == CTF2301_OK);
+    }
+    // The ring is full: the new records are dropped and counted, the old ones stay
+    for (int i = 0; i < 3; i++){
+        CHECK(CTF2301_sample(&dev, configSAMPLER_DEPTH + i) == (uint32_t)CTF2301_ERROR_BUSY);
+    }
+    CHECK(dev.sampler.overruns == 3);
+    CHECK(CTF2301_samplerCount(&dev) == configSAMPLER_DEPTH);
+
+    CHECK(CTF2301_samplerDrain(&dev, records, configSAMPLER_DEPTH) == configSAMPLER_DEPTH);
+    for (int i = 0; i < configSAMPLER_DEPTH; i++){
+        inOrder &= (records[i].sequence == i && records[i].timestamp == (uint32_t)i);
+    }
+    CHECK(inOrder);
+
+    // The next record shows the gap of the dropped ones
+    CHECK(CTF2301_sample(&dev, 100) == CTF2301_OK);
+    CHECK(CTF2301_samplerDrain(&dev, records, configSAMPLER_DEPTH) == 1);
+    CHECK(records[0].sequence == configSAMPLER_DEPTH + 3 && records[0].timestamp == 100);
+}
+
+static void testError(void){
+    CTF2301_Sample record;
+
+    setup();
+    // A failed read pushes nothing
+    chip.nackNext = configI2C_RETRIES + 1;
+    CHECK(CTF2301_sample(&dev, 1) == (uint32_t)CTF2301_ERROR);
+    CHECK(dev.sampler.errors == 1);
+    CHECK(CTF2301_samplerCount(&dev) == 0);
+
+    CHECK(CTF2301_sample(&dev, 2) == CTF2301_OK);
+    CHECK(CTF2301_samplerDrain(&dev, &record, 1) == 1);
+    CHECK(record.timestamp == 2);
+}
+
+int main(void){
+    testRecord();
+    testWrap();
+    testOverrun();
+    testError();
+    return TEST_RESULT("test_sampler");
+}
@@ -0,0 +1,280 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Simulator host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  //
+  Runs the driver against CTF2301_SimChip on CTF2301_SimBus: the register
+  image CTF2301_init() leaves in the chip, warm and cold CTF2301_initWarm(),
+  the look-up table in the LUT resolution of the device configuration,
+  POR while the chip powers up, temperature and TACH reads, NACK and stuck
+  SDA injection and the transaction and byte counters of the bus.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+#include <string.h>
+
+// Upper bounds of a cold init on the bus, a regression in the image or its bursts shows up here first.
+// The default image takes 6 transactions and 51 bytes, configENABLE_SMBUS_TIMEOUT adds a write of 3 bytes.
+#define TEST_INIT_MAX_TRANSACTIONS       7
+#define TEST_INIT_MAX_BYTES              54
+
+static CTF2301_SimBus bus;
+static CTF2301_SimChip chip;
+static CTF2301_Device dev;
+
+static void setup(void){
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    chip.fanMaxRPM = 6000;
+    CTF2301_simAttach(&bus, &chip);
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+}
+
+static void testInitImage(void){
+    static const uint8_t lut[24] = {
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_1), configLUT_PWM_ENTRY_1,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_2), configLUT_PWM_ENTRY_2,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_3), configLUT_PWM_ENTRY_3,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_4), configLUT_PWM_ENTRY_4,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_5), configLUT_PWM_ENTRY_5,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_6), configLUT_PWM_ENTRY_6,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_7), configLUT_PWM_ENTRY_7,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_8), configLUT_PWM_ENTRY_8,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_9), configLUT_PWM_ENTRY_9,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_10), configLUT_PWM_ENTRY_10,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_11), configLUT_PWM_ENTRY_11,
+        CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_12), configLUT_PWM_ENTRY_12
+    };
+    CTF2301_LookupTable table;
+
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    CHECK(chip.regs[ALERT_MASK] == (configALERT_MASK & (uint8_t)~ALERT_STATUS_BUSY));
+    CHECK(chip.regs[CONFIG] == dev.config.configReg);
+    CHECK(chip.regs[TACH_LIMIT_LSB] == (configTACH_LIMIT & 0xFF));
+    CHECK(chip.regs[TACH_LIMIT_MSB] == (configTACH_LIMIT >> 8));
+    CHECK(memcmp(&chip.regs[LOOKUP_TABLE_TEMP_1], lut, sizeof(lut)) == 0);
+    CHECK(bus.transactions <= TEST_INIT_MAX_TRANSACTIONS);
+    CHECK(bus.bytes <= TEST_INIT_MAX_BYTES);
+    CHECK(bus.nacks == 0 && bus.stuck == 0);
+    CHECK(CTF2301_getLookupTable(&dev, &table) == CTF2301_OK);
+    CHECK(table.temp[0] == configLUT_TEMP_ENTRY_1 && table.temp[11] == configLUT_TEMP_ENTRY_12);
+}
+
+static void testInitWarm(void){
+    CTF2301_InitPath path;
+
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // MCU reset only: the chip holds the image and nothing is written
+    CTF2301_detach(&dev);
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    CHECK(CTF2301_initWarm(&dev, &path) == CTF2301_OK);
+    CHECK(path == CTF2301_INIT_PATH_WARM);
+    CHECK(dev.stats.busWrites == 0);
+
+    // Chip power cycled: the image is written again
+    CTF2301_simPowerCycle(&chip);
+    CTF2301_simAdvance(&bus, 2 * CTF2301_SIM_POR_US);
+    CTF2301_resetCacheStats(&dev);
+    CHECK(CTF2301_initWarm(&dev, &path) == CTF2301_OK);
+    CHECK(path == CTF2301_INIT_PATH_COLD);
+    CHECK(dev.stats.busWrites > 0);
+    CHECK(chip.regs[CONFIG] == dev.config.configReg);
+    CHECK(chip.regs[LOOKUP_TABLE_TEMP_1] == CTF2301_INIT_LUT_TEMP(configLUT_TEMP_ENTRY_1));
+
+    // The rewritten image holds across the next MCU reset
+    CTF2301_resetCacheStats(&dev);
+    CHECK(CTF2301_initWarm(&dev, &path) == CTF2301_OK);
+    CHECK(path == CTF2301_INIT_PATH_WARM);
+    CHECK(dev.stats.busWrites == 0);
+}
+
+static void testInitResolution(void){
+    uint8_t halfC = (CTF2301_INIT_LUT_RES != CTF2301_LUT_RES_0_5C);
+    uint8_t code = halfC ? configLUT_TEMP_ENTRY_1 * 2 : configLUT_TEMP_ENTRY_1;
+    uint32_t ret = CTF2301_PENDING;
+    CTF2301_InitPath path;
+    CTF2301_LookupTable table;
+
+    // A device configured for the other LUT resolution than the defines gets the table in its unit
+    setup();
+    dev.config.useEnhancedConfig = 1;
+    dev.config.enhancedConfigReg = (dev.config.enhancedConfigReg & (uint8_t)~0x20) | (halfC ? 0x20 : 0x00);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    CHECK(chip.regs[LOOKUP_TABLE_TEMP_1] == code);
+    CHECK(CTF2301_getLookupTable(&dev, &table) == CTF2301_OK);
+    CHECK(table.resolution == (halfC ? CTF2301_LUT_RES_0_5C : CTF2301_LUT_RES_1C));
+    CHECK(table.temp[11] == (halfC ? configLUT_TEMP_ENTRY_12 * 2 : configLUT_TEMP_ENTRY_12));
+
+    // initWarm compares against the same image
+    CTF2301_resetCacheStats(&dev);
+    CHECK(CTF2301_initWarm(&dev, &path) == CTF2301_OK);
+    CHECK(path == CTF2301_INIT_PATH_WARM);
+    CHECK(dev.stats.busWrites == 0);
+
+    // and so does the non-blocking init
+    memset(&chip.regs[LOOKUP_TABLE_TEMP_1], 0, 24);
+    CTF2301_initBegin(&dev, 0, 100);
+    for (uint32_t nowMs = 0; nowMs < 100 && ret == CTF2301_PENDING; nowMs++){
+        ret = CTF2301_initStep(&dev, nowMs);
+    }
+    CHECK(ret == CTF2301_OK);
+    CHECK(chip.regs[LOOKUP_TABLE_TEMP_1] == code);
+}
+
+static void testPOR(void){
+    setup();
+
+    // POR_STATUS is busy for a while after power-on, init refuses to touch the chip
+    CTF2301_simPowerCycle(&chip);
+    CHECK(CTF2301_init(&dev) == (uint32_t)CTF2301_ERROR_NOT_READY);
+    CTF2301_simAdvance(&bus, 2 * CTF2301_SIM_POR_US);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    CHECK(chip.regs[CONFIG] == dev.config.configReg);
+}
+
+static void testReads(void){
+    uint16_t raw;
+    uint16_t tach;
+    uint32_t rpm;
+    uint32_t simRPM;
+
+    setup();
+    dev.config.directDcyMode = 1;
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+    // Full scale of PWM_VALUE is twice PWM_FREQ, this is half duty cycle
+    CHECK(__CTF2301_SET_PWM_VALUE(&dev, chip.regs[PWM_FREQ]) == CTF2301_OK);
+    chip.localTemp = 40000;
+    chip.remoteTemp = 95000;
+    CTF2301_simAdvance(&bus, 3000000);
+
+    CHECK(CTF2301_readLocalTemp(&dev, &raw) == CTF2301_OK);
+    CHECK(raw == 40 * 16);
+    CHECK(CTF2301_readRemoteTemp(&dev, &raw) == CTF2301_OK);
+    CHECK(raw == 95 * 32);
+
+    // The speed from the TACH count is within 2% of the fan's
+    simRPM = CTF2301_simFanRPM(&chip);
+    CHECK(simRPM > 0);
+    CHECK(CTF2301_readTach(&dev, &tach) == CTF2301_OK);
+    CHECK(tach > 0 && tach < 0xFFFF);
+    rpm = CTF2301_SIM_TACH_CLOCK / tach;
+    CHECK(rpm + simRPM / 50 >= simRPM && rpm <= simRPM + simRPM / 50);
+}
+
+static void testNack(void){
+    uint16_t raw;
+    uint32_t nacks;
+
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // One NACK is absorbed by a retry
+    CTF2301_resetCacheStats(&dev);
+    nacks = bus.nacks;
+    chip.nackNext = 1;
+    CHECK(CTF2301_readLocalTemp(&dev, &raw) == CTF2301_OK);
+    CHECK(dev.stats.retries == 1);
+    CHECK(dev.stats.failures == 0);
+    CHECK(dev.stats.recoveries == 0);
+    CHECK(bus.nacks == nacks + 1);
+
+    // More NACKs than retries fail the read
+    CTF2301_resetCacheStats(&dev);
+    nacks = bus.nacks;
+    chip.nackNext = configI2C_RETRIES + 1;
+    CHECK(CTF2301_readLocalTemp(&dev, &raw) != CTF2301_OK);
+    CHECK(dev.stats.retries == configI2C_RETRIES);
+    CHECK(dev.stats.failures == 1);
+    CHECK(bus.nacks == nacks + configI2C_RETRIES + 1);
+
+    // The chip answers again afterwards
+    CHECK(CTF2301_readLocalTemp(&dev, &raw) == CTF2301_OK);
+}
+
+static void testStuck(void){
+    uint16_t raw;
+
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // SDA held low: the transfer fails, the bus is recovered and the retry goes through
+    CTF2301_resetCacheStats(&dev);
+    chip.sdaStuck = 5;
+    CHECK(CTF2301_readLocalTemp(&dev, &raw) == CTF2301_OK);
+    CHECK(bus.stuck == 1);
+    CHECK(bus.recoveries == 1);
+    CHECK(dev.stats.recoveries == 1);
+    CHECK(dev.stats.retries == 1);
+    CHECK(chip.sdaStuck == 0);
+}
+
+static void testCounters(void){
+    uint8_t id;
+    uint32_t transactions;
+    uint32_t bytes;
+
+    setup();
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // A register read is address + register, repeated start + address, then the data
+    CTF2301_resetCacheStats(&dev);
+    transactions = bus.transactions;
+    bytes = bus.bytes;
+    CHECK(CTF2301_readManufacturerID(&dev, &id) == CTF2301_OK);
+    CHECK(id == CTF2301_MANUFACTURER_ID);
+    CHECK(bus.transactions - transactions == dev.stats.busReads);
+    CHECK(bus.bytes - bytes == 3 * dev.stats.busReads + dev.stats.bytesRead);
+
+    // A register write is address + register, then the data
+    CTF2301_resetCacheStats(&dev);
+    transactions = bus.transactions;
+    bytes = bus.bytes;
+    CHECK(__CTF2301_writeRegister(&dev, LOCAL_HIGH_SETPOINT_MSB, 0x50) == CTF2301_OK);
+    CHECK(bus.transactions - transactions == dev.stats.busWrites);
+    CHECK(bus.bytes - bytes == 2 * dev.stats.busWrites + dev.stats.bytesWritten);
+    CHECK(chip.regs[LOCAL_HIGH_SETPOINT_MSB] == 0x50);
+    CHECK(bus.busyUs >= (uint64_t)bus.bytes * bus.byteUs);
+}
+
+int main(void){
+    testInitImage();
+    testInitWarm();
+    testInitResolution();
+    testPOR();
+    testReads();
+    testNack();
+    testStuck();
+    testCounters();
+    return TEST_RESULT("test_sim");
+}
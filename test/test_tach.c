@@ -0,0 +1,62 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  TACH conversion host test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  CTF2301_tachToRPM() gives the same result as the division it replaces for
+  every TACH count, saturated at 65535, and 0 for a stopped fan.
+
+  make test
+
+ */
+
+#include "CTF2301.h"
+#include "test.h"
+
+int main(void){
+    uint32_t expected;
+    uint32_t mismatches = 0;
+    uint32_t saturated = 0;
+
+    for (uint32_t tach = 1; tach < CTF2301_TACH_INVALID; tach++){
+        expected = CTF2301_TACH_CLOCK / tach;
+        if (expected > 0xFFFF){
+            expected = 0xFFFF;
+            saturated++;
+        }
+        if (CTF2301_tachToRPM((uint16_t)tach) != expected){
+            if (mismatches++ < 10){
+                fprintf(stderr, "tach 0x%04X: %u, expected %u\n", tach, CTF2301_tachToRPM((uint16_t)tach), expected);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(saturated == CTF2301_TACH_CLOCK / 0x10000);
+    CHECK(CTF2301_tachToRPM(0) == 0);
+    CHECK(CTF2301_tachToRPM(CTF2301_TACH_INVALID) == 0);
+    return TEST_RESULT("test_tach");
+}
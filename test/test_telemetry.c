@@ -0,0 +1,359 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Telemetry format test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Encodes records with CTF2301_telemEncode() and decodes them back with
+  CTF2301_telemDecode(), whole and in small chunks: timestamps and
+  sequences that wrap, sequence gaps, alert bytes, block restarts, a reader
+  joining mid-block and the resync after a damaged header. Then records
+  drained from the sampler of a simulated chip, and the telemdump tool on
+  the same stream.
+
+  make test
+
+ */
+
+#include "CTF2301_telemetry.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef TELEMDUMP
+#define TELEMDUMP                        "build/telemdump"
+#endif
+
+#define TEST_RECORDS                     1000
+#define TEST_LOG_BYTES                   (TEST_RECORDS * CTF2301_TELEM_MAX_BYTES)
+
+static CTF2301_Sample in[TEST_RECORDS];
+static CTF2301_Sample out[TEST_RECORDS];
+static uint8_t stream[TEST_LOG_BYTES];
+static uint32_t seed;
+
+static const CTF2301_TelemHeader header = { 0x0142, CONVERSION_RATE_1_HZ, 16, CTF2301_TELEM_REMOTE_FINE };
+
+static uint32_t noise(void){
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static int same(const CTF2301_Sample *a, const CTF2301_Sample *b){
+    return a->timestamp == b->timestamp && a->sequence == b->sequence && a->localTemp == b->localTemp
+        && a->remoteTemp == b->remoteTemp && a->tach == b->tach && a->alertStatus == b->alertStatus && a->pwm == b->pwm;
+}
+
+// Records a sampler would take: slow readings with noise, a steady period with jitter, timestamp and sequence just
+// short of wrapping, every 50th record after some dropped ones, an alert now and then
+static void generate(void){
+    CTF2301_Sample record = { 0xFFFFF000, 0xFFF0, 0x190, 0xC80, 900, 0, 8 };
+    seed = 1;
+    for (int i = 0; i < TEST_RECORDS; i++){
+        record.timestamp += 100 + ((noise() % 8 == 0) ? noise() % 5 : 0);
+        record.sequence += (i % 50 == 49) ? 1 + noise() % 300 : 1;
+        record.localTemp += (noise() % 4 == 0) ? noise() % 3 - 1 : 0;
+        record.remoteTemp += (noise() % 2 == 0) ? noise() % 9 - 4 : 0;
+        record.tach = (noise() % 3 == 0) ? (uint16_t)(900 + noise() % 5) : record.tach;
+        record.pwm = (i % 200 == 100) ? (uint8_t)(noise() % 17) : record.pwm;
+        record.tach = (i == 500) ? CTF2301_TACH_INVALID : record.tach;
+        record.alertStatus = (noise() % 40 == 0) ? (uint8_t)(noise() | 1) : 0;
+        in[i] = record;
+    }
+}
+
+// Encode records [from, to) into dst, restarting a block where asked
+static size_t encode(CTF2301_TelemEncoder *enc, uint8_t *dst, int from, int to, int restart){
+    size_t length = 0;
+    for (int i = from; i < to; i++){
+        uint16_t n = 0;
+        if (i == restart){
+            CTF2301_telemRestart(enc);
+        }
+        CHECK(CTF2301_telemEncode(enc, &in[i], dst + length, CTF2301_TELEM_MAX_BYTES, &n) == CTF2301_OK);
+        length += n;
+    }
+    return length;
+}
+
+// Decode a log fed chunk bytes at a time, the way a reader gets it off a UART
+// Return: records decoded into out[]
+static size_t decode(CTF2301_TelemDecoder *dec, const uint8_t *data, size_t size, size_t chunk, uint32_t *verify){
+    static uint8_t pending[TEST_LOG_BYTES];
+    size_t have = 0;
+    size_t total = 0;
+    size_t fed = 0;
+
+    *verify = 0;
+    while (fed < size || have > 0){
+        size_t take = (size - fed < chunk) ? size - fed : chunk;
+        size_t used;
+        size_t count;
+        memcpy(pending + have, data + fed, take);
+        have += take;
+        fed += take;
+        do {
+            if (CTF2301_telemDecode(dec, pending, have, &used, out + total, TEST_RECORDS - total, &count)
+                == (uint32_t)CTF2301_ERROR_VERIFY){
+                (*verify)++;
+            }
+            total += count;
+            memmove(pending, pending + used, have - used);
+            have -= used;
+        } while (count > 0 && have > 0);
+        if (take == 0){
+            break;
+        }
+    }
+    return total;
+}
+
+static void testRoundTrip(void){
+    static const size_t chunks[] = { TEST_LOG_BYTES, 1, 7, 64 };
+    CTF2301_TelemEncoder enc;
+    CTF2301_TelemDecoder dec;
+    size_t length;
+    uint32_t verify;
+
+    generate();
+    CTF2301_telemInit(&enc, &header);
+    length = encode(&enc, stream, 0, TEST_RECORDS, -1);
+    CHECK(enc.records == TEST_RECORDS && enc.bytes == length);
+    // Mostly a mask and a step
+    CHECK(length < 4 * TEST_RECORDS);
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++){
+        int good = 1;
+        CTF2301_telemDecoderInit(&dec);
+        CHECK(decode(&dec, stream, length, chunks[c], &verify) == TEST_RECORDS);
+        for (int i = 0; i < TEST_RECORDS; i++){
+            good &= same(&in[i], &out[i]);
+        }
+        CHECK(good);
+        CHECK(verify == 0 && dec.skipped == 0);
+        CHECK(dec.blocks == (TEST_RECORDS + configTELEM_BLOCK_RECORDS - 1) / configTELEM_BLOCK_RECORDS);
+        CHECK(dec.header.device == header.device && dec.header.rate == header.rate);
+        CHECK(dec.header.pwmFullScale == header.pwmFullScale && dec.header.flags == header.flags);
+    }
+    // Both wrapped on the way
+    CHECK(in[TEST_RECORDS - 1].timestamp < in[0].timestamp && in[TEST_RECORDS - 1].sequence < in[0].sequence);
+}
+
+static void testSize(void){
+    CTF2301_Sample record = { 0xFFFFFFF0, 0xFFFF, 0x190, 0xC80, 900, 0, 8 };
+    CTF2301_TelemEncoder enc;
+    uint8_t buffer[CTF2301_TELEM_MAX_BYTES];
+    uint16_t n = 0;
+
+    // The first record carries the header and its values in full, then a steady record is a mask and a 0 step
+    CTF2301_telemInit(&enc, &header);
+    CHECK(CTF2301_telemEncode(&enc, &record, buffer, sizeof(buffer), &n) == CTF2301_OK);
+    CHECK(n > CTF2301_TELEM_HEADER_BYTES + 2);
+    for (int i = 0; i < 3; i++){
+        record.timestamp += 1000;
+        record.sequence++;
+        CHECK(CTF2301_telemEncode(&enc, &record, buffer, sizeof(buffer), &n) == CTF2301_OK);
+        CHECK(n == ((i == 0) ? 3 : 2));
+    }
+    CHECK(CTF2301_telemEncode(&enc, &record, buffer, sizeof(buffer) - 1, &n) == (uint32_t)CTF2301_ERROR);
+}
+
+static void testRestart(void){
+    CTF2301_TelemEncoder enc;
+    CTF2301_TelemDecoder dec;
+    size_t length;
+    size_t first;
+    size_t used;
+    size_t count;
+    uint32_t verify;
+    int good = 1;
+
+    // A block started by hand decodes like any other
+    generate();
+    CTF2301_telemInit(&enc, &header);
+    first = encode(&enc, stream, 0, 10, -1);
+    length = first + encode(&enc, stream + first, 10, 100, 10);
+    CTF2301_telemDecoderInit(&dec);
+    CHECK(decode(&dec, stream, length, 5, &verify) == 100);
+    CHECK(dec.blocks == 2 && verify == 0);
+    for (int i = 0; i < 100; i++){
+        good &= same(&in[i], &out[i]);
+    }
+    CHECK(good);
+
+    // A reader joining mid-block skips to the next header and picks up from there
+    CTF2301_telemDecoderInit(&dec);
+    CHECK(CTF2301_telemDecode(&dec, stream + first / 2, length - first / 2, &used, out, TEST_RECORDS, &count)
+          == (uint32_t)CTF2301_ERROR_VERIFY);
+    CHECK(dec.skipped == first - first / 2);
+    CHECK(count == 90 && same(&out[0], &in[10]) && same(&out[89], &in[99]));
+}
+
+static void testCorrupt(void){
+    static const int damage[] = { 0, 1, 8, 10 };   // magic, magic, check byte, timestamp
+    CTF2301_TelemEncoder enc;
+    CTF2301_TelemDecoder dec;
+    size_t offset[2];
+    size_t length;
+    uint32_t verify;
+
+    // Three blocks of 100 records, encoded again for every kind of damage
+    generate();
+    for (size_t d = 0; d < sizeof(damage) / sizeof(damage[0]); d++){
+        int good = 1;
+        CTF2301_telemInit(&enc, &header);
+        offset[0] = encode(&enc, stream, 0, 100, -1);
+        offset[1] = offset[0] + encode(&enc, stream + offset[0], 100, 200, 100);
+        length = offset[1] + encode(&enc, stream + offset[1], 200, 300, 200);
+
+        // A damaged header loses its block, the next block decodes as before
+        stream[offset[0] + damage[d]] ^= 0x04;
+        CTF2301_telemDecoderInit(&dec);
+        CHECK(decode(&dec, stream, length, 16, &verify) == 200);
+        CHECK(verify > 0 && dec.skipped >= offset[1] - offset[0] - CTF2301_TELEM_HEADER_BYTES);
+        CHECK(dec.blocks == 2);
+        for (int i = 0; i < 100; i++){
+            good &= same(&in[i], &out[i]) && same(&in[200 + i], &out[100 + i]);
+        }
+        CHECK(good);
+    }
+}
+
+static void testDrain(void){
+    CTF2301_SimBus bus;
+    CTF2301_SimChip chip;
+    CTF2301_Device dev;
+    CTF2301_TelemHeader fields;
+    CTF2301_TelemEncoder enc;
+    CTF2301_TelemDecoder dec;
+    uint16_t length = 0;
+    size_t used;
+    size_t count;
+
+    CTF2301_simBusInit(&bus, 100000);
+    CTF2301_simChipInit(&chip, configDEVICE_CTF2301_I2C_ADDR);
+    chip.remoteTemp = 61250;
+    CTF2301_simAttach(&bus, &chip);
+    memset(&dev, 0, sizeof(dev));
+    CTF2301_attach(&dev, &bus, configDEVICE_CTF2301_I2C_ADDR);
+    CHECK(CTF2301_init(&dev) == CTF2301_OK);
+
+    // The header follows the chip's setup
+    CHECK(CTF2301_telemHeader(&dev, 7, &fields) == CTF2301_OK);
+    CHECK(fields.device == 7 && fields.rate == chip.regs[CONVERSION_RATE]);
+    CHECK(fields.pwmFullScale == 2 * (chip.regs[PWM_FREQ] & 0x1F));
+
+    for (uint32_t i = 0; i < 10; i++){
+        CTF2301_simAdvance(&bus, 1000000);
+        CHECK(CTF2301_sample(&dev, 1000 * i) == CTF2301_OK);
+    }
+
+    // Only what fits a longest record is taken out of the ring, the rest waits
+    CTF2301_telemInit(&enc, &fields);
+    CHECK(CTF2301_telemDrain(&dev, &enc, stream, CTF2301_TELEM_MAX_BYTES - 1, &length) == 0 && length == 0);
+    CHECK(CTF2301_telemDrain(&dev, &enc, stream, sizeof(stream), &length) == 10);
+    CHECK(CTF2301_samplerCount(&dev) == 0);
+    CTF2301_telemDecoderInit(&dec);
+    CHECK(CTF2301_telemDecode(&dec, stream, length, &used, out, TEST_RECORDS, &count) == CTF2301_OK);
+    CHECK(used == length && count == 10);
+    CHECK(out[9].timestamp == 9000 && out[9].sequence == 9);
+    CHECK(CTF2301_decodeRemote(out[9].remoteTemp) == CTF2301_TEMP_FROM_C(61.25));
+    CHECK(dec.header.device == 7);
+}
+
+// Run telemdump on a log
+// Return: exit status of the tool, records it printed that match in[] in order in *matched
+static int telemdump(const char *path, size_t *matched, size_t *lines){
+    char command[256];
+    char line[256];
+    unsigned v[8];
+    FILE *pipe;
+
+    snprintf(command, sizeof(command), "%s -r %s 2>/dev/null", TELEMDUMP, path);
+    *matched = 0;
+    *lines = 0;
+    pipe = popen(command, "r");
+    if (pipe == NULL){
+        return -1;
+    }
+    while (fgets(line, sizeof(line), pipe) != NULL){
+        if (sscanf(line, "%u,%u,%u,%u,%u,%u,%u,%u", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8){
+            continue;
+        }
+        if (*lines < TEST_RECORDS && v[0] == header.device && v[1] == in[*lines].timestamp
+            && v[2] == in[*lines].sequence && v[3] == in[*lines].localTemp && v[4] == in[*lines].remoteTemp
+            && v[5] == in[*lines].tach && v[6] == in[*lines].pwm && v[7] == in[*lines].alertStatus){
+            (*matched)++;
+        }
+        (*lines)++;
+    }
+    return pclose(pipe);
+}
+
+static void testTool(void){
+    char path[] = "/tmp/test_telemetryXXXXXX";
+    CTF2301_TelemEncoder enc;
+    size_t length;
+    size_t matched;
+    size_t lines;
+    FILE *file;
+    int fd;
+
+    generate();
+    CTF2301_telemInit(&enc, &header);
+    length = encode(&enc, stream, 0, TEST_RECORDS, -1);
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0){
+        return;
+    }
+    file = fdopen(fd, "wb");
+    CHECK(fwrite(stream, 1, length, file) == length);
+    fclose(file);
+
+    CHECK(telemdump(path, &matched, &lines) == 0);
+    CHECK(lines == TEST_RECORDS && matched == TEST_RECORDS);
+
+    // A damaged header loses its block, the rest is printed and the tool fails
+    stream[1] ^= 0x04;
+    file = fopen(path, "wb");
+    CHECK(fwrite(stream, 1, length, file) == length);
+    fclose(file);
+    CHECK(telemdump(path, &matched, &lines) != 0);
+    CHECK(lines == TEST_RECORDS - configTELEM_BLOCK_RECORDS);
+    unlink(path);
+}
+
+int main(void){
+    testRoundTrip();
+    testSize();
+    testRestart();
+    testCorrupt();
+    testDrain();
+    testTool();
+    return TEST_RESULT("test_telemetry");
+}
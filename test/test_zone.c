@@ -0,0 +1,245 @@
+/*
+
+  Sensylink CTF2301 Library for STM32 HAL
+  Fan zone manager test
+
+  MIT License
+
+  Copyright (c) 2024 Weiwei Su, Ausinter Technologies Co., Ltd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+  //
+  Runs CTF2301_zone.c against three CTF2301_SimChip on two buses: the
+  devices are grouped by bus and a snapshot steps both buses at once, zone
+  demands follow the curves and are combined by the coupling or the MAX
+  policy, a device that can't be read drives its zone to the top of its
+  curve and stopped fans are started configZONE_SPIN_UP_STAGGER_MS apart.
+
+  make test
+
+ */
+
+#include "CTF2301_zone.h"
+#include "test.h"
+#include <string.h>
+
+#define TEST_ADDR_0                      configDEVICE_CTF2301_I2C_ADDR
+#define TEST_ADDR_1                      (configDEVICE_CTF2301_I2C_ADDR + 1)
+#define TEST_DEVICES                     3
+
+static CTF2301_SimBus busA;
+static CTF2301_SimBus busB;
+static CTF2301_SimChip chip[TEST_DEVICES];
+static CTF2301_Device dev[TEST_DEVICES];
+static CTF2301_ZoneManager mgr;
+static uint32_t nowMs;
+
+static void setupDevice(uint8_t i, CTF2301_SimBus *bus, uint8_t i2cAddr){
+    CTF2301_simChipInit(&chip[i], i2cAddr);
+    CTF2301_simAttach(bus, &chip[i]);
+    CTF2301_detach(&dev[i]);
+    CTF2301_attach(&dev[i], bus, i2cAddr);
+    dev[i].config.directDcyMode = 1;
+    CHECK(CTF2301_init(&dev[i]) == CTF2301_OK);
+}
+
+// Device 0 and 1 on bus A, device 2 on bus B; device 0 and 2 in zone 0, device 1 in zone 1
+static void setup(CTF2301_ZonePolicy policy){
+    CTF2301_simBusInit(&busA, 100000);
+    CTF2301_simBusInit(&busB, 100000);
+    setupDevice(0, &busA, TEST_ADDR_0);
+    setupDevice(1, &busA, TEST_ADDR_1);
+    setupDevice(2, &busB, TEST_ADDR_0);
+    CTF2301_zoneInit(&mgr, policy);
+    CHECK(CTF2301_zoneAdd(&mgr, &dev[0], 0) == CTF2301_OK);
+    CHECK(CTF2301_zoneAdd(&mgr, &dev[1], 1) == CTF2301_OK);
+    CHECK(CTF2301_zoneAdd(&mgr, &dev[2], 0) == CTF2301_OK);
+    nowMs = 1000;
+}
+
+// Set the remote diodes and let a conversion run on both buses
+static void temps(int32_t c0, int32_t c1, int32_t c2){
+    chip[0].remoteTemp = c0 * 1000;
+    chip[1].remoteTemp = c1 * 1000;
+    chip[2].remoteTemp = c2 * 1000;
+    CTF2301_simAdvance(&busA, 1000000);
+    CTF2301_simAdvance(&busB, 1000000);
+}
+
+// Duty cycle of the default curve, 40°C / 20% to 80°C / 100%
+static uint32_t curve(int32_t c){
+    return CTF2301_DUTY_FULL / 5 + (uint32_t)((uint64_t)(CTF2301_DUTY_FULL - CTF2301_DUTY_FULL / 5) * (c - 40) / 40);
+}
+
+// PWM_VALUE a duty cycle is written as, half steps of PWM_FREQ
+static uint8_t code(uint8_t i, uint32_t duty){
+    uint32_t fullScale = 2 * (chip[i].regs[PWM_FREQ] & 0x1F);
+    return (uint8_t)(((uint64_t)duty * fullScale + CTF2301_DUTY_FULL / 2) / CTF2301_DUTY_FULL);
+}
+
+// Update until every fan runs, one stagger apart
+static void updateAll(void){
+    for (uint8_t i = 0; i < TEST_DEVICES; i++){
+        CHECK(CTF2301_zoneUpdate(&mgr, nowMs) == CTF2301_OK);
+        nowMs += configZONE_SPIN_UP_STAGGER_MS;
+    }
+}
+
+static void testGrouping(void){
+    uint32_t transactionsA;
+    uint32_t transactionsB;
+
+    setup(CTF2301_ZONE_POLICY_COUPLED);
+    CHECK(mgr.members == TEST_DEVICES && mgr.buses == 2);
+    CHECK(mgr.bus[0].members == 2 && mgr.bus[0].member[0] == 0 && mgr.bus[0].member[1] == 1);
+    CHECK(mgr.bus[1].members == 1 && mgr.bus[1].member[0] == 2);
+    CHECK(mgr.member[2].bus == 1);
+
+    // Every step moves both buses one register run on
+    temps(50, 60, 70);
+    transactionsA = busA.transactions;
+    transactionsB = busB.transactions;
+    CHECK(CTF2301_zoneSnapshotBegin(&mgr, 7) == CTF2301_OK);
+    CHECK(CTF2301_zoneSnapshotStep(&mgr) == CTF2301_PENDING);
+    CHECK(busA.transactions != transactionsA && busB.transactions != transactionsB);
+    for (uint8_t i = 1; i < CTF2301_SAMPLE_RUNS; i++){
+        CHECK(CTF2301_zoneSnapshotStep(&mgr) == CTF2301_PENDING);
+    }
+    // Bus B is done with its only device, bus A goes on with the second
+    CHECK(mgr.member[2].status == CTF2301_OK && mgr.member[1].status == (uint32_t)CTF2301_ERROR);
+    transactionsB = busB.transactions - transactionsB;
+    while (CTF2301_zoneSnapshotStep(&mgr) == CTF2301_PENDING){
+    }
+    CHECK(busA.transactions - transactionsA == 2 * transactionsB);
+    for (uint8_t i = 0; i < TEST_DEVICES; i++){
+        CHECK(mgr.member[i].status == CTF2301_OK);
+        CHECK(mgr.member[i].sample.timestamp == 7 && mgr.member[i].sample.sequence == 1);
+    }
+    CHECK(CTF2301_decodeRemote(mgr.member[0].sample.remoteTemp) == CTF2301_TEMP_FROM_C(50));
+    CHECK(CTF2301_decodeRemote(mgr.member[1].sample.remoteTemp) == CTF2301_TEMP_FROM_C(60));
+    CHECK(CTF2301_decodeRemote(mgr.member[2].sample.remoteTemp) == CTF2301_TEMP_FROM_C(70));
+
+    // A snapshot of one bus leaves the other alone
+    transactionsA = busA.transactions;
+    CHECK(CTF2301_zoneSnapshotBus(&mgr, 1, 8) == CTF2301_OK);
+    CHECK(busA.transactions == transactionsA);
+    CHECK(mgr.member[2].sample.sequence == 2 && mgr.member[2].sample.timestamp == 8);
+    CHECK(mgr.member[0].sample.sequence == 1);
+    CHECK(CTF2301_zoneSnapshotBus(&mgr, 2, 8) == (uint32_t)CTF2301_ERROR);
+}
+
+static void testCoupled(void){
+    setup(CTF2301_ZONE_POLICY_COUPLED);
+    CHECK(CTF2301_zoneSetCoupling(&mgr, 1, 0, 128) == CTF2301_OK);
+    CHECK(CTF2301_zoneSetCoupling(&mgr, 0, 4, 128) == (uint32_t)CTF2301_ERROR);
+
+    // Zone 0 runs its hottest device, zone 1 is cool but runs half of zone 0
+    temps(50, 30, 60);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    updateAll();
+    CHECK(mgr.demand[0] == curve(60) && mgr.demand[1] == curve(40));
+    CHECK(mgr.duty[0] == curve(60) && mgr.duty[1] == curve(60) / 2);
+    CHECK(chip[0].regs[PWM_VALUE] == code(0, curve(60)));
+    CHECK(chip[1].regs[PWM_VALUE] == code(1, curve(60) / 2));
+    CHECK(chip[2].regs[PWM_VALUE] == code(2, curve(60)));
+
+    // Past the top of the curve the zone runs its maximum, the coupled zone its own demand when that is higher
+    temps(90, 70, 20);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs) == CTF2301_OK);
+    CHECK(mgr.duty[0] == CTF2301_DUTY_FULL && mgr.duty[1] == curve(70));
+    CHECK(chip[0].regs[PWM_VALUE] == code(0, CTF2301_DUTY_FULL));
+}
+
+static void testMax(void){
+    setup(CTF2301_ZONE_POLICY_MAX);
+
+    // Every zone runs the highest demand
+    temps(45, 75, 50);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    updateAll();
+    CHECK(mgr.demand[0] == curve(50) && mgr.demand[1] == curve(75));
+    CHECK(mgr.duty[0] == curve(75) && mgr.duty[1] == curve(75));
+    for (uint8_t i = 0; i < TEST_DEVICES; i++){
+        CHECK(chip[i].regs[PWM_VALUE] == code(i, curve(75)));
+    }
+}
+
+static void testFailSafe(void){
+    setup(CTF2301_ZONE_POLICY_COUPLED);
+    temps(50, 50, 50);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    updateAll();
+
+    // Device 1 stops answering: the snapshot reports it, the other devices are still read
+    chip[1].nackNext = configI2C_RETRIES + 1;
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == (uint32_t)CTF2301_ERROR);
+    CHECK(mgr.member[1].status == (uint32_t)CTF2301_ERROR);
+    CHECK(mgr.member[0].status == CTF2301_OK && mgr.member[2].status == CTF2301_OK);
+    CHECK(mgr.member[0].sample.sequence == 2 && mgr.member[1].sample.sequence == 1);
+
+    // Its zone goes to the top of its curve, the other zone is left alone
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs) == CTF2301_OK);
+    CHECK(mgr.duty[0] == curve(50) && mgr.duty[1] == CTF2301_DUTY_FULL);
+    CHECK(chip[1].regs[PWM_VALUE] == code(1, CTF2301_DUTY_FULL));
+
+    // Back once it answers again
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs) == CTF2301_OK);
+    CHECK(mgr.duty[1] == curve(50));
+}
+
+static void testSpinUp(void){
+    setup(CTF2301_ZONE_POLICY_COUPLED);
+    temps(60, 60, 60);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+
+    // One stopped fan starts per stagger, the others wait
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs) == CTF2301_OK);
+    CHECK(mgr.member[0].duty == curve(60) && mgr.member[1].duty == 0 && mgr.member[2].duty == 0);
+    CHECK(mgr.spinUpsDeferred == 2);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs + configZONE_SPIN_UP_STAGGER_MS - 1) == CTF2301_OK);
+    CHECK(mgr.member[1].duty == 0 && mgr.spinUpsDeferred == 4);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs + configZONE_SPIN_UP_STAGGER_MS) == CTF2301_OK);
+    CHECK(mgr.member[1].duty == curve(60) && mgr.member[2].duty == 0);
+    CHECK(chip[2].regs[PWM_VALUE] == 0);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs + 2 * configZONE_SPIN_UP_STAGGER_MS) == CTF2301_OK);
+    CHECK(mgr.member[2].duty == curve(60) && mgr.spinUpsDeferred == 5);
+    CHECK(chip[2].regs[PWM_VALUE] == code(2, curve(60)));
+
+    // Running fans change speed without waiting
+    temps(70, 70, 70);
+    CHECK(CTF2301_zoneSnapshot(&mgr, nowMs) == CTF2301_OK);
+    CHECK(CTF2301_zoneUpdate(&mgr, nowMs + 2 * configZONE_SPIN_UP_STAGGER_MS + 1) == CTF2301_OK);
+    for (uint8_t i = 0; i < TEST_DEVICES; i++){
+        CHECK(mgr.member[i].duty == curve(70));
+    }
+    CHECK(mgr.spinUpsDeferred == 5);
+}
+
+int main(void){
+    testGrouping();
+    testCoupled();
+    testMax();
+    testFailSafe();
+    testSpinUp();
+    return TEST_RESULT("test_zone");
+}